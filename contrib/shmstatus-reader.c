@@ -0,0 +1,96 @@
+/*
+ * Lists the hosts and services that have problems, straight from the
+ * shared memory segment Naemon keeps when status_shm is set.
+ *
+ * Build it with
+ *   cc -o shmstatus-reader shmstatus-reader.c $(pkg-config --cflags --libs naemon)
+ * and run it as
+ *   shmstatus-reader [-w] [/naemon-status]
+ * With -w it lists them again every few seconds, following Naemon
+ * across restarts.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <naemon/naemon.h>
+
+static const char *host_states[] = { "UP", "DOWN", "UNREACHABLE" };
+static const char *service_states[] = { "OK", "WARNING", "CRITICAL", "UNKNOWN" };
+
+static const char *state_name(const char **names, unsigned int num_names, int state)
+{
+	return state >= 0 && (unsigned int)state < num_names ? names[state] : "?";
+}
+
+static void print_problem(const struct shmstatus_header *hdr, const struct shmstatus_entry *e,
+                          const char *state, const char *output)
+{
+	printf("%s%s%s: %s (%s, attempt %d/%d)%s - %s\n",
+	       shmstatus_string(hdr, e->name),
+	       e->description ? ";" : "",
+	       e->description ? shmstatus_string(hdr, e->description) : "",
+	       state, e->state_type ? "HARD" : "SOFT",
+	       e->current_attempt, e->max_attempts,
+	       e->problem_has_been_acknowledged ? " ACK" : "",
+	       output);
+}
+
+static void list_problems(const struct shmstatus_header *hdr)
+{
+	struct shmstatus_entry e;
+	char output[SHMSTATUS_OUTPUT_SIZE];
+	unsigned int i;
+
+	for (i = 0; i < hdr->num_hosts; i++) {
+		if (shmstatus_read(hdr, shmstatus_host(hdr, i), &e, output) < 0)
+			continue; /* being hammered with updates. Catch it next time */
+		if (e.has_been_checked && e.current_state)
+			print_problem(hdr, &e, state_name(host_states, 3, e.current_state), output);
+	}
+
+	for (i = 0; i < hdr->num_services; i++) {
+		if (shmstatus_read(hdr, shmstatus_service(hdr, i), &e, output) < 0)
+			continue;
+		if (e.has_been_checked && e.current_state)
+			print_problem(hdr, &e, state_name(service_states, 4, e.current_state), output);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct shmstatus_header *hdr = NULL;
+	const char *name = "/naemon-status";
+	int watch = 0, i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-w"))
+			watch = 1;
+		else
+			name = argv[i];
+	}
+
+	do {
+		/* Naemon creates a new segment whenever it (re)starts */
+		if (hdr && shmstatus_is_stale(hdr)) {
+			shmstatus_detach(hdr);
+			hdr = NULL;
+		}
+		if (!hdr && !(hdr = shmstatus_attach(name))) {
+			fprintf(stderr, "Failed to attach to %s: %s\n", name, strerror(errno));
+			if (!watch)
+				return 1;
+		}
+
+		if (hdr) {
+			list_problems(hdr);
+			if (watch)
+				printf("\n");
+		}
+		if (watch)
+			sleep(5);
+	} while (watch);
+
+	shmstatus_detach(hdr);
+	return 0;
+}
@@ -50,6 +50,8 @@ typedef struct {
 	int (*handler)(int, int, void *); /* where we send data */
 	void *arg; /* the argument we send to the input handler */
 	nm_bufferqueue *bq_out;
+	int out_watched; /* polled for writability, as bq_out has data */
+	void (*drained)(int, void *); /* called once bq_out is empty, see iobroker_wait_drained() */
 } iobroker_fd;
 
 
@@ -57,6 +59,8 @@ struct iobroker_set {
 	iobroker_fd **iobroker_fds;
 	int max_fds; /* max number of sockets we can accept */
 	int num_fds; /* number of sockets we're currently brokering for */
+	void (*before_wait)(void); /* called right before we block waiting for input */
+	void (*after_wait)(void); /* and right after, before any handler runs */
 #ifdef IOBROKER_USES_EPOLL
 	int epfd;
 	struct epoll_event *ep_events;
@@ -345,6 +349,73 @@ void iobroker_destroy(iobroker_set *iobs, int flags)
 }
 
 
+void iobroker_set_wait_hooks(iobroker_set *iobs, void (*before_wait)(void), void (*after_wait)(void))
+{
+	if (!iobs)
+		return;
+	iobs->before_wait = before_wait;
+	iobs->after_wait = after_wait;
+}
+
+
+/*
+ * Output that didn't fit in the socket makes us poll it for
+ * writability until it's all sent, so we can sleep until then instead
+ * of retrying in a busy loop. So does waiting for it to drain, as the
+ * callback is only ever run from iobroker_poll(), even if the output
+ * went out in iobroker_push() meanwhile. Sockets registered with
+ * iobroker_register_out() are polled for it anyway.
+ */
+static void watch_output(iobroker_set *iobs, iobroker_fd *s)
+{
+	int want = s->drained || nm_bufferqueue_get_available(s->bq_out) > 0;
+
+	if (want == s->out_watched)
+		return;
+	s->out_watched = want;
+#ifdef IOBROKER_USES_EPOLL
+	if (!(s->events & EPOLLOUT)) {
+		struct epoll_event ev;
+		ev.events = s->events | (want ? EPOLLOUT : 0);
+		ev.data.fd = s->fd;
+		epoll_ctl(iobs->epfd, EPOLL_CTL_MOD, s->fd, &ev);
+	}
+#endif
+}
+
+/*
+ * Sends what we can of the fd's queued output once it's writable. The
+ * drained callback may unregister the fd, so callers must look it up
+ * again afterwards.
+ */
+static void flush_output(iobroker_set *iobs, iobroker_fd *s)
+{
+	void (*drained)(int, void *);
+
+	if (nm_bufferqueue_get_available(s->bq_out))
+		nm_bufferqueue_write(s->bq_out, s->fd);
+	drained = s->drained;
+	if (drained && !nm_bufferqueue_get_available(s->bq_out))
+		s->drained = NULL;
+	else
+		drained = NULL;
+	watch_output(iobs, s);
+	if (drained)
+		drained(s->fd, s->arg);
+}
+
+int iobroker_wait_drained(iobroker_set *iobs, int fd, void (*drained)(int, void *))
+{
+	if (!iobroker_is_registered(iobs, fd))
+		return IOBROKER_EINVAL;
+	if (drained && !nm_bufferqueue_get_available(iobs->iobroker_fds[fd]->bq_out))
+		return 1;
+
+	iobs->iobroker_fds[fd]->drained = drained;
+	watch_output(iobs, iobs->iobroker_fds[fd]);
+	return 0;
+}
+
 int iobroker_poll(iobroker_set *iobs, int timeout)
 {
 	int i, nfds, ret = 0;
@@ -353,11 +424,15 @@ int iobroker_poll(iobroker_set *iobs, int timeout)
 		return IOBROKER_ENOSET;
 
 #if defined(IOBROKER_USES_EPOLL)
+	if (iobs->before_wait)
+		iobs->before_wait();
 	nfds = epoll_wait(iobs->epfd, iobs->ep_events,
 	                  /* to gain consistent "idling" behaviour with the other mechanisms,
 	                   * we avoid returning immediately here by "faking" maxevents */
 	                  !iobs->num_fds ? 1 : iobs->num_fds,
 	                  timeout);
+	if (iobs->after_wait)
+		iobs->after_wait();
 	if (nfds < 0) {
 		return IOBROKER_ELIB;
 	}
@@ -371,6 +446,15 @@ int iobroker_poll(iobroker_set *iobs, int timeout)
 			continue;
 		}
 		s = iobs->iobroker_fds[fd];
+		if (s && s->out_watched && (iobs->ep_events[i].events & EPOLLOUT)) {
+			int wants_out = s->events & EPOLLOUT;
+
+			flush_output(iobs, s);
+			s = iobs->iobroker_fds[fd];
+			/* nothing but writability is none of the handler's business, unless it asked for it */
+			if (!wants_out && !(iobs->ep_events[i].events & ~EPOLLOUT))
+				continue;
+		}
 
 		if (s) {
 			s->handler(fd, iobs->ep_events[i].events, s->arg);
@@ -385,31 +469,40 @@ int iobroker_poll(iobroker_set *iobs, int timeout)
 	 * used if epoll() or poll() doesn't work properly.
 	 */
 	{
-		fd_set read_fds;
+		fd_set read_fds, write_fds;
 		int num_fds = 0;
 		struct timeval tv;
 
 		FD_ZERO(&read_fds);
+		FD_ZERO(&write_fds);
 		for (i = 0; i < iobs->max_fds; i++) {
 			if (!iobs->iobroker_fds[i])
 				continue;
 			num_fds++;
 			FD_SET(iobs->iobroker_fds[i]->fd, &read_fds);
+			if (iobs->iobroker_fds[i]->out_watched)
+				FD_SET(iobs->iobroker_fds[i]->fd, &write_fds);
 			if (num_fds == iobs->num_fds)
 				break;
 		}
+		if (iobs->before_wait)
+			iobs->before_wait();
 		if (timeout >= 0) {
 			tv.tv_sec = timeout / 1000;
 			tv.tv_usec = (timeout % 1000) * 1000;
-			nfds = select(iobs->max_fds, &read_fds, NULL, NULL, &tv);
+			nfds = select(iobs->max_fds, &read_fds, &write_fds, NULL, &tv);
 		} else { /* timeout of -1 means poll indefinitely */
-			nfds = select(iobs->max_fds, &read_fds, NULL, NULL, NULL);
+			nfds = select(iobs->max_fds, &read_fds, &write_fds, NULL, NULL);
 		}
+		if (iobs->after_wait)
+			iobs->after_wait();
 		if (nfds < 0) {
 			return IOBROKER_ELIB;
 		}
 		num_fds = 0;
 		for (i = 0; i < iobs->max_fds; i++) {
+			if (iobs->iobroker_fds[i] && FD_ISSET(i, &write_fds))
+				flush_output(iobs, iobs->iobroker_fds[i]);
 			if (!iobs->iobroker_fds[i])
 				continue;
 			if (FD_ISSET(iobs->iobroker_fds[i]->fd, &read_fds)) {
@@ -435,15 +528,21 @@ int iobroker_poll(iobroker_set *iobs, int timeout)
 			if (!iobs->iobroker_fds[i])
 				continue;
 			iobs->pfd[p].fd = iobs->iobroker_fds[i]->fd;
-			iobs->pfd[p].events = POLLIN;
+			iobs->pfd[p].events = POLLIN | (iobs->iobroker_fds[i]->out_watched ? POLLOUT : 0);
 			p++;
 		}
+		if (iobs->before_wait)
+			iobs->before_wait();
 		nfds = poll(iobs->pfd, iobs->num_fds, timeout);
+		if (iobs->after_wait)
+			iobs->after_wait();
 		if (nfds < 0) {
 			return IOBROKER_ELIB;
 		}
 		for (i = 0; i < iobs->num_fds; i++) {
 			iobroker_fd *s;
+			if ((iobs->pfd[i].revents & POLLOUT) && (s = iobs->iobroker_fds[iobs->pfd[i].fd]))
+				flush_output(iobs, s);
 			if ((iobs->pfd[i].revents & POLLIN) != POLLIN) {
 				continue;
 			}
@@ -489,6 +588,7 @@ int iobroker_push(iobroker_set *iobs)
 				/* TODO: can't log() in lib */
 			}
 		}
+		watch_output(iobs, s);
 	}
 	return result;
 }
@@ -501,3 +601,11 @@ int iobroker_write_packet(iobroker_set *iobs, int fd, char *buf, size_t len)
 	/* horrible idea? */
 	return iobroker_push(iobs);
 }
+
+size_t iobroker_get_pending_output(iobroker_set *iobs, int fd)
+{
+	if (!iobroker_is_registered(iobs, fd))
+		return 0;
+
+	return nm_bufferqueue_get_available(iobs->iobroker_fds[fd]->bq_out);
+}
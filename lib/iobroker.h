@@ -174,6 +174,17 @@ extern void iobroker_destroy(iobroker_set *iobs, int flags);
  * @return -1 on errors, or number of filedescriptors with input
  */
 extern int iobroker_poll(iobroker_set *iobs, int timeout);
+
+/**
+ * Set functions to call around the part of iobroker_poll() that
+ * blocks, waiting for input. No handlers run in between the two, so
+ * they can hand shared state to other threads while we're idle.
+ * @param iobs The socket set
+ * @param before_wait Called right before waiting, or NULL
+ * @param after_wait Called once the wait is over, before any input
+ *                   handler runs, or NULL
+ */
+extern void iobroker_set_wait_hooks(iobroker_set *iobs, void (*before_wait)(void), void (*after_wait)(void));
 /**
  * Push any pending outgoing data
  * @param iobs The socket set to push everything in.
@@ -194,6 +205,33 @@ int iobroker_push(iobroker_set *iobs);
  */
 int iobroker_write_packet(iobroker_set *iobs, int fd, char *buf, size_t len);
 
+/**
+ * Have a function called once all output queued for this fd by
+ * iobroker_write_packet() has been written. Until then the fd is
+ * polled for writability, so a writer can wait for a slow reader
+ * without spinning. The callback runs from iobroker_poll() and is
+ * forgotten once it has run, or when the fd is unregistered.
+ *
+ * @param[in] iobs The socket set the fd is registered with
+ * @param[in] fd The socket descriptor to wait for
+ * @param[in] drained Called with the fd and its handler argument, or
+ *                    NULL to stop waiting
+ * @returns 0 if we're now waiting, 1 if there's nothing to wait for
+ *          and < 0 on errors
+ */
+int iobroker_wait_drained(iobroker_set *iobs, int fd, void (*drained)(int, void *));
+
+/**
+ * Get the number of bytes queued by iobroker_write_packet() that
+ * haven't been written to this fd yet. Lets a writer hold off
+ * producing more output until the reader has caught up.
+ *
+ * @param[in] iobs The socket set the fd is registered with
+ * @param[in] fd The socket descriptor to check
+ * @returns The number of bytes waiting to be written, 0 if the fd isn't registered
+ */
+size_t iobroker_get_pending_output(iobroker_set *iobs, int fd);
+
 NAGIOS_END_DECL
 #endif /* INCLUDE_iobroker_h__ */
 /** @} */
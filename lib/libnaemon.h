@@ -23,4 +23,5 @@
 #include "nspath.h"
 #include "snprintf.h"
 #include "objutils.h"
+#include "shmstatus.h"
 #endif /* LIB_libnaemon_h__ */
@@ -2,9 +2,11 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/un.h>
+#include <netdb.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <fcntl.h>
@@ -21,6 +23,7 @@ const char *nsock_strerror(int code)
 	case NSOCK_EUNLINK: return "unlink() failed";
 	case NSOCK_ECONNECT: return "connect() failed";
 	case NSOCK_EFCNTL: return "fcntl() failed";
+	case NSOCK_ERESOLVE: return "Failed to resolve address";
 	case NSOCK_EINVAL: return "Invalid arguments";
 	}
 
@@ -89,6 +92,88 @@ int nsock_unix(const char *path, unsigned int flags)
 	return sock;
 }
 
+int nsock_inet(const char *address, unsigned int flags)
+{
+	struct addrinfo hints, *ai, *res = NULL;
+	char *host, *port;
+	int sock = NSOCK_ESOCKET, ret;
+
+	if (!address)
+		return NSOCK_EINVAL;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	if (flags & NSOCK_TCP)
+		hints.ai_socktype = SOCK_STREAM;
+	else if (flags & NSOCK_UDP)
+		hints.ai_socktype = SOCK_DGRAM;
+	else
+		return NSOCK_EINVAL;
+	if (!(flags & NSOCK_CONNECT))
+		hints.ai_flags = AI_PASSIVE;
+
+	if (!(host = strdup(address)))
+		return NSOCK_EINVAL;
+	if (!(port = strrchr(host, ':'))) {
+		free(host);
+		return NSOCK_EINVAL;
+	}
+	*port++ = 0;
+	if (*host == '[' && host[strlen(host) - 1] == ']') {
+		host[strlen(host) - 1] = 0;
+		ret = getaddrinfo(host + 1, port, &hints, &res);
+	} else {
+		ret = getaddrinfo(*host && strcmp(host, "*") ? host : NULL, port, &hints, &res);
+	}
+	free(host);
+	if (ret)
+		return NSOCK_ERESOLVE;
+
+	/* use the first address that works */
+	for (ai = res; ai; ai = ai->ai_next) {
+		int opt = 1;
+
+		if ((sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0) {
+			sock = NSOCK_ESOCKET;
+			continue;
+		}
+
+		if (flags & NSOCK_CONNECT) {
+			if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0)
+				break;
+			close(sock);
+			sock = NSOCK_ECONNECT;
+			continue;
+		}
+
+		if (flags & NSOCK_REUSE)
+			setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+		if (bind(sock, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(sock);
+		sock = NSOCK_EBIND;
+	}
+	freeaddrinfo(res);
+
+	if (sock < 0 || flags & NSOCK_CONNECT)
+		return sock;
+
+	if (!(flags & NSOCK_BLOCK) && fcntl(sock, F_SETFL, O_NONBLOCK) < 0) {
+		close(sock);
+		return NSOCK_EFCNTL;
+	}
+
+	if (flags & NSOCK_UDP)
+		return sock;
+
+	if (listen(sock, 64) < 0) {
+		close(sock);
+		return NSOCK_ELISTEN;
+	}
+
+	return sock;
+}
+
 static inline int nsock_vdprintf(int sd, const char *fmt, va_list ap, int plus)
 {
 	char *buf = NULL;
@@ -25,6 +25,7 @@
 #define NSOCK_EUNLINK  (-4)     /**< failed to unlink() */
 #define NSOCK_ECONNECT (-5)     /**< failed to connect() */
 #define NSOCK_EFCNTL   (-6)     /**< failed to fcntl() */
+#define NSOCK_ERESOLVE (-7)     /**< failed to resolve address */
 #define NSOCK_EINVAL (-EINVAL) /**< -22, normally */
 
 /* flags for the various create calls */
@@ -56,6 +57,18 @@ extern const char *nsock_strerror(int code);
  */
 extern int nsock_unix(const char *path, unsigned int flags);
 
+/**
+ * Create or connect to an internet socket
+ * The address is given as "host:port", where host may be a name,
+ * an IPv4 address or a bracketed IPv6 address ("[::1]:5668"). An
+ * empty host ("*:port" or ":port") listens on all addresses.
+ *
+ * @param address The address to connect to or listen on
+ * @param flags Various options controlling the mode of the socket
+ * @return An NSOCK_E macro on errors, the created socket on succes
+ */
+extern int nsock_inet(const char *address, unsigned int flags);
+
 /**
  * Write a nul-terminated message to the socket pointed to by sd.
  * This isn't quite the same as dprintf(), which doesn't include
@@ -7,10 +7,12 @@ gboolean nm_service_equal(gconstpointer a, gconstpointer b)
 	if (!k1 || !k2)
 		return (k1 == NULL && k2 == NULL);
 
-	if (!g_str_equal(k1->hostname, k2->hostname))
+	/* object names are usually shared, so try the cheap comparison first */
+	if (k1->hostname != k2->hostname && !g_str_equal(k1->hostname, k2->hostname))
 		return FALSE;
 
-	return g_str_equal(k1->service_description, k2->service_description);
+	return k1->service_description == k2->service_description ||
+	       g_str_equal(k1->service_description, k2->service_description);
 }
 
 guint nm_service_hash(gconstpointer key)
@@ -0,0 +1,199 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include "shmstatus.h"
+
+/* how many times a reader tries an entry that keeps changing under it */
+#define SHMSTATUS_READ_TRIES 1000
+
+struct shmstatus_header *shmstatus_attach(const char *name)
+{
+	struct shmstatus_header *hdr;
+	struct stat st;
+	int fd, saved_errno;
+
+	if ((fd = shm_open(name, O_RDONLY, 0)) < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0) {
+		saved_errno = errno;
+		close(fd);
+		errno = saved_errno;
+		return NULL;
+	}
+	if ((size_t)st.st_size < sizeof(*hdr)) {
+		close(fd);
+		errno = EPROTO;
+		return NULL;
+	}
+
+	hdr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	saved_errno = errno;
+	close(fd);
+	if (hdr == MAP_FAILED) {
+		errno = saved_errno;
+		return NULL;
+	}
+
+	if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != SHMSTATUS_MAGIC || hdr->version != SHMSTATUS_VERSION ||
+	    hdr->entry_size != sizeof(struct shmstatus_entry) || hdr->size != (uint64_t)st.st_size) {
+		munmap(hdr, st.st_size);
+		errno = EPROTO;
+		return NULL;
+	}
+
+	return hdr;
+}
+
+void shmstatus_detach(struct shmstatus_header *hdr)
+{
+	if (hdr)
+		munmap(hdr, hdr->size);
+}
+
+int shmstatus_is_stale(const struct shmstatus_header *hdr)
+{
+	return __atomic_load_n(&hdr->stale, __ATOMIC_ACQUIRE) != 0;
+}
+
+int shmstatus_read(const struct shmstatus_header *hdr, const struct shmstatus_entry *e,
+                   struct shmstatus_entry *copy, char *output)
+{
+	uint32_t before, after;
+	int i;
+
+	for (i = 0; i < SHMSTATUS_READ_TRIES; i++) {
+		before = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+		if (before & 1) {
+			/* Naemon is in the middle of it */
+			sched_yield();
+			continue;
+		}
+
+		memcpy(copy, e, sizeof(*copy));
+		if (output) {
+			size_t len = copy->plugin_output_len;
+
+			if (len >= SHMSTATUS_OUTPUT_SIZE)
+				len = SHMSTATUS_OUTPUT_SIZE - 1;
+			memcpy(output, (const char *)hdr + copy->plugin_output, len);
+			output[len] = 0;
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&e->seq, __ATOMIC_RELAXED);
+		if (before == after)
+			return 0;
+	}
+
+	errno = EAGAIN;
+	return -1;
+}
+
+struct shmstatus_header *shmstatus_create(const char *name, unsigned int num_hosts,
+        unsigned int num_services, size_t names_size)
+{
+	struct shmstatus_header *hdr;
+	unsigned int i, entries = num_hosts + num_services;
+	size_t size;
+	int fd, saved_errno;
+
+	/* readers attached to an old segment keep it until they detach */
+	shm_unlink(name);
+	if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0)
+		return NULL;
+
+	size = sizeof(*hdr) + entries * (sizeof(struct shmstatus_entry) + SHMSTATUS_OUTPUT_SIZE) + names_size;
+	if (ftruncate(fd, size) < 0) {
+		saved_errno = errno;
+		close(fd);
+		shm_unlink(name);
+		errno = saved_errno;
+		return NULL;
+	}
+
+	hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	saved_errno = errno;
+	close(fd);
+	if (hdr == MAP_FAILED) {
+		shm_unlink(name);
+		errno = saved_errno;
+		return NULL;
+	}
+
+	/* ftruncate() gave us zeroes, so only the non-zero parts are set */
+	hdr->version = SHMSTATUS_VERSION;
+	hdr->entry_size = sizeof(struct shmstatus_entry);
+	hdr->size = size;
+	hdr->pid = getpid();
+	hdr->created = time(NULL);
+	hdr->num_hosts = num_hosts;
+	hdr->num_services = num_services;
+	hdr->hosts = sizeof(*hdr);
+	hdr->services = hdr->hosts + num_hosts * sizeof(struct shmstatus_entry);
+	hdr->names = hdr->services + num_services * sizeof(struct shmstatus_entry) + entries * SHMSTATUS_OUTPUT_SIZE;
+	hdr->names_size = names_size;
+
+	/* the service entries follow the host entries, so this covers both */
+	for (i = 0; i < entries; i++) {
+		struct shmstatus_entry *e = shmstatus_host(hdr, i);
+		e->plugin_output = hdr->services + num_services * sizeof(*e) + i * SHMSTATUS_OUTPUT_SIZE;
+	}
+
+	/* readers check the magic last, so they never see a half-made header */
+	__atomic_store_n(&hdr->magic, SHMSTATUS_MAGIC, __ATOMIC_RELEASE);
+	return hdr;
+}
+
+void shmstatus_destroy(struct shmstatus_header *hdr, const char *name)
+{
+	if (!hdr)
+		return;
+
+	__atomic_store_n(&hdr->stale, 1, __ATOMIC_RELEASE);
+	munmap(hdr, hdr->size);
+	if (name)
+		shm_unlink(name);
+}
+
+uint64_t shmstatus_add_string(struct shmstatus_header *hdr, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	uint64_t offset;
+
+	if (hdr->names_used + len > hdr->names_size)
+		return 0;
+
+	offset = hdr->names + hdr->names_used;
+	memcpy((char *)hdr + offset, str, len);
+	hdr->names_used += len;
+	return offset;
+}
+
+void shmstatus_write_begin(struct shmstatus_entry *e)
+{
+	__atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELAXED);
+	/* the odd sequence number must be seen before any of the new data */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void shmstatus_set_output(struct shmstatus_header *hdr, struct shmstatus_entry *e, const char *output)
+{
+	size_t len = output ? strnlen(output, SHMSTATUS_OUTPUT_SIZE - 1) : 0;
+
+	memcpy((char *)hdr + e->plugin_output, output ? output : "", len);
+	((char *)hdr)[e->plugin_output + len] = 0;
+	e->plugin_output_len = len;
+}
+
+void shmstatus_write_end(struct shmstatus_entry *e)
+{
+	__atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELEASE);
+}
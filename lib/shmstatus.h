@@ -0,0 +1,194 @@
+#ifndef LIBNAEMON_shmstatus_h__
+#define LIBNAEMON_shmstatus_h__
+
+#if !defined (_NAEMON_H_INSIDE) && !defined (NAEMON_COMPILATION)
+#error "Only <naemon/naemon.h> can be included directly."
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "lnae-utils.h"
+
+NAGIOS_BEGIN_DECL
+
+/**
+ * @file shmstatus.h
+ * @brief Host and service state in a shared memory segment
+ *
+ * Naemon can mirror the state of all hosts and services into a POSIX
+ * shared memory segment, so local tools can read it without parsing
+ * status.dat or talking to the query handler. The segment has a fixed
+ * layout: a header, one entry per host, one per service, a slot of
+ * SHMSTATUS_OUTPUT_SIZE bytes of plugin output per entry and finally
+ * the host names and service descriptions. Everything is found through
+ * offsets from the start of the segment.
+ *
+ * Each entry is versioned by a sequence counter that is odd while
+ * Naemon updates the entry. Readers copy the entry and retry if the
+ * counter was odd or changed meanwhile, so they never see half an
+ * update and never block Naemon. shmstatus_read() does that for you.
+ *
+ * When Naemon restarts or shuts down it sets the stale flag in the
+ * header of the old segment. Readers should then detach and attach to
+ * the new one, which has the same name.
+ *
+ * @{
+ */
+
+#define SHMSTATUS_MAGIC 0x6e6d7373 /**< "nmss" */
+#define SHMSTATUS_VERSION 1
+#define SHMSTATUS_OUTPUT_SIZE 256 /**< plugin output is truncated to fit, nul byte included */
+
+/** The segment header */
+struct shmstatus_header {
+	uint32_t magic; /**< SHMSTATUS_MAGIC */
+	uint32_t version; /**< SHMSTATUS_VERSION */
+	uint32_t stale; /**< set once Naemon is done with this segment */
+	uint32_t entry_size; /**< sizeof(struct shmstatus_entry) */
+	uint64_t size; /**< the size of the whole segment */
+	int64_t pid; /**< the Naemon process updating it */
+	int64_t created; /**< when the segment was created */
+	uint32_t num_hosts; /**< number of host entries */
+	uint32_t num_services; /**< number of service entries */
+	uint64_t hosts; /**< offset of the first host entry */
+	uint64_t services; /**< offset of the first service entry */
+	uint64_t names; /**< offset of the host names and service descriptions */
+	uint64_t names_size; /**< space set aside for them */
+	uint64_t names_used; /**< space taken so far */
+};
+
+/**
+ * The state of a single host or service. Hosts and services are
+ * stored by their id, so the entry for service 17 is the 18th service
+ * entry.
+ */
+struct shmstatus_entry {
+	uint32_t seq; /**< odd while the entry is being updated */
+	uint32_t id; /**< the host or service id */
+	uint32_t host_id; /**< for services, the id of their host */
+	uint32_t plugin_output_len; /**< length of the (possibly truncated) plugin output */
+	uint64_t name; /**< offset of the host name */
+	uint64_t description; /**< offset of the service description, 0 for hosts */
+	uint64_t plugin_output; /**< offset of the plugin output */
+	int32_t current_state;
+	int32_t last_hard_state;
+	int32_t state_type;
+	int32_t current_attempt;
+	int32_t max_attempts;
+	int32_t checks_enabled;
+	int32_t has_been_checked;
+	int32_t problem_has_been_acknowledged;
+	int32_t scheduled_downtime_depth;
+	int32_t is_flapping;
+	int64_t last_check;
+	int64_t next_check;
+	int64_t last_state_change;
+	int64_t last_hard_state_change;
+	double latency;
+	double execution_time;
+};
+
+/** The host entry with the given id */
+static inline struct shmstatus_entry *shmstatus_host(const struct shmstatus_header *hdr, unsigned int id)
+{
+	return (struct shmstatus_entry *)((char *)hdr + hdr->hosts) + id;
+}
+
+/** The service entry with the given id */
+static inline struct shmstatus_entry *shmstatus_service(const struct shmstatus_header *hdr, unsigned int id)
+{
+	return (struct shmstatus_entry *)((char *)hdr + hdr->services) + id;
+}
+
+/** The string at the given offset, such as an entry's name or description */
+static inline const char *shmstatus_string(const struct shmstatus_header *hdr, uint64_t offset)
+{
+	return offset ? (const char *)hdr + offset : NULL;
+}
+
+/**
+ * Maps the named segment read-only
+ * @param[in] name The name of the segment, as in Naemon's status_shm setting
+ * @return The segment header, or NULL with errno set on errors. EPROTO
+ *         means the segment isn't one we understand.
+ */
+struct shmstatus_header *shmstatus_attach(const char *name);
+
+/**
+ * Unmaps a segment mapped with shmstatus_attach()
+ * @param[in] hdr The segment
+ */
+void shmstatus_detach(struct shmstatus_header *hdr);
+
+/**
+ * Checks if Naemon has moved on from a segment
+ * @param[in] hdr The segment
+ * @return 1 if the reader should attach again, 0 otherwise
+ */
+int shmstatus_is_stale(const struct shmstatus_header *hdr);
+
+/**
+ * Takes a consistent copy of an entry and its plugin output
+ * @param[in] hdr The segment
+ * @param[in] e The entry to copy
+ * @param[out] copy Where to put the copy
+ * @param[out] output At least SHMSTATUS_OUTPUT_SIZE bytes for the plugin
+ *             output, or NULL if it isn't needed
+ * @return 0 on success, -1 with errno set to EAGAIN if the entry was
+ *         updated every time we tried
+ */
+int shmstatus_read(const struct shmstatus_header *hdr, const struct shmstatus_entry *e,
+                   struct shmstatus_entry *copy, char *output);
+
+/**
+ * Creates the named segment, replacing any old one by that name, and
+ * maps it read-write. The entries are zeroed.
+ * @param[in] name The name of the segment
+ * @param[in] num_hosts Number of host entries
+ * @param[in] num_services Number of service entries
+ * @param[in] names_size Space needed for names and descriptions,
+ *            nul bytes included
+ * @return The segment header, or NULL with errno set on errors
+ */
+struct shmstatus_header *shmstatus_create(const char *name, unsigned int num_hosts,
+        unsigned int num_services, size_t names_size);
+
+/**
+ * Marks a segment created with shmstatus_create() stale and unmaps it
+ * @param[in] hdr The segment
+ * @param[in] name If not NULL, the segment is removed as well
+ */
+void shmstatus_destroy(struct shmstatus_header *hdr, const char *name);
+
+/**
+ * Copies a name or description into the segment
+ * @param[in] hdr The segment
+ * @param[in] str The string to copy
+ * @return Its offset, or 0 if the space set aside for names is used up
+ */
+uint64_t shmstatus_add_string(struct shmstatus_header *hdr, const char *str);
+
+/**
+ * Starts updating an entry. There must only be one writer.
+ * @param[in] e The entry
+ */
+void shmstatus_write_begin(struct shmstatus_entry *e);
+
+/**
+ * Copies plugin output into an entry being updated
+ * @param[in] hdr The segment
+ * @param[in] e The entry
+ * @param[in] output The plugin output, or NULL
+ */
+void shmstatus_set_output(struct shmstatus_header *hdr, struct shmstatus_entry *e, const char *output);
+
+/**
+ * Finishes updating an entry, making the update visible to readers
+ * @param[in] e The entry
+ */
+void shmstatus_write_end(struct shmstatus_entry *e);
+
+NAGIOS_END_DECL
+
+/** @} */
+#endif /* LIBNAEMON_shmstatus_h__ */
@@ -108,6 +108,60 @@ static int listen_handler(int fd, int events, void *arg)
 	return 0;
 }
 
+static int drained_calls;
+static void drained_handler(int fd, void *arg)
+{
+	drained_calls++;
+}
+
+static int ignore_input(int fd, int events, void *arg)
+{
+	return 0;
+}
+
+/* a writer waiting for a slow reader must be woken by the poll, not spin */
+static void test_wait_drained(void)
+{
+	iobroker_set *set;
+	int sv[2], i, total = 0, len, flags;
+	char buf[64 * 1024];
+
+	set = iobroker_create();
+	t_req(!socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+	flags = fcntl(sv[0], F_GETFL);
+	fcntl(sv[0], F_SETFL, flags | O_NONBLOCK);
+	flags = fcntl(sv[1], F_GETFL);
+	fcntl(sv[1], F_SETFL, flags | O_NONBLOCK);
+	iobroker_register(set, sv[0], NULL, ignore_input);
+
+	ok_int(iobroker_wait_drained(set, sv[1], drained_handler), IOBROKER_EINVAL, "waiting on an unregistered fd must fail");
+	ok_int(iobroker_wait_drained(set, sv[0], drained_handler), 1, "nothing to wait for with nothing queued");
+
+	memset(buf, 'x', sizeof(buf));
+	for (i = 0; i < 64; i++)
+		iobroker_write_packet(set, sv[0], buf, sizeof(buf));
+	test(iobroker_get_pending_output(set, sv[0]) > 0, "a reader that doesn't read must leave output queued");
+	ok_int(iobroker_wait_drained(set, sv[0], drained_handler), 0, "waiting for queued output");
+
+	iobroker_poll(set, 10);
+	ok_int(drained_calls, 0, "must not be called while the reader is stalled");
+
+	for (i = 0; i < 10000 && !drained_calls; i++) {
+		while ((len = read(sv[1], buf, sizeof(buf))) > 0)
+			total += len;
+		iobroker_poll(set, 10);
+	}
+	while ((len = read(sv[1], buf, sizeof(buf))) > 0)
+		total += len;
+	ok_int(drained_calls, 1, "drained callback must be called once");
+	ok_int(total, 64 * (int)sizeof(buf), "all output must have been written");
+	ok_int((int)iobroker_get_pending_output(set, sv[0]), 0, "nothing left queued");
+
+	iobroker_close(set, sv[0]);
+	close(sv[1]);
+	iobroker_destroy(set, 0);
+}
+
 void sighandler(int sig)
 {
 	/* test failed */
@@ -189,6 +243,8 @@ int main(int argc, char **argv)
 	iobroker_close(iobs, listen_fd);
 	iobroker_destroy(iobs, 0);
 
+	test_wait_drained();
+
 	t_end();
 	return 0;
 }
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <sys/wait.h>
+#include "shmstatus.c"
+#include "t-utils.h"
+
+#define SEGMENT_NAME "/naemon-test-shmstatus"
+#define NUM_HOSTS 4
+#define NUM_SERVICES 16
+#define UPDATES 200000
+
+/* every field is derived from n, so a torn read shows up as a mismatch */
+static void fill_entry(struct shmstatus_header *hdr, struct shmstatus_entry *e, uint32_t n)
+{
+	char output[SHMSTATUS_OUTPUT_SIZE * 2];
+
+	snprintf(output, sizeof(output), "update %u %*s", n, (int)(n % (SHMSTATUS_OUTPUT_SIZE + 10)), "x");
+
+	shmstatus_write_begin(e);
+	e->current_state = n % 4;
+	e->last_hard_state = (n + 1) % 4;
+	e->current_attempt = n;
+	e->max_attempts = n + 1;
+	e->last_check = n;
+	e->next_check = (int64_t)n + 300;
+	e->latency = n / 2.0;
+	e->execution_time = n * 2.0;
+	shmstatus_set_output(hdr, e, output);
+	shmstatus_write_end(e);
+}
+
+static int entry_is_consistent(const struct shmstatus_entry *e, const char *output)
+{
+	uint32_t n = e->current_attempt;
+	char expected[SHMSTATUS_OUTPUT_SIZE * 2];
+
+	snprintf(expected, sizeof(expected), "update %u %*s", n, (int)(n % (SHMSTATUS_OUTPUT_SIZE + 10)), "x");
+	expected[SHMSTATUS_OUTPUT_SIZE - 1] = 0;
+
+	return e->current_state == (int32_t)(n % 4) &&
+	       e->last_hard_state == (int32_t)((n + 1) % 4) &&
+	       e->max_attempts == (int32_t)n + 1 &&
+	       e->last_check == n &&
+	       e->next_check == (int64_t)n + 300 &&
+	       e->latency == n / 2.0 &&
+	       e->execution_time == n * 2.0 &&
+	       e->plugin_output_len == strlen(expected) &&
+	       !strcmp(output, expected);
+}
+
+static void test_layout(void)
+{
+	struct shmstatus_header *hdr, *rd;
+	struct shmstatus_entry copy;
+	char output[SHMSTATUS_OUTPUT_SIZE];
+	uint64_t host, svc;
+
+	t_start("Creating and attaching");
+	hdr = shmstatus_create(SEGMENT_NAME, 1, 1, 32);
+	t_req(hdr != NULL);
+	host = shmstatus_add_string(hdr, "host1");
+	svc = shmstatus_add_string(hdr, "svc1");
+	test(host && svc, "strings must fit");
+	test(!shmstatus_add_string(hdr, "a description that won't fit anymore"), "strings past names_size must be refused");
+	shmstatus_host(hdr, 0)->name = host;
+	shmstatus_service(hdr, 0)->name = host;
+	shmstatus_service(hdr, 0)->description = svc;
+
+	fill_entry(hdr, shmstatus_service(hdr, 0), 17);
+
+	rd = shmstatus_attach(SEGMENT_NAME);
+	t_req(rd != NULL);
+	ok_uint(rd->num_hosts, 1, "host count");
+	ok_uint(rd->num_services, 1, "service count");
+	test(!shmstatus_read(rd, shmstatus_service(rd, 0), &copy, output), "reading an idle entry must work");
+	ok_uint(copy.seq, 2, "sequence number after one update");
+	ok_str(shmstatus_string(rd, copy.name), "host1", "host name");
+	ok_str(shmstatus_string(rd, copy.description), "svc1", "service description");
+	test(shmstatus_string(rd, shmstatus_host(rd, 0)->description) == NULL, "hosts have no description");
+	test(entry_is_consistent(&copy, output), "entry must read back as written");
+
+	/* a writer that died half way through leaves the entry unreadable */
+	shmstatus_write_begin(shmstatus_host(hdr, 0));
+	test(shmstatus_read(rd, shmstatus_host(rd, 0), &copy, NULL) < 0 && errno == EAGAIN, "half-written entry must not be read");
+	shmstatus_write_end(shmstatus_host(hdr, 0));
+
+	test(!shmstatus_is_stale(rd), "new segment must not be stale");
+	shmstatus_destroy(hdr, SEGMENT_NAME);
+	test(shmstatus_is_stale(rd), "destroyed segment must be stale");
+	shmstatus_detach(rd);
+	test(shmstatus_attach(SEGMENT_NAME) == NULL && errno == ENOENT, "removed segment must be gone");
+	t_end();
+}
+
+static void test_concurrent_updates(void)
+{
+	struct shmstatus_header *hdr, *rd;
+	struct shmstatus_entry copy;
+	char output[SHMSTATUS_OUTPUT_SIZE];
+	unsigned int reads = 0, torn = 0, read_errors = 0, i;
+	uint32_t last[NUM_SERVICES] = { 0 };
+	int status, backwards = 0;
+	pid_t pid;
+
+	t_start("Reading while another process writes");
+	hdr = shmstatus_create(SEGMENT_NAME, NUM_HOSTS, NUM_SERVICES, 0);
+	t_req(hdr != NULL);
+	for (i = 0; i < NUM_SERVICES; i++)
+		fill_entry(hdr, shmstatus_service(hdr, i), 0);
+
+	pid = fork();
+	t_req(pid >= 0);
+	if (!pid) {
+		uint32_t n;
+
+		for (n = 1; n <= UPDATES; n++)
+			fill_entry(hdr, shmstatus_service(hdr, n % NUM_SERVICES), n);
+		_exit(0);
+	}
+
+	rd = shmstatus_attach(SEGMENT_NAME);
+	t_req(rd != NULL);
+	while (waitpid(pid, &status, WNOHANG) == 0) {
+		for (i = 0; i < NUM_SERVICES; i++) {
+			if (shmstatus_read(rd, shmstatus_service(rd, i), &copy, output) < 0) {
+				read_errors++;
+				continue;
+			}
+			reads++;
+			if (!entry_is_consistent(&copy, output))
+				torn++;
+			if ((uint32_t)copy.current_attempt < last[i])
+				backwards++;
+			last[i] = (uint32_t)copy.current_attempt;
+		}
+	}
+
+	test(WIFEXITED(status) && !WEXITSTATUS(status), "writer must finish cleanly");
+	test(reads > 0, "must have read something (%u reads, %u retries exhausted)", reads, read_errors);
+	ok_uint(torn, 0, "inconsistent reads");
+	test(!backwards, "entries must never go back in time");
+
+	/* and once the writer is done, everything is as it left it */
+	for (i = 0; i < NUM_SERVICES; i++) {
+		t_req(!shmstatus_read(rd, shmstatus_service(rd, i), &copy, output));
+		if (!entry_is_consistent(&copy, output) || (uint32_t)copy.current_attempt != UPDATES - (UPDATES - i) % NUM_SERVICES)
+			break;
+	}
+	ok_uint(i, NUM_SERVICES, "entries in their final state");
+
+	shmstatus_detach(rd);
+	shmstatus_destroy(hdr, SEGMENT_NAME);
+	t_end();
+}
+
+int main(int argc, char **argv)
+{
+	t_set_colors(0);
+	t_start("shmstatus tests");
+	test_layout();
+	test_concurrent_updates();
+	return t_end();
+}
@@ -1,7 +1,12 @@
 #include "worker.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/socket.h>
+#include <glib.h>
 
 struct kvvec_buf *build_kvvec_buf(struct kvvec *kvv)
 {
@@ -35,6 +40,171 @@ int worker_set_sockopts(int sd, int bufsize)
 	return ret;
 }
 
+char *worker_auth_response(const char *secret, size_t secret_len, const char *challenge)
+{
+	if (!secret || !challenge)
+		return NULL;
+
+	return g_compute_hmac_for_string(G_CHECKSUM_SHA256, (const guchar *)secret, secret_len, challenge, -1);
+}
+
+int worker_challenge(char *challenge, size_t size)
+{
+	unsigned char raw[WORKER_CHALLENGE_LEN / 2];
+	int fd;
+	size_t i;
+
+	if (size < WORKER_CHALLENGE_LEN + 1) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ((fd = open("/dev/urandom", O_RDONLY)) < 0)
+		return -1;
+	if (read(fd, raw, sizeof(raw)) != sizeof(raw)) {
+		close(fd);
+		errno = EIO;
+		return -1;
+	}
+	close(fd);
+
+	for (i = 0; i < sizeof(raw); i++)
+		sprintf(&challenge[i * 2], "%02x", raw[i]);
+
+	return 0;
+}
+
+int worker_auth_matches(const char *expected, const char *got)
+{
+	size_t i, len = strlen(expected);
+	unsigned char diff = 0;
+
+	if (strlen(got) != len)
+		return 0;
+	for (i = 0; i < len; i++)
+		diff |= expected[i] ^ got[i];
+
+	return diff == 0;
+}
+
+/* HMAC of "<label>:<master challenge>:<worker challenge>" */
+static char *worker_derive(const char *secret, size_t secret_len, const char *label,
+                           const char *master_challenge, const char *worker_challenge)
+{
+	char *data, *ret;
+
+	if (!secret || !master_challenge || !worker_challenge)
+		return NULL;
+
+	data = g_strdup_printf("%s:%s:%s", label, master_challenge, worker_challenge);
+	ret = g_compute_hmac_for_string(G_CHECKSUM_SHA256, (const guchar *)secret, secret_len, data, -1);
+	g_free(data);
+	return ret;
+}
+
+char *worker_master_proof(const char *secret, size_t secret_len,
+                          const char *master_challenge, const char *worker_challenge)
+{
+	return worker_derive(secret, secret_len, "master", master_challenge, worker_challenge);
+}
+
+struct worker_session *worker_session_create(const char *secret, size_t secret_len,
+        const char *master_challenge, const char *worker_challenge, int is_master)
+{
+	struct worker_session *ws;
+
+	ws = calloc(1, sizeof(*ws));
+	if (!ws)
+		return NULL;
+
+	ws->key = worker_derive(secret, secret_len, "session", master_challenge, worker_challenge);
+	if (!ws->key) {
+		free(ws);
+		return NULL;
+	}
+	ws->send_dir = is_master ? 'm' : 'w';
+	ws->recv_dir = is_master ? 'w' : 'm';
+
+	return ws;
+}
+
+void worker_session_destroy(struct worker_session *ws)
+{
+	if (!ws)
+		return;
+
+	memset(ws->key, 0, strlen(ws->key));
+	g_free(ws->key);
+	free(ws);
+}
+
+/* writes the 64 hex digits of the mac for message seq in direction dir */
+static void worker_session_mac(struct worker_session *ws, char dir, unsigned long long seq,
+                               const char *msg, size_t len, char *mac)
+{
+	GHmac *hmac;
+	char header[64];
+
+	snprintf(header, sizeof(header), "%c:%llu:", dir, seq);
+	hmac = g_hmac_new(G_CHECKSUM_SHA256, (const guchar *)ws->key, strlen(ws->key));
+	g_hmac_update(hmac, (const guchar *)header, strlen(header));
+	g_hmac_update(hmac, (const guchar *)msg, len);
+	memcpy(mac, g_hmac_get_string(hmac), 64);
+	g_hmac_unref(hmac);
+}
+
+struct kvvec_buf *worker_session_sign(struct worker_session *ws, const char *msg, size_t len)
+{
+	struct kvvec_buf *kvvb;
+
+	if (!ws || !msg)
+		return NULL;
+
+	kvvb = malloc(sizeof(*kvvb));
+	if (!kvvb)
+		return NULL;
+	kvvb->buflen = len + WORKER_MAC_PAIR_LEN;
+	kvvb->bufsize = kvvb->buflen + MSG_DELIM_LEN;
+	kvvb->buf = malloc(kvvb->bufsize);
+	if (!kvvb->buf) {
+		free(kvvb);
+		return NULL;
+	}
+
+	memcpy(kvvb->buf, msg, len);
+	memcpy(kvvb->buf + len, "mac=", 4);
+	worker_session_mac(ws, ws->send_dir, ws->sent++, msg, len, kvvb->buf + len + 4);
+	kvvb->buf[kvvb->buflen - 1] = PAIR_SEP;
+	memcpy(kvvb->buf + kvvb->buflen, MSG_DELIM, MSG_DELIM_LEN);
+
+	return kvvb;
+}
+
+int worker_session_verify(struct worker_session *ws, const char *msg, size_t *len)
+{
+	char expected[65], got[65];
+	size_t msg_len;
+
+	if (!ws || !msg || *len < WORKER_MAC_PAIR_LEN)
+		return -1;
+
+	/* the mac pair must be a pair of its own, and the last one */
+	msg_len = *len - WORKER_MAC_PAIR_LEN;
+	if ((msg_len && msg[msg_len - 1] != PAIR_SEP) || memcmp(msg + msg_len, "mac=", 4) ||
+	    msg[*len - 1] != PAIR_SEP)
+		return -1;
+
+	memcpy(got, msg + msg_len + 4, 64);
+	got[64] = 0;
+	worker_session_mac(ws, ws->recv_dir, ws->received, msg, msg_len, expected);
+	expected[64] = 0;
+	if (!worker_auth_matches(expected, got))
+		return -1;
+
+	ws->received++;
+	*len = msg_len;
+	return 0;
+}
+
 char *worker_ioc2msg(nm_bufferqueue *bq, size_t *size, int flags)
 {
 	char *res;
@@ -69,6 +69,109 @@ extern char *worker_ioc2msg(nm_bufferqueue *ioc, size_t *size, int flags);
  */
 extern int worker_set_sockopts(int sd, int bufsize);
 
+/**
+ * Compute a remote worker's answer to the challenge the master sends
+ * when it connects over the network. Both sides run this with the
+ * shared secret; only the answer travels over the wire.
+ * @param[in] secret The shared secret
+ * @param[in] secret_len Length of secret
+ * @param[in] challenge The nul-terminated challenge sent by the master
+ * @return A newly allocated hex string (free with g_free()), NULL on errors
+ */
+extern char *worker_auth_response(const char *secret, size_t secret_len, const char *challenge);
+
+/**
+ * Fill a buffer with a fresh random challenge, as hex
+ * @param[out] challenge Where to put it. Must hold at least
+ *             WORKER_CHALLENGE_LEN + 1 bytes
+ * @param[in] size Size of challenge
+ * @return 0 on success, -1 with errno set on errors
+ */
+extern int worker_challenge(char *challenge, size_t size);
+#define WORKER_CHALLENGE_LEN 32 /**< hex digits in a challenge */
+
+/**
+ * Compare an authentication response with the expected one, without
+ * leaking how much of it matched
+ * @param[in] expected The response we computed ourselves
+ * @param[in] got The response the peer sent
+ * @return 1 if they match, 0 otherwise
+ */
+extern int worker_auth_matches(const char *expected, const char *got);
+
+/**
+ * Compute the master's answer to the challenge a remote worker sends
+ * in its registration request. It differs from worker_auth_response()
+ * so neither side can be made to answer its own challenge for the
+ * other, and covers both challenges so it can't be replayed.
+ * @param[in] secret The shared secret
+ * @param[in] secret_len Length of secret
+ * @param[in] master_challenge The challenge the master sent
+ * @param[in] worker_challenge The challenge the worker sent
+ * @return A newly allocated hex string (free with g_free()), NULL on errors
+ */
+extern char *worker_master_proof(const char *secret, size_t secret_len,
+                                 const char *master_challenge, const char *worker_challenge);
+
+/**
+ * Once a remote worker and the master have authenticated each other,
+ * every message between them carries a final mac=<hex> pair. It's an
+ * HMAC-SHA256 of the rest of the message and a per-direction sequence
+ * number, keyed with a session key derived from the secret and both
+ * challenges, so messages can't be forged, altered, dropped,
+ * reordered or replayed, not even from an earlier session.
+ */
+struct worker_session {
+	char *key; /**< the session key */
+	char send_dir; /**< 'm' for the master, 'w' for the worker */
+	char recv_dir; /**< the peer's send_dir */
+	unsigned long long sent; /**< sequence number of the next message we send */
+	unsigned long long received; /**< sequence number of the next message we expect */
+};
+
+/** Length of the mac=<hex> pair, separator included */
+#define WORKER_MAC_PAIR_LEN (4 + 64 + 1)
+
+/**
+ * Set up the message authentication for a session
+ * @param[in] secret The shared secret
+ * @param[in] secret_len Length of secret
+ * @param[in] master_challenge The challenge the master sent
+ * @param[in] worker_challenge The challenge the worker sent
+ * @param[in] is_master Nonzero on the master's end of the connection
+ * @return A new session, NULL on errors
+ */
+extern struct worker_session *worker_session_create(const char *secret, size_t secret_len,
+        const char *master_challenge, const char *worker_challenge, int is_master);
+
+/**
+ * Destroy a session created with worker_session_create()
+ * @param[in] ws The session. May be NULL
+ */
+extern void worker_session_destroy(struct worker_session *ws);
+
+/**
+ * Sign a message before sending it
+ * @param[in] ws The session
+ * @param[in] msg The message, pair separators included but without
+ *            the message delimiter
+ * @param[in] len Length of msg
+ * @return A newly allocated kvvec buffer holding the message, its mac
+ *         pair and the message delimiter, or NULL on errors
+ */
+extern struct kvvec_buf *worker_session_sign(struct worker_session *ws, const char *msg, size_t len);
+
+/**
+ * Check the mac pair of a received message
+ * @param[in] ws The session
+ * @param[in] msg The message, without the message delimiter
+ * @param[in,out] len Length of msg. On success it's set to the length
+ *                of the message without its mac pair
+ * @return 0 if the message is authentic, -1 otherwise. The connection
+ *         can't be trusted after a failure and should be closed.
+ */
+extern int worker_session_verify(struct worker_session *ws, const char *msg, size_t *len);
+
 NAGIOS_END_DECL
 
 #endif
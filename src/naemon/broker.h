@@ -161,6 +161,7 @@
 
 #define NEBATTR_CHECK_ALERT                   1
 #define NEBATTR_CHECK_FIRST                   2
+#define NEBATTR_CHECK_OUTPUT_UNCHANGED        4         /* output, long output and perfdata are the same as last time */
 
 
 /****** EVENT BROKER FUNCTIONS *************/
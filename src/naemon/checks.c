@@ -26,10 +26,25 @@
 /* for process_check_result_* */
 #include <sys/types.h>
 #include <dirent.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 
 /* forward declarations */
 static const char *spool_file_source_name(void *source);
 static void reap_check_results(struct nm_event_execution_properties *evprop);
+static int process_spool_entry(const char *dirname, const char *name);
+
+/*
+ * Number of checks scheduled for each of the next CHECK_SLOTS seconds,
+ * kept when check_load_levelling_window is set. A slot remembers which
+ * second it counts, so slots for seconds that have passed get reused.
+ */
+#define CHECK_SLOTS 8192
+static struct check_slot {
+	time_t when;
+	unsigned int checks;
+} check_slots[CHECK_SLOTS];
 
 
 static struct check_engine nagios_spool_check_engine = {
@@ -43,6 +58,26 @@ static const char *spool_file_source_name(void *source)
 	return "check result spool dir";
 }
 
+/*
+ * check_result_path as watched by watch_check_result_path(). Names of
+ * result files waiting to be processed are kept in queue. rescan is
+ * set when the directory has to be read to find them, which happens
+ * at startup, when the kernel dropped events, when the queue was too
+ * long to add more to it and every max_check_result_file_age seconds,
+ * to get rid of files that never got their .ok file.
+ */
+static struct {
+	char *dirname;
+	int fd;
+	int rescan;
+	GQueue queue;
+	timed_event *drain_event;
+	timed_event *sweep_event;
+} spool_watch = { NULL, -1, FALSE, G_QUEUE_INIT, NULL, NULL };
+
+/* more queued names than this, and we'd rather read the directory again */
+#define SPOOL_QUEUE_MAX 262144
+
 
 /******************************************************************/
 /************************* INIT FUNCTIONS *************************/
@@ -50,6 +85,7 @@ static const char *spool_file_source_name(void *source)
 
 void checks_init(void)
 {
+	reset_check_slots();
 	checks_init_hosts();
 	checks_init_services();
 
@@ -57,6 +93,101 @@ void checks_init(void)
 
 	/* add a check result reaper event */
 	schedule_event(check_reaper_interval, reap_check_results, NULL);
+
+	/* pick up spooled results as they arrive if we can */
+	if (nagios_iobs && check_result_path)
+		watch_check_result_path(check_result_path);
+}
+
+void checks_deinit(void)
+{
+	unwatch_check_result_path();
+}
+
+/******************************************************************/
+/************************ LOAD LEVELLING **************************/
+/******************************************************************/
+
+static struct check_slot *get_check_slot(time_t when)
+{
+	return &check_slots[when % CHECK_SLOTS];
+}
+
+unsigned int check_slot_occupancy(time_t when)
+{
+	struct check_slot *slot = get_check_slot(when);
+
+	return slot->when == when ? slot->checks : 0;
+}
+
+void book_check_slot(time_t when)
+{
+	struct check_slot *slot;
+
+	if (!check_load_levelling_window)
+		return;
+
+	slot = get_check_slot(when);
+	if (slot->when != when) {
+		slot->when = when;
+		slot->checks = 0;
+	}
+	slot->checks++;
+}
+
+void release_check_slot(time_t when)
+{
+	struct check_slot *slot = get_check_slot(when);
+
+	if (slot->when == when && slot->checks)
+		slot->checks--;
+}
+
+void reset_check_slots(void)
+{
+	memset(check_slots, 0, sizeof(check_slots));
+}
+
+time_t level_check_delay(time_t now, time_t delay, time_t interval, int options)
+{
+	time_t window, offset, best = delay;
+	unsigned int best_checks;
+
+	/* checks someone asked for, or that must run soon, stay put */
+	if (options & (CHECK_OPTION_FORCE_EXECUTION | CHECK_OPTION_FRESHNESS_CHECK | CHECK_OPTION_ORPHAN_CHECK | CHECK_OPTION_DEPENDENCY_CHECK))
+		return delay;
+
+	/* the whole window has to fit within the check interval */
+	window = check_load_levelling_window;
+	if (window > interval)
+		window = interval;
+	window /= 2;
+	if (window < 1 || delay < 1 || delay + window >= CHECK_SLOTS)
+		return delay;
+
+	/*
+	 * Pick the least busy second within the window, looking outwards
+	 * from the requested one so ties keep the interval as it was.
+	 */
+	best_checks = check_slot_occupancy(now + delay);
+	for (offset = 1; offset <= window && best_checks; offset++) {
+		unsigned int checks;
+
+		checks = check_slot_occupancy(now + delay + offset);
+		if (checks < best_checks) {
+			best = delay + offset;
+			best_checks = checks;
+		}
+		if (delay - offset < 1)
+			continue;
+		checks = check_slot_occupancy(now + delay - offset);
+		if (checks < best_checks) {
+			best = delay - offset;
+			best_checks = checks;
+		}
+	}
+
+	return best;
 }
 
 /******************************************************************/
@@ -72,6 +203,10 @@ static void reap_check_results(struct nm_event_execution_properties *evprop)
 		/* Reschedule, since reccuring */
 		schedule_event(check_reaper_interval, reap_check_results, NULL);
 
+		/* the spool watcher takes care of the check result queue */
+		if (spool_watch.fd >= 0)
+			return;
+
 
 		log_debug_info(DEBUGL_CHECKS, 0, "Starting to reap check results.\n");
 
@@ -87,128 +222,292 @@ static void reap_check_results(struct nm_event_execution_properties *evprop)
 /******************************************************************/
 
 
-/**
- * Parse check output, long output and performance data from a buffer
- * into a struct.
- *
- * @param buf Buffer from which to parse check output
- * @param check_output Where to store the parsed output
- * @return Pointer to the populated check_output struct, or NULL on error
+/*
+ * Finds the parts of a plugin's output without copying anything. The
+ * first non-empty line is the short output, up to a '|' if it has one,
+ * in which case the rest of that line is perfdata. Everything after the
+ * first line is long output, up to the first '|' in it. What follows
+ * that '|' is perfdata spread over several lines, see join_perf_data().
  */
-struct check_output *parse_output(const char *buf, struct check_output *check_output)
+void scan_check_output(const char *buf, struct check_output_slices *slices)
 {
-	char *saveptr = NULL, *tmpbuf = NULL;
-	char *p = NULL, *tmp = NULL;
-	GString *perf_data_string;
+	const char *end, *eol, *bar, *rest;
 
-	check_output->perf_data = NULL;
-	check_output->long_output = NULL;
-	check_output->short_output = NULL;
+	memset(slices, 0, sizeof(*slices));
 	if (!buf || !*buf)
-		return check_output;
-	tmpbuf = nm_strdup(buf);
+		return;
+
+	end = buf + strlen(buf);
+	while (buf < end && *buf == '\n')
+		buf++;
+
+	slices->short_output = buf;
+	if (!(eol = memchr(buf, '\n', end - buf)))
+		eol = end;
+	if ((bar = memchr(buf, '|', eol - buf))) {
+		slices->short_len = bar - buf;
+		slices->perf_data = bar + 1;
+		slices->perf_len = eol - (bar + 1);
+	} else {
+		slices->short_len = eol - buf;
+	}
+
+	rest = eol < end ? eol + 1 : end;
+	if (rest == end)
+		return;
 
-	perf_data_string = g_string_new(NULL);
-	tmp = strtok_r(tmpbuf, "\n", &saveptr);
-	if (tmp != NULL) {
-		p = (char *)strpbrk((const char *) tmp, "|");
+	if (!(bar = memchr(rest, '|', end - rest))) {
+		slices->long_output = rest;
+		slices->long_len = end - rest;
+		return;
 	}
-	if (p == NULL) {
-		/* No perfdata in first line of output. */
-		check_output->short_output = tmp ? nm_strdup(tmp) : nm_strdup("");
-	} else {
-		/*
-		 * There is perfdata on the first line
-		 * the short output consists of the all bytes up
-		 * to the perf data delimiter (|), stash those
-		 * bytes and add the rest of the string to the
-		 * perf data buffer.
-		 * */
-		if (p != tmp) {
-			check_output->short_output = nm_strndup(tmp, (size_t)(p - tmp));
-		} else {
-			check_output->short_output = nm_strdup("");
-		}
-		perf_data_string = g_string_append(perf_data_string, tmp + (p - tmp) + 1);
+	if (bar != rest) {
+		slices->long_output = rest;
+		slices->long_len = bar - rest;
 	}
+	slices->perf_lines = bar + 1;
+	slices->perf_lines_len = end - (bar + 1);
+}
 
-	/*
-	 * Get the rest of the string, if any.
-	 * */
-	if ((tmp = strtok_r(NULL, "", &saveptr))) {
-
-		/* Is there a perf data delimiter somewhere in the long output? */
-		p = (char *)strpbrk((const char *) tmp, "|");
-		if (p == NULL) {
-			/* No more perfdata, rest is long output*/
-			check_output->long_output = nm_strdup(tmp);
-		} else {
-			/* There is perfdata, limit what we regard as long output */
-			if (p != tmp) {
-				check_output->long_output = nm_strndup(tmp, (size_t)(p - tmp));
-			}
+/*
+ * glues the perfdata from the first line and the lines following the
+ * long output together into dst, which must have room for
+ * perf_len + perf_lines_len + 2 bytes. Returns the length written.
+ */
+static size_t join_perf_data_into(const struct check_output_slices *slices, char *dst)
+{
+	const char *p, *end, *eol;
+	size_t len;
 
-			/*
-			 * Get rest of string, line by line. This is perfdata if it exists.
-			 * This also gets rid of any interleaved newlines in the
-			 * perf data - we're not interested in those.
-			 * */
-			tmp = strtok_r(p + 1, "\n", &saveptr);
-			while (tmp) {
-
-				/* Backwards compatibility
-				 * Each "newline" is padded by a space, if it doesn't
-				 * already have such a padding.
-				 *
-				 * This is a bit silly, since it's not mentioned anywhere
-				 * in the documentation as far as I can tell, but I opt to keep
-				 * it this way in order to not break existing installations.
-				 * */
-				if (*tmp != ' ') {
-					perf_data_string = g_string_append_c(perf_data_string, ' ');
-				}
-				perf_data_string = g_string_append(perf_data_string, tmp);
-				tmp = strtok_r(NULL, "\n", &saveptr);
-			}
+	if ((len = slices->perf_len))
+		memcpy(dst, slices->perf_data, len);
+
+	p = slices->perf_lines;
+	end = p + slices->perf_lines_len;
+	while (p < end) {
+		if (*p == '\n') {
+			p++;
+			continue;
 		}
+		if (!(eol = memchr(p, '\n', end - p)))
+			eol = end;
+
+		/* Backwards compatibility
+		 * Each "newline" is padded by a space, if it doesn't
+		 * already have such a padding.
+		 *
+		 * This is a bit silly, since it's not mentioned anywhere
+		 * in the documentation as far as I can tell, but I opt to keep
+		 * it this way in order to not break existing installations.
+		 * */
+		if (*p != ' ')
+			dst[len++] = ' ';
+		memcpy(dst + len, p, eol - p);
+		len += eol - p;
+		p = eol;
+	}
+	dst[len] = 0;
+	return len;
+}
+
+/* as join_perf_data_into(), but allocated. Returns NULL if there's no perfdata */
+static char *join_perf_data(const struct check_output_slices *slices)
+{
+	char *perf_data;
+
+	if (!slices->perf_len && !slices->perf_lines_len)
+		return NULL;
+
+	/* every line may get a padding space, and every line but the first one costs a newline */
+	perf_data = nm_malloc(slices->perf_len + slices->perf_lines_len + 2);
+	if (!join_perf_data_into(slices, perf_data)) {
+		free(perf_data);
+		return NULL;
 	}
+	return perf_data;
+}
+
+/*
+ * copies the long output into dst, turning newlines into "\n". dst
+ * must have room for twice the length plus one. Returns the length
+ * written.
+ */
+static size_t escape_output_into(const char *str, size_t len, char *dst)
+{
+	const char *p, *end = str + len, *nl;
+	char *w = dst;
+
+	for (p = str; (nl = memchr(p, '\n', end - p)); p = nl + 1) {
+		memcpy(w, p, nl - p);
+		w += nl - p;
+		*w++ = '\\';
+		*w++ = 'n';
+	}
+	memcpy(w, p, end - p);
+	w += end - p;
+	*w = 0;
+	return w - dst;
+}
+
+/* copies the long output, turning newlines into "\n" */
+static char *escape_output_slice(const char *str, size_t len)
+{
+	const char *p, *end = str + len, *nl;
+	char *escaped;
+	size_t newlines = 0;
+
+	for (p = str; (nl = memchr(p, '\n', end - p)); p = nl + 1)
+		newlines++;
+	if (!newlines)
+		return nm_strndup(str, len);
+
+	escaped = nm_malloc(len + newlines + 1);
+	escape_output_into(str, len, escaped);
+	return escaped;
+}
+
+/**
+ * Parse check output, long output and performance data from a buffer
+ * into a struct.
+ *
+ * @param buf Buffer from which to parse check output
+ * @param check_output Where to store the parsed output
+ * @return Pointer to the populated check_output struct, or NULL on error
+ */
+struct check_output *parse_output(const char *buf, struct check_output *check_output)
+{
+	struct check_output_slices slices;
 
-	check_output->perf_data = strcmp(perf_data_string->str, "") != 0 ? nm_strdup(perf_data_string->str) : NULL;
-	g_string_free(perf_data_string, TRUE);
-	free(tmpbuf);
+	scan_check_output(buf, &slices);
+	check_output->short_output = slices.short_output ? nm_strndup(slices.short_output, slices.short_len) : NULL;
+	check_output->long_output = slices.long_output ? nm_strndup(slices.long_output, slices.long_len) : NULL;
+	check_output->perf_data = join_perf_data(&slices);
 	return check_output;
 }
 
 /* parse raw plugin output and return: short and long output, perf data */
 int parse_check_output(char *buf, char **short_output, char **long_output, char **perf_data, int escape_newlines_please, int newlines_are_escaped)
 {
-	struct check_output *check_output = nm_malloc(sizeof(struct check_output));
-	check_output = parse_output(buf, check_output);
-	*short_output = check_output->short_output;
-	*perf_data = check_output->perf_data;
-	if (escape_newlines_please == TRUE && check_output->long_output != NULL) {
-		*long_output = escape_plugin_output(check_output->long_output);
-		free(check_output->long_output);
-	} else {
-		*long_output = check_output->long_output;
-	}
-	free(check_output);
+	struct check_output_slices slices;
+
+	scan_check_output(buf, &slices);
+	*short_output = slices.short_output ? nm_strndup(slices.short_output, slices.short_len) : NULL;
+	if (!slices.long_output)
+		*long_output = NULL;
+	else if (escape_newlines_please == TRUE)
+		*long_output = escape_output_slice(slices.long_output, slices.long_len);
+	else
+		*long_output = nm_strndup(slices.long_output, slices.long_len);
+	*perf_data = join_perf_data(&slices);
 	strip(*short_output);
 	strip(*perf_data);
 	return OK;
 }
 
 
+/* what strip() would leave of a slice, without touching it */
+static const char *trim_output_slice(const char *str, size_t *len)
+{
+	const char *end = str + *len;
+
+	while (str < end && (*str == ' ' || *str == '\t' || *str == '\r' || *str == '\n'))
+		str++;
+	while (end > str && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r' || end[-1] == '\n'))
+		end--;
+	*len = end - str;
+	return str;
+}
+
+/*
+ * Sets *stored to the len bytes at str, or frees it if str is NULL,
+ * unless that's what it already holds. Returns TRUE if it changed.
+ */
+static int replace_output(char **stored, const char *str, size_t len)
+{
+	if (!str) {
+		if (!*stored)
+			return FALSE;
+		nm_free(*stored);
+		return TRUE;
+	}
+	if (*stored && !strncmp(*stored, str, len) && !(*stored)[len])
+		return FALSE;
+
+	nm_free(*stored);
+	*stored = nm_malloc(len + 1);
+	memcpy(*stored, str, len);
+	(*stored)[len] = 0;
+	return TRUE;
+}
+
+/*
+ * Stores the short output, escaped long output and perfdata of buf
+ * the same way parse_check_output() would, but only replaces the parts
+ * that differ from what's already stored. The parts are built in a
+ * buffer that's reused between calls, so a check that keeps returning
+ * the same output costs no allocations at all. Semicolons in the short
+ * output are turned into colons, and no_output is used if buf is
+ * empty. Returns the CHECK_OUTPUT_* parts that changed.
+ */
+int store_check_output(const char *buf, const char *no_output, char **short_output, char **long_output, char **perf_data)
+{
+	static char *scratch;
+	static size_t scratch_size;
+	struct check_output_slices slices;
+	const char *str;
+	size_t len, need, i;
+	int changed = 0;
+
+	scan_check_output(buf, &slices);
+
+	need = slices.short_len;
+	if (slices.long_len * 2 > need)
+		need = slices.long_len * 2;
+	if (slices.perf_len + slices.perf_lines_len + 1 > need)
+		need = slices.perf_len + slices.perf_lines_len + 1;
+	if (need + 1 > scratch_size) {
+		scratch_size = need + 1;
+		scratch = nm_realloc(scratch, scratch_size);
+	}
+
+	if (slices.short_output) {
+		len = slices.short_len;
+		str = trim_output_slice(slices.short_output, &len);
+		for (i = 0; i < len; i++)
+			scratch[i] = str[i] == ';' ? ':' : str[i];
+		str = scratch;
+	} else {
+		str = no_output;
+		len = no_output ? strlen(no_output) : 0;
+	}
+	if (replace_output(short_output, str, len))
+		changed |= CHECK_OUTPUT_SHORT;
+
+	str = NULL;
+	len = 0;
+	if (slices.long_output) {
+		len = escape_output_into(slices.long_output, slices.long_len, scratch);
+		str = scratch;
+	}
+	if (replace_output(long_output, str, len))
+		changed |= CHECK_OUTPUT_LONG;
+
+	str = NULL;
+	len = 0;
+	if ((slices.perf_len || slices.perf_lines_len) && (len = join_perf_data_into(&slices, scratch)))
+		str = trim_output_slice(scratch, &len);
+	if (replace_output(perf_data, str, len))
+		changed |= CHECK_OUTPUT_PERF;
+
+	return changed;
+}
+
+
 /* processes files in the check result queue directory */
 int process_check_result_queue(char *dirname)
 {
-	char file[MAX_FILENAME_LENGTH];
 	DIR *dirp = NULL;
 	struct dirent *dirfile = NULL;
-	register int x = 0;
-	struct stat stat_buf;
-	struct stat ok_stat_buf;
-	char *temp_buffer = NULL;
 	int result = OK, check_result_files = 0;
 	time_t start;
 
@@ -244,67 +543,311 @@ int process_check_result_queue(char *dirname)
 		}
 
 		/* process this if it's a check result file... */
-		x = strlen(dirfile->d_name);
-		if (x == 7 && dirfile->d_name[0] == 'c') {
+		if (strlen(dirfile->d_name) == 7 && dirfile->d_name[0] == 'c') {
+			result = process_spool_entry(dirname, dirfile->d_name);
 
-			/* create /path/to/file */
-			int written_size = snprintf(file, sizeof(file), "%s/%s", dirname, dirfile->d_name);
-			file[sizeof(file) - 1] = '\x0';
+			/* break out if we encountered an error */
+			if (result == ERROR)
+				break;
 
-			/* Check for encoding errors */
-			if (written_size < 0) {
-				nm_log(NSLOG_RUNTIME_WARNING,
-				       "Warning: encoding error on check result file path '`%s'.\n", file);
-				continue;
-			}
+			check_result_files += result;
+		}
+	}
 
-			/* Check if the filename was truncated */
-			if (written_size > 0 && (size_t)written_size >= sizeof(file)) {
-				nm_log(NSLOG_RUNTIME_WARNING,
-				       "Warning: truncated path to check result file '%s'.\n", file);
-				continue;
-			}
+	closedir(dirp);
 
-			if (stat(file, &stat_buf) == -1) {
-				nm_log(NSLOG_RUNTIME_WARNING,
-				       "Warning: Could not stat() check result file '%s'.\n", file);
-				continue;
-			}
+	return check_result_files;
 
-			/* we only care about real files */
-			if (!S_ISREG(stat_buf.st_mode))
-				continue;
+}
 
-			/* at this point we have a regular file... */
 
-			/* if the file is too old, we delete it */
-			if (stat_buf.st_mtime + max_check_result_file_age < time(NULL)) {
-				delete_check_result_file(dirfile->d_name);
-				continue;
-			}
+/*
+ * Processes the check result file name in dirname, unless there's no
+ * .ok file saying it's complete yet, or it's too old, in which case
+ * it's deleted instead. Returns TRUE if it was processed, FALSE if it
+ * was skipped and ERROR if processing it failed.
+ */
+static int process_spool_entry(const char *dirname, const char *name)
+{
+	char file[MAX_FILENAME_LENGTH];
+	char *temp_buffer = NULL;
+	struct stat stat_buf;
+	struct stat ok_stat_buf;
+	int written_size, result;
 
-			/* can we find the associated ok-to-go file ? */
-			nm_asprintf(&temp_buffer, "%s.ok", file);
-			result = stat(temp_buffer, &ok_stat_buf);
-			nm_free(temp_buffer);
-			if (result == -1)
-				continue;
+	/* create /path/to/file */
+	written_size = snprintf(file, sizeof(file), "%s/%s", dirname, name);
+	file[sizeof(file) - 1] = '\x0';
 
-			/* process the file */
-			result = process_check_result_file(file);
+	/* Check for encoding errors */
+	if (written_size < 0) {
+		nm_log(NSLOG_RUNTIME_WARNING,
+		       "Warning: encoding error on check result file path '`%s'.\n", file);
+		return FALSE;
+	}
 
-			/* break out if we encountered an error */
-			if (result == ERROR)
-				break;
+	/* Check if the filename was truncated */
+	if ((size_t)written_size >= sizeof(file)) {
+		nm_log(NSLOG_RUNTIME_WARNING,
+		       "Warning: truncated path to check result file '%s'.\n", file);
+		return FALSE;
+	}
 
-			check_result_files++;
+	if (stat(file, &stat_buf) == -1) {
+		/* queued twice, or picked up by a rescan already */
+		if (errno == ENOENT) {
+			log_debug_info(DEBUGL_CHECKS, 1, "Check result file '%s' is already gone\n", file);
+			return FALSE;
 		}
+		nm_log(NSLOG_RUNTIME_WARNING,
+		       "Warning: Could not stat() check result file '%s'.\n", file);
+		return FALSE;
 	}
 
+	/* we only care about real files */
+	if (!S_ISREG(stat_buf.st_mode))
+		return FALSE;
+
+	/* at this point we have a regular file... */
+
+	/* if the file is too old, we delete it */
+	if (stat_buf.st_mtime + max_check_result_file_age < time(NULL)) {
+		delete_check_result_file(file);
+		return FALSE;
+	}
+
+	/* can we find the associated ok-to-go file ? */
+	nm_asprintf(&temp_buffer, "%s.ok", file);
+	result = stat(temp_buffer, &ok_stat_buf);
+	nm_free(temp_buffer);
+	if (result == -1)
+		return FALSE;
+
+	/* process the file */
+	if (process_check_result_file(file) == ERROR)
+		return ERROR;
+
+	return TRUE;
+}
+
+
+/******************************************************************/
+/******************** CHECK RESULT SPOOL WATCHER ******************/
+/******************************************************************/
+
+/*
+ * Submitters write cXXXXXX to check_result_path and then create
+ * cXXXXXX.ok to say it's complete, so when inotify tells us about the
+ * .ok file, the result is ready. The names are queued and worked off
+ * check_result_batch_size at a time, once per event loop iteration,
+ * so a flood of results can't keep us from everything else. The
+ * directory is only read in full at startup, when the kernel's event
+ * queue overflowed and every max_check_result_file_age seconds to
+ * clean out stale files.
+ */
+
+static void drain_check_result_spool(struct nm_event_execution_properties *evprop);
+
+static void schedule_spool_drain(void)
+{
+	if (!spool_watch.drain_event)
+		spool_watch.drain_event = schedule_event(0, drain_check_result_spool, NULL);
+}
+
+/* a pending rescan will find it anyway */
+static void queue_spool_entry(const char *name, size_t len)
+{
+	if (spool_watch.rescan)
+		return;
+
+	if (g_queue_get_length(&spool_watch.queue) >= SPOOL_QUEUE_MAX) {
+		log_debug_info(DEBUGL_CHECKS, 0, "Check result queue is full, reading '%s' again once it's drained\n", spool_watch.dirname);
+		spool_watch.rescan = TRUE;
+		return;
+	}
+	g_queue_push_tail(&spool_watch.queue, nm_strndup(name, len));
+}
+
+/*
+ * queues the result files in the directory. If there are more than
+ * fit in the queue, the rest are found by the next rescan, once the
+ * ones queued now are processed and gone.
+ */
+static int rescan_check_result_spool(void)
+{
+	DIR *dirp;
+	struct dirent *dirfile;
+
+	spool_watch.rescan = FALSE;
+
+	if ((dirp = opendir(spool_watch.dirname)) == NULL) {
+		log_debug_info(DEBUGL_CHECKS, 1, "Could not open check result queue directory '%s' for reading: %s\n", spool_watch.dirname, strerror(errno));
+		return ERROR;
+	}
+	while (!spool_watch.rescan && (dirfile = readdir(dirp)) != NULL) {
+		if (strlen(dirfile->d_name) == 7 && dirfile->d_name[0] == 'c')
+			queue_spool_entry(dirfile->d_name, 7);
+	}
 	closedir(dirp);
 
+	log_debug_info(DEBUGL_CHECKS, 1, "Queued %u check result files from '%s'\n", g_queue_get_length(&spool_watch.queue), spool_watch.dirname);
+	return OK;
+}
+
+int process_check_result_spool(unsigned int max_files)
+{
+	int check_result_files = 0;
+	unsigned int i;
+	char *name;
+
+	if (!spool_watch.dirname)
+		return 0;
+
+	/* what's queued goes first, so a rescan doesn't queue it twice */
+	if (spool_watch.rescan && g_queue_is_empty(&spool_watch.queue))
+		rescan_check_result_spool();
+
+	for (i = 0; i < max_files && (name = g_queue_pop_head(&spool_watch.queue)); i++) {
+		int result = process_spool_entry(spool_watch.dirname, name);
+
+		free(name);
+		if (result == ERROR)
+			continue;
+		check_result_files += result;
+	}
+
+	if (check_result_files)
+		log_debug_info(DEBUGL_CHECKS, 1, "Processed %d check result files, %u still queued\n", check_result_files, g_queue_get_length(&spool_watch.queue));
+
 	return check_result_files;
+}
+
+static void drain_check_result_spool(struct nm_event_execution_properties *evprop)
+{
+	spool_watch.drain_event = NULL;
+	if (evprop->execution_type != EVENT_EXEC_NORMAL)
+		return;
+
+	process_check_result_spool(check_result_batch_size);
+
+	/* leave the rest for the next loop iteration */
+	if (spool_watch.rescan || !g_queue_is_empty(&spool_watch.queue))
+		schedule_spool_drain();
+}
+
+static time_t spool_sweep_interval(void)
+{
+	return max_check_result_file_age > 0 ? max_check_result_file_age : check_reaper_interval;
+}
+
+/*
+ * Nothing tells us about result files that are never completed, so
+ * read the whole directory now and then. process_spool_entry() deletes
+ * the ones that are too old, as the reaper does without inotify.
+ */
+static void sweep_check_result_spool(struct nm_event_execution_properties *evprop)
+{
+	if (evprop->execution_type != EVENT_EXEC_NORMAL) {
+		spool_watch.sweep_event = NULL;
+		return;
+	}
+
+	spool_watch.sweep_event = schedule_event(spool_sweep_interval(), sweep_check_result_spool, NULL);
+	log_debug_info(DEBUGL_CHECKS, 1, "Looking for stale check result files in '%s'\n", spool_watch.dirname);
+	spool_watch.rescan = TRUE;
+	schedule_spool_drain();
+}
 
+#ifdef HAVE_SYS_INOTIFY_H
+static int spool_watch_input(int sd, int events, void *discard)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *ev;
+	ssize_t len;
+	char *p;
+
+	while ((len = read(sd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+			ev = (const struct inotify_event *)p;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				nm_log(NSLOG_RUNTIME_WARNING, "Warning: Missed check result spool events, reading '%s' again\n", spool_watch.dirname);
+				spool_watch.rescan = TRUE;
+				continue;
+			}
+
+			/* the directory was removed or moved away, leave it to the reaper */
+			if (ev->mask & IN_IGNORED) {
+				nm_log(NSLOG_RUNTIME_WARNING, "Warning: Stopped watching check result path '%s'\n", spool_watch.dirname);
+				unwatch_check_result_path();
+				return 0;
+			}
+
+			/* cXXXXXX.ok, but the name may be padded with NULs */
+			if (ev->len >= 10 && ev->name[0] == 'c' && !strcmp(ev->name + 7, ".ok"))
+				queue_spool_entry(ev->name, 7);
+		}
+	}
+
+	if (len < 0 && errno != EAGAIN && errno != EINTR)
+		nm_log(NSLOG_RUNTIME_WARNING, "Warning: Failed to read check result spool events: %s\n", strerror(errno));
+
+	if (spool_watch.rescan || !g_queue_is_empty(&spool_watch.queue))
+		schedule_spool_drain();
+
+	return 0;
+}
+#endif
+
+int watch_check_result_path(const char *dirname)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+	int fd;
+
+	unwatch_check_result_path();
+
+	if ((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+		nm_log(NSLOG_RUNTIME_WARNING, "Warning: Failed to set up inotify for check result path '%s': %s\n", dirname, strerror(errno));
+		return ERROR;
+	}
+	if (inotify_add_watch(fd, dirname, IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0) {
+		log_debug_info(DEBUGL_CHECKS, 1, "Not watching check result path '%s': %s\n", dirname, strerror(errno));
+		close(fd);
+		return ERROR;
+	}
+	if (iobroker_register(nagios_iobs, fd, NULL, spool_watch_input) < 0) {
+		nm_log(NSLOG_RUNTIME_WARNING, "Warning: Failed to register check result path watcher with the IO broker\n");
+		close(fd);
+		return ERROR;
+	}
+
+	spool_watch.dirname = nm_strdup(dirname);
+	spool_watch.fd = fd;
+
+	/* pick up whatever was left there while we weren't looking */
+	spool_watch.rescan = TRUE;
+	schedule_spool_drain();
+	spool_watch.sweep_event = schedule_event(spool_sweep_interval(), sweep_check_result_spool, NULL);
+
+	log_debug_info(DEBUGL_CHECKS, 0, "Watching check result path '%s'\n", dirname);
+	return OK;
+#else
+	return ERROR;
+#endif
+}
+
+void unwatch_check_result_path(void)
+{
+	if (spool_watch.drain_event)
+		destroy_event(spool_watch.drain_event);
+	if (spool_watch.sweep_event)
+		destroy_event(spool_watch.sweep_event);
+	if (spool_watch.fd >= 0)
+		iobroker_close(nagios_iobs, spool_watch.fd);
+	spool_watch.fd = -1;
+	spool_watch.rescan = FALSE;
+	g_queue_clear_full(&spool_watch.queue, free);
+	nm_free(spool_watch.dirname);
 }
 
 
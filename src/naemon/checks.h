@@ -34,6 +34,29 @@
 		retry_check_window(o) : \
 		normal_check_window(o))
 
+/*
+ * Check priority classes. Checks due in the same second, and checks
+ * waiting for a worker, are handled highest class first, so routine
+ * checks can't hold up host checks or the retries confirming a problem.
+ * Notifications and event handlers are in a class of their own at the
+ * top, and are never dropped from the worker backlog to make room.
+ */
+enum check_priority {
+	CHECK_PRIORITY_REGULAR = 0, /* routine scheduled checks */
+	CHECK_PRIORITY_FRESHNESS,   /* stale passive results */
+	CHECK_PRIORITY_RETRY,       /* confirming a soft problem state */
+	CHECK_PRIORITY_HOST,        /* host checks, which services depend on */
+	CHECK_PRIORITY_HANDLER,     /* notifications and event handlers */
+};
+#define CHECK_PRIORITIES (CHECK_PRIORITY_HANDLER + 1)
+
+/* the class a service check with the given check options belongs to */
+#define service_check_priority(o, options) \
+	((o->current_state != STATE_OK && o->state_type == SOFT_STATE) ? \
+		CHECK_PRIORITY_RETRY : \
+		((options) & CHECK_OPTION_FRESHNESS_CHECK) ? \
+		CHECK_PRIORITY_FRESHNESS : CHECK_PRIORITY_REGULAR)
+
 NAGIOS_BEGIN_DECL
 
 /*
@@ -79,12 +102,35 @@ struct check_output {
 	char *perf_data;
 };
 
+/* the parts of a plugin's output, pointing into the buffer it was scanned from */
+struct check_output_slices {
+	const char *short_output;	/* NULL if there's no output at all */
+	size_t short_len;
+	const char *long_output;	/* NULL if there's no long output */
+	size_t long_len;
+	const char *perf_data;		/* perfdata on the first line */
+	size_t perf_len;
+	const char *perf_lines;		/* perfdata lines following the long output */
+	size_t perf_lines_len;
+};
+
+/* parts of the stored output that store_check_output() replaced */
+#define CHECK_OUTPUT_SHORT (1 << 0)
+#define CHECK_OUTPUT_LONG  (1 << 1)
+#define CHECK_OUTPUT_PERF  (1 << 2)
+
 void checks_init(void); /* Init check execution, schedule events */
+void checks_deinit(void);
 
+void scan_check_output(const char *buf, struct check_output_slices *slices);
 int parse_check_output(char *, char **, char **, char **, int, int);
+int store_check_output(const char *buf, const char *no_output, char **short_output, char **long_output, char **perf_data);
 struct check_output *parse_output(const char *, struct check_output *);
 
 int process_check_result_queue(char *);
+int watch_check_result_path(const char *dirname);	/* queue results as they're spooled, instead of reading the directory */
+void unwatch_check_result_path(void);
+int process_check_result_spool(unsigned int max_files);	/* processes up to max_files queued results */
 int process_check_result_file(char *);
 int process_check_result(check_result *);
 int delete_check_result_file(char *);
@@ -92,6 +138,19 @@ int init_check_result(check_result *);
 int free_check_result(check_result *);                  	/* frees memory associated with a host/service check result */
 time_t get_random_next_timeperiod_slot(time_t, const timeperiod *);
 
+/*
+ * Load levelling, see check_load_levelling_window. Every scheduled check
+ * books the second it runs in and releases it when it runs or is moved.
+ * level_check_delay() returns the delay to use instead of the requested
+ * one, moving it by at most half a window (and half an interval) to the
+ * second with the fewest checks booked.
+ */
+time_t level_check_delay(time_t now, time_t delay, time_t interval, int options);
+void book_check_slot(time_t when);
+void release_check_slot(time_t when);
+unsigned int check_slot_occupancy(time_t when);
+void reset_check_slots(void);
+
 NAGIOS_END_DECL
 
 #endif
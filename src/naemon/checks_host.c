@@ -121,11 +121,14 @@ void schedule_next_host_check(host *hst, time_t delay, int options)
 		destroy_event(hst->next_check_event);
 	}
 
-	/* Schedule the event */
+	/* Schedule the event, in the least busy second nearby if load levelling */
+	if (check_load_levelling_window)
+		delay = level_check_delay(current_time.tv_sec, delay, check_window(hst), options);
 	hst->check_options = options;
 	hst->next_check = delay + current_time.tv_sec;
+	book_check_slot(hst->next_check);
 	tv_set(&hst->last_update);
-	hst->next_check_event = schedule_event(delay, handle_host_check_event, (void *)hst);
+	hst->next_check_event = schedule_event_priority(delay, CHECK_PRIORITY_HOST, handle_host_check_event, (void *)hst);
 
 	/* update the status log, since next_check and check_options is updated */
 	update_host_status(hst, FALSE);
@@ -153,6 +156,7 @@ static void handle_host_check_event(struct nm_event_execution_properties *evprop
 
 		/* When the callback is called, the pointer to the timed event is invalid */
 		hst->next_check_event = NULL;
+		release_check_slot(hst->next_check);
 
 		/*
 		 * Reschedule the next check one check interval in the future. Can be
@@ -190,6 +194,7 @@ static void handle_host_check_event(struct nm_event_execution_properties *evprop
 	} else if (evprop->execution_type == EVENT_EXEC_ABORTED) {
 		/* If the event is destroyed, remove the reference. */
 		hst->next_check_event = NULL;
+		release_check_slot(hst->next_check);
 	}
 }
 
@@ -202,7 +207,6 @@ static void handle_host_check_event(struct nm_event_execution_properties *evprop
 static int run_async_host_check(host *hst, int check_options, double latency)
 {
 	nagios_macros mac;
-	char *raw_command = NULL;
 	char *processed_command = NULL;
 	struct timeval start_time, end_time;
 	check_result *cr;
@@ -306,16 +310,7 @@ static int run_async_host_check(host *hst, int check_options, double latency)
 	memset(&mac, 0, sizeof(mac));
 	grab_host_macros_r(&mac, hst);
 
-	get_raw_command_line_r(&mac, hst->check_command_ptr, hst->check_command, &raw_command, macro_options);
-	if (raw_command == NULL) {
-		clear_volatile_macros_r(&mac);
-		log_debug_info(DEBUGL_CHECKS, 0, "Raw check command for host '%s' was NULL - aborting.\n", hst->name);
-		return ERROR;
-	}
-
-	/* process any macros contained in the argument */
-	process_macros_r(&mac, raw_command, &processed_command, macro_options);
-	nm_free(raw_command);
+	get_processed_command_line_r(&mac, hst->check_command_ptr, hst->check_command, &processed_command, macro_options);
 	if (processed_command == NULL) {
 		clear_volatile_macros_r(&mac);
 		log_debug_info(DEBUGL_CHECKS, 0, "Processed check command for host '%s' was NULL - aborting.\n", hst->name);
@@ -355,7 +350,7 @@ static int run_async_host_check(host *hst, int check_options, double latency)
 		return neb_result == NEBERROR_CALLBACKOVERRIDE ? OK : ERROR;
 	}
 
-	runchk_result = wproc_run_callback(processed_command, hst->check_timeout, handle_worker_host_check, (void *)cr, &mac);
+	runchk_result = wproc_run_check_callback(hst->check_command_ptr, processed_command, hst->check_timeout, CHECK_PRIORITY_HOST, handle_worker_host_check, (void *)cr, &mac);
 	if (runchk_result == ERROR) {
 		nm_log(NSLOG_RUNTIME_ERROR,
 		       "Unable to send check for host '%s' to worker (ret=%d)\n", hst->name, runchk_result);
@@ -386,12 +381,16 @@ static int run_async_host_check(host *hst, int check_options, double latency)
  */
 int update_host_state_post_check(struct host *hst, struct check_result *cr)
 {
-	int result;
-	char *temp_ptr = NULL;
+	int result, assumed_up, was_assumed_up;
+	char *error_output = NULL;
 
 	if (!hst || !cr)
 		return ERROR;
 
+	/* hosts without a check command keep a fixed short output, see below */
+	assumed_up = cr->check_type == CHECK_TYPE_ACTIVE && hst->check_command == NULL;
+	was_assumed_up = assumed_up && !g_strcmp0(hst->plugin_output, "(Host assumed to be UP)");
+
 	log_debug_info(DEBUGL_CHECKS, 1, "** Handling check result for host '%s' from '%s'...\n", hst->name, check_result_source(cr));
 	log_debug_info(DEBUGL_CHECKS, 2, "\tCheck Type:         %s\n", (cr->check_type == CHECK_TYPE_ACTIVE) ? "Active" : "Passive");
 	log_debug_info(DEBUGL_CHECKS, 2, "\tCheck Options:      %d\n", cr->check_options);
@@ -435,30 +434,6 @@ int update_host_state_post_check(struct host *hst, struct check_result *cr)
 	if (hst->state_type == HARD_STATE)
 		hst->last_hard_state = hst->current_state;
 
-	/* clear the old plugin output and perf data buffers */
-	nm_free(hst->plugin_output);
-	nm_free(hst->long_plugin_output);
-	nm_free(hst->perf_data);
-
-	/* parse check output to get: (1) short output, (2) long output, (3) perf data */
-	parse_check_output(cr->output, &hst->plugin_output, &hst->long_plugin_output, &hst->perf_data, TRUE, FALSE);
-
-	/* make sure we have some data */
-	if (hst->plugin_output == NULL) {
-		hst->plugin_output = nm_strdup("(No output returned from host check)");
-	}
-
-	/* replace semicolons in plugin output (but not performance data) with colons */
-	if ((temp_ptr = hst->plugin_output)) {
-		while ((temp_ptr = strchr(temp_ptr, ';')))
-			* temp_ptr = ':';
-	}
-
-	log_debug_info(DEBUGL_CHECKS, 2, "Parsing check output...\n");
-	log_debug_info(DEBUGL_CHECKS, 2, "Short Output: %s\n", (hst->plugin_output == NULL) ? "NULL" : hst->plugin_output);
-	log_debug_info(DEBUGL_CHECKS, 2, "Long Output:  %s\n", (hst->long_plugin_output == NULL) ? "NULL" : hst->long_plugin_output);
-	log_debug_info(DEBUGL_CHECKS, 2, "Perf Data:    %s\n", (hst->perf_data == NULL) ? "NULL" : hst->perf_data);
-
 	/* get the unprocessed return code */
 	/* NOTE: for passive checks, this is the final/processed state */
 	result = cr->return_code;
@@ -468,10 +443,7 @@ int update_host_state_post_check(struct host *hst, struct check_result *cr)
 		hst->is_executing = FALSE;
 
 		if (cr->early_timeout) {
-			nm_free(hst->plugin_output);
-			nm_free(hst->long_plugin_output);
-			nm_free(hst->perf_data);
-			nm_asprintf(&hst->plugin_output, "(Host check timed out after %.2lf seconds)", hst->execution_time);
+			nm_asprintf(&error_output, "(Host check timed out after %.2lf seconds)", hst->execution_time);
 			result = STATE_UNKNOWN;
 		}
 
@@ -481,10 +453,7 @@ int update_host_state_post_check(struct host *hst, struct check_result *cr)
 			nm_log(NSLOG_RUNTIME_WARNING,
 			       "Warning:  Check of host '%s' did not exit properly!\n", hst->name);
 
-			nm_free(hst->plugin_output);
-			nm_free(hst->long_plugin_output);
-			nm_free(hst->perf_data);
-			hst->plugin_output = nm_strdup("(Host check did not exit properly)");
+			error_output = nm_strdup("(Host check did not exit properly)");
 
 			result = STATE_CRITICAL;
 		}
@@ -495,20 +464,40 @@ int update_host_state_post_check(struct host *hst, struct check_result *cr)
 			nm_log(NSLOG_RUNTIME_WARNING,
 			       "Warning: Return code of %d for check of host '%s' was out of bounds.%s\n", cr->return_code, hst->name, (cr->return_code == 126 || cr->return_code == 127) ? " Make sure the plugin you're trying to run actually exists." : "");
 
-			nm_free(hst->plugin_output);
-			nm_free(hst->long_plugin_output);
-			nm_free(hst->perf_data);
-			nm_asprintf(&hst->plugin_output, "(Return code of %d is out of bounds%s)", cr->return_code, (cr->return_code == 126 || cr->return_code == 127) ? " - plugin may be missing" : "");
+			nm_asprintf(&error_output, "(Return code of %d is out of bounds%s)", cr->return_code, (cr->return_code == 126 || cr->return_code == 127) ? " - plugin may be missing" : "");
 
 			result = STATE_CRITICAL;
 		}
+	}
+
+	/* errors replace whatever the plugin may have said */
+	if (error_output) {
+		hst->output_changed = store_check_output(error_output, NULL, &hst->plugin_output, &hst->long_plugin_output, &hst->perf_data);
+		nm_free(error_output);
+	} else {
+		/*
+		 * parse check output to get: (1) short output, (2) long output, (3) perf data,
+		 * replacing semicolons in plugin output (but not performance data) with colons
+		 */
+		hst->output_changed = store_check_output(cr->output, "(No output returned from host check)", &hst->plugin_output, &hst->long_plugin_output, &hst->perf_data);
+
+		log_debug_info(DEBUGL_CHECKS, 2, "Parsing check output...\n");
+		log_debug_info(DEBUGL_CHECKS, 2, "Short Output: %s\n", (hst->plugin_output == NULL) ? "NULL" : hst->plugin_output);
+		log_debug_info(DEBUGL_CHECKS, 2, "Long Output:  %s\n", (hst->long_plugin_output == NULL) ? "NULL" : hst->long_plugin_output);
+		log_debug_info(DEBUGL_CHECKS, 2, "Perf Data:    %s\n", (hst->perf_data == NULL) ? "NULL" : hst->perf_data);
+	}
 
-		/* a NULL host check command means we should assume the host is UP */
-		if (hst->check_command == NULL) {
+	/* a NULL host check command means we should assume the host is UP */
+	if (assumed_up) {
+		if (g_strcmp0(hst->plugin_output, "(Host assumed to be UP)")) {
 			nm_free(hst->plugin_output);
 			hst->plugin_output = nm_strdup("(Host assumed to be UP)");
-			result = STATE_OK;
 		}
+		/* compare against what we had before, not the parsed output we just replaced */
+		hst->output_changed &= ~CHECK_OUTPUT_SHORT;
+		if (!was_assumed_up)
+			hst->output_changed |= CHECK_OUTPUT_SHORT;
+		result = STATE_OK;
 	}
 
 	/* translate return code to basic UP/DOWN state - the DOWN/UNREACHABLE state determination is made later */
@@ -591,13 +580,9 @@ int handle_async_host_check_result(host *temp_host, check_result *cr)
 	if (!temp_host->last_check)
 		first_recorded_state = NEBATTR_CHECK_FIRST;
 
+	/* the output may be replaced, see hst->output_changed instead */
 	memcpy(&pre, temp_host, sizeof(pre));
-	if (temp_host->plugin_output)
-		pre.plugin_output = nm_strdup(temp_host->plugin_output);
-	if (temp_host->long_plugin_output)
-		pre.long_plugin_output = nm_strdup(temp_host->long_plugin_output);
-	if (temp_host->perf_data)
-		pre.perf_data = nm_strdup(temp_host->perf_data);
+	pre.plugin_output = pre.long_plugin_output = pre.perf_data = NULL;
 
 	/******************* PROCESS THE CHECK RESULTS ******************/
 	update_host_state_post_check(temp_host, cr);
@@ -605,16 +590,12 @@ int handle_async_host_check_result(host *temp_host, check_result *cr)
 	/* process the host check result */
 	process_host_check_result(temp_host, &pre, &alert_recorded);
 
-	nm_free(pre.plugin_output);
-	nm_free(pre.long_plugin_output);
-	nm_free(pre.perf_data);
-
 	log_debug_info(DEBUGL_CHECKS, 1, "** Async check result for host '%s' handled: new state=%d\n", temp_host->name, temp_host->current_state);
 
 	broker_host_check(
 	    NEBTYPE_HOSTCHECK_PROCESSED,
 	    NEBFLAG_NONE,
-	    alert_recorded | first_recorded_state,
+	    alert_recorded | first_recorded_state | (temp_host->output_changed ? NEBATTR_NONE : NEBATTR_CHECK_OUTPUT_UNCHANGED),
 	    temp_host,
 	    temp_host->check_type,
 	    temp_host->current_state,
@@ -676,6 +657,16 @@ static void handle_worker_host_check(wproc_result *wpres, void *arg, int flags)
 			cr->source = wpres->source;
 			process_check_result(cr);
 		}
+	} else if (flags & WPROC_JOB_DROPPED) {
+		/* the check never ran, so keep the state we have and try again later */
+		hst = find_host(cr->host_name);
+		if (hst) {
+			log_debug_info(DEBUGL_CHECKS, 0, "Check of host '%s' was dropped before a worker ran it\n", hst->name);
+			hst->is_executing = FALSE;
+			tv_set(&hst->last_update);
+			if (hst->check_interval != 0.0)
+				schedule_next_host_check(hst, get_host_check_interval_s(hst), CHECK_OPTION_NONE);
+		}
 	}
 	free_check_result(cr);
 	nm_free(cr);
@@ -899,7 +890,7 @@ static int process_host_check_result(host *hst, host *prev, int *alert_recorded)
 	/******************** POST-PROCESSING STUFF *********************/
 
 	/* if the plugin output differs from previous check and no state change, log the current state/output if state stalking is enabled */
-	if (hst->last_state == hst->current_state && should_stalk(hst) && (g_strcmp0(prev->plugin_output, hst->plugin_output) || g_strcmp0(prev->long_plugin_output, hst->long_plugin_output))) {
+	if (hst->last_state == hst->current_state && should_stalk(hst) && (hst->output_changed & (CHECK_OUTPUT_SHORT | CHECK_OUTPUT_LONG))) {
 		log_host_event(hst);
 		*alert_recorded = NEBATTR_CHECK_ALERT;
 	}
@@ -123,11 +123,14 @@ void schedule_next_service_check(service *svc, time_t delay, int options)
 		destroy_event(svc->next_check_event);
 	}
 
-	/* Schedule the event */
+	/* Schedule the event, in the least busy second nearby if load levelling */
+	if (check_load_levelling_window)
+		delay = level_check_delay(current_time.tv_sec, delay, check_window(svc), options);
 	svc->check_options = options;
 	svc->next_check = delay + current_time.tv_sec;
+	book_check_slot(svc->next_check);
 	tv_set(&svc->last_update);
-	svc->next_check_event = schedule_event(delay, handle_service_check_event, (void *)svc);
+	svc->next_check_event = schedule_event_priority(delay, service_check_priority(svc, options), handle_service_check_event, (void *)svc);
 
 	/* update the status log, since next_check and check_options is updated */
 	update_service_status(svc, FALSE);
@@ -158,6 +161,7 @@ static void handle_service_check_event(struct nm_event_execution_properties *evp
 
 		/* When the callback is called, the pointer to the timed event is invalid */
 		temp_service->next_check_event = NULL;
+		release_check_slot(temp_service->next_check);
 
 		/* Reschedule next check directly, might be replaced later */
 		if (temp_service->check_interval != 0.0 && temp_service->is_executing == FALSE) {
@@ -310,6 +314,7 @@ static void handle_service_check_event(struct nm_event_execution_properties *evp
 	} else if (evprop->execution_type == EVENT_EXEC_ABORTED) {
 		/* If the event is destroyed, remove the reference. */
 		temp_service->next_check_event = NULL;
+		release_check_slot(temp_service->next_check);
 	}
 }
 
@@ -322,7 +327,6 @@ static void handle_service_check_event(struct nm_event_execution_properties *evp
 static int run_scheduled_service_check(service *svc, int check_options, double latency)
 {
 	nagios_macros mac;
-	char *raw_command = NULL;
 	char *processed_command = NULL;
 	struct timeval start_time, end_time;
 	host *temp_host = NULL;
@@ -375,16 +379,7 @@ static int run_scheduled_service_check(service *svc, int check_options, double l
 	grab_host_macros_r(&mac, temp_host);
 	grab_service_macros_r(&mac, svc);
 
-	get_raw_command_line_r(&mac, svc->check_command_ptr, svc->check_command, &raw_command, macro_options);
-	if (raw_command == NULL) {
-		clear_volatile_macros_r(&mac);
-		log_debug_info(DEBUGL_CHECKS, 0, "Raw check command for service '%s' on host '%s' was NULL - aborting.\n", svc->description, svc->host_name);
-		return ERROR;
-	}
-
-	/* process any macros contained in the argument */
-	process_macros_r(&mac, raw_command, &processed_command, macro_options);
-	nm_free(raw_command);
+	get_processed_command_line_r(&mac, svc->check_command_ptr, svc->check_command, &processed_command, macro_options);
 	if (processed_command == NULL) {
 		clear_volatile_macros_r(&mac);
 		log_debug_info(DEBUGL_CHECKS, 0, "Processed check command for service '%s' on host '%s' was NULL - aborting.\n", svc->description, svc->host_name);
@@ -422,7 +417,7 @@ static int run_scheduled_service_check(service *svc, int check_options, double l
 	}
 
 	/* paw off the check to a worker to run */
-	runchk_result = wproc_run_callback(processed_command, svc->check_timeout, handle_worker_service_check, (void *)cr, &mac);
+	runchk_result = wproc_run_check_callback(svc->check_command_ptr, processed_command, svc->check_timeout, service_check_priority(svc, check_options), handle_worker_service_check, (void *)cr, &mac);
 	if (runchk_result == ERROR) {
 		nm_log(NSLOG_RUNTIME_ERROR,
 		       "Unable to send check for service '%s' on host '%s' to worker (ret=%d)\n", svc->description, svc->host_name, runchk_result);
@@ -473,6 +468,18 @@ static void handle_worker_service_check(wproc_result *wpres, void *arg, int flag
 		cr->engine = NULL;
 		cr->source = wpres->source;
 		process_check_result(cr);
+	} else if (flags & WPROC_JOB_DROPPED) {
+		/* the check never ran, so keep the state we have and try again later */
+		service *svc = find_service(cr->host_name, cr->service_description);
+		if (svc) {
+			log_debug_info(DEBUGL_CHECKS, 0, "Check of service '%s' on host '%s' was dropped before a worker ran it\n", svc->description, svc->host_name);
+			if (currently_running_service_checks > 0)
+				currently_running_service_checks--;
+			svc->is_executing = FALSE;
+			tv_set(&svc->last_update);
+			if (svc->check_interval != 0.0)
+				schedule_next_service_check(svc, get_service_check_interval_s(svc), CHECK_OPTION_NONE);
+		}
 	}
 	free_check_result(cr);
 	nm_free(cr);
@@ -489,9 +496,7 @@ int handle_async_service_check_result(service *temp_service, check_result *queue
 	int route_result = STATE_UP;
 	int alert_recorded = NEBATTR_NONE;
 	int first_recorded_state = NEBATTR_NONE;
-	char *old_plugin_output = NULL;
-	char *old_long_plugin_output = NULL;
-	char *temp_ptr = NULL;
+	char *error_output = NULL;
 	servicedependency *temp_dependency = NULL;
 	service *master_service = NULL;
 	int state_changes_use_cached_state = TRUE; /* TODO - 09/23/07 move this to a global variable */
@@ -565,19 +570,8 @@ int handle_async_service_check_result(service *temp_service, check_result *queue
 	/* save the old service status info */
 	temp_service->last_state = temp_service->current_state;
 
-	/* save old plugin output */
-	if (temp_service->plugin_output)
-		old_plugin_output = nm_strdup(temp_service->plugin_output);
-
-	if (temp_service->long_plugin_output)
-		old_long_plugin_output = strdup(temp_service->long_plugin_output);
-	/* clear the old plugin output and perf data buffers */
-	nm_free(temp_service->plugin_output);
-	nm_free(temp_service->long_plugin_output);
-	nm_free(temp_service->perf_data);
-
 	if (queued_check_result->early_timeout == TRUE) {
-		nm_asprintf(&temp_service->plugin_output, "(Service check timed out after %.2lf seconds)", temp_service->execution_time);
+		nm_asprintf(&error_output, "(Service check timed out after %.2lf seconds)", temp_service->execution_time);
 		temp_service->current_state = service_check_timeout_state;
 	}
 	/* if there was some error running the command, just skip it (this shouldn't be happening) */
@@ -586,7 +580,7 @@ int handle_async_service_check_result(service *temp_service, check_result *queue
 		nm_log(NSLOG_RUNTIME_WARNING,
 		       "Warning:  Check of service '%s' on host '%s' did not exit properly!\n", temp_service->description, temp_service->host_name);
 
-		temp_service->plugin_output = nm_strdup("(Service check did not exit properly)");
+		error_output = nm_strdup("(Service check did not exit properly)");
 
 		temp_service->current_state = STATE_CRITICAL;
 	}
@@ -597,7 +591,7 @@ int handle_async_service_check_result(service *temp_service, check_result *queue
 		nm_log(NSLOG_RUNTIME_WARNING,
 		       "Warning: Return code of %d for check of service '%s' on host '%s' was out of bounds.%s\n", queued_check_result->return_code, temp_service->description, temp_service->host_name, (queued_check_result->return_code == 126 ? "Make sure the plugin you're trying to run is executable." : (queued_check_result->return_code == 127 ? " Make sure the plugin you're trying to run actually exists." : "")));
 
-		nm_asprintf(&temp_service->plugin_output, "(Return code of %d is out of bounds%s)", queued_check_result->return_code, (queued_check_result->return_code == 126 ? " - plugin may not be executable" : (queued_check_result->return_code == 127 ? " - plugin may be missing" : "")));
+		nm_asprintf(&error_output, "(Return code of %d is out of bounds%s)", queued_check_result->return_code, (queued_check_result->return_code == 126 ? " - plugin may not be executable" : (queued_check_result->return_code == 127 ? " - plugin may be missing" : "")));
 
 		temp_service->current_state = STATE_CRITICAL;
 	}
@@ -605,18 +599,11 @@ int handle_async_service_check_result(service *temp_service, check_result *queue
 	/* else the return code is okay... */
 	else {
 
-		/* parse check output to get: (1) short output, (2) long output, (3) perf data */
-		parse_check_output(queued_check_result->output, &temp_service->plugin_output, &temp_service->long_plugin_output, &temp_service->perf_data, TRUE, FALSE);
-
-		/* make sure the plugin output isn't null */
-		if (temp_service->plugin_output == NULL)
-			temp_service->plugin_output = nm_strdup("(No output returned from plugin)");
-
-		/* replace semicolons in plugin output (but not performance data) with colons */
-		else if ((temp_ptr = temp_service->plugin_output)) {
-			while ((temp_ptr = strchr(temp_ptr, ';')))
-				* temp_ptr = ':';
-		}
+		/*
+		 * parse check output to get: (1) short output, (2) long output, (3) perf data,
+		 * replacing semicolons in plugin output (but not performance data) with colons
+		 */
+		temp_service->output_changed = store_check_output(queued_check_result->output, "(No output returned from plugin)", &temp_service->plugin_output, &temp_service->long_plugin_output, &temp_service->perf_data);
 
 		log_debug_info(DEBUGL_CHECKS, 2, "Parsing check output...\n");
 		log_debug_info(DEBUGL_CHECKS, 2, "Short Output: %s\n", (temp_service->plugin_output == NULL) ? "NULL" : temp_service->plugin_output);
@@ -627,6 +614,12 @@ int handle_async_service_check_result(service *temp_service, check_result *queue
 		temp_service->current_state = queued_check_result->return_code;
 	}
 
+	/* errors replace whatever the plugin may have said */
+	if (error_output) {
+		temp_service->output_changed = store_check_output(error_output, NULL, &temp_service->plugin_output, &temp_service->long_plugin_output, &temp_service->perf_data);
+		nm_free(error_output);
+	}
+
 
 	/* record the time the last state ended */
 	switch (temp_service->last_state) {
@@ -1108,7 +1101,7 @@ int handle_async_service_check_result(service *temp_service, check_result *queue
 	}
 
 	/* if we're stalking this state type and state was not already logged AND the plugin output changed since last check, log it now.. */
-	if (temp_service->state_type == HARD_STATE && state_change == FALSE && !alert_recorded && (g_strcmp0(old_plugin_output, temp_service->plugin_output) || g_strcmp0(old_long_plugin_output, temp_service->long_plugin_output))) {
+	if (temp_service->state_type == HARD_STATE && state_change == FALSE && !alert_recorded && (temp_service->output_changed & (CHECK_OUTPUT_SHORT | CHECK_OUTPUT_LONG))) {
 		if (should_stalk(temp_service)) {
 			log_service_event(temp_service);
 			alert_recorded = NEBATTR_CHECK_ALERT;
@@ -1118,7 +1111,7 @@ int handle_async_service_check_result(service *temp_service, check_result *queue
 	broker_service_check(
 	    NEBTYPE_SERVICECHECK_PROCESSED,
 	    NEBFLAG_NONE,
-	    alert_recorded | first_recorded_state,
+	    alert_recorded | first_recorded_state | (temp_service->output_changed ? NEBATTR_NONE : NEBATTR_CHECK_OUTPUT_UNCHANGED),
 	    temp_service,
 	    temp_service->check_type,
 	    queued_check_result->start_time,
@@ -1152,10 +1145,6 @@ int handle_async_service_check_result(service *temp_service, check_result *queue
 	/* update service performance info */
 	update_service_performance_data(temp_service);
 
-	/* free allocated memory */
-	nm_free(old_plugin_output);
-	nm_free(old_long_plugin_output);
-
 	return OK;
 }
 
@@ -2072,8 +2072,8 @@ static int host_command_handler(const struct external_command *ext_command, time
 		set_host_notification_number(target_host, GV_INT("notification_number"));
 		return OK;
 	case CMD_CHANGE_HOST_CHECK_TIMEPERIOD:
-		nm_free(target_host->check_period);
-		target_host->check_period = nm_strdup((GV_TIMEPERIOD("check_timeperiod"))->name);
+		nm_intern_release(target_host->check_period);
+		target_host->check_period = nm_intern((GV_TIMEPERIOD("check_timeperiod"))->name);
 		target_host->check_period_ptr = GV_TIMEPERIOD("check_timeperiod");
 		target_host->modified_attributes |= MODATTR_CHECK_TIMEPERIOD;
 		broker_adaptive_host_data(NEBTYPE_ADAPTIVEHOST_UPDATE, NEBFLAG_NONE, NEBATTR_NONE, target_host, ext_command->id, MODATTR_CHECK_TIMEPERIOD, target_host->modified_attributes);
@@ -2092,8 +2092,8 @@ static int host_command_handler(const struct external_command *ext_command, time
 	case CMD_SEND_CUSTOM_HOST_NOTIFICATION:
 		return host_notification(target_host, NOTIFICATION_CUSTOM, GV("author"), GV("comment"), GV_INT("options"));
 	case CMD_CHANGE_HOST_NOTIFICATION_TIMEPERIOD:
-		nm_free(target_host->notification_period);
-		target_host->notification_period = nm_strdup((GV_TIMEPERIOD("notification_timeperiod"))->name);
+		nm_intern_release(target_host->notification_period);
+		target_host->notification_period = nm_intern((GV_TIMEPERIOD("notification_timeperiod"))->name);
 		target_host->notification_period_ptr = GV_TIMEPERIOD("notification_timeperiod");
 		target_host->modified_attributes |= MODATTR_NOTIFICATION_TIMEPERIOD;
 
@@ -2370,8 +2370,8 @@ static int service_command_handler(const struct external_command *ext_command, t
 		set_service_notification_number(target_service, GV_INT("notification_number"));
 		return OK;
 	case CMD_CHANGE_SVC_CHECK_TIMEPERIOD:
-		nm_free(target_service->check_period);
-		target_service->check_period = nm_strdup((GV_TIMEPERIOD("check_timeperiod"))->name);
+		nm_intern_release(target_service->check_period);
+		target_service->check_period = nm_intern((GV_TIMEPERIOD("check_timeperiod"))->name);
 		target_service->check_period_ptr = GV("check_timeperiod");
 		target_service->modified_attributes |= MODATTR_CHECK_TIMEPERIOD;
 
@@ -2383,8 +2383,8 @@ static int service_command_handler(const struct external_command *ext_command, t
 		return service_notification(target_service, NOTIFICATION_CUSTOM, GV("author"), GV("comment"), GV_INT("options"));
 
 	case CMD_CHANGE_SVC_NOTIFICATION_TIMEPERIOD:
-		nm_free(target_service->notification_period);
-		target_service->notification_period = nm_strdup(GV_TIMEPERIOD("notification_timeperiod")->name);
+		nm_intern_release(target_service->notification_period);
+		target_service->notification_period = nm_intern(GV_TIMEPERIOD("notification_timeperiod")->name);
 		target_service->notification_period_ptr = GV("notification_timeperiod");
 		target_service->modified_attributes |= MODATTR_NOTIFICATION_TIMEPERIOD;
 
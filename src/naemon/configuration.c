@@ -124,9 +124,25 @@ read_config_file(const char *main_config_file, nagios_macros *mac)
 
 		else if (!strcmp(variable, "check_workers"))
 			num_check_workers = atoi(value);
+		else if (!strcmp(variable, "max_check_workers"))
+			max_check_workers = atoi(value);
+		else if (!strcmp(variable, "config_load_threads"))
+			config_load_threads = atoi(value);
+		else if (!strcmp(variable, "max_job_output_size"))
+			max_job_output_size = strtoul(value, NULL, 0);
+		else if (!strcmp(variable, "max_worker_backlog"))
+			max_worker_backlog = strtoul(value, NULL, 0);
+		else if (!strcmp(variable, "query_handler_threads"))
+			query_handler_threads = atoi(value);
 		else if (!strcmp(variable, "query_socket")) {
 			nm_free(qh_socket_path);
 			qh_socket_path = nspath_absolute(value, config_rel_path);
+		} else if (!strcmp(variable, "worker_listen_address")) {
+			nm_free(worker_listen_address);
+			worker_listen_address = nm_strdup(value);
+		} else if (!strcmp(variable, "worker_secret_file")) {
+			nm_free(worker_secret_file);
+			worker_secret_file = nspath_absolute(value, config_rel_path);
 		} else if (!strcmp(variable, "log_file")) {
 
 			if (strlen(value) > MAX_FILENAME_LENGTH - 1) {
@@ -444,6 +460,16 @@ read_config_file(const char *main_config_file, nagios_macros *mac)
 			}
 		}
 
+		else if (!strcmp(variable, "check_load_levelling_window")) {
+
+			check_load_levelling_window = atoi(value);
+			if (check_load_levelling_window < 0) {
+				nm_asprintf(&error_message, "Illegal value for check_load_levelling_window");
+				error = TRUE;
+				break;
+			}
+		}
+
 		else if (!strcmp(variable, "retention_scheduling_horizon")) {
 
 			retention_scheduling_horizon = atoi(value);
@@ -714,6 +740,15 @@ read_config_file(const char *main_config_file, nagios_macros *mac)
 			}
 		}
 
+		else if (!strcmp(variable, "check_result_batch_size")) {
+			check_result_batch_size = strtoul(value, NULL, 0);
+			if (check_result_batch_size < 1) {
+				nm_asprintf(&error_message, "Illegal value for check_result_batch_size");
+				error = TRUE;
+				break;
+			}
+		}
+
 		else if (!strcmp(variable, "sleep_time")) {
 			obsoleted_warning(variable, NULL);
 		}
@@ -968,6 +1003,10 @@ read_config_file(const char *main_config_file, nagios_macros *mac)
 		/* BEGIN status data variables */
 		else if (!strcmp(variable, "status_file"))
 			status_file = nspath_absolute(value, config_rel_path);
+		else if (!strcmp(variable, "status_shm")) {
+			nm_free(status_shm);
+			status_shm = nm_strdup(value);
+		}
 		else if (strstr(input, "state_retention_file=") == input)
 			retention_file = nspath_absolute(value, config_rel_path);
 		/* END status data variables */
@@ -1015,6 +1054,12 @@ read_config_file(const char *main_config_file, nagios_macros *mac)
 			host_perfdata_process_empty_results = (atoi(value) > 0) ? TRUE : FALSE;
 		else if (!strcmp(variable, "service_perfdata_process_empty_results"))
 			service_perfdata_process_empty_results = (atoi(value) > 0) ? TRUE : FALSE;
+		else if (!strcmp(variable, "perfdata_flush_size"))
+			perfdata_flush_size = strtoul(value, NULL, 0);
+		else if (!strcmp(variable, "perfdata_flush_interval"))
+			perfdata_flush_interval = strtoul(value, NULL, 0);
+		else if (!strcmp(variable, "perfdata_max_buffer_size"))
+			perfdata_max_buffer_size = strtoul(value, NULL, 0);
 		/*** END perfdata variables */
 
 		else if (!strcmp(variable, "cfg_file")) {
@@ -1339,12 +1384,14 @@ int pre_flight_check(void)
 	/* check object relationships               */
 	/********************************************/
 	pre_flight_object_check(&warnings, &errors);
+	timing_point("Done checking object relationships\n");
 
 	/********************************************/
 	/* check for circular paths between hosts   */
 	/********************************************/
 	if (!allow_circular_dependencies) {
 		pre_flight_circular_check(&warnings, &errors);
+		timing_point("Done checking for circular paths\n");
 	}
 
 	/********************************************/
@@ -21,6 +21,7 @@
 #define DEFAULT_CHECK_REAPER_INTERVAL				10	/* interval in seconds to reap host and service check results */
 #define DEFAULT_MAX_REAPER_TIME                 		30      /* maximum number of seconds to spend reaping service checks before we break out for a while */
 #define DEFAULT_MAX_CHECK_RESULT_AGE				3600    /* maximum number of seconds that a check result file is considered to be valid */
+#define DEFAULT_CHECK_RESULT_BATCH_SIZE				1000	/* maximum number of spooled check result files to process per event loop iteration */
 #define DEFAULT_MAX_PARALLEL_SERVICE_CHECKS 			0	/* maximum number of service checks we can have running at any given time (0=unlimited) */
 #define DEFAULT_RETENTION_UPDATE_INTERVAL			60	/* minutes between auto-save of retention data */
 #define DEFAULT_RETAINED_SCHEDULING_RANDOMIZE_WINDOW	60	/* number of seconds used for randomizing the re-scheduling of checks missed over a restart */
@@ -53,6 +54,9 @@
 #define DEFAULT_DEBUG_VERBOSITY                                 1
 #define DEFAULT_MAX_DEBUG_FILE_SIZE                             1000000 /* max size of debug log */
 
+#define DEFAULT_MAX_JOB_OUTPUT_SIZE                             16777216 /* max stdout and stderr kept from a worker job */
+#define DEFAULT_MAX_WORKER_BACKLOG                              10000 /* jobs waiting for a free worker */
+
 #define DEFAULT_AGGRESSIVE_HOST_CHECKING			0	/* don't use "aggressive" host checking */
 #define DEFAULT_CHECK_EXTERNAL_COMMANDS				1 	/* check for external commands */
 #define DEFAULT_CHECK_ORPHANED_SERVICES				1	/* check for orphaned services */
@@ -97,6 +101,9 @@
 #define DEFAULT_SERVICE_PERFDATA_FILE_TEMPLATE "[SERVICEPERFDATA]\t$TIMET$\t$HOSTNAME$\t$SERVICEDESC$\t$SERVICEEXECUTIONTIME$\t$SERVICELATENCY$\t$SERVICEOUTPUT$\t$SERVICEPERFDATA$"
 #define DEFAULT_HOST_PERFDATA_PROCESS_EMPTY_RESULTS 1
 #define DEFAULT_SERVICE_PERFDATA_PROCESS_EMPTY_RESULTS 1
+#define DEFAULT_PERFDATA_FLUSH_SIZE				65536	/* write buffered perfdata lines once this many bytes are waiting */
+#define DEFAULT_PERFDATA_FLUSH_INTERVAL				1	/* ... or at least this often (in seconds) */
+#define DEFAULT_PERFDATA_MAX_BUFFER_SIZE			67108864	/* drop perfdata lines rather than buffer more than 64MiB per file */
 
 
 /* Legacy way to find out default locations - do not go near these, as they
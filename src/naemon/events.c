@@ -13,6 +13,7 @@
 struct timed_event {
 	size_t pos;
 	struct timespec event_time;
+	int priority;
 	event_callback callback;
 	void *user_data;
 };
@@ -70,6 +71,15 @@ static inline int evheap_compare(struct timed_event *eva, struct timed_event *ev
 		return -1;
 	if (eva->event_time.tv_sec > evb->event_time.tv_sec)
 		return 1;
+	/*
+	 * Within a second, priority goes before the exact time. Checks are
+	 * scheduled with a resolution of one second anyway, so this only
+	 * reorders what's due together.
+	 */
+	if (eva->priority > evb->priority)
+		return -1;
+	if (eva->priority < evb->priority)
+		return 1;
 	if (eva->event_time.tv_nsec < evb->event_time.tv_nsec)
 		return -1;
 	if (eva->event_time.tv_nsec > evb->event_time.tv_nsec)
@@ -217,7 +227,11 @@ static void evheap_destroy(struct timed_event_queue *q)
 
 timed_event *schedule_event(time_t delay, event_callback callback, void *user_data)
 {
+	return schedule_event_priority(delay, 0, callback, user_data);
+}
 
+timed_event *schedule_event_priority(time_t delay, int priority, event_callback callback, void *user_data)
+{
 	timed_event *event;
 
 	g_return_val_if_fail(event_queue != NULL, NULL);
@@ -228,6 +242,7 @@ timed_event *schedule_event(time_t delay, event_callback callback, void *user_da
 	clock_gettime(EVENT_CLOCK_ID, &event->event_time);
 	event->event_time.tv_sec += delay;
 
+	event->priority = priority;
 	event->callback = callback;
 	event->user_data = user_data;
 
@@ -321,13 +336,12 @@ static int event_poll_full(iobroker_set *iobs, long int timeout_ms)
 		time_diff = timeout_ms;
 	}
 
-	if (!iobroker_push(iobs)) {
-		/* There is a backlog for data sending? Catch up at "idle
-		* priority", i.e. prevent sleeping while awaiting
-		* results, but continue to run events as usual.
-		*/
-		time_diff = 0;
-	}
+	/*
+	 * Send what we can of any backlog of outgoing data. The rest goes
+	 * out as the sockets become writable, which wakes up the poll
+	 * below, so a client that doesn't read can't keep us from sleeping.
+	 */
+	iobroker_push(iobs);
 	inputs = iobroker_poll(iobs, time_diff);
 	if (inputs < 0) {
 		if (errno == EINTR) {
@@ -45,6 +45,12 @@ typedef void (*event_callback)(struct nm_event_execution_properties *);
  * Schedule a timed event. At the given time, the callback is executed
  */
 timed_event *schedule_event(time_t delay, event_callback callback, void *user_data);
+
+/**
+ * Same as schedule_event(), but among the events due within the same
+ * second, the ones with a higher priority are executed first
+ */
+timed_event *schedule_event_priority(time_t delay, int priority, event_callback callback, void *user_data);
 void destroy_event(timed_event *event);
 
 /**
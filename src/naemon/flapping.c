@@ -14,22 +14,22 @@
 /******************** FLAP DETECTION FUNCTIONS ********************/
 /******************************************************************/
 
-static double flapping_pct(int *history, int idx, int len)
+static double flapping_pct(state_history_t history, int idx, int len)
 {
 	double low_curve_value = 0.75;
 	double high_curve_value = 1.25;
 	double curved_changes = 0.0, curved_percent_change;
 	int last = 0, x, y;
 
-	last = history[idx];
+	last = state_history_get(history, idx);
 	y = idx < len ? idx : 0;
 
 	/* calculate overall and curved percent state changes */
 	for (x = 1; x < MAX_STATE_HISTORY_ENTRIES; x++) {
-		if (last != history[y])
+		if (last != state_history_get(history, y))
 			curved_changes += (((double)(x - 1) * (high_curve_value - low_curve_value)) / ((double)(MAX_STATE_HISTORY_ENTRIES - 2))) + low_curve_value;
 
-		last = history[y];
+		last = state_history_get(history, y);
 
 		y++;
 		if (y >= MAX_STATE_HISTORY_ENTRIES)
@@ -71,7 +71,7 @@ void check_for_service_flapping(service *svc, int update)
 	high_threshold = (svc->high_flap_threshold <= 0.0) ? high_service_flap_threshold : svc->high_flap_threshold;
 
 	/* record the current state in the state history */
-	svc->state_history[svc->state_history_index] = svc->current_state;
+	state_history_set(&svc->state_history, svc->state_history_index, svc->current_state);
 
 	/* increment state history index to next available slot */
 	svc->state_history_index++;
@@ -153,7 +153,7 @@ void check_for_host_flapping(host *hst, int update, int actual_check)
 	hst->last_state_history_update = current_time;
 
 	/* record the current state in the state history */
-	hst->state_history[hst->state_history_index] = hst->current_state;
+	state_history_set(&hst->state_history, hst->state_history_index, hst->current_state);
 
 	/* increment state history index to next available slot */
 	hst->state_history_index++;
@@ -9,6 +9,7 @@
 #include "objectlist.h"
 #include "objects_command.h"
 #include "macros.h" /* For MAX_USER_MACROS */
+#include "logging.h" /* For debug_level and debug_verbosity */
 
 NAGIOS_BEGIN_DECL
 
@@ -30,7 +31,15 @@ extern objectlist *objcfg_dirs;
 extern unsigned int nofile_limit, nproc_limit, max_apps;
 
 extern int num_check_workers;
+extern int max_check_workers;
+extern int config_load_threads;
+extern unsigned long max_job_output_size;
+extern unsigned int max_worker_backlog;
+extern int query_handler_threads;
 extern char *qh_socket_path;
+extern char *status_shm;
+extern char *worker_listen_address;
+extern char *worker_secret_file;
 
 extern char *macro_user[MAX_USER_MACROS];
 
@@ -84,6 +93,7 @@ extern int max_parallel_service_checks;
 
 extern int check_reaper_interval;
 extern int max_check_reaper_time;
+extern unsigned int check_result_batch_size;
 extern int service_freshness_check_interval;
 extern int host_freshness_check_interval;
 extern int auto_rescheduling_interval;
@@ -117,6 +127,7 @@ extern int retention_update_interval;
 extern int use_retained_program_state;
 extern int use_retained_scheduling_info;
 extern int retained_scheduling_randomize_window;
+extern int check_load_levelling_window;
 extern int retention_scheduling_horizon;
 extern char *retention_file;
 extern unsigned long retained_host_attribute_mask;
@@ -145,8 +156,6 @@ extern char *use_timezone;
 extern time_t max_check_result_file_age;
 
 extern char *debug_file;
-extern int debug_level;
-extern int debug_verbosity;
 extern unsigned long max_debug_file_size;
 
 extern int allow_empty_hostgroup_assignment;
@@ -12,6 +12,9 @@
 
 static FILE *debug_file_fp;
 static FILE *log_fp;
+/* object config resolution may log from several threads at once, and
+ * modules may well log from within their log data callbacks */
+static GRecMutex log_mutex;
 
 int log_initial_states = DEFAULT_LOG_INITIAL_STATES;
 int log_current_states = DEFAULT_LOG_CURRENT_STATES;
@@ -186,7 +189,9 @@ void nm_log(int data_type, const char *fmt, ...)
 
 	va_start(ap, fmt);
 	if (vasprintf(&buffer, fmt, ap) > 0) {
+		g_rec_mutex_lock(&log_mutex);
 		write_to_logs_and_console(buffer, data_type, TRUE);
+		g_rec_mutex_unlock(&log_mutex);
 		free(buffer);
 	}
 	va_end(ap);
@@ -307,7 +312,7 @@ int close_debug_log(void)
 
 
 /* write to the debug log */
-int log_debug_info(int level, int verbosity, const char *fmt, ...)
+int (log_debug_info)(int level, int verbosity, const char *fmt, ...)
 {
 	va_list ap;
 	char *tmppath = NULL;
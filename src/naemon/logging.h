@@ -79,6 +79,23 @@ NAGIOS_BEGIN_DECL
 
 extern int log_initial_states;
 extern int log_current_states;
+extern int debug_level;
+extern int debug_verbosity;
+
+/*
+ * The debug categories compiled in. Building with
+ * --with-debug-levels=<mask> strips every log_debug_info() call for
+ * the other categories at compile time.
+ */
+#ifndef NAEMON_DEBUG_LEVELS
+# define NAEMON_DEBUG_LEVELS DEBUGL_ALL
+#endif
+
+/* true if a debug message with this level and verbosity gets logged */
+#define nm_debug_enabled(level, verbosity) \
+	(((level) & NAEMON_DEBUG_LEVELS) && \
+	 (debug_level == DEBUGL_ALL || ((level) & debug_level)) && \
+	 (verbosity) <= debug_verbosity)
 
 /**** Logging Functions ****/
 void nm_log(int, const char *, ...)
@@ -86,6 +103,20 @@ __attribute__((__format__(__printf__, 2, 3)));
 int log_debug_info(int, int, const char *, ...)
 __attribute__((__format__(__printf__, 3, 4)));
 
+/*
+ * Test the level and verbosity before evaluating any of the
+ * arguments, so disabled debug messages neither evaluate them nor
+ * call the function. Level and verbosity are evaluated more than once.
+ * A statement expression rather than ?:, so messages compiled out by
+ * --with-debug-levels don't leave statements without effect behind.
+ */
+#define log_debug_info(level, verbosity, ...) ({ \
+	int debug_ret_ = OK; \
+	if (nm_debug_enabled(level, verbosity)) \
+		debug_ret_ = log_debug_info(level, verbosity, __VA_ARGS__); \
+	debug_ret_; \
+})
+
 int rotate_log_file(time_t);            /* rotates the main log file */
 int write_log_file_info(time_t *);      /* records log file/version info */
 int open_debug_log(void);
@@ -55,8 +55,48 @@ struct grab_custom_value_parameters {
 };
 
 
+/* the kinds of spans a macro template is made of */
+enum macro_span_type {
+	MACRO_SPAN_LITERAL, /* plain text, copied as-is */
+	MACRO_SPAN_NAMED,   /* anything we can't resolve until it's expanded */
+	MACRO_SPAN_X,       /* a regular macro without arguments */
+	MACRO_SPAN_ARGV,    /* $ARGx$ */
+	MACRO_SPAN_USER,    /* $USERx$ */
+};
+
+struct macro_span {
+	enum macro_span_type type;
+	int code;       /* macro code, or argv/user macro index */
+	int options;    /* escaping options for MACRO_SPAN_X */
+	int terminated; /* FALSE for a trailing macro without its closing $ */
+	size_t len;
+	const char *str; /* literal text or macro name */
+};
+
+struct macro_template {
+	unsigned int num_spans;
+	size_t literal_len;
+	char *strings;
+	struct macro_span spans[];
+};
+
+/* the compiled arguments of a "command!arg1!arg2" string */
+struct command_args {
+	int argc;
+	struct macro_template *argv[MAX_COMMAND_ARGUMENTS];
+};
+
+/*
+ * command lines and check_command arguments we've already compiled,
+ * keyed by the string they were compiled from
+ */
+static GHashTable *command_line_templates;
+static GHashTable *command_arg_templates;
+
+
 /* prototypes for recursive or chain-recursive functions */
 static int grab_custom_macro_value_r(nagios_macros *mac, char *macro_name, char *arg1, char *arg2, char **output);
+static void expand_command_args(nagios_macros *mac, const char *cmd, int macro_options);
 
 
 nagios_macros *get_global_macros(void)
@@ -121,13 +161,6 @@ static int grab_custom_object_macro_r(nagios_macros *mac, char *macro_name, cust
 /* given a "raw" command, return the "expanded" or "whole" command line */
 int get_raw_command_line_r(nagios_macros *mac, command *cmd_ptr, char *cmd, char **full_command, int macro_options)
 {
-	char *temp_arg = NULL;
-	char *arg_buffer = NULL;
-	size_t cmd_len = 0;
-	register int x = 0;
-	register int y = 0;
-	register int arg_index = 0;
-
 	/* clear the argv macros */
 	clear_argv_macros_r(mac);
 
@@ -140,56 +173,12 @@ int get_raw_command_line_r(nagios_macros *mac, command *cmd_ptr, char *cmd, char
 	/* get the full command line */
 	*full_command = nm_strdup((cmd_ptr->command_line == NULL) ? "" : cmd_ptr->command_line);
 
-	if (cmd == NULL) {
-		log_debug_info(DEBUGL_COMMANDS | DEBUGL_CHECKS | DEBUGL_MACROS, 2, "Expanded Command Output: %s\n", *full_command);
-		return OK;
-	}
-
-	cmd_len = strlen(cmd);
-	temp_arg = nm_malloc(cmd_len);
-
-	/* get the command arguments */
-	/* skip the command name (we're about to get the arguments)... */
-	for (arg_index = 0;; arg_index++) {
-		if (cmd[arg_index] == '!' || cmd[arg_index] == '\x0')
-			break;
-	}
-
-	/* get each command argument */
-	for (x = 0; x < MAX_COMMAND_ARGUMENTS; x++) {
-
-		/* we reached the end of the arguments... */
-		if (cmd[arg_index] == '\x0')
-			break;
-
-		/* get the next argument */
-		/* can't use strtok(), as that's used in process_macros... */
-		for (arg_index++, y = 0; y < (int)cmd_len - 1; arg_index++) {
-
-			/* handle escaped argument delimiters */
-			if (cmd[arg_index] == '\\' && cmd[arg_index + 1] == '!') {
-				arg_index++;
-			} else if (cmd[arg_index] == '!' || cmd[arg_index] == '\x0') {
-				/* end of argument */
-				break;
-			}
-
-			/* copy the character */
-			temp_arg[y] = cmd[arg_index];
-			y++;
-		}
-		temp_arg[y] = '\x0';
-
-		/* ADDED 01/29/04 EG */
-		/* process any macros we find in the argument */
-		process_macros_r(mac, temp_arg, &arg_buffer, macro_options);
-
-		mac->argv[x] = arg_buffer;
-	}
+	/* process any macros we find in the arguments */
+	if (cmd != NULL)
+		expand_command_args(mac, cmd, macro_options);
 
 	log_debug_info(DEBUGL_COMMANDS | DEBUGL_CHECKS | DEBUGL_MACROS, 2, "Expanded Command Output: %s\n", *full_command);
 
-	nm_free(temp_arg);
 	return OK;
 }
 
@@ -2311,151 +2300,381 @@ static int grab_macro_value_r(nagios_macros *mac, char *macro_buffer, char **out
 }
 
 
+/* adds text to the last span if that's a literal, or starts a new one */
+static char *add_literal_span(struct macro_template *tmpl, char *strings, const char *text, size_t len)
+{
+	struct macro_span *span = tmpl->num_spans ? &tmpl->spans[tmpl->num_spans - 1] : NULL;
+
+	if (!len)
+		return strings;
+
+	tmpl->literal_len += len;
+	if (span && span->type == MACRO_SPAN_LITERAL) {
+		/* the literal is always the last thing we wrote, so overwrite its nul */
+		memcpy(strings - 1, text, len);
+		strings[len - 1] = 0;
+		span->len += len;
+		return strings + len;
+	}
+
+	span = &tmpl->spans[tmpl->num_spans++];
+	span->type = MACRO_SPAN_LITERAL;
+	span->str = strings;
+	span->len = len;
+	memcpy(strings, text, len);
+	strings[len] = 0;
+	return strings + len + 1;
+}
+
 /*
- * replace macros in notification commands with their values,
- * the thread-safe version
+ * resolve as much of a macro as we can without knowing what it will be
+ * expanded for. This has to follow the order of grab_macro_value_r()
  */
-int process_macros_r(nagios_macros *mac, char *input_buffer, char **output_buffer, int options)
+static void resolve_macro_span(struct macro_span *span)
 {
-	char *temp_buffer = NULL;
-	char *save_buffer = NULL;
-	char *buf_ptr = NULL;
-	char *delim_ptr = NULL;
-	int in_macro = FALSE;
-	char *selected_macro = NULL;
-	char *original_macro = NULL;
-	int result = OK;
-	int free_macro = FALSE;
-	int macro_options = 0;
+	const struct macro_key_code *mkey;
+	int x;
 
-	if (output_buffer == NULL || input_buffer == NULL)
-		return ERROR;
+	span->type = MACRO_SPAN_NAMED;
 
-	*output_buffer = nm_strdup("");
-	in_macro = FALSE;
+	if (!strncmp(span->str, "ARG", 3)) {
+		x = atoi(span->str + 3);
+		if (x > 0 && x <= MAX_COMMAND_ARGUMENTS) {
+			span->type = MACRO_SPAN_ARGV;
+			span->code = x - 1;
+		}
+		return;
+	}
 
-	log_debug_info(DEBUGL_MACROS, 1, "**** BEGIN MACRO PROCESSING ***********\n");
-	log_debug_info(DEBUGL_MACROS, 1, "Processing: '%s'\n", input_buffer);
+	if (!strncmp(span->str, "USER", 4)) {
+		x = atoi(span->str + 4);
+		if (x > 0 && x <= MAX_USER_MACROS) {
+			span->type = MACRO_SPAN_USER;
+			span->code = x - 1;
+		}
+		return;
+	}
 
-	/* use a duplicate of original buffer, so we don't modify the original */
-	save_buffer = buf_ptr = nm_strdup(input_buffer);
-	while (buf_ptr) {
+	/* vault macros and on-demand macros are looked up every time */
+	if (!strncmp(span->str, "VAULT", 5) || strchr(span->str, ':'))
+		return;
 
-		/* save pointer to this working part of buffer */
-		temp_buffer = buf_ptr;
+	if ((mkey = find_macro_key(span->str))) {
+		span->type = MACRO_SPAN_X;
+		span->code = mkey->code;
+		span->options = mkey->options;
+	}
+}
 
-		/* find the next delimiter - terminate preceding string and advance buffer pointer for next run */
-		if ((delim_ptr = strchr(buf_ptr, '$'))) {
-			delim_ptr[0] = '\x0';
-			buf_ptr = (char *)delim_ptr + 1;
-		}
-		/* no delimiter found - we already have the last of the buffer */
-		else
-			buf_ptr = NULL;
+/*
+ * split a string into literal text and macros. The rules are those
+ * process_macros_r() has always used: every other $-delimited part
+ * is a macro, "$$" is a literal $ and a failed or unterminated macro
+ * is left as it was
+ */
+struct macro_template *compile_macro_template(const char *input)
+{
+	struct macro_template *tmpl;
+	struct macro_span *span;
+	const char *part, *next, *delim;
+	char *strings;
+	unsigned int max_spans = 1;
+	size_t len;
+	int in_macro = FALSE;
 
-		log_debug_info(DEBUGL_MACROS, 2, "  Processing part: '%s'\n", temp_buffer);
+	for (part = input; (part = strchr(part, '$')); part++)
+		max_spans++;
 
-		/* we're in plain text... */
-		if (in_macro == FALSE) {
+	len = strlen(input);
+	tmpl = nm_calloc(1, sizeof(*tmpl) + max_spans * sizeof(struct macro_span));
+	tmpl->strings = strings = nm_malloc(len + max_spans + 1);
 
-			/* add the plain text to the end of the already processed buffer */
-			*output_buffer = nm_realloc(*output_buffer, strlen(*output_buffer) + strlen(temp_buffer) + 1);
-			strcat(*output_buffer, temp_buffer);
+	for (part = input; part; part = next) {
+		if ((delim = strchr(part, '$'))) {
+			len = delim - part;
+			next = delim + 1;
+		} else {
+			len = strlen(part);
+			next = NULL;
+		}
 
-			log_debug_info(DEBUGL_MACROS, 2, "  Not currently in macro.  Running output (%lu): '%s'\n", (unsigned long)strlen(*output_buffer), *output_buffer);
+		/* we're in plain text... */
+		if (in_macro == FALSE) {
+			strings = add_literal_span(tmpl, strings, part, len);
 			in_macro = TRUE;
 			continue;
 		}
 
+		in_macro = FALSE;
+
 		/* an escaped $ is done by specifying two $$ next to each other */
-		if (!strcmp(temp_buffer, "")) {
-			log_debug_info(DEBUGL_MACROS, 2, "  Escaped $.  Running output (%lu): '%s'\n", (unsigned long)strlen(*output_buffer), *output_buffer);
-			*output_buffer = nm_realloc(*output_buffer, strlen(*output_buffer) + 2);
-			strcat(*output_buffer, "$");
-			in_macro = FALSE;
+		if (!len) {
+			strings = add_literal_span(tmpl, strings, "$", 1);
 			continue;
 		}
 
-		/* looks like we're in a macro, so process it... */
-		/* grab the macro value */
-		free_macro = FALSE;
+		span = &tmpl->spans[tmpl->num_spans++];
+		span->str = strings;
+		span->len = len;
+		span->terminated = next != NULL;
+		memcpy(strings, part, len);
+		strings[len] = 0;
+		strings += len + 1;
+		resolve_macro_span(span);
+	}
+
+	return tmpl;
+}
+
+void free_macro_template(struct macro_template *tmpl)
+{
+	if (!tmpl)
+		return;
+	nm_free(tmpl->strings);
+	nm_free(tmpl);
+}
+
+/* expand a template into a newly allocated string */
+char *expand_macro_template_r(nagios_macros *mac, const struct macro_template *tmpl, int options)
+{
+	GString *buf;
+	const struct macro_span *span;
+	char *selected_macro, *original_macro, *cleaned_macro;
+	int free_macro, macro_options, result;
+	unsigned int i;
+
+	buf = g_string_sized_new(tmpl->literal_len + 64);
+
+	for (i = 0; i < tmpl->num_spans; i++) {
+		span = &tmpl->spans[i];
 		selected_macro = NULL;
-		result = grab_macro_value_r(mac, temp_buffer, &selected_macro, &macro_options, &free_macro);
-		log_debug_info(DEBUGL_MACROS, 2, "  Processed '%s', Free: %d\n", temp_buffer, free_macro);
+		free_macro = FALSE;
+		macro_options = 0;
+		result = OK;
+
+		switch (span->type) {
+		case MACRO_SPAN_LITERAL:
+			g_string_append_len(buf, span->str, span->len);
+			continue;
+
+		case MACRO_SPAN_ARGV:
+			selected_macro = mac->argv[span->code];
+			break;
+
+		case MACRO_SPAN_USER:
+			selected_macro = macro_user[span->code];
+			break;
+
+		case MACRO_SPAN_X:
+			/* same shortcut as in grab_macro_value_r() */
+			if (span->code == MACRO_HOSTADDRESS && mac->host_ptr) {
+				selected_macro = mac->host_ptr->address;
+				break;
+			}
+			result = grab_macrox_value_r(mac, span->code, NULL, NULL, &selected_macro, &free_macro);
+			macro_options = span->options;
+			break;
+
+		case MACRO_SPAN_NAMED:
+			result = grab_macro_value_r(mac, (char *)span->str, &selected_macro, &macro_options, &free_macro);
+			break;
+		}
 
-		/**
-		 * we couldn't parse the macro cause the macro
-		 * doesn't exist, so continue on
-		 */
+		log_debug_info(DEBUGL_MACROS, 2, "  Processed '%.*s', Free: %d\n", (int)span->len, span->str, free_macro);
+
+		/* the macro doesn't exist, so leave it as it was */
 		if (result != OK) {
 			if (free_macro == TRUE)
 				nm_free(selected_macro);
 
-			/* add the plain text to the end of the already processed buffer */
-			*output_buffer = nm_realloc(*output_buffer, strlen(*output_buffer) + strlen(temp_buffer) + 3);
-			strcat(*output_buffer, "$");
-			strcat(*output_buffer, temp_buffer);
-
-			/* if we still do not reach the end of string */
-			if (buf_ptr)
-				strcat(*output_buffer, "$");
-
-			in_macro = FALSE;
+			g_string_append_c(buf, '$');
+			g_string_append_len(buf, span->str, span->len);
+			if (span->terminated)
+				g_string_append_c(buf, '$');
 			continue;
 		}
 
-		/* insert macro */
-		if (selected_macro != NULL) {
-			log_debug_info(DEBUGL_MACROS, 2, "  Processed '%s', Free: %d,  Cleaning options: %d\n", temp_buffer, free_macro, options);
+		if (selected_macro == NULL)
+			continue;
 
-			/* URL encode the macro if requested - this allocates new memory */
-			if (options & URL_ENCODE_MACRO_CHARS) {
-				original_macro = selected_macro;
-				selected_macro = get_url_encoded_string(selected_macro);
-				if (free_macro == TRUE) {
-					nm_free(original_macro);
-				}
-				free_macro = TRUE;
+		/* URL encode the macro if requested - this allocates new memory */
+		if (options & URL_ENCODE_MACRO_CHARS) {
+			original_macro = selected_macro;
+			selected_macro = get_url_encoded_string(selected_macro);
+			if (free_macro == TRUE) {
+				nm_free(original_macro);
 			}
+			free_macro = TRUE;
+		}
 
-			/* some macros should sometimes be cleaned */
-			if (macro_options & options & (STRIP_ILLEGAL_MACRO_CHARS | ESCAPE_MACRO_CHARS)) {
-				char *cleaned_macro = NULL;
+		/* some macros should sometimes be cleaned */
+		if (macro_options & options & (STRIP_ILLEGAL_MACRO_CHARS | ESCAPE_MACRO_CHARS)) {
+			if ((cleaned_macro = clean_macro_chars(selected_macro, options)) != NULL) {
+				g_string_append(buf, cleaned_macro);
+				if (*cleaned_macro)
+					free(cleaned_macro);
+			}
+		}
+		/* others are not cleaned */
+		else {
+			g_string_append(buf, selected_macro);
+		}
 
-				/* add the (cleaned) processed macro to the end of the already processed buffer */
-				if (selected_macro != NULL && (cleaned_macro = clean_macro_chars(selected_macro, options)) != NULL) {
-					*output_buffer = nm_realloc(*output_buffer, strlen(*output_buffer) + strlen(cleaned_macro) + 1);
-					strcat(*output_buffer, cleaned_macro);
-					if (*cleaned_macro)
-						free(cleaned_macro);
+		/* free memory if necessary (if we URL encoded the macro or we were told to do so by grab_macro_value()) */
+		if (free_macro == TRUE)
+			nm_free(selected_macro);
+	}
 
-					log_debug_info(DEBUGL_MACROS, 2, "  Cleaned macro.  Running output (%lu): '%s'\n", (unsigned long)strlen(*output_buffer), *output_buffer);
-				}
-			}
+	return g_string_free(buf, FALSE);
+}
 
-			/* others are not cleaned */
-			else {
-				/* add the processed macro to the end of the already processed buffer */
-				if (selected_macro != NULL) {
-					*output_buffer = nm_realloc(*output_buffer, strlen(*output_buffer) + strlen(selected_macro) + 1);
-					strcat(*output_buffer, selected_macro);
 
-					log_debug_info(DEBUGL_MACROS, 2, "  Uncleaned macro.  Running output (%lu): '%s'\n", (unsigned long)strlen(*output_buffer), *output_buffer);
-				}
-			}
+/*
+ * split "command!arg1!arg2" into its (unprocessed) arguments and
+ * compile each of them
+ */
+static struct command_args *compile_command_args(const char *cmd)
+{
+	struct command_args *args;
+	char *temp_arg = NULL;
+	size_t cmd_len = 0;
+	register int x = 0;
+	register int y = 0;
+	register int arg_index = 0;
 
-			/* free memory if necessary (if we URL encoded the macro or we were told to do so by grab_macro_value()) */
-			if (free_macro == TRUE)
-				nm_free(selected_macro);
+	args = nm_calloc(1, sizeof(*args));
+	cmd_len = strlen(cmd);
+	temp_arg = nm_malloc(cmd_len + 1);
 
-			log_debug_info(DEBUGL_MACROS, 2, "  Just finished macro.  Running output (%lu): '%s'\n", (unsigned long)strlen(*output_buffer), *output_buffer);
+	/* skip the command name (we're about to get the arguments)... */
+	for (arg_index = 0;; arg_index++) {
+		if (cmd[arg_index] == '!' || cmd[arg_index] == '\x0')
+			break;
+	}
+
+	/* get each command argument */
+	for (x = 0; x < MAX_COMMAND_ARGUMENTS; x++) {
+
+		/* we reached the end of the arguments... */
+		if (cmd[arg_index] == '\x0')
+			break;
+
+		/* get the next argument */
+		/* can't use strtok(), as that's used in process_macros... */
+		for (arg_index++, y = 0; y < (int)cmd_len - 1; arg_index++) {
+
+			/* handle escaped argument delimiters */
+			if (cmd[arg_index] == '\\' && cmd[arg_index + 1] == '!') {
+				arg_index++;
+			} else if (cmd[arg_index] == '!' || cmd[arg_index] == '\x0') {
+				/* end of argument */
+				break;
+			}
+
+			/* copy the character */
+			temp_arg[y] = cmd[arg_index];
+			y++;
 		}
+		temp_arg[y] = '\x0';
 
-		in_macro = FALSE;
+		args->argv[x] = compile_macro_template(temp_arg);
+		args->argc = x + 1;
 	}
 
-	/* free copy of input buffer */
-	nm_free(save_buffer);
+	nm_free(temp_arg);
+	return args;
+}
+
+static void free_command_args(gpointer data)
+{
+	struct command_args *args = data;
+	int x;
+
+	for (x = 0; x < args->argc; x++)
+		free_macro_template(args->argv[x]);
+	nm_free(args);
+}
+
+static void expand_command_args(nagios_macros *mac, const char *cmd, int macro_options)
+{
+	struct command_args *args;
+	int x;
+
+	if (!command_arg_templates)
+		command_arg_templates = g_hash_table_new_full(g_str_hash, g_str_equal, free, free_command_args);
+
+	if (!(args = g_hash_table_lookup(command_arg_templates, cmd))) {
+		args = compile_command_args(cmd);
+		g_hash_table_insert(command_arg_templates, nm_strdup(cmd), args);
+	}
+
+	for (x = 0; x < args->argc; x++)
+		mac->argv[x] = expand_macro_template_r(mac, args->argv[x], macro_options);
+}
+
+int get_processed_command_line_r(nagios_macros *mac, command *cmd_ptr, char *cmd, char **processed_command, int macro_options)
+{
+	struct macro_template *tmpl;
+	const char *command_line;
+
+	/* clear the argv macros */
+	clear_argv_macros_r(mac);
+
+	/* make sure we've got all the requirements */
+	if (cmd_ptr == NULL || processed_command == NULL)
+		return ERROR;
+
+	command_line = cmd_ptr->command_line ? cmd_ptr->command_line : "";
+	log_debug_info(DEBUGL_COMMANDS | DEBUGL_CHECKS | DEBUGL_MACROS, 2, "Raw Command Input: %s\n", command_line);
+
+	if (cmd != NULL)
+		expand_command_args(mac, cmd, macro_options);
+
+	if (!command_line_templates)
+		command_line_templates = g_hash_table_new_full(g_str_hash, g_str_equal, free, (GDestroyNotify)free_macro_template);
+
+	if (!(tmpl = g_hash_table_lookup(command_line_templates, command_line))) {
+		tmpl = compile_macro_template(command_line);
+		g_hash_table_insert(command_line_templates, nm_strdup(command_line), tmpl);
+	}
+
+	*processed_command = expand_macro_template_r(mac, tmpl, macro_options);
+
+	log_debug_info(DEBUGL_COMMANDS | DEBUGL_CHECKS | DEBUGL_MACROS, 2, "Processed Command Output: %s\n", *processed_command);
+
+	return OK;
+}
+
+void free_command_templates(void)
+{
+	if (command_line_templates) {
+		g_hash_table_destroy(command_line_templates);
+		command_line_templates = NULL;
+	}
+	if (command_arg_templates) {
+		g_hash_table_destroy(command_arg_templates);
+		command_arg_templates = NULL;
+	}
+}
+
+
+/*
+ * replace macros in notification commands with their values,
+ * the thread-safe version
+ */
+int process_macros_r(nagios_macros *mac, char *input_buffer, char **output_buffer, int options)
+{
+	struct macro_template *tmpl;
+
+	if (output_buffer == NULL || input_buffer == NULL)
+		return ERROR;
+
+	log_debug_info(DEBUGL_MACROS, 1, "**** BEGIN MACRO PROCESSING ***********\n");
+	log_debug_info(DEBUGL_MACROS, 1, "Processing: '%s'\n", input_buffer);
+
+	tmpl = compile_macro_template(input_buffer);
+	*output_buffer = expand_macro_template_r(mac, tmpl, options);
+	free_macro_template(tmpl);
 
 	log_debug_info(DEBUGL_MACROS, 1, "  Done.  Final output: '%s'\n", *output_buffer);
 	log_debug_info(DEBUGL_MACROS, 1, "**** END MACRO PROCESSING *************\n");
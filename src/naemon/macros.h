@@ -234,6 +234,24 @@ int process_macros_r(nagios_macros *mac, char *, char **, int);
 /* given a raw command line, determine the actual command to run */
 int get_raw_command_line_r(nagios_macros *mac, command *, char *, char **, int);
 
+/*
+ * Same as get_raw_command_line_r() followed by process_macros_r() on
+ * the result, but the command line and its arguments are parsed only
+ * once and kept as precompiled templates. Not thread-safe.
+ */
+int get_processed_command_line_r(nagios_macros *mac, command *, char *, char **, int);
+
+/*
+ * A macro template is a string split into literal text and macro
+ * references, with the macro names resolved as far as possible.
+ * Expanding it gives the same result as process_macros_r() on the
+ * string it was compiled from.
+ */
+struct macro_template;
+struct macro_template *compile_macro_template(const char *input);
+char *expand_macro_template_r(nagios_macros *mac, const struct macro_template *tmpl, int options);
+void free_macro_template(struct macro_template *tmpl);
+
 /*
  * These functions updates *mac with the values from
  * their respective object type.
@@ -248,6 +266,7 @@ int grab_contact_macros_r(nagios_macros *mac, contact *);
 int init_macros(void);
 int init_macrox_names(void);
 int free_macrox_names(void);
+void free_command_templates(void);
 
 /* clear out memory from *mac */
 int clear_argv_macros_r(nagios_macros *mac);
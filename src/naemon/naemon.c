@@ -288,6 +288,7 @@ int main(int argc, char **argv)
 		printf("  -u, --use-precached-objects  Use precached object config file\n");
 		printf("  -d, --daemon                 Starts Naemon in daemon mode, instead of as a foreground process\n");
 		printf("  -W, --worker /path/to/socket Act as a worker for an already running daemon\n");
+		printf("     --worker tcp:host:port    Act as a remote worker, see worker_listen_address\n");
 		printf("  --allow-root                 Let naemon run as root. THIS IS NOT RECOMMENDED AT ALL.\n");
 		printf("\n");
 		printf("  -h, --help                   Print this help and exit\n");
@@ -748,6 +749,7 @@ int main(int argc, char **argv)
 			broker_program_state(NEBTYPE_PROCESS_RESTART, NEBFLAG_USER_INITIATED, NEBATTR_RESTART_NORMAL);
 
 		disconnect_command_file_worker();
+		checks_deinit();
 
 		/* save service and host state information */
 		save_state_information(FALSE);
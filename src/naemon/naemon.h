@@ -48,6 +48,7 @@
 #include "objects_timeperiod.h"
 #include "perfdata.h"
 #include "query-handler.h"
+#include "query-state.h"
 #include "sehandlers.h"
 #include "shared.h"
 #include "sretention.h"
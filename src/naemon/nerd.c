@@ -10,7 +10,9 @@
  */
 
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
+#include <sys/time.h>
 #include "config.h"
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -27,6 +29,7 @@
 #include "globals.h"
 #include "nm_alloc.h"
 #include "events.h"
+#include "perfdata.h"
 
 struct nerd_channel {
 	const char *name; /* name of this channel */
@@ -42,7 +45,72 @@ struct nerd_channel {
 static nebmodule nerd_mod; /* fake module to get our callbacks accepted */
 static struct nerd_channel **channels;
 static unsigned int num_channels, alloc_channels;
-static unsigned int chan_host_checks_id, chan_service_checks_id;
+static unsigned int chan_host_checks_id, chan_service_checks_id, chan_metrics_id;
+static unsigned int chan_state_changes_id;
+
+/*
+ * The statechanges channel sends one line per host or service whose
+ * state changed, carrying only the fields that did:
+ *
+ *   <seq>\thost\t<id>\t<host_name>\t<field>=<value>...
+ *   <seq>\tservice\t<id>\t<host_name>\t<service_description>\t<field>=<value>...
+ *
+ * Sequence numbers increase by one per change, and the last
+ * NERD_STATE_RING_SIZE changes are kept so a consumer that reconnects
+ * (or notices a gap) can subscribe with "statechanges:<stream>:<seq>"
+ * and get everything after <seq> replayed. The stream id changes on
+ * every (re)start, since object ids may too. If the changes can't be
+ * replayed the consumer is told to resync from a full state query.
+ */
+#define NERD_STATE_RING_SIZE 8192
+/* don't queue more than this for a subscriber that isn't reading */
+#define NERD_STATE_HIGH_WATER (1024 * 1024)
+
+struct state_snapshot {
+	int current_state;
+	int state_type;
+	int current_attempt;
+	int has_been_checked;
+	int problem_has_been_acknowledged;
+	int scheduled_downtime_depth;
+	int is_flapping;
+	guint output_hash;
+};
+
+static const struct {
+	const char *name;
+	size_t offset;
+} snapshot_fields[] = {
+	{ "current_state", offsetof(struct state_snapshot, current_state) },
+	{ "state_type", offsetof(struct state_snapshot, state_type) },
+	{ "current_attempt", offsetof(struct state_snapshot, current_attempt) },
+	{ "has_been_checked", offsetof(struct state_snapshot, has_been_checked) },
+	{ "problem_has_been_acknowledged", offsetof(struct state_snapshot, problem_has_been_acknowledged) },
+	{ "scheduled_downtime_depth", offsetof(struct state_snapshot, scheduled_downtime_depth) },
+	{ "is_flapping", offsetof(struct state_snapshot, is_flapping) },
+};
+
+#define snapshot_object(snap, obj) \
+	do { \
+		(snap)->current_state = (obj)->current_state; \
+		(snap)->state_type = (obj)->state_type; \
+		(snap)->current_attempt = (obj)->current_attempt; \
+		(snap)->has_been_checked = (obj)->has_been_checked; \
+		(snap)->problem_has_been_acknowledged = (obj)->problem_has_been_acknowledged; \
+		(snap)->scheduled_downtime_depth = (obj)->scheduled_downtime_depth; \
+		(snap)->is_flapping = (obj)->is_flapping; \
+		(snap)->output_hash = (obj)->plugin_output ? g_str_hash((obj)->plugin_output) : 0; \
+	} while (0)
+
+struct state_change {
+	unsigned long long seq;
+	char *line;
+	size_t len;
+};
+
+static unsigned long long state_stream_id, state_seq;
+static struct state_change *state_ring;
+static struct state_snapshot *host_snapshots, *service_snapshots;
 
 
 static struct nerd_channel *find_channel(const char *name)
@@ -188,15 +256,21 @@ static int unsubscribe(int sd, struct nerd_channel *chan)
 	return 0;
 }
 
-/* removes a subscriber entirely and closes its socket */
-int nerd_cancel_subscriber(int sd)
+/* removes a subscriber from all channels */
+int nerd_unsubscribe_all(int sd)
 {
 	unsigned int i;
 
 	for (i = 0; i < num_channels; i++) {
 		cancel_channel_subscription(channels[i], sd);
 	}
+	return 0;
+}
 
+/* removes a subscriber entirely and closes its socket */
+int nerd_cancel_subscriber(int sd)
+{
+	nerd_unsubscribe_all(sd);
 	iobroker_close(nagios_iobs, sd);
 	return 0;
 }
@@ -265,6 +339,217 @@ static int chan_service_checks(int cb, void *data)
 	return 0;
 }
 
+/* parsed performance data, one line protocol line per value */
+static int chan_metrics(int cb, void *data)
+{
+	struct perfdata pd;
+	struct timeval when;
+	const char *host_name, *service_description = NULL, *perf_data;
+	GString *buf;
+
+	if (cb == NEBCALLBACK_HOST_CHECK_DATA) {
+		nebstruct_host_check_data *ds = (nebstruct_host_check_data *)data;
+		host *h = (host *)ds->object_ptr;
+
+		if (ds->type != NEBTYPE_HOSTCHECK_PROCESSED)
+			return 0;
+		host_name = h->name;
+		perf_data = h->perf_data;
+		when = ds->end_time;
+	} else {
+		nebstruct_service_check_data *ds = (nebstruct_service_check_data *)data;
+		service *s = (service *)ds->object_ptr;
+
+		if (ds->type != NEBTYPE_SERVICECHECK_PROCESSED)
+			return 0;
+		host_name = s->host_name;
+		service_description = s->description;
+		perf_data = s->perf_data;
+		when = ds->end_time;
+	}
+
+	if (!perf_data || !*perf_data)
+		return 0;
+
+	if (!perfdata_parse(perf_data, &pd)) {
+		perfdata_free(&pd);
+		return 0;
+	}
+	buf = g_string_sized_new(256);
+	perfdata_line_protocol(buf, host_name, service_description, &pd, &when);
+	if (buf->len)
+		nerd_broadcast(chan_metrics_id, buf->str, buf->len);
+	g_string_free(buf, TRUE);
+	perfdata_free(&pd);
+	return 0;
+}
+
+static void append_escaped(GString *buf, const char *str)
+{
+	for (; *str; str++) {
+		switch (*str) {
+		case '\\': g_string_append(buf, "\\\\"); break;
+		case '\t': g_string_append(buf, "\\t"); break;
+		case '\n': g_string_append(buf, "\\n"); break;
+		default: g_string_append_c(buf, *str); break;
+		}
+	}
+}
+
+/* appends the fields that differ and updates the snapshot to match */
+static void diff_snapshot(GString *buf, struct state_snapshot *old, const struct state_snapshot *cur, const char *output)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(snapshot_fields); i++) {
+		int old_value = *(int *)((char *)old + snapshot_fields[i].offset);
+		int cur_value = *(const int *)((const char *)cur + snapshot_fields[i].offset);
+
+		if (old_value != cur_value)
+			g_string_append_printf(buf, "\t%s=%d", snapshot_fields[i].name, cur_value);
+	}
+	if (old->output_hash != cur->output_hash) {
+		g_string_append(buf, "\tplugin_output=");
+		append_escaped(buf, output ? output : "");
+	}
+	*old = *cur;
+}
+
+static void queue_state_change(int sd, const char *line, size_t len)
+{
+	/*
+	 * a subscriber this far behind misses the change, sees the gap
+	 * in sequence numbers and can resubscribe to have it replayed
+	 */
+	if (iobroker_get_pending_output(nagios_iobs, sd) > NERD_STATE_HIGH_WATER)
+		return;
+	iobroker_write_packet(nagios_iobs, sd, (char *)line, len);
+}
+
+static void record_state_change(GString *buf)
+{
+	struct state_change *chg = &state_ring[state_seq % NERD_STATE_RING_SIZE];
+	objectlist *list;
+
+	g_string_append_c(buf, '\n');
+	nm_free(chg->line);
+	chg->seq = state_seq;
+	chg->len = buf->len;
+	chg->line = g_string_free(buf, FALSE);
+
+	for (list = channels[chan_state_changes_id]->subscriptions; list; list = list->next) {
+		struct nerd_subscription *subscr = (struct nerd_subscription *)list->object_ptr;
+		queue_state_change(subscr->sd, chg->line, chg->len);
+	}
+}
+
+static void take_state_snapshots(void)
+{
+	unsigned int i;
+
+	nm_free(host_snapshots);
+	nm_free(service_snapshots);
+	host_snapshots = nm_calloc(num_objects.hosts + 1, sizeof(*host_snapshots));
+	service_snapshots = nm_calloc(num_objects.services + 1, sizeof(*service_snapshots));
+	for (i = 0; i < num_objects.hosts; i++)
+		snapshot_object(&host_snapshots[i], host_ary[i]);
+	for (i = 0; i < num_objects.services; i++)
+		snapshot_object(&service_snapshots[i], service_ary[i]);
+}
+
+static int chan_state_changes(int cb, void *data)
+{
+	struct state_snapshot cur;
+	GString *fields;
+
+	if (cb == NEBCALLBACK_PROCESS_DATA) {
+		nebstruct_process_data *ds = (nebstruct_process_data *)data;
+
+		/* retention data is loaded by now, so that's what we diff against */
+		if (ds->type == NEBTYPE_PROCESS_EVENTLOOPSTART)
+			take_state_snapshots();
+		return 0;
+	}
+
+	if (!host_snapshots)
+		return 0;
+
+	fields = g_string_sized_new(128);
+	if (cb == NEBCALLBACK_HOST_STATUS_DATA) {
+		host *h = (host *)((nebstruct_host_status_data *)data)->object_ptr;
+
+		if (h->id >= num_objects.hosts) {
+			g_string_free(fields, TRUE);
+			return 0;
+		}
+		snapshot_object(&cur, h);
+		diff_snapshot(fields, &host_snapshots[h->id], &cur, h->plugin_output);
+		if (fields->len) {
+			GString *buf = g_string_sized_new(fields->len + 64);
+			g_string_printf(buf, "%llu\thost\t%u\t%s%s", ++state_seq, h->id, h->name, fields->str);
+			record_state_change(buf);
+		}
+	} else {
+		service *s = (service *)((nebstruct_service_status_data *)data)->object_ptr;
+
+		if (s->id >= num_objects.services) {
+			g_string_free(fields, TRUE);
+			return 0;
+		}
+		snapshot_object(&cur, s);
+		diff_snapshot(fields, &service_snapshots[s->id], &cur, s->plugin_output);
+		if (fields->len) {
+			GString *buf = g_string_sized_new(fields->len + 64);
+			g_string_printf(buf, "%llu\tservice\t%u\t%s\t%s%s", ++state_seq, s->id, s->host_name, s->description, fields->str);
+			record_state_change(buf);
+		}
+	}
+	g_string_free(fields, TRUE);
+	return 0;
+}
+
+/* sends a new subscriber whatever it missed, or tells it to resync */
+static void replay_state_changes(int sd, const char *resume)
+{
+	unsigned long long stream = 0, seq = 0, oldest;
+	char *end, buf[64];
+	int len;
+
+	if (resume) {
+		stream = strtoull(resume, &end, 10);
+		if (*end == ':')
+			seq = strtoull(end + 1, &end, 10);
+		if (*end)
+			stream = 0;
+	}
+
+	oldest = state_seq > NERD_STATE_RING_SIZE ? state_seq - NERD_STATE_RING_SIZE + 1 : 1;
+	if (!stream || stream != state_stream_id || seq > state_seq || seq + 1 < oldest) {
+		len = snprintf(buf, sizeof(buf), "%llu\tresync\t%llu\n", state_seq, state_stream_id);
+		queue_state_change(sd, buf, len);
+		return;
+	}
+
+	len = snprintf(buf, sizeof(buf), "%llu\tresume\t%llu\n", seq, state_stream_id);
+	queue_state_change(sd, buf, len);
+	for (seq++; seq <= state_seq; seq++) {
+		struct state_change *chg = &state_ring[seq % NERD_STATE_RING_SIZE];
+		queue_state_change(sd, chg->line, chg->len);
+	}
+}
+
+static void state_changes_deinit(void)
+{
+	unsigned int i;
+
+	for (i = 0; state_ring && i < NERD_STATE_RING_SIZE; i++)
+		nm_free(state_ring[i].line);
+	nm_free(state_ring);
+	nm_free(host_snapshots);
+	nm_free(service_snapshots);
+	state_seq = 0;
+}
+
 static int nerd_deinit(void)
 {
 	unsigned int i;
@@ -285,6 +570,7 @@ static int nerd_deinit(void)
 	}
 	nm_free(channels);
 	num_channels = 0;
+	state_changes_deinit();
 	alloc_channels = 0;
 
 	return 0;
@@ -327,11 +613,14 @@ static int nerd_qh_handler(int sd, char *request, unsigned int len)
 	int action;
 
 	if (!*request || !strcmp(request, "help")) {
-		nsock_printf_nul(sd, "Manage subscriptions to NERD channels.\n"
-		                 "Valid commands:\n"
-		                 "  list                      list available channels\n"
-		                 "  subscribe <channel>       subscribe to a channel\n"
-		                 "  unsubscribe <channel>     unsubscribe to a channel\n");
+		qh_printf_nul(sd, "Manage subscriptions to NERD channels.\n"
+		              "Valid commands:\n"
+		              "  list                      list available channels\n"
+		              "  subscribe <channel>       subscribe to a channel\n"
+		              "  subscribe statechanges:<stream>:<seq>\n"
+		              "                            subscribe to state changes, replaying\n"
+		              "                            those after <seq> if still possible\n"
+		              "  unsubscribe <channel>     unsubscribe to a channel\n");
 		return 0;
 	}
 
@@ -339,9 +628,9 @@ static int nerd_qh_handler(int sd, char *request, unsigned int len)
 		unsigned int i;
 		for (i = 0; i < num_channels; i++) {
 			chan = channels[i];
-			nsock_printf(sd, "%-15s %s\n", chan->name, chan->description);
+			qh_printf(sd, "%-15s %s\n", chan->name, chan->description);
 		}
-		nsock_printf(sd, "%c", 0);
+		qh_write(sd, "", 1);
 		return 0;
 	}
 
@@ -368,9 +657,11 @@ static int nerd_qh_handler(int sd, char *request, unsigned int len)
 		return 400;
 	}
 
-	if (action == NERD_SUBSCRIBE)
+	if (action == NERD_SUBSCRIBE) {
 		subscribe(sd, chan, fmt);
-	else
+		if (chan == channels[chan_state_changes_id])
+			replay_state_changes(sd, fmt);
+	} else
 		unsubscribe(sd, chan);
 
 	return 0;
@@ -379,6 +670,8 @@ static int nerd_qh_handler(int sd, char *request, unsigned int len)
 /* nebmod_init(), but loaded even if no modules are */
 int nerd_init(void)
 {
+	struct timeval tv;
+
 	nerd_mod.deinit_func = nerd_deinit;
 	nerd_mod.filename = (char *)"NERD"; /* something to log */
 
@@ -395,6 +688,23 @@ int nerd_init(void)
 	chan_service_checks_id = nerd_mkchan("servicechecks",
 	                                     "Service check results",
 	                                     chan_service_checks, nebcallback_flag(NEBCALLBACK_SERVICE_CHECK_DATA));
+	chan_metrics_id = nerd_mkchan("metrics",
+	                              "Parsed performance data in InfluxDB line protocol",
+	                              chan_metrics, nebcallback_flag(NEBCALLBACK_HOST_CHECK_DATA) | nebcallback_flag(NEBCALLBACK_SERVICE_CHECK_DATA));
+
+	/*
+	 * changes have to be tracked whether anyone is subscribed or not,
+	 * so these callbacks stay registered for as long as we're running
+	 */
+	chan_state_changes_id = nerd_mkchan("statechanges",
+	                                    "Changed host and service state, with sequence numbers",
+	                                    chan_state_changes, 0);
+	gettimeofday(&tv, NULL);
+	state_stream_id = (unsigned long long)tv.tv_sec * 1000000 + tv.tv_usec;
+	state_ring = nm_calloc(NERD_STATE_RING_SIZE, sizeof(*state_ring));
+	neb_register_callback(NEBCALLBACK_PROCESS_DATA, &nerd_mod, 0, chan_state_changes);
+	neb_register_callback(NEBCALLBACK_HOST_STATUS_DATA, &nerd_mod, 0, chan_state_changes);
+	neb_register_callback(NEBCALLBACK_SERVICE_STATUS_DATA, &nerd_mod, 0, chan_state_changes);
 
 	nm_log(NSLOG_INFO_MESSAGE, "nerd: Fully initialized and ready to rock!\n");
 	return 0;
@@ -20,6 +20,7 @@ struct nerd_subscription {
 int nerd_init(void);
 int nerd_mkchan(const char *name, const char *description, int (*handler)(int, void *), unsigned int callbacks);
 int nerd_cancel_subscriber(int sd);
+int nerd_unsubscribe_all(int sd);
 int nerd_get_channel_id(const char *chan_name);
 objectlist *nerd_get_subscriptions(int chan_id);
 int nerd_broadcast(unsigned int chan_id, void *buf, unsigned int len);
@@ -63,3 +63,102 @@ void nm_asprintf(char **strp, const char *fmt, ...)
 	}
 	va_end(ap);
 }
+
+/* keeps data[] suitably aligned for anything we put there */
+#define NM_ARENA_ALIGN 16
+#define NM_ARENA_ALIGN_UP(x) (((x) + NM_ARENA_ALIGN - 1) & ~((size_t)NM_ARENA_ALIGN - 1))
+#define NM_OBJECT_ARENA_BLOCK (256 * 1024)
+
+struct nm_arena_block {
+	struct nm_arena_block *next;
+	size_t size;
+	size_t used;
+	char *data;
+};
+
+struct nm_arena {
+	struct nm_arena_block *blocks;
+	size_t block_size;
+	size_t allocated;
+};
+
+static nm_arena *object_arena;
+
+nm_arena *nm_arena_create(size_t block_size)
+{
+	nm_arena *arena = nm_calloc(1, sizeof(*arena));
+	arena->block_size = block_size;
+	return arena;
+}
+
+static struct nm_arena_block *nm_arena_add_block(nm_arena *arena, size_t size)
+{
+	struct nm_arena_block *block;
+	size_t header = NM_ARENA_ALIGN_UP(sizeof(*block));
+
+	block = nm_malloc(header + size);
+	block->data = (char *)block + header;
+	block->size = size;
+	block->used = 0;
+	arena->allocated += size;
+
+	/*
+	 * oversized requests get a block of their own. Put it behind the
+	 * current one so we keep filling that.
+	 */
+	if (arena->blocks && size > arena->block_size) {
+		block->next = arena->blocks->next;
+		arena->blocks->next = block;
+	} else {
+		block->next = arena->blocks;
+		arena->blocks = block;
+	}
+	return block;
+}
+
+void *nm_arena_alloc(nm_arena *arena, size_t size)
+{
+	struct nm_arena_block *block = arena->blocks;
+	void *ptr;
+
+	size = NM_ARENA_ALIGN_UP(size ? size : 1);
+	if (!block || block->size - block->used < size)
+		block = nm_arena_add_block(arena, size > arena->block_size ? size : arena->block_size);
+
+	ptr = block->data + block->used;
+	block->used += size;
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+void nm_arena_destroy(nm_arena *arena)
+{
+	struct nm_arena_block *block, *next;
+
+	if (!arena)
+		return;
+
+	for (block = arena->blocks; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+	free(arena);
+}
+
+size_t nm_arena_size(const nm_arena *arena)
+{
+	return arena ? arena->allocated : 0;
+}
+
+void *nm_object_alloc(size_t size)
+{
+	if (!object_arena)
+		object_arena = nm_arena_create(NM_OBJECT_ARENA_BLOCK);
+	return nm_arena_alloc(object_arena, size);
+}
+
+void nm_object_arena_release(void)
+{
+	nm_arena_destroy(object_arena);
+	object_arena = NULL;
+}
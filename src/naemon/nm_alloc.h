@@ -12,4 +12,24 @@ void *nm_strdup(const char *s);
 void *nm_strndup(const char *s, size_t size);
 void nm_asprintf(char **strp, const char *fmt, ...);
 #define nm_free(ptr) do { if(ptr) { free(ptr); ptr = NULL; } } while(0)
+
+/*
+ * Arenas hand out zeroed memory that is never freed piecemeal. All of
+ * it is released by a single nm_arena_destroy().
+ */
+typedef struct nm_arena nm_arena;
+nm_arena *nm_arena_create(size_t block_size);
+void *nm_arena_alloc(nm_arena *arena, size_t size);
+void nm_arena_destroy(nm_arena *arena);
+size_t nm_arena_size(const nm_arena *arena);
+
+/*
+ * Object structs and the member lists hanging off them live in an arena
+ * per configuration generation. Their destroy functions release what
+ * they point to but leave the structs themselves to
+ * nm_object_arena_release(), which free_memory() calls once all objects
+ * are gone.
+ */
+void *nm_object_alloc(size_t size);
+void nm_object_arena_release(void);
 #endif
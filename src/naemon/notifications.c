@@ -1022,7 +1022,7 @@ int notify_contact_of_service(nagios_macros *mac, contact *cntct, service *svc,
 		nj->ctc = cntct;
 		nj->hst = svc->host_ptr;
 		nj->svc = svc;
-		if (ERROR == wproc_run_callback(processed_command, notification_timeout, notification_handle_job_result, nj, mac)) {
+		if (ERROR == wproc_run_check_callback(temp_commandsmember->command_ptr, processed_command, notification_timeout, CHECK_PRIORITY_HANDLER, notification_handle_job_result, nj, mac)) {
 			nm_log(NSLOG_RUNTIME_ERROR, "wproc: Unable to send notification for service '%s on host '%s' to worker\n", svc->description, svc->host_ptr->name);
 			free(nj);
 		}
@@ -1866,7 +1866,7 @@ int notify_contact_of_host(nagios_macros *mac, contact *cntct, host *hst, int ty
 		nj->ctc = cntct;
 		nj->hst = hst;
 		nj->svc = NULL;
-		if (ERROR == wproc_run_callback(processed_command, notification_timeout, notification_handle_job_result, nj, mac)) {
+		if (ERROR == wproc_run_check_callback(temp_commandsmember->command_ptr, processed_command, notification_timeout, CHECK_PRIORITY_HANDLER, notification_handle_job_result, nj, mac)) {
 			nm_log(NSLOG_RUNTIME_ERROR, "wproc: Unable to send notification for host '%s' to worker\n", hst->name);
 			free(nj);
 		}
@@ -2322,7 +2322,7 @@ int run_global_service_notification_handler(nagios_macros *mac, service *svc, in
 	nj->ctc = NULL;
 	nj->hst = svc->host_ptr;
 	nj->svc = svc;
-	if (ERROR == wproc_run_callback(processed_command, notification_timeout, notification_handle_job_result, nj, mac)) {
+	if (ERROR == wproc_run_check_callback(NULL, processed_command, notification_timeout, CHECK_PRIORITY_HANDLER, notification_handle_job_result, nj, mac)) {
 		nm_log(NSLOG_RUNTIME_ERROR, "wproc: Unable to send notification for service '%s on host '%s' to worker\n", svc->description, svc->host_ptr->name);
 		free(nj);
 	}
@@ -2414,7 +2414,7 @@ int run_global_host_notification_handler(nagios_macros *mac, host *hst, int type
 	nj->ctc = NULL;
 	nj->hst = hst;
 	nj->svc = NULL;
-	if (ERROR == wproc_run_callback(processed_command, notification_timeout, notification_handle_job_result, nj, mac)) {
+	if (ERROR == wproc_run_check_callback(NULL, processed_command, notification_timeout, CHECK_PRIORITY_HANDLER, notification_handle_job_result, nj, mac)) {
 		nm_log(NSLOG_RUNTIME_ERROR, "wproc: Unable to send notification for host '%s' to worker\n", hst->name);
 		free(nj);
 	}
@@ -113,6 +113,9 @@ command *find_command(const char *name)
 
 void fcache_command(FILE *fp, const command *temp_command)
 {
-	fprintf(fp, "define command {\n\tcommand_name\t%s\n\tcommand_line\t%s\n\t}\n\n",
+	fprintf(fp, "define command {\n\tcommand_name\t%s\n\tcommand_line\t%s\n",
 	        temp_command->name, temp_command->command_line);
+	if (temp_command->max_output_size)
+		fprintf(fp, "\tmax_output_size\t%lu\n", temp_command->max_output_size);
+	fprintf(fp, "\t}\n\n");
 }
@@ -24,6 +24,7 @@ struct command {
 	unsigned int id;
 	char    *name;
 	char    *command_line;
+	unsigned long max_output_size; /* 0 means max_job_output_size */
 	struct command *next;
 };
 
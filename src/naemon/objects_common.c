@@ -4,9 +4,18 @@
 #include "xodtemplate.h"
 #include <string.h>
 #include <ctype.h>
+#include <glib.h>
 
 char *illegal_object_chars = NULL;
 
+struct interned_string {
+	unsigned int refs;
+	char str[];
+};
+
+/* char * => struct interned_string *, keyed on the interned copy itself */
+static GHashTable *intern_pool;
+
 customvariablesmember *add_custom_variable_to_object(customvariablesmember **object_ptr, char *varname, char *varvalue)
 {
 	customvariablesmember *new_customvariablesmember = NULL;
@@ -117,3 +126,49 @@ int contains_illegal_object_chars(const char *name)
 
 	return FALSE;
 }
+
+char *nm_intern(const char *str)
+{
+	struct interned_string *is;
+	size_t len;
+
+	if (str == NULL)
+		return NULL;
+
+	if (intern_pool == NULL)
+		intern_pool = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, free);
+
+	is = g_hash_table_lookup(intern_pool, str);
+	if (is == NULL) {
+		len = strlen(str);
+		is = nm_malloc(sizeof(*is) + len + 1);
+		is->refs = 0;
+		memcpy(is->str, str, len + 1);
+		g_hash_table_insert(intern_pool, is->str, is);
+	}
+	is->refs++;
+	return is->str;
+}
+
+void nm_intern_release(char *str)
+{
+	struct interned_string *is;
+
+	if (str == NULL)
+		return;
+
+	is = intern_pool ? g_hash_table_lookup(intern_pool, str) : NULL;
+	if (is == NULL || is->str != str) {
+		/* somebody assigned a copy of their own */
+		free(str);
+		return;
+	}
+
+	if (--is->refs == 0)
+		g_hash_table_remove(intern_pool, str);
+}
+
+unsigned int nm_intern_count(void)
+{
+	return intern_pool ? g_hash_table_size(intern_pool) : 0;
+}
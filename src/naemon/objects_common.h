@@ -8,6 +8,7 @@
 #include "lib/lnae-utils.h"
 #include "common.h"
 #include <stdio.h>
+#include <stdint.h>
 
 NAGIOS_BEGIN_DECL
 
@@ -15,6 +16,24 @@ extern char *illegal_object_chars;
 
 #define MAX_STATE_HISTORY_ENTRIES		21	/* max number of old states to keep track of for flap detection */
 
+/*
+ * The flap detection history is a ring of MAX_STATE_HISTORY_ENTRIES
+ * states, packed two bits each. Host and service states all fit.
+ */
+typedef uint64_t state_history_t;
+#define STATE_HISTORY_MASK 3
+
+static inline int state_history_get(state_history_t history, int idx)
+{
+	return (int)((history >> (idx * 2)) & STATE_HISTORY_MASK);
+}
+
+static inline void state_history_set(state_history_t *history, int idx, int state)
+{
+	*history &= ~((state_history_t)STATE_HISTORY_MASK << (idx * 2));
+	*history |= ((state_history_t)state & STATE_HISTORY_MASK) << (idx * 2);
+}
+
 /*
  * flags for notification_options, flapping_options and other similar
  * flags. They overlap (hosts and services), so we can't use enum's.
@@ -69,5 +88,18 @@ const char *check_type_name(int check_type);
 
 int contains_illegal_object_chars(const char *name);
 
+/*
+ * Interned strings for attributes lots of objects share, such as check
+ * commands, time period names and notes. Equal strings share a single
+ * reference counted copy. Each nm_intern() must be matched by one
+ * nm_intern_release(); interned strings must never be modified or passed
+ * to nm_free(). Releasing a string that wasn't interned frees it, so
+ * callers that assign their own copies to these members keep working.
+ * Neither is thread safe; only the main thread may call them.
+ */
+char *nm_intern(const char *str);
+void nm_intern_release(char *str);
+unsigned int nm_intern_count(void);
+
 NAGIOS_END_DECL
 #endif
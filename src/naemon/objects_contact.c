@@ -264,7 +264,7 @@ contactsmember *add_contact_to_object(contactsmember **object_ptr, char *contact
 	}
 
 	/* allocate memory for a new member */
-	new_contactsmember = nm_malloc(sizeof(contactsmember));
+	new_contactsmember = nm_object_alloc(sizeof(contactsmember));
 	new_contactsmember->contact_name = c->name;
 
 	/* set initial values */
@@ -144,7 +144,7 @@ contactgroupsmember *add_contactgroup_to_object(contactgroupsmember **cg_list, c
 		nm_log(NSLOG_CONFIG_ERROR, "Error: Contactgroup '%s' is not defined anywhere\n", group_name);
 		return NULL;
 	}
-	cgm = nm_malloc(sizeof(*cgm));
+	cgm = nm_object_alloc(sizeof(*cgm));
 	cgm->group_name = cg->group_name;
 	cgm->group_ptr = cg;
 	cgm->next = *cg_list;
@@ -66,7 +66,7 @@ host *create_host(const char *name)
 		return NULL;
 	}
 
-	new_host = nm_calloc(1, sizeof(*new_host));
+	new_host = nm_object_alloc(sizeof(*new_host));
 
 	new_host->name = new_host->display_name = new_host->alias = new_host->address = nm_strdup(name);
 	new_host->child_hosts = g_tree_new_full((GCompareDataFunc)my_strsorter, NULL, g_free, NULL);
@@ -129,13 +129,13 @@ int setup_host_variables(host *new_host, const char *display_name, const char *a
 	if (address)
 		new_host->address = nm_strdup(address);
 	if (check_tp) {
-		new_host->check_period = nm_strdup(check_tp->name);
+		new_host->check_period = nm_intern(check_tp->name);
 		new_host->check_period_ptr = check_tp;
 	}
-	new_host->notification_period = notify_tp ? nm_strdup(notify_tp->name) : NULL;
+	new_host->notification_period = notify_tp ? nm_intern(notify_tp->name) : NULL;
 	new_host->notification_period_ptr = notify_tp;
 	if (check_command) {
-		new_host->check_command = nm_strdup(check_command);
+		new_host->check_command = nm_intern(check_command);
 		new_host->check_command_ptr = find_bang_command(check_command);
 		if (new_host->check_command_ptr == NULL) {
 			nm_log(NSLOG_VERIFICATION_ERROR, "Error: Host check command '%s' specified for host '%s' is not defined anywhere!", new_host->check_command, new_host->name);
@@ -143,20 +143,20 @@ int setup_host_variables(host *new_host, const char *display_name, const char *a
 		}
 	}
 	if (event_handler) {
-		new_host->event_handler = nm_strdup(event_handler);
+		new_host->event_handler = nm_intern(event_handler);
 		new_host->event_handler_ptr = find_bang_command(event_handler);
 		if (new_host->event_handler_ptr == NULL) {
 			nm_log(NSLOG_VERIFICATION_ERROR, "Error: Event handler command '%s' specified for host '%s' not defined anywhere", new_host->event_handler, new_host->name);
 			return -1;
 		}
 	}
-	new_host->notes = notes ? nm_strdup(notes) : NULL;
-	new_host->notes_url = notes_url ? nm_strdup(notes_url) : NULL;
-	new_host->action_url = action_url ? nm_strdup(action_url) : NULL;
-	new_host->icon_image = icon_image ? nm_strdup(icon_image) : NULL;
-	new_host->icon_image_alt = icon_image_alt ? nm_strdup(icon_image_alt) : NULL;
-	new_host->vrml_image = vrml_image ? nm_strdup(vrml_image) : NULL;
-	new_host->statusmap_image = statusmap_image ? nm_strdup(statusmap_image) : NULL;
+	new_host->notes = nm_intern(notes);
+	new_host->notes_url = nm_intern(notes_url);
+	new_host->action_url = nm_intern(action_url);
+	new_host->icon_image = nm_intern(icon_image);
+	new_host->icon_image_alt = nm_intern(icon_image_alt);
+	new_host->vrml_image = nm_intern(vrml_image);
+	new_host->statusmap_image = nm_intern(statusmap_image);
 
 	/* duplicate non-string vars */
 	new_host->hourly_value = hourly_value;
@@ -226,41 +226,18 @@ static gboolean my_g_tree_visit_pick_one(gpointer key, gpointer value, gpointer
 	return TRUE; /* Stop traversal */
 }
 
+/*
+ * the host itself, its service links, contacts and contact groups are
+ * in the object arena and go away with nm_object_arena_release()
+ */
 void destroy_host(host *this_host)
 {
-	struct servicesmember *this_servicesmember, *next_servicesmember;
-	struct contactgroupsmember *this_contactgroupsmember, *next_contactgroupsmember;
-	struct contactsmember *this_contactsmember, *next_contactsmember;
 	struct customvariablesmember *this_customvariablesmember, *next_customvariablesmember;
 	struct objectlist *slavelist;
 
 	if (!this_host)
 		return;
 
-	/* free memory for service links */
-	this_servicesmember = this_host->services;
-	while (this_servicesmember != NULL) {
-		next_servicesmember = this_servicesmember->next;
-		nm_free(this_servicesmember);
-		this_servicesmember = next_servicesmember;
-	}
-
-	/* free memory for contact groups */
-	this_contactgroupsmember = this_host->contact_groups;
-	while (this_contactgroupsmember != NULL) {
-		next_contactgroupsmember = this_contactgroupsmember->next;
-		nm_free(this_contactgroupsmember);
-		this_contactgroupsmember = next_contactgroupsmember;
-	}
-
-	/* free memory for contacts */
-	this_contactsmember = this_host->contacts;
-	while (this_contactsmember != NULL) {
-		next_contactsmember = this_contactsmember->next;
-		nm_free(this_contactsmember);
-		this_contactsmember = next_contactsmember;
-	}
-
 	/* free memory for custom variables */
 	this_customvariablesmember = this_host->custom_variables;
 	while (this_customvariablesmember != NULL) {
@@ -320,21 +297,20 @@ void destroy_host(host *this_host)
 	free_objectlist(&this_host->notify_deps);
 	free_objectlist(&this_host->exec_deps);
 	free_objectlist(&this_host->escalation_list);
-	nm_free(this_host->check_command);
-	nm_free(this_host->event_handler);
-	nm_free(this_host->check_period);
-	nm_free(this_host->notification_period);
-	nm_free(this_host->notes);
-	nm_free(this_host->notes_url);
-	nm_free(this_host->action_url);
-	nm_free(this_host->icon_image);
-	nm_free(this_host->icon_image_alt);
-	nm_free(this_host->vrml_image);
-	nm_free(this_host->statusmap_image);
+	nm_intern_release(this_host->check_command);
+	nm_intern_release(this_host->event_handler);
+	nm_intern_release(this_host->check_period);
+	nm_intern_release(this_host->notification_period);
+	nm_intern_release(this_host->notes);
+	nm_intern_release(this_host->notes_url);
+	nm_intern_release(this_host->action_url);
+	nm_intern_release(this_host->icon_image);
+	nm_intern_release(this_host->icon_image_alt);
+	nm_intern_release(this_host->vrml_image);
+	nm_intern_release(this_host->statusmap_image);
 	nm_free(this_host->current_notification_id);
 	nm_free(this_host->last_problem_id);
 	nm_free(this_host->current_problem_id);
-	nm_free(this_host);
 }
 
 host *find_host(const char *name)
@@ -22,121 +22,128 @@ struct servicesmember;
 extern struct host **host_ary;
 extern struct host *host_list;
 
+/* see the comment above struct service for how members are ordered */
 struct host {
+	/* scheduling and check execution */
 	unsigned int id;
-	char    *name;
-	char    *display_name;
-	char	*alias;
-	char    *address;
-	GTree   *parent_hosts; /* char * => struct host * */
-	GTree   *child_hosts; /* char * => struct host * */
-	struct servicesmember *services;
-	char    *check_command;
-	int     initial_state;
-	int		check_timeout;
-	double  check_interval;
-	double  retry_interval;
-	int     max_attempts;
-	char    *event_handler;
-	struct contactgroupsmember *contact_groups;
-	struct contactsmember *contacts;
-	double  notification_interval;
-	double  first_notification_delay;
-	unsigned int notification_options;
-	unsigned int hourly_value;
-	char	*notification_period;
-	char    *check_period;
-	int     flap_detection_enabled;
-	double  low_flap_threshold;
-	double  high_flap_threshold;
-	int     flap_detection_options;
-	unsigned int stalking_options;
-	int     check_freshness;
-	int     freshness_threshold;
-	int     process_performance_data;
-	int     checks_enabled;
-	const char *check_source;
-	int     accept_passive_checks;
-	int     event_handler_enabled;
-	int     retain_status_information;
-	int     retain_nonstatus_information;
-	int     obsess;
-	char    *notes;
-	char    *notes_url;
-	char    *action_url;
-	char    *icon_image;
-	char    *icon_image_alt;
-	char    *statusmap_image; /* used by lots of graphing tools */
-	char    *vrml_image;
-	int     have_2d_coords;
-	int     x_2d;
-	int     y_2d;
-	int     have_3d_coords;
-	double  x_3d;
-	double  y_3d;
-	double  z_3d;
-	customvariablesmember *custom_variables;
-	int     problem_has_been_acknowledged;
-	int     acknowledgement_type;
-	time_t  acknowledgement_end_time;
-	int     check_type;
 	int     current_state;
 	int     last_state;
 	int     last_hard_state;
-	char	*plugin_output;
-	char    *long_plugin_output;
-	char    *perf_data;
 	int     state_type;
+	int     check_type;
 	int     current_attempt;
-	unsigned long current_event_id;
-	unsigned long last_event_id;
-	char   *current_problem_id;
-	char   *last_problem_id;
-	time_t  problem_start;
-	time_t  problem_end;
-	double  latency;
-	double  execution_time;
+	int     max_attempts;
 	int     is_executing;
+	int     checks_enabled;
 	int     check_options;
-	int     notifications_enabled;
-	time_t  last_notification;
-	time_t  next_notification;
-	time_t  next_check;
-	time_t  last_check;
-	time_t	last_state_change;
-	time_t	last_hard_state_change;
-	time_t  last_time_up;
-	time_t  last_time_down;
-	time_t  last_time_unreachable;
 	int     has_been_checked;
+	int     check_freshness;
+	int     freshness_threshold;
 	int     is_being_freshened;
+	int     accept_passive_checks;
+	time_t  next_check;
+	time_t  last_check;
+	double  check_interval;
+	double  retry_interval;
+	struct command *check_command_ptr;
+	struct timeperiod *check_period_ptr;
+	struct servicesmember *services;
+	struct timed_event *next_check_event;
+
+	/* check result handling, flap detection and notifications */
+	int		check_timeout;
+	int     initial_state;
+	int     is_flapping;
+	int     flap_detection_enabled;
+	int     flap_detection_options;
+	int     state_history_index;
+	int     scheduled_downtime_depth;
+	int     problem_has_been_acknowledged;
+	int     acknowledgement_type;
+	int     notifications_enabled;
+	unsigned int notification_options;
 	int     notified_on;
 	int     current_notification_number;
 	int     no_more_notifications;
-	char   *current_notification_id;
 	int     check_flapping_recovery_notification;
-	int     scheduled_downtime_depth;
+	unsigned int stalking_options;
+	int     event_handler_enabled;
+	int     process_performance_data;
+	int     obsess;
+	int     retain_status_information;
+	int     retain_nonstatus_information;
+	int     total_services;
+	unsigned int hourly_value;
 	int     pending_flex_downtime; /* UNUSED */
-	int     state_history[MAX_STATE_HISTORY_ENTRIES];    /* flap detection */
-	int     state_history_index;
+	state_history_t state_history; /* flap detection, see state_history_get() */
 	time_t  last_state_history_update;
-	int     is_flapping;
-	unsigned long flapping_comment_id;
-	struct objectlist *comments_list;
 	double  percent_state_change;
-	int     total_services;
+	double  low_flap_threshold;
+	double  high_flap_threshold;
+	double  latency;
+	double  execution_time;
+	double  notification_interval;
+	double  first_notification_delay;
+	time_t	last_state_change;
+	time_t	last_hard_state_change;
+	time_t  last_time_up;
+	time_t  last_time_down;
+	time_t  last_time_unreachable;
+	time_t  acknowledgement_end_time;
+	time_t  last_notification;
+	time_t  next_notification;
+	time_t  problem_start;
+	time_t  problem_end;
+	unsigned long current_event_id;
+	unsigned long last_event_id;
+	unsigned long flapping_comment_id;
 	unsigned long modified_attributes;
-	struct command *event_handler_ptr;
-	struct command *check_command_ptr;
-	struct timeperiod *check_period_ptr;
+	char	*plugin_output;
+	char    *long_plugin_output;
+	char    *perf_data;
+	unsigned int output_changed; /* CHECK_OUTPUT_* parts the last check result replaced */
+	const char *check_source;
 	struct timeperiod *notification_period_ptr;
-	struct objectlist *hostgroups_ptr;
+	struct command *event_handler_ptr;
 	/* objects we depend upon */
 	struct objectlist *exec_deps, *notify_deps;
 	struct objectlist *escalation_list;
+	struct contactgroupsmember *contact_groups;
+	struct contactsmember *contacts;
+	struct objectlist *comments_list;
+	char   *current_problem_id;
+	char   *last_problem_id;
+	char   *current_notification_id;
 	struct timeval  last_update /* timestamp when object has been updated the last time */;
+
+	/* identity, configuration and presentation; rarely touched after startup */
+	int     have_2d_coords;
+	int     x_2d;
+	int     y_2d;
+	int     have_3d_coords;
+	double  x_3d;
+	double  y_3d;
+	double  z_3d;
+	char    *name;
+	char    *display_name;
+	char	*alias;
+	char    *address;
+	char    *check_command;
+	char    *event_handler;
+	char    *check_period;
+	char	*notification_period;
+	GTree   *parent_hosts; /* char * => struct host * */
+	GTree   *child_hosts; /* char * => struct host * */
+	struct objectlist *hostgroups_ptr;
+	customvariablesmember *custom_variables;
+	char    *notes;
+	char    *notes_url;
+	char    *action_url;
+	char    *icon_image;
+	char    *icon_image_alt;
+	char    *statusmap_image; /* used by lots of graphing tools */
+	char    *vrml_image;
 	struct  host *next;
-	struct timed_event *next_check_event;
 };
 
 static const struct flag_map host_flag_map[] = {
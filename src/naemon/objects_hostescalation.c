@@ -26,12 +26,11 @@ hostescalation *add_hostescalation(char *host_name, int first_notification, int
 		return NULL;
 	}
 
-	new_hostescalation = nm_calloc(1, sizeof(*new_hostescalation));
+	new_hostescalation = nm_object_alloc(sizeof(*new_hostescalation));
 
 	/* add the escalation to its host */
 	if (prepend_object_to_objectlist(&h->escalation_list, new_hostescalation) != OK) {
 		nm_log(NSLOG_CONFIG_ERROR, "Error: Could not add hostescalation to host '%s'\n", host_name);
-		free(new_hostescalation);
 		return NULL;
 	}
 
@@ -49,29 +48,11 @@ hostescalation *add_hostescalation(char *host_name, int first_notification, int
 	return new_hostescalation;
 }
 
+/* escalations and their contact lists are in the object arena */
 void destroy_hostescalation(hostescalation *this_hostescalation)
 {
-	contactsmember *this_contactsmember;
-	/* free memory for the contact group members */
-	contactgroupsmember *this_contactgroupsmember;
 	if (!this_hostescalation)
 		return;
-	this_contactgroupsmember = this_hostescalation->contact_groups;
-
-	while (this_contactgroupsmember != NULL) {
-		contactgroupsmember *next_contactgroupsmember = this_contactgroupsmember->next;
-		nm_free(this_contactgroupsmember);
-		this_contactgroupsmember = next_contactgroupsmember;
-	}
-
-	/* free memory for contacts */
-	this_contactsmember = this_hostescalation->contacts;
-	while (this_contactsmember != NULL) {
-		contactsmember *next_contactsmember = this_contactsmember->next;
-		nm_free(this_contactsmember);
-		this_contactsmember = next_contactsmember;
-	}
-	nm_free(this_hostescalation);
 	num_objects.hostescalations--;
 }
 
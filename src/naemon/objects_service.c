@@ -19,8 +19,7 @@ service **service_ary = NULL;
 int init_objects_service(int elems)
 {
 	service_ary = nm_calloc(elems, sizeof(service *));
-	service_hash_table = g_hash_table_new_full(nm_service_hash, nm_service_equal,
-	                     (GDestroyNotify) nm_service_key_destroy, NULL);
+	service_hash_table = g_hash_table_new(nm_service_hash, nm_service_equal);
 	return OK;
 }
 
@@ -64,12 +63,12 @@ service *create_service(host *hst, const char *description)
 	}
 
 	/* allocate memory */
-	new_service = nm_calloc(1, sizeof(*new_service));
+	new_service = nm_object_alloc(sizeof(*new_service));
 
 	new_service->host_ptr = hst;
 	new_service->host_name = hst->name;
 
-	new_servicesmember = nm_calloc(1, sizeof(servicesmember));
+	new_servicesmember = nm_object_alloc(sizeof(servicesmember));
 	new_servicesmember->host_name = new_service->host_name;
 	new_servicesmember->service_description = new_service->description;
 	new_servicesmember->service_ptr = new_service;
@@ -143,36 +142,26 @@ int setup_service_variables(service *new_service, const char *display_name, cons
 	/* duplicate vars, but assign what we can */
 	new_service->notification_period_ptr = np;
 	new_service->check_period_ptr = cp;
-	new_service->check_period = cp ? nm_strdup(cp->name) : NULL;
-	new_service->notification_period = np ? nm_strdup(np->name) : NULL;
-	new_service->check_command = nm_strdup(check_command);
+	new_service->check_period = cp ? nm_intern(cp->name) : NULL;
+	new_service->notification_period = np ? nm_intern(np->name) : NULL;
+	new_service->check_command = nm_intern(check_command);
 	new_service->check_command_ptr = cmd;
 	if (display_name) {
 		new_service->display_name = nm_strdup(display_name);
 	}
 	if (event_handler) {
-		new_service->event_handler = nm_strdup(event_handler);
+		new_service->event_handler = nm_intern(event_handler);
 		new_service->event_handler_ptr = find_bang_command(event_handler);
 		if (new_service->event_handler_ptr == NULL) {
 			nm_log(NSLOG_VERIFICATION_ERROR, "Error: Event handler command '%s' specified in service '%s' for host '%s' not defined anywhere", new_service->event_handler, new_service->description, new_service->host_name);
 			return -1;
 		}
 	}
-	if (notes) {
-		new_service->notes = nm_strdup(notes);
-	}
-	if (notes_url) {
-		new_service->notes_url = nm_strdup(notes_url);
-	}
-	if (action_url) {
-		new_service->action_url = nm_strdup(action_url);
-	}
-	if (icon_image) {
-		new_service->icon_image = nm_strdup(icon_image);
-	}
-	if (icon_image_alt) {
-		new_service->icon_image_alt = nm_strdup(icon_image_alt);
-	}
+	new_service->notes = nm_intern(notes);
+	new_service->notes_url = nm_intern(notes_url);
+	new_service->action_url = nm_intern(action_url);
+	new_service->icon_image = nm_intern(icon_image);
+	new_service->icon_image_alt = nm_intern(icon_image_alt);
 
 	new_service->hourly_value = hourly_value;
 	new_service->check_timeout = check_timeout;
@@ -210,7 +199,7 @@ int setup_service_variables(service *new_service, const char *display_name, cons
 
 int register_service(service *new_service)
 {
-
+	nm_service_key *key;
 	host *h;
 	g_return_val_if_fail(service_hash_table != NULL, ERROR);
 
@@ -225,8 +214,11 @@ int register_service(service *new_service)
 		return ERROR;
 	}
 
-	g_hash_table_insert(service_hash_table,
-	                    nm_service_key_create(new_service->host_name, new_service->description), new_service);
+	/* the key borrows the service's own strings rather than copying them */
+	key = nm_object_alloc(sizeof(*key));
+	key->hostname = new_service->host_name;
+	key->service_description = new_service->description;
+	g_hash_table_insert(service_hash_table, key, new_service);
 
 	new_service->id = num_objects.services++;
 	service_ary[new_service->id] = new_service;
@@ -245,7 +237,7 @@ servicesmember *add_parent_to_service(service *svc, service *parent)
 	if (!svc || !parent)
 		return NULL;
 
-	sm = nm_calloc(1, sizeof(*sm));
+	sm = nm_object_alloc(sizeof(*sm));
 
 	sm->host_name = parent->host_name;
 	sm->service_description = parent->description;
@@ -272,34 +264,17 @@ customvariablesmember *add_custom_variable_to_service(service *svc, char *varnam
 }
 
 /* destroy a single service object, set truncate_lists to TRUE when lists should be simply emptied instead of removing item by item.
- * Enable truncate_list when removing all objects and disble when removing a specific one. */
+ * Enable truncate_list when removing all objects and disble when removing a specific one.
+ * The service itself, its parent links, contacts and contact groups are in the
+ * object arena and go away with nm_object_arena_release() */
 void destroy_service(service *this_service, int truncate_lists)
 {
-	struct contactgroupsmember *this_contactgroupsmember, *next_contactgroupsmember;
-	struct contactsmember *this_contactsmember, *next_contactsmember;
 	struct customvariablesmember *this_customvariablesmember, *next_customvariablesmember;
-	struct servicesmember *this_servicesmember, *next_servicesmember;
 	struct objectlist *slavelist;
 
 	if (!this_service)
 		return;
 
-	/* free memory for contact groups */
-	this_contactgroupsmember = this_service->contact_groups;
-	while (this_contactgroupsmember != NULL) {
-		next_contactgroupsmember = this_contactgroupsmember->next;
-		nm_free(this_contactgroupsmember);
-		this_contactgroupsmember = next_contactgroupsmember;
-	}
-
-	/* free memory for contacts */
-	this_contactsmember = this_service->contacts;
-	while (this_contactsmember != NULL) {
-		next_contactsmember = this_contactsmember->next;
-		nm_free(this_contactsmember);
-		this_contactsmember = next_contactsmember;
-	}
-
 	/* free memory for custom variables */
 	this_customvariablesmember = this_service->custom_variables;
 	while (this_customvariablesmember != NULL) {
@@ -310,14 +285,6 @@ void destroy_service(service *this_service, int truncate_lists)
 		this_customvariablesmember = next_customvariablesmember;
 	}
 
-	/* free memory for service parents */
-	this_servicesmember = this_service->parents;
-	while (this_servicesmember != NULL) {
-		next_servicesmember = this_servicesmember->next;
-		nm_free(this_servicesmember);
-		this_servicesmember = next_servicesmember;
-	}
-
 	/* free memory for service groups */
 	if(!truncate_lists) {
 		/* remove them one by one */
@@ -325,6 +292,13 @@ void destroy_service(service *this_service, int truncate_lists)
 			remove_service_from_servicegroup(this_service->servicegroups_ptr->object_ptr, this_service);
 	}
 
+	/* the hash key points to our strings, so it can't outlive us */
+	if (!truncate_lists && service_hash_table && find_service(this_service->host_name, this_service->description) == this_service) {
+		g_hash_table_remove(service_hash_table, &((nm_service_key) {
+			this_service->host_name, this_service->description
+		}));
+	}
+
 	for (slavelist = this_service->notify_deps; slavelist; slavelist = slavelist->next)
 		destroy_servicedependency(slavelist->object_ptr);
 	for (slavelist = this_service->exec_deps; slavelist; slavelist = slavelist->next)
@@ -335,7 +309,7 @@ void destroy_service(service *this_service, int truncate_lists)
 	if (this_service->display_name != this_service->description)
 		nm_free(this_service->display_name);
 	nm_free(this_service->description);
-	nm_free(this_service->check_command);
+	nm_intern_release(this_service->check_command);
 	nm_free(this_service->plugin_output);
 	nm_free(this_service->long_plugin_output);
 	nm_free(this_service->perf_data);
@@ -345,18 +319,17 @@ void destroy_service(service *this_service, int truncate_lists)
 	free_objectlist(&this_service->notify_deps);
 	free_objectlist(&this_service->exec_deps);
 	free_objectlist(&this_service->escalation_list);
-	nm_free(this_service->event_handler);
-	nm_free(this_service->check_period);
-	nm_free(this_service->notification_period);
-	nm_free(this_service->notes);
-	nm_free(this_service->notes_url);
-	nm_free(this_service->action_url);
-	nm_free(this_service->icon_image);
-	nm_free(this_service->icon_image_alt);
+	nm_intern_release(this_service->event_handler);
+	nm_intern_release(this_service->check_period);
+	nm_intern_release(this_service->notification_period);
+	nm_intern_release(this_service->notes);
+	nm_intern_release(this_service->notes_url);
+	nm_intern_release(this_service->action_url);
+	nm_intern_release(this_service->icon_image);
+	nm_intern_release(this_service->icon_image_alt);
 	nm_free(this_service->current_notification_id);
 	nm_free(this_service->last_problem_id);
 	nm_free(this_service->current_problem_id);
-	nm_free(this_service);
 }
 
 service *find_service(const char *host_name, const char *svc_desc)
@@ -22,112 +22,126 @@ typedef struct servicesmember servicesmember;
 extern struct service *service_list;
 extern struct service **service_ary;
 
+/*
+ * Members are grouped by how often they're touched rather than by what
+ * they mean. The first two cache lines hold everything the scheduler,
+ * freshness checks and check dispatching look at, so walking service_ary
+ * doesn't drag strings and notification bookkeeping into the cache.
+ * Integers are kept together to avoid padding; keep it that way when
+ * adding members.
+ */
 struct service {
+	/* scheduling and check execution */
 	unsigned int id;
-	char	*host_name;
-	char	*description;
-	char    *display_name;
-	struct servicesmember *parents;
-	struct servicesmember *children;
-	char    *check_command;
-	char    *event_handler;
-	int     initial_state;
-	int     check_timeout;
+	int	current_state;
+	int	last_state;
+	int	last_hard_state;
+	int     state_type;
+	int     check_type;
+	int	current_attempt;
+	int	max_attempts;
+	int     is_executing;
+	int	checks_enabled;
+	int     check_options;
+	int     has_been_checked;
+	int     check_freshness;
+	int     freshness_threshold;
+	int     is_being_freshened;
+	int     accept_passive_checks;
+	time_t	next_check;
+	time_t	last_check;
 	double	check_interval;
 	double  retry_interval;
-	int	max_attempts;
-	struct contactgroupsmember *contact_groups;
-	struct contactsmember *contacts;
-	double	notification_interval;
-	double  first_notification_delay;
-	unsigned int notification_options;
-	unsigned int stalking_options;
-	unsigned int hourly_value;
+	struct host *host_ptr;
+	struct timeperiod *check_period_ptr;
+	struct command *check_command_ptr;
+	struct timed_event *next_check_event;
+
+	/* check result handling, flap detection and notifications */
+	int     check_timeout;
+	int     initial_state;
 	int     is_volatile;
-	char	*notification_period;
-	char	*check_period;
+	int     is_flapping;
 	int     flap_detection_enabled;
-	double  low_flap_threshold;
-	double  high_flap_threshold;
 	unsigned int flap_detection_options;
-	int     process_performance_data;
-	int     check_freshness;
-	int     freshness_threshold;
-	int     accept_passive_checks;
-	int     event_handler_enabled;
-	int	checks_enabled;
-	const char *check_source;
-	int     retain_status_information;
-	int     retain_nonstatus_information;
-	int     notifications_enabled;
-	int     obsess;
-	char    *notes;
-	char    *notes_url;
-	char    *action_url;
-	char    *icon_image;
-	char    *icon_image_alt;
-	struct customvariablesmember *custom_variables;
+	int     state_history_index;
+	int     scheduled_downtime_depth;
 	int     problem_has_been_acknowledged;
 	int     acknowledgement_type;
-	time_t  acknowledgement_end_time;
 	int     host_problem_at_last_check;
-	int     check_type;
-	int	current_state;
-	int	last_state;
-	int	last_hard_state;
-	char	*plugin_output;
-	char    *long_plugin_output;
-	char    *perf_data;
-	int     state_type;
-	time_t	next_check;
-	time_t	last_check;
-	int	current_attempt;
-	unsigned long current_event_id;
-	unsigned long last_event_id;
-	char   *current_problem_id;
-	char   *last_problem_id;
-	time_t  problem_start;
-	time_t  problem_end;
-	time_t	last_notification;
-	time_t  next_notification;
+	int     notifications_enabled;
+	unsigned int notification_options;
+	unsigned int notified_on;
+	int     current_notification_number;
 	int     no_more_notifications;
 	int     check_flapping_recovery_notification;
+	unsigned int stalking_options;
+	int     event_handler_enabled;
+	int     process_performance_data;
+	int     obsess;
+	int     retain_status_information;
+	int     retain_nonstatus_information;
+	int     pending_flex_downtime; /* UNUSED */
+	state_history_t state_history; /* flap detection, see state_history_get() */
+	double  percent_state_change;
+	double  low_flap_threshold;
+	double  high_flap_threshold;
+	double  latency;
+	double  execution_time;
+	double	notification_interval;
+	double  first_notification_delay;
 	time_t	last_state_change;
 	time_t	last_hard_state_change;
 	time_t  last_time_ok;
 	time_t  last_time_warning;
 	time_t  last_time_unknown;
 	time_t  last_time_critical;
-	int     has_been_checked;
-	int     is_being_freshened;
-	unsigned int notified_on;
-	int     current_notification_number;
-	char   *current_notification_id;
-	double  latency;
-	double  execution_time;
-	int     is_executing;
-	int     check_options;
-	int     scheduled_downtime_depth;
-	int     pending_flex_downtime; /* UNUSED */
-	int     state_history[MAX_STATE_HISTORY_ENTRIES];    /* flap detection */
-	int     state_history_index;
-	int     is_flapping;
+	time_t  acknowledgement_end_time;
+	time_t	last_notification;
+	time_t  next_notification;
+	time_t  problem_start;
+	time_t  problem_end;
+	unsigned long current_event_id;
+	unsigned long last_event_id;
 	unsigned long flapping_comment_id;
-	struct objectlist *comments_list;
-	double  percent_state_change;
 	unsigned long modified_attributes;
-	struct host *host_ptr;
+	char	*plugin_output;
+	char    *long_plugin_output;
+	char    *perf_data;
+	unsigned int output_changed; /* CHECK_OUTPUT_* parts the last check result replaced */
+	const char *check_source;
+	struct timeperiod *notification_period_ptr;
 	struct command *event_handler_ptr;
 	char *event_handler_args;
-	struct command *check_command_ptr;
-	struct timeperiod *check_period_ptr;
-	struct timeperiod *notification_period_ptr;
-	struct objectlist *servicegroups_ptr;
-	struct objectlist *exec_deps, *notify_deps;
 	struct objectlist *escalation_list;
+	struct objectlist *exec_deps, *notify_deps;
+	struct contactgroupsmember *contact_groups;
+	struct contactsmember *contacts;
+	struct objectlist *comments_list;
+	char   *current_problem_id;
+	char   *last_problem_id;
+	char   *current_notification_id;
 	struct timeval last_update /* timestamp when object has been updated the last time */;
+
+	/* identity, configuration and presentation; rarely touched after startup */
+	unsigned int hourly_value;
+	char	*host_name;
+	char	*description;
+	char    *display_name;
+	char    *check_command;
+	char    *event_handler;
+	char	*check_period;
+	char	*notification_period;
+	struct servicesmember *parents;
+	struct servicesmember *children;
+	struct objectlist *servicegroups_ptr;
+	struct customvariablesmember *custom_variables;
+	char    *notes;
+	char    *notes_url;
+	char    *action_url;
+	char    *icon_image;
+	char    *icon_image_alt;
 	struct service *next;
-	struct timed_event *next_check_event;
 };
 
 struct servicesmember {
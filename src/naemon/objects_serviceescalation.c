@@ -27,7 +27,7 @@ serviceescalation *add_serviceescalation(char *host_name, char *description, int
 		return NULL ;
 	}
 
-	new_serviceescalation = nm_calloc(1, sizeof(*new_serviceescalation));
+	new_serviceescalation = nm_object_alloc(sizeof(*new_serviceescalation));
 
 	if (prepend_object_to_objectlist(&svc->escalation_list, new_serviceescalation) != OK) {
 		nm_log(NSLOG_CONFIG_ERROR, "Could not add escalation to service '%s' on host '%s'\n",
@@ -52,28 +52,11 @@ serviceescalation *add_serviceescalation(char *host_name, char *description, int
 	return new_serviceescalation;
 }
 
+/* escalations and their contact lists are in the object arena */
 void destroy_serviceescalation(serviceescalation *this_serviceescalation)
 {
-	contactsmember *this_contactsmember;
-	contactgroupsmember *this_contactgroupsmember;
 	if (!this_serviceescalation)
 		return;
-
-	this_contactgroupsmember = this_serviceescalation->contact_groups;
-	while (this_contactgroupsmember != NULL) {
-		contactgroupsmember *next_contactgroupsmember = this_contactgroupsmember->next;
-		nm_free(this_contactgroupsmember);
-		this_contactgroupsmember = next_contactgroupsmember;
-	}
-
-	/* free memory for contacts */
-	this_contactsmember = this_serviceescalation->contacts;
-	while (this_contactsmember != NULL) {
-		contactsmember *next_contactsmember = this_contactsmember->next;
-		nm_free(this_contactsmember);
-		this_contactsmember = next_contactsmember;
-	}
-	nm_free(this_serviceescalation);
 	num_objects.serviceescalations--;
 }
 
@@ -6,11 +6,15 @@
 #include "events.h"
 #include "logging.h"
 #include "workers.h"
+#include "query-handler.h"
+#include "defaults.h"
 #include "nm_alloc.h"
+#include "lib/nsock.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <string.h>
+#include <math.h>
 
 int     perfdata_timeout;
 char    *host_perfdata_command = NULL;
@@ -29,6 +33,9 @@ char    *host_perfdata_file_processing_command = NULL;
 char    *service_perfdata_file_processing_command = NULL;
 int     host_perfdata_process_empty_results = DEFAULT_HOST_PERFDATA_PROCESS_EMPTY_RESULTS;
 int     service_perfdata_process_empty_results = DEFAULT_SERVICE_PERFDATA_PROCESS_EMPTY_RESULTS;
+unsigned long perfdata_flush_size = DEFAULT_PERFDATA_FLUSH_SIZE;
+unsigned long perfdata_flush_interval = DEFAULT_PERFDATA_FLUSH_INTERVAL;
+unsigned long perfdata_max_buffer_size = DEFAULT_PERFDATA_MAX_BUFFER_SIZE;
 
 static command *host_perfdata_command_ptr = NULL;
 static command *service_perfdata_command_ptr = NULL;
@@ -39,12 +46,33 @@ static int service_perfdata_fd = -1;
 static nm_bufferqueue *host_perfdata_bq = NULL;
 static nm_bufferqueue *service_perfdata_bq = NULL;
 
+/*
+ * Lines waiting to be written to a perfdata file. They're collected
+ * here and handed to the bufferqueue as a single block when flushing,
+ * so a batch costs one write() rather than one per line.
+ */
+struct perfdata_batch {
+	GString *buf;
+	int dropping; /* TRUE while the buffer is full */
+	unsigned long lines;
+	unsigned long flushes;
+	unsigned long failed_flushes;
+	unsigned long long bytes_written;
+	unsigned long dropped_lines;
+	unsigned long long dropped_bytes;
+};
+static struct perfdata_batch host_perfdata_batch;
+static struct perfdata_batch service_perfdata_batch;
+
 static void xpddefault_process_host_perfdata_file(struct nm_event_execution_properties *evprop);
 static void xpddefault_process_service_perfdata_file(struct nm_event_execution_properties *evprop);
 static int xpddefault_run_service_performance_data_command(nagios_macros *mac, service *);
 static int xpddefault_run_host_performance_data_command(nagios_macros *mac, host *);
 
-static int flush_perfdata(nm_bufferqueue *bq, int fd, const char *filename);
+static int queue_perfdata(nm_bufferqueue *bq, struct perfdata_batch *batch, const char *filename, const char *line, size_t len);
+static int flush_perfdata(nm_bufferqueue *bq, struct perfdata_batch *batch, int fd, const char *filename);
+static void xpddefault_flush_perfdata_files(struct nm_event_execution_properties *evprop);
+static int xpddefault_qh_handler(int sd, char *buf, unsigned int len);
 static int xpddefault_update_service_performance_data_file(nagios_macros *mac, service *);
 static int xpddefault_update_host_performance_data_file(nagios_macros *mac, host *);
 
@@ -171,6 +199,15 @@ int initialize_performance_data(const char *cfgfile)
 			schedule_event(service_perfdata_file_processing_interval, xpddefault_process_service_perfdata_file, NULL);
 	}
 
+	if (host_perfdata_bq != NULL || service_perfdata_bq != NULL) {
+		/* make sure nothing sits in the buffers for too long */
+		if (perfdata_flush_interval > 0 && perfdata_flush_size > 0)
+			schedule_event(perfdata_flush_interval, xpddefault_flush_perfdata_files, NULL);
+
+		if (qh_register_handler("perfdata", "Performance data file writer statistics", QH_OPT_THREADSAFE, xpddefault_qh_handler) < 0)
+			nm_log(NSLOG_RUNTIME_ERROR, "perfdata: Failed to register with query handler\n");
+	}
+
 	/* save the host perf data file macro */
 	nm_free(mac->x[MACRO_HOSTPERFDATAFILE]);
 	if (host_perfdata_file != NULL) {
@@ -204,8 +241,8 @@ int cleanup_performance_data(void)
 	nm_free(host_perfdata_file_processing_command);
 	nm_free(service_perfdata_file_processing_command);
 	// one last attempt to write what remains buffered, just in case:
-	flush_perfdata(host_perfdata_bq, host_perfdata_fd, host_perfdata_file);
-	flush_perfdata(service_perfdata_bq, service_perfdata_fd, service_perfdata_file);
+	flush_perfdata(host_perfdata_bq, &host_perfdata_batch, host_perfdata_fd, host_perfdata_file);
+	flush_perfdata(service_perfdata_bq, &service_perfdata_batch, service_perfdata_fd, service_perfdata_file);
 	close(host_perfdata_fd);
 	host_perfdata_fd = -1;
 	close(service_perfdata_fd);
@@ -214,6 +251,12 @@ int cleanup_performance_data(void)
 	host_perfdata_bq = NULL;
 	nm_bufferqueue_destroy(service_perfdata_bq);
 	service_perfdata_bq = NULL;
+	if (host_perfdata_batch.buf)
+		g_string_free(host_perfdata_batch.buf, TRUE);
+	memset(&host_perfdata_batch, 0, sizeof(host_perfdata_batch));
+	if (service_perfdata_batch.buf)
+		g_string_free(service_perfdata_batch.buf, TRUE);
+	memset(&service_perfdata_batch, 0, sizeof(service_perfdata_batch));
 
 	return OK;
 }
@@ -430,15 +473,55 @@ static int xpddefault_open_perfdata_file(char *perfdata_file, int is_pipe, int a
 	return perfdata_fd;
 }
 
-/* flush the perfdata stored in `bq` to the file referred to by `fd`, named by `filename`. Returns -1 on error, 0 on success. */
-static int flush_perfdata(nm_bufferqueue *bq, int fd, const char *filename)
+/*
+ * add a line to the batch for the file named by `filename`. Returns
+ * ERROR if the line was dropped because too much is buffered already.
+ */
+static int queue_perfdata(nm_bufferqueue *bq, struct perfdata_batch *batch, const char *filename, const char *line, size_t len)
 {
+	size_t buffered = nm_bufferqueue_get_available(bq) + (batch->buf ? batch->buf->len : 0);
+
+	if (perfdata_max_buffer_size > 0 && buffered + len > perfdata_max_buffer_size) {
+		if (!batch->dropping)
+			nm_log(NSLOG_RUNTIME_WARNING, "Warning: More than %lu bytes of performance data waiting for %s - dropping performance data until it can be written\n", perfdata_max_buffer_size, filename);
+		batch->dropping = TRUE;
+		batch->dropped_lines++;
+		batch->dropped_bytes += len;
+		return ERROR;
+	}
+	if (batch->dropping) {
+		nm_log(NSLOG_INFO_MESSAGE, "Performance data for %s is being written again, %lu lines dropped so far\n", filename, batch->dropped_lines);
+		batch->dropping = FALSE;
+	}
+
+	if (batch->buf == NULL)
+		batch->buf = g_string_sized_new(perfdata_flush_size ? perfdata_flush_size : 1024);
+	g_string_append_len(batch->buf, line, len);
+	batch->lines++;
+
+	return OK;
+}
+
+/* flush the perfdata stored in `bq` and `batch` to the file referred to by `fd`, named by `filename`. Returns -1 on error, 0 on success. */
+static int flush_perfdata(nm_bufferqueue *bq, struct perfdata_batch *batch, int fd, const char *filename)
+{
+	int sent;
+
 	if(bq == NULL)
 		return -1;
+	if (batch->buf && batch->buf->len) {
+		nm_bufferqueue_push(bq, batch->buf->str, batch->buf->len);
+		g_string_truncate(batch->buf, 0);
+	}
 	if (fd >= 0) {
-		if (nm_bufferqueue_write(bq, fd) >= 0) {
+		if (!nm_bufferqueue_get_available(bq))
+			return 0;
+		if ((sent = nm_bufferqueue_write(bq, fd)) >= 0) {
+			batch->flushes++;
+			batch->bytes_written += sent;
 			return 0;
 		}
+		batch->failed_flushes++;
 		nm_log(NSLOG_RUNTIME_WARNING,
 		       "Warning: Failed to flush performance data to performance file %s",
 		       filename);
@@ -446,6 +529,52 @@ static int flush_perfdata(nm_bufferqueue *bq, int fd, const char *filename)
 	return -1;
 
 }
+
+/* writes whatever has been waiting in the batches since the last flush */
+static void xpddefault_flush_perfdata_files(struct nm_event_execution_properties *evprop)
+{
+	if (evprop->execution_type == EVENT_EXEC_NORMAL) {
+		/* Recurring event */
+		schedule_event(perfdata_flush_interval, xpddefault_flush_perfdata_files, NULL);
+
+		if (host_perfdata_bq != NULL)
+			flush_perfdata(host_perfdata_bq, &host_perfdata_batch, host_perfdata_fd, host_perfdata_file);
+		if (service_perfdata_bq != NULL)
+			flush_perfdata(service_perfdata_bq, &service_perfdata_batch, service_perfdata_fd, service_perfdata_file);
+	}
+}
+
+static void print_perfdata_stats(int sd, const char *type, const char *filename, nm_bufferqueue *bq, struct perfdata_batch *batch)
+{
+	if (bq == NULL)
+		return;
+
+	qh_printf(sd, "type=%s;file=%s;buffered=%lu;max_buffered=%lu;lines=%lu;flushes=%lu;failed_flushes=%lu;bytes_written=%llu;dropped_lines=%lu;dropped_bytes=%llu\n",
+	          type, filename,
+	          (unsigned long)(nm_bufferqueue_get_available(bq) + (batch->buf ? batch->buf->len : 0)),
+	          perfdata_max_buffer_size, batch->lines, batch->flushes, batch->failed_flushes,
+	          batch->bytes_written, batch->dropped_lines, batch->dropped_bytes);
+}
+
+static int xpddefault_qh_handler(int sd, char *buf, unsigned int len)
+{
+	if (!*buf || !strcmp(buf, "help")) {
+		qh_printf_nul(sd, "Performance data file writer.\n"
+		              "Valid commands:\n"
+		              "  stats   Print how much data is buffered and how much has been\n"
+		              "          written and dropped for each performance data file");
+		return 0;
+	}
+
+	if (!strcmp(buf, "stats")) {
+		print_perfdata_stats(sd, "host", host_perfdata_file, host_perfdata_bq, &host_perfdata_batch);
+		print_perfdata_stats(sd, "service", service_perfdata_file, service_perfdata_bq, &service_perfdata_batch);
+		return 0;
+	}
+
+	return 400;
+}
+
 /* processes delimiter characters in templates */
 static int xpddefault_preprocess_file_templates(char *template)
 {
@@ -510,10 +639,15 @@ static int xpddefault_update_service_performance_data_file(nagios_macros *mac, s
 
 	log_debug_info(DEBUGL_PERFDATA, 2, "Processed service performance data file output: %s\n", processed_output);
 
-	nm_bufferqueue_push(service_perfdata_bq, processed_output, strlen(processed_output));
-
-	/* temporary failures are fine - if it's serious, we log before we run the processing event */
-	flush_perfdata(service_perfdata_bq, service_perfdata_fd, service_perfdata_file);
+	/*
+	 * write once enough has been collected, the flush event takes care
+	 * of the rest. temporary failures are fine - if it's serious, we
+	 * log before we run the processing event
+	 */
+	if (queue_perfdata(service_perfdata_bq, &service_perfdata_batch, service_perfdata_file, processed_output, strlen(processed_output)) == OK) {
+		if (perfdata_flush_interval == 0 || service_perfdata_batch.buf->len >= perfdata_flush_size)
+			flush_perfdata(service_perfdata_bq, &service_perfdata_batch, service_perfdata_fd, service_perfdata_file);
+	}
 
 	nm_free(raw_output);
 	nm_free(processed_output);
@@ -548,10 +682,15 @@ static int xpddefault_update_host_performance_data_file(nagios_macros *mac, host
 
 	log_debug_info(DEBUGL_PERFDATA, 2, "Processed host performance data file output: %s\n", processed_output);
 
-	nm_bufferqueue_push(host_perfdata_bq, processed_output, strlen(processed_output));
-
-	/* temporary failures are fine - if it's serious, we log before we run the processing event */
-	flush_perfdata(host_perfdata_bq, host_perfdata_fd, host_perfdata_file);
+	/*
+	 * write once enough has been collected, the flush event takes care
+	 * of the rest. temporary failures are fine - if it's serious, we
+	 * log before we run the processing event
+	 */
+	if (queue_perfdata(host_perfdata_bq, &host_perfdata_batch, host_perfdata_file, processed_output, strlen(processed_output)) == OK) {
+		if (perfdata_flush_interval == 0 || host_perfdata_batch.buf->len >= perfdata_flush_size)
+			flush_perfdata(host_perfdata_bq, &host_perfdata_batch, host_perfdata_fd, host_perfdata_file);
+	}
 
 	nm_free(raw_output);
 	nm_free(processed_output);
@@ -570,7 +709,7 @@ static void xpddefault_process_host_job_handler(struct wproc_result *wpres, void
 	                       host_perfdata_file_pipe,
 	                       host_perfdata_file_append);
 	if (host_perfdata_fd > 0)
-		flush_perfdata(host_perfdata_bq, host_perfdata_fd, host_perfdata_file);
+		flush_perfdata(host_perfdata_bq, &host_perfdata_batch, host_perfdata_fd, host_perfdata_file);
 }
 
 /* periodically process the host perf data file */
@@ -615,7 +754,7 @@ static void xpddefault_process_host_perfdata_file(struct nm_event_execution_prop
 
 		if (host_perfdata_fd >= 0) {
 
-			if (flush_perfdata(host_perfdata_bq, host_perfdata_fd, host_perfdata_file) == 0) {
+			if (flush_perfdata(host_perfdata_bq, &host_perfdata_batch, host_perfdata_fd, host_perfdata_file) == 0) {
 				close(host_perfdata_fd);
 				host_perfdata_fd = -1;
 				wproc_run_callback(processed_command_line, perfdata_timeout, xpddefault_process_host_job_handler, NULL, &mac);
@@ -639,7 +778,7 @@ static void xpddefault_process_service_job_handler(struct wproc_result *wpres, v
 	                          service_perfdata_file_pipe,
 	                          service_perfdata_file_append);
 	if (service_perfdata_fd > 0)
-		flush_perfdata(service_perfdata_bq, service_perfdata_fd, service_perfdata_file);
+		flush_perfdata(service_perfdata_bq, &service_perfdata_batch, service_perfdata_fd, service_perfdata_file);
 }
 
 /* periodically process the service perf data file */
@@ -683,7 +822,7 @@ static void xpddefault_process_service_perfdata_file(struct nm_event_execution_p
 		log_debug_info(DEBUGL_PERFDATA, 2, "Processed service performance data file processing command line: %s\n", processed_command_line);
 
 		if (service_perfdata_fd >= 0) {
-			if (flush_perfdata(service_perfdata_bq, service_perfdata_fd, service_perfdata_file) == 0) {
+			if (flush_perfdata(service_perfdata_bq, &service_perfdata_batch, service_perfdata_fd, service_perfdata_file) == 0) {
 				close(service_perfdata_fd);
 				service_perfdata_fd = -1;
 				wproc_run_callback(processed_command_line, perfdata_timeout, xpddefault_process_service_job_handler, NULL, &mac);
@@ -693,3 +832,308 @@ static void xpddefault_process_service_perfdata_file(struct nm_event_execution_p
 		nm_free(processed_command_line);
 	}
 }
+
+
+/******************************************************************/
+/******************* PERFORMANCE DATA PARSING *********************/
+/******************************************************************/
+
+#define PERFDATA_SPACE " \t\r\n"
+
+/*
+ * parses a plain decimal number, with either '.' or ',' as decimal
+ * separator, from the start of `str`. Returns a pointer past it, or
+ * NULL if there's no number there.
+ */
+static char *parse_perfdata_number(char *str, double *value)
+{
+	char *p = str, *sep = NULL, saved;
+	int digits = 0;
+
+	if (*p == '-' || *p == '+')
+		p++;
+	for (; (*p >= '0' && *p <= '9') || ((*p == '.' || *p == ',') && !sep); p++) {
+		if (*p == '.' || *p == ',')
+			sep = p;
+		else
+			digits++;
+	}
+	if (!digits)
+		return NULL;
+	if (*p == 'e' || *p == 'E') {
+		char *exp = p + 1;
+		if (*exp == '-' || *exp == '+')
+			exp++;
+		if (*exp >= '0' && *exp <= '9') {
+			for (p = exp; *p >= '0' && *p <= '9'; p++)
+				;
+		}
+	}
+	if (sep)
+		*sep = '.';
+	/* don't let strtod() wander off into hex or "inf" */
+	saved = *p;
+	*p = 0;
+	*value = g_ascii_strtod(str, NULL);
+	*p = saved;
+	if (!isfinite(*value))
+		return NULL;
+	return p;
+}
+
+/* parses a complete field as a number */
+static int parse_perfdata_double(char *field, double *value)
+{
+	char *end = parse_perfdata_number(field, value);
+
+	return end && !*end ? OK : ERROR;
+}
+
+/* parses a [@][start:]end threshold */
+static int parse_perfdata_range(char *field, struct perfdata_range *range)
+{
+	char *colon;
+
+	range->start = 0;
+	range->end = INFINITY;
+	range->inside = FALSE;
+
+	if (*field == '@') {
+		range->inside = TRUE;
+		field++;
+	}
+
+	if ((colon = strchr(field, ':'))) {
+		*colon = 0;
+		if (!strcmp(field, "~"))
+			range->start = -INFINITY;
+		else if (*field && parse_perfdata_double(field, &range->start) != OK)
+			return ERROR;
+		field = colon + 1;
+		if (!*field)
+			return OK;
+	}
+
+	if (parse_perfdata_double(field, &range->end) != OK)
+		return ERROR;
+	if (range->start > range->end)
+		return ERROR;
+
+	return OK;
+}
+
+/* parses the value[UOM];[warn];[crit];[min];[max] part of an item */
+static int parse_perfdata_fields(char *str, struct perfdata_value *pv)
+{
+	char *field, *next, *uom;
+	int i;
+
+	if ((next = strchr(str, ';')))
+		*next++ = 0;
+
+	if (*str == 'U' && !str[1]) {
+		pv->value = NAN;
+		uom = str + 1;
+	} else if (!(uom = parse_perfdata_number(str, &pv->value))) {
+		return ERROR;
+	}
+	if (strspn(uom, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ%") != strlen(uom))
+		return ERROR;
+	pv->uom = uom;
+
+	/*
+	 * thresholds and limits are helpful extras; a broken one
+	 * is left out rather than making us lose the value
+	 */
+	for (i = 0; next && i < 4; i++) {
+		field = next;
+		if ((next = strchr(field, ';')))
+			*next++ = 0;
+		if (!*field)
+			continue;
+
+		switch (i) {
+		case 0:
+			if (parse_perfdata_range(field, &pv->warn) == OK)
+				pv->flags |= PERFDATA_HAS_WARN;
+			break;
+		case 1:
+			if (parse_perfdata_range(field, &pv->crit) == OK)
+				pv->flags |= PERFDATA_HAS_CRIT;
+			break;
+		case 2:
+			if (parse_perfdata_double(field, &pv->min) == OK)
+				pv->flags |= PERFDATA_HAS_MIN;
+			break;
+		case 3:
+			if (parse_perfdata_double(field, &pv->max) == OK)
+				pv->flags |= PERFDATA_HAS_MAX;
+			break;
+		}
+	}
+
+	return OK;
+}
+
+/*
+ * parses performance data as described in the plugin development
+ * guidelines: space separated label=value[UOM];[warn];[crit];[min];[max]
+ * items where the label may be single-quoted, with '' for a quote.
+ * Items that don't make sense are skipped and counted. `pd` must be
+ * released with perfdata_free().
+ */
+int perfdata_parse(const char *str, struct perfdata *pd)
+{
+	unsigned int alloc = 0;
+	char *p;
+
+	memset(pd, 0, sizeof(*pd));
+	if (str == NULL)
+		return 0;
+
+	pd->buf = p = nm_strdup(str);
+	for (;;) {
+		struct perfdata_value pv;
+		char *label, *label_end, *end, saved;
+
+		p += strspn(p, PERFDATA_SPACE);
+		if (!*p)
+			break;
+
+		memset(&pv, 0, sizeof(pv));
+		if (*p == '\'') {
+			char *w;
+
+			label = w = ++p;
+			for (; *p; p++) {
+				if (*p == '\'') {
+					if (p[1] != '\'')
+						break;
+					p++;
+				}
+				*w++ = *p;
+			}
+			if (!*p) {
+				/* unterminated quote, the rest is garbage */
+				pd->malformed++;
+				break;
+			}
+			label_end = w;
+			p++;
+		} else {
+			label = p;
+			p += strcspn(p, "=" PERFDATA_SPACE);
+			label_end = p;
+		}
+
+		end = p + strcspn(p, PERFDATA_SPACE);
+		saved = *end;
+		*end = 0;
+
+		if (*p != '=' || label_end == label || parse_perfdata_fields(p + 1, &pv) != OK) {
+			pd->malformed++;
+		} else {
+			*label_end = 0;
+			pv.label = label;
+			if (pd->count >= alloc) {
+				alloc = alloc ? alloc * 2 : 8;
+				pd->values = nm_realloc(pd->values, alloc * sizeof(*pd->values));
+			}
+			pd->values[pd->count++] = pv;
+		}
+
+		if (!saved)
+			break;
+		p = end + 1;
+	}
+
+	return pd->count;
+}
+
+void perfdata_free(struct perfdata *pd)
+{
+	nm_free(pd->buf);
+	nm_free(pd->values);
+	pd->count = 0;
+}
+
+/* tag values may not contain unescaped commas, equal signs, spaces or backslashes */
+static void line_protocol_tag(GString *out, const char *key, const char *value)
+{
+	g_string_append_c(out, ',');
+	g_string_append(out, key);
+	g_string_append_c(out, '=');
+	for (; *value; value++) {
+		if ((unsigned char)*value < ' ') {
+			g_string_append_c(out, '_');
+			continue;
+		}
+		if (*value == ',' || *value == '=' || *value == ' ' || *value == '\\')
+			g_string_append_c(out, '\\');
+		g_string_append_c(out, *value);
+	}
+}
+
+static void line_protocol_field(GString *out, int *first, const char *key, double value)
+{
+	char buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+	if (!isfinite(value))
+		return;
+	g_string_append_c(out, *first ? ' ' : ',');
+	*first = FALSE;
+	g_string_append(out, key);
+	g_string_append_c(out, '=');
+	g_string_append(out, g_ascii_formatd(buf, sizeof(buf), "%.15g", value));
+}
+
+static void line_protocol_range(GString *out, int *first, const char *name, const struct perfdata_range *range)
+{
+	char key[16];
+
+	snprintf(key, sizeof(key), "%s_lo", name);
+	line_protocol_field(out, first, key, range->start);
+	snprintf(key, sizeof(key), "%s_hi", name);
+	line_protocol_field(out, first, key, range->end);
+	if (range->inside)
+		g_string_append_printf(out, ",%s_inside=t", name);
+}
+
+/*
+ * appends one line per value to `out`, in the InfluxDB line protocol:
+ * perfdata,host=h,service=s,label=l[,unit=u] value=1[,warn_lo=..] <ns>
+ * Values that are undetermined ("U") are left out.
+ */
+void perfdata_line_protocol(GString *out, const char *host_name, const char *service_description, const struct perfdata *pd, const struct timeval *when)
+{
+	unsigned long long ns = (unsigned long long)when->tv_sec * 1000000000ULL + (unsigned long long)when->tv_usec * 1000ULL;
+	unsigned int i;
+
+	for (i = 0; i < pd->count; i++) {
+		const struct perfdata_value *pv = &pd->values[i];
+		int first = TRUE;
+
+		if (isnan(pv->value))
+			continue;
+
+		g_string_append(out, "perfdata");
+		line_protocol_tag(out, "host", host_name);
+		if (service_description)
+			line_protocol_tag(out, "service", service_description);
+		line_protocol_tag(out, "label", pv->label);
+		if (*pv->uom)
+			line_protocol_tag(out, "unit", pv->uom);
+
+		line_protocol_field(out, &first, "value", pv->value);
+		if (pv->flags & PERFDATA_HAS_WARN)
+			line_protocol_range(out, &first, "warn", &pv->warn);
+		if (pv->flags & PERFDATA_HAS_CRIT)
+			line_protocol_range(out, &first, "crit", &pv->crit);
+		if (pv->flags & PERFDATA_HAS_MIN)
+			line_protocol_field(out, &first, "min", pv->min);
+		if (pv->flags & PERFDATA_HAS_MAX)
+			line_protocol_field(out, &first, "max", pv->max);
+
+		g_string_append_printf(out, " %llu\n", ns);
+	}
+}
@@ -10,6 +10,38 @@
 
 NAGIOS_BEGIN_DECL
 
+/* a warning or critical threshold, [@][start:]end */
+struct perfdata_range {
+	double start;               /* -INFINITY for "~" */
+	double end;                 /* INFINITY when left out */
+	int inside;                 /* alert inside the range rather than outside ('@') */
+};
+
+#define PERFDATA_HAS_WARN (1 << 0)
+#define PERFDATA_HAS_CRIT (1 << 1)
+#define PERFDATA_HAS_MIN  (1 << 2)
+#define PERFDATA_HAS_MAX  (1 << 3)
+
+/* one label=value[UOM];[warn];[crit];[min];[max] item */
+struct perfdata_value {
+	const char *label;
+	const char *uom;            /* "" if there's none */
+	double value;               /* NAN if undetermined ("U") */
+	unsigned int flags;         /* PERFDATA_HAS_* for the fields below */
+	struct perfdata_range warn;
+	struct perfdata_range crit;
+	double min;
+	double max;
+};
+
+/* the parsed performance data of one check result */
+struct perfdata {
+	char *buf;                  /* labels and units point into this */
+	struct perfdata_value *values;
+	unsigned int count;
+	unsigned int malformed;     /* items that were skipped */
+};
+
 extern int     perfdata_timeout;
 extern char    *host_perfdata_command;
 extern char    *service_perfdata_command;
@@ -27,6 +59,9 @@ extern char    *host_perfdata_file_processing_command;
 extern char    *service_perfdata_file_processing_command;
 extern int     host_perfdata_process_empty_results;
 extern int     service_perfdata_process_empty_results;
+extern unsigned long perfdata_flush_size;
+extern unsigned long perfdata_flush_interval;
+extern unsigned long perfdata_max_buffer_size;
 
 int initialize_performance_data(const char *);    /* initializes performance data */
 int cleanup_performance_data(void);               /* cleans up performance data */
@@ -34,5 +69,9 @@ int cleanup_performance_data(void);               /* cleans up performance data
 int update_host_performance_data(host *);         /* updates host performance data */
 int update_service_performance_data(service *);   /* updates service performance data */
 
+int perfdata_parse(const char *str, struct perfdata *pd);  /* parses a perfdata string, returns the number of values */
+void perfdata_free(struct perfdata *pd);
+void perfdata_line_protocol(GString *out, const char *host_name, const char *service_description, const struct perfdata *pd, const struct timeval *when);
+
 NAGIOS_END_DECL
 #endif
@@ -2,6 +2,8 @@
 #include "lib/libnaemon.h"
 #include "lib/nsock.h"
 #include "query-handler.h"
+#include "query-state.h"
+#include "nerd.h"
 #include "events.h"
 #include "utils.h"
 #include "logging.h"
@@ -12,8 +14,17 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <string.h>
+#include <stdarg.h>
+#include <sys/time.h>
 #include <glib.h>
 
+/* stop handling a client's requests while this much of its responses is still unsent */
+#define QH_OUTPUT_HIGH_WATER (256 * 1024)
+/* and disconnect it if it piles up this many bytes of requests meanwhile */
+#define QH_MAX_PENDING_INPUT (1024 * 1024)
+/* or if it doesn't read any of its responses for this many seconds */
+#define QH_STALL_TIMEOUT 30
+
 /* A registered handler */
 struct query_handler {
 	const char *name; /* also "address" of this handler. Must be unique */
@@ -21,6 +32,35 @@ struct query_handler {
 	unsigned int options;
 	qh_handler handler;
 	struct query_handler *prev_qh, *next_qh;
+	unsigned long requests; /* number of requests handled */
+	unsigned long errors; /* number of those answered with an error code */
+	double time_total, time_max; /* seconds spent in the handler function */
+};
+
+/* A connected client */
+struct qh_client {
+	int sd;
+	nm_bufferqueue *bq; /* requests we haven't gotten to yet */
+	int waiting; /* for the client to catch up with its responses */
+	timed_event *event; /* disconnects it if it doesn't */
+	size_t stalled_at; /* bytes it had left to read when we last looked */
+	int closing; /* closed as soon as its responses have been sent */
+	struct qh_job *job; /* request running on the thread pool, if any */
+	int hungup; /* socket is gone, but the job still points here */
+};
+
+/* A request handed to the thread pool */
+struct qh_job {
+	struct qh_client *client;
+	int sd;
+	struct query_handler *qh;
+	char *buf; /* the request as received */
+	char *query; /* points into buf */
+	unsigned int query_len;
+	char *query_copy; /* what the handler gets, as it may scribble on it */
+	GString *out; /* what the handler wrote */
+	int result;
+	double elapsed;
 };
 
 static struct query_handler *qhandlers;
@@ -29,15 +69,31 @@ static unsigned int qh_running;
 unsigned int qh_max_running = 0; /* defaults to unlimited */
 static GHashTable *qh_table;
 
+/*
+ * Handlers registered with QH_OPT_THREADSAFE run on this pool, if
+ * query_handler_threads is set. They hold qh_object_lock for reading
+ * while they run, and the main thread holds it for writing at all
+ * times except while it's blocked in the I/O broker's wait, with no
+ * event or input handler running. They therefore see the objects as
+ * the main thread left them, never half-way through a change. Results come back through
+ * qh_pool_done, and a byte on qh_pool_pipe wakes up the main thread
+ * to send them.
+ */
+static GThreadPool *qh_pool;
+static GAsyncQueue *qh_pool_done;
+static int qh_pool_pipe[2] = { -1, -1 };
+static GRWLock qh_object_lock;
+static GPrivate qh_thread_job = G_PRIVATE_INIT(NULL); /* the job a pool thread is running */
+
 /* the echo service. stupid, but useful for testing */
 static int qh_echo(int sd, char *buf, unsigned int len)
 {
 	if (!strcmp(buf, "help")) {
-		nsock_printf_nul(sd,
-		                 "Query handler that simply echoes back what you send it.");
+		qh_printf_nul(sd,
+		              "Query handler that simply echoes back what you send it.");
 		return 0;
 	}
-	return nsock_write_all(sd, buf, len);
+	return qh_write(sd, buf, len);
 }
 
 static struct query_handler *qh_find_handler(const char *name)
@@ -90,25 +146,176 @@ const char *qh_strerror(int code)
 	return "Unknown error";
 }
 
-static int qh_input(int sd, int events, void *bq_)
+static int qh_vprintf(int sd, const char *fmt, va_list ap, int plus)
 {
-	nm_bufferqueue *bq = (nm_bufferqueue *)bq_;
-	int result;
-	size_t len;
-	unsigned int query_len = 0;
-	char *buf, *space;
-	struct query_handler *qh;
-	char *handler = NULL, *query = NULL;
+	char *buf = NULL;
+	int len;
+
+	len = vasprintf(&buf, fmt, ap);
+	if (len < 0)
+		return len;
+	len = qh_write(sd, buf, len + plus) < 0 ? -1 : len + plus;
+	free(buf);
+	return len;
+}
 
-	result = nm_bufferqueue_read(bq, sd);
-	/* disconnect? */
-	if (result == 0 || (result < 0 && errno == EPIPE)) {
-		nm_bufferqueue_destroy(bq);
-		iobroker_close(nagios_iobs, sd);
-		qh_running--;
+int qh_printf(int sd, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = qh_vprintf(sd, fmt, ap, 0);
+	va_end(ap);
+	return ret;
+}
+
+int qh_printf_nul(int sd, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = qh_vprintf(sd, fmt, ap, 1);
+	va_end(ap);
+	return ret;
+}
+
+int qh_write(int sd, const char *buf, size_t len)
+{
+	struct qh_job *job = g_private_get(&qh_thread_job);
+
+	/* on the thread pool, output goes back to the main thread with the result */
+	if (job) {
+		if (sd != job->sd)
+			return -1;
+		g_string_append_len(job->out, buf, len);
 		return 0;
 	}
 
+	/* not one of ours, or taken over by someone who writes to it directly */
+	if (!iobroker_is_registered(nagios_iobs, sd))
+		return nsock_write_all(sd, buf, len);
+
+	return iobroker_write_packet(nagios_iobs, sd, (char *)buf, len) ? -1 : 0;
+}
+
+static void qh_client_destroy(struct qh_client *client)
+{
+	timed_event *ev = client->event;
+
+	client->event = NULL;
+	if (ev)
+		destroy_event(ev);
+	nm_bufferqueue_destroy(client->bq);
+	nm_free(client);
+	qh_running--;
+}
+
+static void qh_client_close(struct qh_client *client)
+{
+	nerd_unsubscribe_all(client->sd);
+	iobroker_close(nagios_iobs, client->sd);
+	if (client->job) {
+		/* freed when the job is done with it */
+		client->hungup = TRUE;
+		return;
+	}
+	qh_client_destroy(client);
+}
+
+int qh_in_thread_pool(void)
+{
+	return g_private_get(&qh_thread_job) != NULL;
+}
+
+/* iobroker wait hooks: only the blocking wait itself, never an input handler, runs unlocked */
+static void qh_unlock_objects(void)
+{
+	if (qh_pool)
+		g_rw_lock_writer_unlock(&qh_object_lock);
+}
+
+static void qh_lock_objects(void)
+{
+	if (qh_pool)
+		g_rw_lock_writer_lock(&qh_object_lock);
+}
+
+static void qh_job_destroy(struct qh_job *job)
+{
+	nm_free(job->buf);
+	nm_free(job->query_copy);
+	g_string_free(job->out, TRUE);
+	nm_free(job);
+}
+
+static void qh_pool_run(gpointer data, gpointer user_data)
+{
+	struct qh_job *job = (struct qh_job *)data;
+	struct timeval start, stop;
+	char c = 0;
+
+	g_private_set(&qh_thread_job, job);
+	g_rw_lock_reader_lock(&qh_object_lock);
+	gettimeofday(&start, NULL);
+	job->result = job->qh->handler(job->sd, job->query_copy, job->query_len);
+	gettimeofday(&stop, NULL);
+	g_rw_lock_reader_unlock(&qh_object_lock);
+	g_private_set(&qh_thread_job, NULL);
+	job->elapsed = tv_delta_f(&start, &stop);
+
+	g_async_queue_push(qh_pool_done, job);
+	/* if the pipe is full, the main thread has a wakeup coming anyway */
+	if (write(qh_pool_pipe[1], &c, 1) < 0)
+		return;
+}
+
+/*
+ * Accounts for a request its handler is done with and acts on the
+ * result. Takes ownership of buf. Returns QH_TAKEOVER if the client
+ * is gone because its handler took over the socket, and 0 otherwise.
+ */
+static int qh_request_done(struct qh_client *client, struct query_handler *qh, char *buf, int result, double elapsed)
+{
+	qh->requests++;
+	qh->time_total += elapsed;
+	if (elapsed > qh->time_max)
+		qh->time_max = elapsed;
+	if (result >= 300 || result == -1)
+		qh->errors++;
+
+	if (result >= 100) {
+		qh_printf_nul(client->sd, "%d: %s", result, qh_strerror(result));
+	}
+
+	if (result >= 300 || (*buf != '@' && result != QH_TAKEOVER) || result == QH_CLOSE || result == -1) {
+		/* error code, one-shot query the handler is done with or a handler asking us to close */
+		client->closing = TRUE;
+	} else if (result == QH_TAKEOVER || result == 101) {
+		/* the handler (or the protocol it switched to) owns the socket now */
+		nm_free(buf);
+		qh_client_destroy(client);
+		return QH_TAKEOVER;
+	}
+	nm_free(buf);
+	return 0;
+}
+
+/*
+ * Runs a single request, or hands it to the thread pool, in which case
+ * client->job is set until it's done. Returns what qh_request_done()
+ * does.
+ */
+static int qh_request(struct qh_client *client, char *buf, size_t len)
+{
+	int sd = client->sd, result;
+	unsigned int query_len = 0;
+	char *space;
+	struct query_handler *qh;
+	char *handler = NULL, *query = NULL;
+	struct timeval start, stop;
+
 	/*
 	 * A request looks like this: '[@|#]<qh>[<SP>][<query>]\0'.
 	 * That is, optional '#' (oneshot) or '@' (keepalive),
@@ -118,11 +325,6 @@ static int qh_input(int sd, int events, void *bq_)
 	 * will be thrown.
 	 */
 
-	/* Use data up to the first nul byte */
-	nm_bufferqueue_unshift_to_delim(bq, "\0", 1, &len, (void **)&buf);
-	if (!buf)
-		return 0;
-
 	/* Identify handler part and any magic query bytes */
 	if (*buf == '@' || *buf == '#') {
 		handler = buf + 1;
@@ -143,10 +345,9 @@ static int qh_input(int sd, int events, void *bq_)
 	/* locate the handler */
 	if (!(qh = qh_find_handler(handler))) {
 		/* not found. that's a 404 */
-		nsock_printf(sd, "404: %s: No such handler", handler);
+		qh_printf(sd, "404: %s: No such handler", handler);
 		nm_free(buf);
-		iobroker_close(nagios_iobs, sd);
-		nm_bufferqueue_destroy(bq);
+		client->closing = TRUE;
 		return 0;
 	}
 
@@ -154,37 +355,259 @@ static int qh_input(int sd, int events, void *bq_)
 	while (query_len > 0 && (query[query_len - 1] == 0 || query[query_len - 1] == '\n'))
 		query[--query_len] = 0;
 
+	if (qh_pool && (qh->options & QH_OPT_THREADSAFE)) {
+		struct qh_job *job = nm_calloc(1, sizeof(*job));
+
+		job->client = client;
+		job->sd = sd;
+		job->qh = qh;
+		job->buf = buf;
+		job->query = query;
+		job->query_len = query_len;
+		job->query_copy = nm_malloc(query_len + 1);
+		memcpy(job->query_copy, query, query_len + 1);
+		job->out = g_string_new(NULL);
+		client->job = job;
+		g_thread_pool_push(qh_pool, job, NULL);
+		return 0;
+	}
+
 	/* now pass the query to the handler */
-	if ((result = qh->handler(sd, query, query_len)) >= 100) {
-		nsock_printf_nul(sd, "%d: %s", result, qh_strerror(result));
+	gettimeofday(&start, NULL);
+	result = qh->handler(sd, query, query_len);
+	gettimeofday(&stop, NULL);
+
+	return qh_request_done(client, qh, buf, result, tv_delta_f(&start, &stop));
+}
+
+static void qh_client_drained(int sd, void *client_);
+static void qh_client_stalled(struct nm_event_execution_properties *evprop);
+
+/*
+ * Handles every complete request the client has sent, so pipelined
+ * requests on keepalive connections are answered in one go, but stops
+ * while too much of the responses is still waiting to be written and
+ * resumes once the client has read them.
+ */
+static void qh_client_process(struct qh_client *client)
+{
+	size_t len;
+	char *buf;
+
+	/* already waiting for it, or for the thread pool */
+	if (client->waiting || client->job)
+		return;
+
+	while (!client->closing) {
+		if (iobroker_get_pending_output(nagios_iobs, client->sd) >= QH_OUTPUT_HIGH_WATER)
+			break;
+
+		/* Use data up to the first nul byte */
+		nm_bufferqueue_unshift_to_delim(client->bq, "\0", 1, &len, (void **)&buf);
+		if (!buf)
+			return;
+
+		if (qh_request(client, buf, len) == QH_TAKEOVER || client->job)
+			return;
 	}
 
-	if (result >= 300 || *buf != '@') {
-		/* error code or one-shot query */
-		nm_free(buf);
-		iobroker_close(nagios_iobs, sd);
-		nm_bufferqueue_destroy(bq);
+	/* sleep until the socket has taken it all, rather than polling for it. Closing clients with nothing left to send are done */
+	if (iobroker_wait_drained(nagios_iobs, client->sd, qh_client_drained)) {
+		qh_client_close(client);
+		return;
+	}
+	client->waiting = TRUE;
+	if (!client->event) {
+		client->stalled_at = iobroker_get_pending_output(nagios_iobs, client->sd);
+		client->event = schedule_event(QH_STALL_TIMEOUT, qh_client_stalled, client);
+	}
+}
+
+static void qh_client_drained(int sd, void *client_)
+{
+	struct qh_client *client = (struct qh_client *)client_;
+	timed_event *ev = client->event;
+
+	client->waiting = FALSE;
+	client->event = NULL;
+	if (ev)
+		destroy_event(ev);
+	if (client->closing) {
+		qh_client_close(client);
+		return;
+	}
+	qh_client_process(client);
+}
+
+static void qh_client_stalled(struct nm_event_execution_properties *evprop)
+{
+	struct qh_client *client = evprop->user_data;
+	size_t pending;
+
+	if (evprop->execution_type != EVENT_EXEC_NORMAL) {
+		/* the event queue is going away. If we cancelled it ourselves, there's nothing left to do */
+		if (client->event) {
+			client->event = NULL;
+			qh_client_close(client);
+		}
+		return;
+	}
+	client->event = NULL;
+
+	pending = iobroker_get_pending_output(nagios_iobs, client->sd);
+	if (pending >= client->stalled_at) {
+		nm_log(NSLOG_RUNTIME_WARNING, "qh: Client on socket %d read nothing of its %lu bytes of responses in %d seconds. Disconnecting\n",
+		       client->sd, (unsigned long)pending, QH_STALL_TIMEOUT);
+		qh_client_close(client);
+		return;
+	}
+	client->stalled_at = pending;
+	client->event = schedule_event(QH_STALL_TIMEOUT, qh_client_stalled, client);
+}
+
+static void qh_job_done(struct qh_job *job)
+{
+	struct qh_client *client = job->client;
+	struct timeval start, stop;
+	int result = job->result;
+	double elapsed = job->elapsed;
+	char *buf = job->buf;
+
+	client->job = NULL;
+	if (client->hungup) {
+		qh_client_destroy(client);
+		qh_job_destroy(job);
+		return;
+	}
+
+	job->buf = NULL;
+	if (result == QH_RUN_IN_MAIN) {
+		/* the handler can't do this one on the thread pool after all */
+		gettimeofday(&start, NULL);
+		result = job->qh->handler(client->sd, job->query, job->query_len);
+		gettimeofday(&stop, NULL);
+		elapsed += tv_delta_f(&start, &stop);
+	} else if (job->out->len) {
+		qh_write(client->sd, job->out->str, job->out->len);
+	}
+
+	result = qh_request_done(client, job->qh, buf, result, elapsed);
+	qh_job_destroy(job);
+	if (result != QH_TAKEOVER)
+		qh_client_process(client);
+}
+
+static int qh_pool_input(int fd, int events, void *arg)
+{
+	struct qh_job *job;
+	char buf[128];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	while ((job = g_async_queue_try_pop(qh_pool_done)))
+		qh_job_done(job);
+	return 0;
+}
+
+static int qh_pool_init(void)
+{
+	GError *error = NULL;
+
+	if (query_handler_threads <= 0 || qh_pool)
 		return 0;
+
+	if (pipe(qh_pool_pipe) < 0) {
+		nm_log(NSLOG_RUNTIME_ERROR, "qh: Failed to create thread pool wakeup pipe: %s\n", strerror(errno));
+		return -1;
+	}
+	(void)fcntl(qh_pool_pipe[0], F_SETFL, O_NONBLOCK);
+	(void)fcntl(qh_pool_pipe[1], F_SETFL, O_NONBLOCK);
+	(void)fcntl(qh_pool_pipe[0], F_SETFD, FD_CLOEXEC);
+	(void)fcntl(qh_pool_pipe[1], F_SETFD, FD_CLOEXEC);
+	if (iobroker_register(nagios_iobs, qh_pool_pipe[0], NULL, qh_pool_input) < 0) {
+		nm_log(NSLOG_RUNTIME_ERROR, "qh: Failed to register thread pool wakeup pipe with I/O broker\n");
+		close(qh_pool_pipe[0]);
+		close(qh_pool_pipe[1]);
+		qh_pool_pipe[0] = qh_pool_pipe[1] = -1;
+		return -1;
 	}
-	nm_free(buf);
 
-	/* check for magic handler codes */
-	switch (result) {
-	case QH_CLOSE: /* oneshot handler */
-	case -1:       /* general error */
-		iobroker_close(nagios_iobs, sd);
-	/* fallthrough */
-	case QH_TAKEOVER: /* handler takes over */
-	case 101:         /* switch protocol (takeover + message) */
-		nm_bufferqueue_destroy(bq);
-		break;
+	qh_pool = g_thread_pool_new(qh_pool_run, NULL, query_handler_threads, TRUE, &error);
+	if (!qh_pool) {
+		nm_log(NSLOG_RUNTIME_ERROR, "qh: Failed to start %d query handler threads: %s\n", query_handler_threads, error->message);
+		g_clear_error(&error);
+		iobroker_close(nagios_iobs, qh_pool_pipe[0]);
+		close(qh_pool_pipe[1]);
+		qh_pool_pipe[0] = qh_pool_pipe[1] = -1;
+		return -1;
 	}
+	qh_pool_done = g_async_queue_new();
+
+	/* the main thread has it from here on, except while it's idle */
+	g_rw_lock_writer_lock(&qh_object_lock);
+	iobroker_set_wait_hooks(nagios_iobs, qh_unlock_objects, qh_lock_objects);
+	nm_log(NSLOG_INFO_MESSAGE, "qh: Running thread-safe query handlers on %d threads\n", query_handler_threads);
 	return 0;
 }
 
-static int qh_registration_input(int sd, int events, void *bq_)
+static void qh_pool_deinit(void)
+{
+	struct qh_job *job;
+
+	if (!qh_pool)
+		return;
+
+	/* let what's queued finish, then throw the results away */
+	iobroker_set_wait_hooks(nagios_iobs, NULL, NULL);
+	g_rw_lock_writer_unlock(&qh_object_lock);
+	g_thread_pool_free(qh_pool, FALSE, TRUE);
+	qh_pool = NULL;
+	while ((job = g_async_queue_try_pop(qh_pool_done))) {
+		if (job->client->hungup)
+			qh_client_destroy(job->client);
+		else
+			job->client->job = NULL;
+		qh_job_destroy(job);
+	}
+	g_async_queue_unref(qh_pool_done);
+	qh_pool_done = NULL;
+	iobroker_close(nagios_iobs, qh_pool_pipe[0]);
+	close(qh_pool_pipe[1]);
+	qh_pool_pipe[0] = qh_pool_pipe[1] = -1;
+}
+
+static int qh_input(int sd, int events, void *client_)
 {
-	nm_bufferqueue *bq = (nm_bufferqueue *)bq_;
+	struct qh_client *client = (struct qh_client *)client_;
+	int result;
+
+	result = nm_bufferqueue_read(client->bq, sd);
+	/* disconnect? */
+	if (result == 0 || (result < 0 && errno == EPIPE)) {
+		qh_client_close(client);
+		return 0;
+	}
+
+	/* nothing more will be answered on this one, so don't keep it around */
+	if (client->closing) {
+		nm_bufferqueue_drop(client->bq, nm_bufferqueue_get_available(client->bq));
+		return 0;
+	}
+
+	if (nm_bufferqueue_get_available(client->bq) > QH_MAX_PENDING_INPUT) {
+		nm_log(NSLOG_RUNTIME_WARNING, "qh: Client on socket %d sent %lu bytes of requests without reading the responses. Disconnecting\n",
+		       sd, (unsigned long)nm_bufferqueue_get_available(client->bq));
+		qh_client_close(client);
+		return 0;
+	}
+
+	qh_client_process(client);
+	return 0;
+}
+
+static int qh_registration_input(int sd, int events, void *arg)
+{
+	struct qh_client *client;
 	struct sockaddr sa;
 	socklen_t slen = 0;
 	int nsd, result;
@@ -197,22 +620,26 @@ static int qh_registration_input(int sd, int events, void *bq_)
 		return 0;
 	}
 
-	if (!(bq = nm_bufferqueue_create())) {
+	client = nm_calloc(1, sizeof(*client));
+	client->sd = nsd;
+	if (!(client->bq = nm_bufferqueue_create())) {
 		nm_log(NSLOG_RUNTIME_ERROR, "qh: Failed to create iocache for inbound request\n");
 		nsock_printf(nsd, "500: Internal server error");
+		nm_free(client);
 		close(nsd);
 		return 0;
 	}
 
 	/*
-	 * @todo: Stash the iocache and the socket in some
-	 * addressable list so we can release them on deinit
+	 * @todo: Stash the clients in some addressable list so
+	 * we can release them on deinit
 	 */
-	result = iobroker_register(nagios_iobs, nsd, bq, qh_input);
+	result = iobroker_register(nagios_iobs, nsd, client, qh_input);
 	if (result < 0) {
 		nm_log(NSLOG_RUNTIME_ERROR, "qh: Failed to register input socket %d with I/O broker: %s; errno=%d (%s)\n",
 		       nsd, iobroker_strerror(result), errno, strerror(errno));
-		nm_bufferqueue_destroy(bq);
+		nm_bufferqueue_destroy(client->bq);
+		nm_free(client);
 		close(nsd);
 		return 0;
 	}
@@ -288,6 +715,7 @@ int qh_register_handler(const char *name, const char *description, unsigned int
 
 void qh_deinit(const char *path)
 {
+	qh_pool_deinit();
 	g_hash_table_destroy(qh_table);
 	qh_table = NULL;
 	qhandlers = NULL;
@@ -301,24 +729,38 @@ static int qh_help(int sd, char *buf, unsigned int len)
 	struct query_handler *qh;
 
 	if (!*buf || !strcmp(buf, "help")) {
-		nsock_printf_nul(sd,
-		                 "  help <name>   show help for handler <name>\n"
-		                 "  help list     list registered handlers\n");
+		qh_printf_nul(sd,
+		              "  help <name>   show help for handler <name>\n"
+		              "  help list     list registered handlers\n"
+		              "  help stats    show request counts and handler latency\n");
 		return 0;
 	}
 
 	if (!strcmp(buf, "list")) {
 		for (qh = qhandlers; qh; qh = qh->next_qh) {
-			nsock_printf(sd, "%-10s %s\n", qh->name, qh->description ? qh->description : "(No description available)");
+			qh_printf(sd, "%-10s %s\n", qh->name, qh->description ? qh->description : "(No description available)");
 		}
-		nsock_printf(sd, "%c", 0);
+		qh_write(sd, "", 1);
+		return 0;
+	}
+
+	if (!strcmp(buf, "stats")) {
+		qh_printf(sd, "connections=%u;max_connections=%u\n", qh_running, qh_max_running);
+		for (qh = qhandlers; qh; qh = qh->next_qh) {
+			qh_printf(sd, "handler=%s;requests=%lu;errors=%lu;avg_time=%.6f;max_time=%.6f\n",
+			          qh->name, qh->requests, qh->errors,
+			          qh->requests ? qh->time_total / qh->requests : 0.0, qh->time_max);
+		}
+		qh_write(sd, "", 1);
 		return 0;
 	}
 
 	if (!(qh = qh_find_handler(buf))) {
-		nsock_printf_nul(sd, "No handler named '%s' is registered\n", buf);
+		qh_printf_nul(sd, "No handler named '%s' is registered\n", buf);
+	} else if (qh_in_thread_pool() && !(qh->options & QH_OPT_THREADSAFE)) {
+		return QH_RUN_IN_MAIN;
 	} else if (qh->handler(sd, "help", 4) > 200) {
-		nsock_printf_nul(sd, "The handler %s doesn't have any help yet.", buf);
+		qh_printf_nul(sd, "The handler %s doesn't have any help yet.", buf);
 	}
 
 	return 0;
@@ -330,11 +772,11 @@ static int qh_command(int sd, char *buf, unsigned int len)
 	int mode;
 
 	if (!*buf || !strcmp(buf, "help")) {
-		nsock_printf_nul(sd, "Query handler for naemon commands.\n"
-		                 "Available commands:\n"
-		                 "  run <command>     Run a command\n"
-		                 "  runkv <command>   Run a command as escaped kvvec\n"
-		                );
+		qh_printf_nul(sd, "Query handler for naemon commands.\n"
+		              "Available commands:\n"
+		              "  run <command>     Run a command\n"
+		              "  runkv <command>   Run a command as escaped kvvec\n"
+		             );
 		return 0;
 	}
 	if ((space = memchr(buf, ' ', len)))
@@ -352,7 +794,7 @@ static int qh_command(int sd, char *buf, unsigned int len)
 			if (res == OK) {
 				return 200;
 			} else {
-				nsock_printf_nul(sd, "400: %s\n", error->message);
+				qh_printf_nul(sd, "400: %s\n", error->message);
 				g_clear_error(&error);
 				return 0;
 			}
@@ -403,8 +845,12 @@ int qh_init(const char *path)
 
 	/* now register our the in-core handlers */
 	qh_register_handler("command", "Naemon external commands interface", 0, qh_command);
-	qh_register_handler("echo", "The Echo Service - What You Put Is What You Get", 0, qh_echo);
-	qh_register_handler("help", "Help for the query handler", 0, qh_help);
+	qh_register_handler("echo", "The Echo Service - What You Put Is What You Get", QH_OPT_THREADSAFE, qh_echo);
+	qh_register_handler("help", "Help for the query handler", QH_OPT_THREADSAFE, qh_help);
+	qh_state_init();
+
+	/* without it, thread-safe handlers just run in the main thread */
+	qh_pool_init();
 
 	return 0;
 }
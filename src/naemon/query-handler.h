@@ -10,6 +10,10 @@
 #define QH_CLOSE     1  /* we should close the socket */
 #define QH_INVALID   2  /* invalid query. Log and close */
 #define QH_TAKEOVER  3  /* handler will take full control. de-register but don't close */
+#define QH_RUN_IN_MAIN 4 /* can't answer this on the thread pool. Call again from the main thread */
+
+/* options for qh_register_handler() */
+#define QH_OPT_THREADSAFE (1 << 0) /* only reads state and only answers through qh_write() and friends */
 
 NAGIOS_BEGIN_DECL
 
@@ -20,6 +24,29 @@ int qh_init(const char *path);
 void qh_deinit(const char *path);
 int qh_register_handler(const char *name, const char *description, unsigned int options, qh_handler handler);
 const char *qh_strerror(int code);
+
+/*
+ * Handlers should answer through these rather than writing to the
+ * socket themselves. They queue the response behind whatever the
+ * client hasn't read yet, so pipelined requests are answered in order
+ * and a slow reader never blocks the core. They return what their
+ * nsock_*() counterparts do.
+ */
+int qh_write(int sd, const char *buf, size_t len);
+int qh_printf(int sd, const char *fmt, ...)
+	__attribute__((__format__(__printf__, 2, 3)));
+int qh_printf_nul(int sd, const char *fmt, ...)
+	__attribute__((__format__(__printf__, 2, 3)));
+
+/*
+ * With query_handler_threads set, handlers registered with
+ * QH_OPT_THREADSAFE run on a thread pool, while the main thread waits
+ * for I/O. They must not change anything, touch the I/O broker or take
+ * over the socket, but can return QH_RUN_IN_MAIN for requests that
+ * need to. qh_in_thread_pool() tells them where they're running.
+ */
+int qh_in_thread_pool(void);
+
 void qh_close_socket(void);
 
 NAGIOS_END_DECL
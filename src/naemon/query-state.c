@@ -0,0 +1,969 @@
+/*
+ * The "state" query handler
+ *
+ * Answers queries like
+ *
+ *   services;columns=host_name,service_description,current_state;filter=current_state!=0
+ *
+ * with a line of column names followed by one tab separated line per
+ * matching object, read straight from the objects in memory. This is
+ * what status.dat pollers really want, without waiting for the next
+ * status file dump or parsing all of it.
+ *
+ * Results are rendered a slice at a time from a timed event, and only
+ * while the client keeps up with what we've already queued for it, so
+ * neither a large result nor a slow reader can stall the core.
+ */
+
+#include "config.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <glib.h>
+#include "lib/libnaemon.h"
+#include "common.h"
+#include "comments.h"
+#include "downtime.h"
+#include "events.h"
+#include "globals.h"
+#include "logging.h"
+#include "objects_host.h"
+#include "objects_service.h"
+#include "query-handler.h"
+#include "query-state.h"
+#include "utils.h"
+#include "nm_alloc.h"
+
+/* objects looked at per event, and how much output may wait for the client */
+#define STATE_ROWS_PER_SLICE 500
+#define STATE_OUTPUT_HIGH_WATER (64 * 1024)
+/* clients that read nothing of it for this many seconds are dropped */
+#define STATE_STALL_TIMEOUT 30
+/* queries looking at more objects than this are streamed from the main thread */
+#define STATE_THREADED_MAX_OBJECTS 5000
+
+enum state_column_type {
+	STATE_COL_STR,
+	STATE_COL_INT,
+	STATE_COL_ULONG,
+	STATE_COL_TIME,
+	STATE_COL_DOUBLE,
+	STATE_COL_STATS, /* int[3], 1/5/15 minute counts as in status.dat */
+};
+
+static const char *state_column_type_names[] = {
+	"string", "int", "int", "time", "float", "stats",
+};
+
+struct state_column {
+	const char *name;
+	enum state_column_type type;
+	size_t offset;
+};
+
+/* program status, copied when the query starts */
+struct program_state {
+	const char *version;
+	int nagios_pid;
+	int daemon_mode;
+	time_t program_start;
+	time_t last_log_rotation;
+	int enable_notifications;
+	int active_service_checks_enabled;
+	int passive_service_checks_enabled;
+	int active_host_checks_enabled;
+	int passive_host_checks_enabled;
+	int enable_event_handlers;
+	int obsess_over_services;
+	int obsess_over_hosts;
+	int check_service_freshness;
+	int check_host_freshness;
+	int enable_flap_detection;
+	int process_performance_data;
+	unsigned long modified_host_attributes;
+	unsigned long modified_service_attributes;
+	unsigned long next_comment_id;
+	unsigned long next_downtime_id;
+	unsigned long next_event_id;
+	int check_stats[MAX_CHECK_STATS_TYPES][3];
+};
+
+enum state_filter_op {
+	STATE_OP_EQ,
+	STATE_OP_NE,
+	STATE_OP_LT,
+	STATE_OP_LE,
+	STATE_OP_GT,
+	STATE_OP_GE,
+	STATE_OP_MATCH,
+	STATE_OP_NOMATCH,
+};
+
+/* two-character operators first, so "<=" isn't taken for "<" */
+static const struct {
+	const char *str;
+	enum state_filter_op op;
+} state_filter_ops[] = {
+	{ "!=", STATE_OP_NE },
+	{ "<=", STATE_OP_LE },
+	{ ">=", STATE_OP_GE },
+	{ "!~", STATE_OP_NOMATCH },
+	{ "=", STATE_OP_EQ },
+	{ "<", STATE_OP_LT },
+	{ ">", STATE_OP_GT },
+	{ "~", STATE_OP_MATCH },
+};
+
+struct state_filter {
+	const struct state_column *column;
+	enum state_filter_op op;
+	const char *value;
+	double number;
+};
+
+struct state_stream;
+
+struct state_table {
+	const char *name;
+	const struct state_column *columns;
+	unsigned int num_columns;
+	void (*start)(struct state_stream *stream);
+	const void *(*next_row)(struct state_stream *stream);
+};
+
+struct state_stream {
+	int sd;
+	char *query; /* filter values point into this */
+	const struct state_table *table;
+	const struct state_column **columns;
+	unsigned int num_columns;
+	struct state_filter *filters;
+	unsigned int num_filters;
+	unsigned long limit; /* 0 means all rows */
+	unsigned long rows;
+	unsigned int pos; /* index into the object array or ids */
+	GArray *ids; /* comment and downtime ids, taken when the query starts */
+	struct program_state program;
+	int started, done;
+	GString *out;
+	timed_event *event; /* renders the next slice */
+	timed_event *stall_event; /* drops the client if it stops reading */
+	size_t stalled_at; /* output it had left to read when we last looked */
+};
+
+#define PROGRAM_COLUMN(type, member) { #member, STATE_COL_##type, offsetof(struct program_state, member) }
+#define PROGRAM_STATS_COLUMN(name, idx) { name, STATE_COL_STATS, offsetof(struct program_state, check_stats[idx]) }
+
+static const struct state_column program_columns[] = {
+	PROGRAM_COLUMN(STR, version),
+	PROGRAM_COLUMN(INT, nagios_pid),
+	PROGRAM_COLUMN(INT, daemon_mode),
+	PROGRAM_COLUMN(TIME, program_start),
+	PROGRAM_COLUMN(TIME, last_log_rotation),
+	PROGRAM_COLUMN(INT, enable_notifications),
+	PROGRAM_COLUMN(INT, active_service_checks_enabled),
+	PROGRAM_COLUMN(INT, passive_service_checks_enabled),
+	PROGRAM_COLUMN(INT, active_host_checks_enabled),
+	PROGRAM_COLUMN(INT, passive_host_checks_enabled),
+	PROGRAM_COLUMN(INT, enable_event_handlers),
+	PROGRAM_COLUMN(INT, obsess_over_services),
+	PROGRAM_COLUMN(INT, obsess_over_hosts),
+	PROGRAM_COLUMN(INT, check_service_freshness),
+	PROGRAM_COLUMN(INT, check_host_freshness),
+	PROGRAM_COLUMN(INT, enable_flap_detection),
+	PROGRAM_COLUMN(INT, process_performance_data),
+	PROGRAM_COLUMN(ULONG, modified_host_attributes),
+	PROGRAM_COLUMN(ULONG, modified_service_attributes),
+	PROGRAM_COLUMN(ULONG, next_comment_id),
+	PROGRAM_COLUMN(ULONG, next_downtime_id),
+	PROGRAM_COLUMN(ULONG, next_event_id),
+	PROGRAM_STATS_COLUMN("active_scheduled_host_check_stats", ACTIVE_SCHEDULED_HOST_CHECK_STATS),
+	PROGRAM_STATS_COLUMN("active_ondemand_host_check_stats", ACTIVE_ONDEMAND_HOST_CHECK_STATS),
+	PROGRAM_STATS_COLUMN("passive_host_check_stats", PASSIVE_HOST_CHECK_STATS),
+	PROGRAM_STATS_COLUMN("active_scheduled_service_check_stats", ACTIVE_SCHEDULED_SERVICE_CHECK_STATS),
+	PROGRAM_STATS_COLUMN("active_ondemand_service_check_stats", ACTIVE_ONDEMAND_SERVICE_CHECK_STATS),
+	PROGRAM_STATS_COLUMN("passive_service_check_stats", PASSIVE_SERVICE_CHECK_STATS),
+	PROGRAM_STATS_COLUMN("cached_host_check_stats", ACTIVE_CACHED_HOST_CHECK_STATS),
+	PROGRAM_STATS_COLUMN("cached_service_check_stats", ACTIVE_CACHED_SERVICE_CHECK_STATS),
+	PROGRAM_STATS_COLUMN("external_command_stats", EXTERNAL_COMMAND_STATS),
+	PROGRAM_STATS_COLUMN("parallel_host_check_stats", PARALLEL_HOST_CHECK_STATS),
+	PROGRAM_STATS_COLUMN("serial_host_check_stats", SERIAL_HOST_CHECK_STATS),
+};
+
+/* column names follow status.dat where there is one */
+#define HOST_COLUMN(name, type, member) { name, STATE_COL_##type, offsetof(struct host, member) }
+
+static const struct state_column host_columns[] = {
+	HOST_COLUMN("host_name", STR, name),
+	HOST_COLUMN("display_name", STR, display_name),
+	HOST_COLUMN("alias", STR, alias),
+	HOST_COLUMN("address", STR, address),
+	HOST_COLUMN("modified_attributes", ULONG, modified_attributes),
+	HOST_COLUMN("check_command", STR, check_command),
+	HOST_COLUMN("check_period", STR, check_period),
+	HOST_COLUMN("notification_period", STR, notification_period),
+	HOST_COLUMN("check_interval", DOUBLE, check_interval),
+	HOST_COLUMN("retry_interval", DOUBLE, retry_interval),
+	HOST_COLUMN("event_handler", STR, event_handler),
+	HOST_COLUMN("has_been_checked", INT, has_been_checked),
+	HOST_COLUMN("is_executing", INT, is_executing),
+	HOST_COLUMN("check_execution_time", DOUBLE, execution_time),
+	HOST_COLUMN("check_latency", DOUBLE, latency),
+	HOST_COLUMN("check_type", INT, check_type),
+	HOST_COLUMN("check_source", STR, check_source),
+	HOST_COLUMN("current_state", INT, current_state),
+	HOST_COLUMN("last_state", INT, last_state),
+	HOST_COLUMN("last_hard_state", INT, last_hard_state),
+	HOST_COLUMN("last_event_id", ULONG, last_event_id),
+	HOST_COLUMN("current_event_id", ULONG, current_event_id),
+	HOST_COLUMN("current_problem_id", STR, current_problem_id),
+	HOST_COLUMN("last_problem_id", STR, last_problem_id),
+	HOST_COLUMN("problem_start", TIME, problem_start),
+	HOST_COLUMN("problem_end", TIME, problem_end),
+	HOST_COLUMN("plugin_output", STR, plugin_output),
+	HOST_COLUMN("long_plugin_output", STR, long_plugin_output),
+	HOST_COLUMN("performance_data", STR, perf_data),
+	HOST_COLUMN("last_check", TIME, last_check),
+	HOST_COLUMN("next_check", TIME, next_check),
+	HOST_COLUMN("check_options", INT, check_options),
+	HOST_COLUMN("current_attempt", INT, current_attempt),
+	HOST_COLUMN("max_attempts", INT, max_attempts),
+	HOST_COLUMN("state_type", INT, state_type),
+	HOST_COLUMN("last_state_change", TIME, last_state_change),
+	HOST_COLUMN("last_hard_state_change", TIME, last_hard_state_change),
+	HOST_COLUMN("last_time_up", TIME, last_time_up),
+	HOST_COLUMN("last_time_down", TIME, last_time_down),
+	HOST_COLUMN("last_time_unreachable", TIME, last_time_unreachable),
+	HOST_COLUMN("last_notification", TIME, last_notification),
+	HOST_COLUMN("next_notification", TIME, next_notification),
+	HOST_COLUMN("no_more_notifications", INT, no_more_notifications),
+	HOST_COLUMN("current_notification_number", INT, current_notification_number),
+	HOST_COLUMN("current_notification_id", STR, current_notification_id),
+	HOST_COLUMN("notifications_enabled", INT, notifications_enabled),
+	HOST_COLUMN("problem_has_been_acknowledged", INT, problem_has_been_acknowledged),
+	HOST_COLUMN("acknowledgement_type", INT, acknowledgement_type),
+	HOST_COLUMN("acknowledgement_end_time", TIME, acknowledgement_end_time),
+	HOST_COLUMN("active_checks_enabled", INT, checks_enabled),
+	HOST_COLUMN("passive_checks_enabled", INT, accept_passive_checks),
+	HOST_COLUMN("event_handler_enabled", INT, event_handler_enabled),
+	HOST_COLUMN("flap_detection_enabled", INT, flap_detection_enabled),
+	HOST_COLUMN("process_performance_data", INT, process_performance_data),
+	HOST_COLUMN("obsess", INT, obsess),
+	HOST_COLUMN("is_flapping", INT, is_flapping),
+	HOST_COLUMN("percent_state_change", DOUBLE, percent_state_change),
+	HOST_COLUMN("scheduled_downtime_depth", INT, scheduled_downtime_depth),
+	HOST_COLUMN("total_services", INT, total_services),
+};
+
+#define SERVICE_COLUMN(name, type, member) { name, STATE_COL_##type, offsetof(struct service, member) }
+
+static const struct state_column service_columns[] = {
+	SERVICE_COLUMN("host_name", STR, host_name),
+	SERVICE_COLUMN("service_description", STR, description),
+	SERVICE_COLUMN("display_name", STR, display_name),
+	SERVICE_COLUMN("modified_attributes", ULONG, modified_attributes),
+	SERVICE_COLUMN("check_command", STR, check_command),
+	SERVICE_COLUMN("check_period", STR, check_period),
+	SERVICE_COLUMN("notification_period", STR, notification_period),
+	SERVICE_COLUMN("check_interval", DOUBLE, check_interval),
+	SERVICE_COLUMN("retry_interval", DOUBLE, retry_interval),
+	SERVICE_COLUMN("event_handler", STR, event_handler),
+	SERVICE_COLUMN("has_been_checked", INT, has_been_checked),
+	SERVICE_COLUMN("is_executing", INT, is_executing),
+	SERVICE_COLUMN("is_volatile", INT, is_volatile),
+	SERVICE_COLUMN("check_execution_time", DOUBLE, execution_time),
+	SERVICE_COLUMN("check_latency", DOUBLE, latency),
+	SERVICE_COLUMN("check_type", INT, check_type),
+	SERVICE_COLUMN("check_source", STR, check_source),
+	SERVICE_COLUMN("current_state", INT, current_state),
+	SERVICE_COLUMN("last_state", INT, last_state),
+	SERVICE_COLUMN("last_hard_state", INT, last_hard_state),
+	SERVICE_COLUMN("last_event_id", ULONG, last_event_id),
+	SERVICE_COLUMN("current_event_id", ULONG, current_event_id),
+	SERVICE_COLUMN("current_problem_id", STR, current_problem_id),
+	SERVICE_COLUMN("last_problem_id", STR, last_problem_id),
+	SERVICE_COLUMN("problem_start", TIME, problem_start),
+	SERVICE_COLUMN("problem_end", TIME, problem_end),
+	SERVICE_COLUMN("current_attempt", INT, current_attempt),
+	SERVICE_COLUMN("max_attempts", INT, max_attempts),
+	SERVICE_COLUMN("state_type", INT, state_type),
+	SERVICE_COLUMN("last_state_change", TIME, last_state_change),
+	SERVICE_COLUMN("last_hard_state_change", TIME, last_hard_state_change),
+	SERVICE_COLUMN("last_time_ok", TIME, last_time_ok),
+	SERVICE_COLUMN("last_time_warning", TIME, last_time_warning),
+	SERVICE_COLUMN("last_time_unknown", TIME, last_time_unknown),
+	SERVICE_COLUMN("last_time_critical", TIME, last_time_critical),
+	SERVICE_COLUMN("plugin_output", STR, plugin_output),
+	SERVICE_COLUMN("long_plugin_output", STR, long_plugin_output),
+	SERVICE_COLUMN("performance_data", STR, perf_data),
+	SERVICE_COLUMN("last_check", TIME, last_check),
+	SERVICE_COLUMN("next_check", TIME, next_check),
+	SERVICE_COLUMN("check_options", INT, check_options),
+	SERVICE_COLUMN("current_notification_number", INT, current_notification_number),
+	SERVICE_COLUMN("current_notification_id", STR, current_notification_id),
+	SERVICE_COLUMN("last_notification", TIME, last_notification),
+	SERVICE_COLUMN("next_notification", TIME, next_notification),
+	SERVICE_COLUMN("no_more_notifications", INT, no_more_notifications),
+	SERVICE_COLUMN("notifications_enabled", INT, notifications_enabled),
+	SERVICE_COLUMN("active_checks_enabled", INT, checks_enabled),
+	SERVICE_COLUMN("passive_checks_enabled", INT, accept_passive_checks),
+	SERVICE_COLUMN("event_handler_enabled", INT, event_handler_enabled),
+	SERVICE_COLUMN("problem_has_been_acknowledged", INT, problem_has_been_acknowledged),
+	SERVICE_COLUMN("acknowledgement_type", INT, acknowledgement_type),
+	SERVICE_COLUMN("acknowledgement_end_time", TIME, acknowledgement_end_time),
+	SERVICE_COLUMN("flap_detection_enabled", INT, flap_detection_enabled),
+	SERVICE_COLUMN("process_performance_data", INT, process_performance_data),
+	SERVICE_COLUMN("obsess", INT, obsess),
+	SERVICE_COLUMN("is_flapping", INT, is_flapping),
+	SERVICE_COLUMN("percent_state_change", DOUBLE, percent_state_change),
+	SERVICE_COLUMN("scheduled_downtime_depth", INT, scheduled_downtime_depth),
+};
+
+#define COMMENT_COLUMN(type, member) { #member, STATE_COL_##type, offsetof(struct comment, member) }
+
+static const struct state_column comment_columns[] = {
+	COMMENT_COLUMN(ULONG, comment_id),
+	COMMENT_COLUMN(INT, comment_type),
+	COMMENT_COLUMN(STR, host_name),
+	COMMENT_COLUMN(STR, service_description),
+	COMMENT_COLUMN(INT, entry_type),
+	COMMENT_COLUMN(INT, source),
+	COMMENT_COLUMN(INT, persistent),
+	COMMENT_COLUMN(TIME, entry_time),
+	COMMENT_COLUMN(INT, expires),
+	COMMENT_COLUMN(TIME, expire_time),
+	COMMENT_COLUMN(STR, author),
+	COMMENT_COLUMN(STR, comment_data),
+};
+
+#define DOWNTIME_COLUMN(type, member) { #member, STATE_COL_##type, offsetof(struct scheduled_downtime, member) }
+
+static const struct state_column downtime_columns[] = {
+	DOWNTIME_COLUMN(ULONG, downtime_id),
+	DOWNTIME_COLUMN(INT, type),
+	DOWNTIME_COLUMN(STR, host_name),
+	DOWNTIME_COLUMN(STR, service_description),
+	DOWNTIME_COLUMN(ULONG, comment_id),
+	DOWNTIME_COLUMN(TIME, entry_time),
+	DOWNTIME_COLUMN(TIME, start_time),
+	DOWNTIME_COLUMN(TIME, flex_downtime_start),
+	DOWNTIME_COLUMN(TIME, end_time),
+	DOWNTIME_COLUMN(ULONG, triggered_by),
+	DOWNTIME_COLUMN(INT, fixed),
+	DOWNTIME_COLUMN(ULONG, duration),
+	DOWNTIME_COLUMN(INT, is_in_effect),
+	DOWNTIME_COLUMN(INT, start_notification_sent),
+	DOWNTIME_COLUMN(STR, author),
+	DOWNTIME_COLUMN(STR, comment),
+};
+
+static void start_program_rows(struct state_stream *stream)
+{
+	struct program_state *p = &stream->program;
+	int i;
+
+	generate_check_stats();
+
+	p->version = VERSION;
+	p->nagios_pid = nagios_pid;
+	p->daemon_mode = daemon_mode;
+	p->program_start = program_start;
+	p->last_log_rotation = last_log_rotation;
+	p->enable_notifications = enable_notifications;
+	p->active_service_checks_enabled = execute_service_checks;
+	p->passive_service_checks_enabled = accept_passive_service_checks;
+	p->active_host_checks_enabled = execute_host_checks;
+	p->passive_host_checks_enabled = accept_passive_host_checks;
+	p->enable_event_handlers = enable_event_handlers;
+	p->obsess_over_services = obsess_over_services;
+	p->obsess_over_hosts = obsess_over_hosts;
+	p->check_service_freshness = check_service_freshness;
+	p->check_host_freshness = check_host_freshness;
+	p->enable_flap_detection = enable_flap_detection;
+	p->process_performance_data = process_performance_data;
+	p->modified_host_attributes = modified_host_process_attributes;
+	p->modified_service_attributes = modified_service_process_attributes;
+	p->next_comment_id = next_comment_id;
+	p->next_downtime_id = next_downtime_id;
+	p->next_event_id = next_event_id;
+	for (i = 0; i < MAX_CHECK_STATS_TYPES; i++)
+		memcpy(p->check_stats[i], check_statistics[i].minute_stats, sizeof(p->check_stats[i]));
+}
+
+static const void *next_program_row(struct state_stream *stream)
+{
+	return stream->pos++ ? NULL : &stream->program;
+}
+
+static const void *next_host_row(struct state_stream *stream)
+{
+	return stream->pos < num_objects.hosts ? host_ary[stream->pos++] : NULL;
+}
+
+static const void *next_service_row(struct state_stream *stream)
+{
+	return stream->pos < num_objects.services ? service_ary[stream->pos++] : NULL;
+}
+
+/*
+ * comments and downtimes may come and go while we're streaming, so
+ * we remember their ids and skip the ones that are gone by the time
+ * we get to them
+ */
+static void start_comment_rows(struct state_stream *stream)
+{
+	GHashTableIter iter;
+	gpointer comment_;
+
+	stream->ids = g_array_new(FALSE, FALSE, sizeof(unsigned long));
+	if (!comment_hashtable)
+		return;
+	g_hash_table_iter_init(&iter, comment_hashtable);
+	while (g_hash_table_iter_next(&iter, NULL, &comment_))
+		g_array_append_val(stream->ids, ((struct comment *)comment_)->comment_id);
+}
+
+static const void *next_comment_row(struct state_stream *stream)
+{
+	struct comment *temp_comment;
+
+	while (stream->pos < stream->ids->len) {
+		temp_comment = find_comment(g_array_index(stream->ids, unsigned long, stream->pos++), HOST_COMMENT | SERVICE_COMMENT);
+		if (temp_comment)
+			return temp_comment;
+	}
+	return NULL;
+}
+
+static void start_downtime_rows(struct state_stream *stream)
+{
+	struct scheduled_downtime *temp_downtime;
+
+	stream->ids = g_array_new(FALSE, FALSE, sizeof(unsigned long));
+	for (temp_downtime = scheduled_downtime_list; temp_downtime; temp_downtime = temp_downtime->next)
+		g_array_append_val(stream->ids, temp_downtime->downtime_id);
+}
+
+static const void *next_downtime_row(struct state_stream *stream)
+{
+	struct scheduled_downtime *temp_downtime;
+
+	while (stream->pos < stream->ids->len) {
+		temp_downtime = find_downtime(ANY_DOWNTIME, g_array_index(stream->ids, unsigned long, stream->pos++));
+		if (temp_downtime)
+			return temp_downtime;
+	}
+	return NULL;
+}
+
+static const struct state_table state_tables[] = {
+	{ "program", program_columns, ARRAY_SIZE(program_columns), start_program_rows, next_program_row },
+	{ "hosts", host_columns, ARRAY_SIZE(host_columns), NULL, next_host_row },
+	{ "services", service_columns, ARRAY_SIZE(service_columns), NULL, next_service_row },
+	{ "comments", comment_columns, ARRAY_SIZE(comment_columns), start_comment_rows, next_comment_row },
+	{ "downtimes", downtime_columns, ARRAY_SIZE(downtime_columns), start_downtime_rows, next_downtime_row },
+};
+
+static const struct state_table *find_state_table(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(state_tables); i++) {
+		if (!strcmp(state_tables[i].name, name))
+			return &state_tables[i];
+	}
+	return NULL;
+}
+
+static const struct state_column *find_state_column(const struct state_table *table, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < table->num_columns; i++) {
+		if (!strcmp(table->columns[i].name, name))
+			return &table->columns[i];
+	}
+	return NULL;
+}
+
+static double column_number(const struct state_column *col, const void *obj)
+{
+	const char *p = (const char *)obj + col->offset;
+
+	switch (col->type) {
+	case STATE_COL_INT:
+		return *(const int *)p;
+	case STATE_COL_ULONG:
+		return *(const unsigned long *)p;
+	case STATE_COL_TIME:
+		return *(const time_t *)p;
+	case STATE_COL_DOUBLE:
+		return *(const double *)p;
+	default:
+		return 0.0;
+	}
+}
+
+static const char *column_string(const struct state_column *col, const void *obj)
+{
+	const char *str = *(const char * const *)((const char *)obj + col->offset);
+
+	return str ? str : "";
+}
+
+/* backslash, tab and newline are all that can break a row */
+static void append_escaped(GString *out, const char *str)
+{
+	size_t len;
+
+	for (;;) {
+		len = strcspn(str, "\\\t\n");
+		g_string_append_len(out, str, len);
+		str += len;
+		if (!*str)
+			return;
+		g_string_append_c(out, '\\');
+		g_string_append_c(out, *str == '\t' ? 't' : *str == '\n' ? 'n' : '\\');
+		str++;
+	}
+}
+
+static void render_value(GString *out, const struct state_column *col, const void *obj)
+{
+	const char *p = (const char *)obj + col->offset;
+	const int *stats;
+
+	switch (col->type) {
+	case STATE_COL_STR:
+		append_escaped(out, column_string(col, obj));
+		break;
+	case STATE_COL_INT:
+		g_string_append_printf(out, "%d", *(const int *)p);
+		break;
+	case STATE_COL_ULONG:
+		g_string_append_printf(out, "%lu", *(const unsigned long *)p);
+		break;
+	case STATE_COL_TIME:
+		g_string_append_printf(out, "%lu", (unsigned long)*(const time_t *)p);
+		break;
+	case STATE_COL_DOUBLE:
+		g_string_append_printf(out, "%.3f", *(const double *)p);
+		break;
+	case STATE_COL_STATS:
+		stats = (const int *)p;
+		g_string_append_printf(out, "%d,%d,%d", stats[0], stats[1], stats[2]);
+		break;
+	}
+}
+
+static int filter_matches(const struct state_filter *f, const void *obj)
+{
+	int cmp;
+
+	if (f->column->type == STATE_COL_STR) {
+		const char *str = column_string(f->column, obj);
+
+		if (f->op == STATE_OP_MATCH)
+			return strstr(str, f->value) != NULL;
+		if (f->op == STATE_OP_NOMATCH)
+			return strstr(str, f->value) == NULL;
+		cmp = strcmp(str, f->value);
+	} else {
+		double num = column_number(f->column, obj);
+
+		cmp = num < f->number ? -1 : num > f->number;
+	}
+
+	switch (f->op) {
+	case STATE_OP_EQ: return cmp == 0;
+	case STATE_OP_NE: return cmp != 0;
+	case STATE_OP_LT: return cmp < 0;
+	case STATE_OP_LE: return cmp <= 0;
+	case STATE_OP_GT: return cmp > 0;
+	case STATE_OP_GE: return cmp >= 0;
+	default: return FALSE;
+	}
+}
+
+static int parse_state_columns(struct state_stream *stream, char *list, char **error)
+{
+	const struct state_column *col;
+	char *name, *next;
+
+	nm_free(stream->columns);
+	stream->num_columns = 0;
+	stream->columns = nm_malloc(sizeof(*stream->columns) * (strlen(list) / 2 + 1));
+	for (name = list; name; name = next) {
+		if ((next = strchr(name, ',')))
+			*next++ = 0;
+		if (!(col = find_state_column(stream->table, name))) {
+			*error = g_strdup_printf("No column '%s' in %s", name, stream->table->name);
+			return ERROR;
+		}
+		stream->columns[stream->num_columns++] = col;
+	}
+	return OK;
+}
+
+static int parse_state_filter(struct state_stream *stream, char *str, char **error)
+{
+	struct state_filter *f;
+	size_t len = strcspn(str, "!<>=~");
+	char *end;
+	unsigned int i;
+
+	stream->filters = nm_realloc(stream->filters, sizeof(*stream->filters) * (stream->num_filters + 1));
+	f = &stream->filters[stream->num_filters];
+
+	for (i = 0; i < ARRAY_SIZE(state_filter_ops); i++) {
+		if (!strncmp(str + len, state_filter_ops[i].str, strlen(state_filter_ops[i].str)))
+			break;
+	}
+	if (i == ARRAY_SIZE(state_filter_ops)) {
+		*error = g_strdup_printf("No operator in filter '%s'", str);
+		return ERROR;
+	}
+	f->op = state_filter_ops[i].op;
+	f->value = str + len + strlen(state_filter_ops[i].str);
+
+	str[len] = 0;
+	if (!(f->column = find_state_column(stream->table, str))) {
+		*error = g_strdup_printf("No column '%s' in %s", str, stream->table->name);
+		return ERROR;
+	}
+	if (f->column->type == STATE_COL_STATS) {
+		*error = g_strdup_printf("Can't filter on column '%s'", str);
+		return ERROR;
+	}
+	if (f->column->type != STATE_COL_STR) {
+		if (f->op == STATE_OP_MATCH || f->op == STATE_OP_NOMATCH) {
+			*error = g_strdup_printf("Column '%s' is a number, and ~ only works on strings", str);
+			return ERROR;
+		}
+		f->number = strtod(f->value, &end);
+		if (!*f->value || *end) {
+			*error = g_strdup_printf("Column '%s' is a number, and '%s' isn't", str, f->value);
+			return ERROR;
+		}
+	}
+	stream->num_filters++;
+	return OK;
+}
+
+static void state_stream_destroy(struct state_stream *stream)
+{
+	if (!stream)
+		return;
+	if (stream->ids)
+		g_array_free(stream->ids, TRUE);
+	if (stream->out)
+		g_string_free(stream->out, TRUE);
+	nm_free(stream->columns);
+	nm_free(stream->filters);
+	nm_free(stream->query);
+	nm_free(stream);
+}
+
+/* <table>[;columns=<col>[,<col>...]][;filter=<col><op><value>]...[;limit=<n>] */
+static struct state_stream *state_stream_create(const char *query, char **error)
+{
+	struct state_stream *stream;
+	char *opt, *next, *end;
+	unsigned int i;
+
+	stream = nm_calloc(1, sizeof(*stream));
+	stream->sd = -1;
+	stream->query = nm_strdup(query);
+	if ((next = strchr(stream->query, ';')))
+		*next++ = 0;
+
+	if (!(stream->table = find_state_table(stream->query))) {
+		*error = g_strdup_printf("No table named '%s'", stream->query);
+		state_stream_destroy(stream);
+		return NULL;
+	}
+
+	for (opt = next; opt; opt = next) {
+		if ((next = strchr(opt, ';')))
+			*next++ = 0;
+		if (!strncmp(opt, "columns=", 8)) {
+			if (parse_state_columns(stream, opt + 8, error) != OK)
+				break;
+		} else if (!strncmp(opt, "filter=", 7)) {
+			if (parse_state_filter(stream, opt + 7, error) != OK)
+				break;
+		} else if (!strncmp(opt, "limit=", 6)) {
+			stream->limit = strtoul(opt + 6, &end, 10);
+			if (!opt[6] || *end) {
+				*error = g_strdup_printf("Invalid limit '%s'", opt + 6);
+				break;
+			}
+		} else if (*opt) {
+			*error = g_strdup_printf("Unknown option '%s'", opt);
+			break;
+		}
+	}
+	if (opt) {
+		state_stream_destroy(stream);
+		return NULL;
+	}
+
+	if (!stream->columns) {
+		stream->num_columns = stream->table->num_columns;
+		stream->columns = nm_malloc(sizeof(*stream->columns) * stream->num_columns);
+		for (i = 0; i < stream->num_columns; i++)
+			stream->columns[i] = &stream->table->columns[i];
+	}
+
+	stream->out = g_string_sized_new(STATE_OUTPUT_HIGH_WATER / 4);
+	if (stream->table->start)
+		stream->table->start(stream);
+
+	return stream;
+}
+
+/*
+ * appends the header (first time around) and the rows for the next
+ * max_objects objects to out. Returns TRUE once there are no more.
+ */
+static int state_stream_render(struct state_stream *stream, GString *out, unsigned int max_objects)
+{
+	const void *obj;
+	unsigned int i, x;
+
+	if (!stream->started) {
+		for (x = 0; x < stream->num_columns; x++) {
+			if (x)
+				g_string_append_c(out, '\t');
+			g_string_append(out, stream->columns[x]->name);
+		}
+		g_string_append_c(out, '\n');
+		stream->started = TRUE;
+	}
+
+	for (i = 0; i < max_objects; i++) {
+		if (stream->limit && stream->rows >= stream->limit)
+			return TRUE;
+		if (!(obj = stream->table->next_row(stream)))
+			return TRUE;
+
+		for (x = 0; x < stream->num_filters; x++) {
+			if (!filter_matches(&stream->filters[x], obj))
+				break;
+		}
+		if (x < stream->num_filters)
+			continue;
+
+		for (x = 0; x < stream->num_columns; x++) {
+			if (x)
+				g_string_append_c(out, '\t');
+			render_value(out, stream->columns[x], obj);
+		}
+		g_string_append_c(out, '\n');
+		stream->rows++;
+	}
+	return FALSE;
+}
+
+static void state_stream_close(struct state_stream *stream)
+{
+	timed_event *ev = stream->event, *stall_ev = stream->stall_event;
+
+	stream->event = stream->stall_event = NULL;
+	if (ev)
+		destroy_event(ev);
+	if (stall_ev)
+		destroy_event(stall_ev);
+	iobroker_close(nagios_iobs, stream->sd);
+	state_stream_destroy(stream);
+}
+
+static void state_stream_slice(struct nm_event_execution_properties *evprop);
+static void state_stream_stalled(struct nm_event_execution_properties *evprop);
+static void state_stream_drained(int sd, void *arg);
+
+static void state_stream_continue(struct state_stream *stream)
+{
+	size_t pending = iobroker_get_pending_output(nagios_iobs, stream->sd);
+
+	if (!stream->done && pending < STATE_OUTPUT_HIGH_WATER) {
+		g_string_truncate(stream->out, 0);
+		if ((stream->done = state_stream_render(stream, stream->out, STATE_ROWS_PER_SLICE)))
+			g_string_append_c(stream->out, 0);
+		if (stream->out->len)
+			iobroker_write_packet(nagios_iobs, stream->sd, stream->out->str, stream->out->len);
+		pending = iobroker_get_pending_output(nagios_iobs, stream->sd);
+	}
+
+	/* the client is keeping up, so carry on with the next slice */
+	if (!stream->done && pending < STATE_OUTPUT_HIGH_WATER) {
+		stream->event = schedule_event(0, state_stream_slice, stream);
+		return;
+	}
+
+	/* leave it be until the client has caught up, without polling for it */
+	if (iobroker_wait_drained(nagios_iobs, stream->sd, state_stream_drained)) {
+		log_debug_info(DEBUGL_IPC, 1, "qh: state: Sent %lu %s rows to socket %d\n", stream->rows, stream->table->name, stream->sd);
+		state_stream_close(stream);
+		return;
+	}
+	if (!stream->stall_event) {
+		stream->stalled_at = pending;
+		stream->stall_event = schedule_event(STATE_STALL_TIMEOUT, state_stream_stalled, stream);
+	}
+}
+
+static void state_stream_slice(struct nm_event_execution_properties *evprop)
+{
+	struct state_stream *stream = evprop->user_data;
+
+	if (evprop->execution_type != EVENT_EXEC_NORMAL) {
+		/* the event queue is going away. If we cancelled it ourselves, there's nothing left to do */
+		if (stream->event) {
+			stream->event = NULL;
+			state_stream_close(stream);
+		}
+		return;
+	}
+	stream->event = NULL;
+	state_stream_continue(stream);
+}
+
+static void state_stream_drained(int sd, void *arg)
+{
+	struct state_stream *stream = (struct state_stream *)arg;
+	timed_event *ev = stream->stall_event;
+
+	stream->stall_event = NULL;
+	if (ev)
+		destroy_event(ev);
+	state_stream_continue(stream);
+}
+
+static void state_stream_stalled(struct nm_event_execution_properties *evprop)
+{
+	struct state_stream *stream = evprop->user_data;
+	size_t pending;
+
+	if (evprop->execution_type != EVENT_EXEC_NORMAL) {
+		if (stream->stall_event) {
+			stream->stall_event = NULL;
+			state_stream_close(stream);
+		}
+		return;
+	}
+	stream->stall_event = NULL;
+
+	pending = iobroker_get_pending_output(nagios_iobs, stream->sd);
+	if (pending >= stream->stalled_at) {
+		nm_log(NSLOG_RUNTIME_WARNING, "qh: state: Client on socket %d read nothing of its %s rows in %d seconds. Disconnecting\n",
+		       stream->sd, stream->table->name, STATE_STALL_TIMEOUT);
+		state_stream_close(stream);
+		return;
+	}
+	stream->stalled_at = pending;
+	stream->stall_event = schedule_event(STATE_STALL_TIMEOUT, state_stream_stalled, stream);
+}
+
+/* there's nothing more to ask for, so the only input we expect is the hangup */
+static int state_stream_input(int sd, int events, void *arg)
+{
+	struct state_stream *stream = (struct state_stream *)arg;
+	char buf[512];
+	ssize_t len;
+
+	len = read(sd, buf, sizeof(buf));
+	if (len > 0 || (len < 0 && (errno == EAGAIN || errno == EINTR)))
+		return 0;
+
+	log_debug_info(DEBUGL_IPC, 1, "qh: state: Socket %d hung up after %lu %s rows\n", sd, stream->rows, stream->table->name);
+	state_stream_close(stream);
+	return 0;
+}
+
+static void qh_state_columns(int sd, const char *name)
+{
+	const struct state_table *table;
+	unsigned int i;
+
+	if (!(table = find_state_table(name))) {
+		qh_printf_nul(sd, "400: No table named '%s'\n", name);
+		return;
+	}
+	for (i = 0; i < table->num_columns; i++)
+		qh_printf(sd, "%s\t%s\n", table->columns[i].name, state_column_type_names[table->columns[i].type]);
+	qh_write(sd, "", 1);
+}
+
+static int qh_state(int sd, char *buf, unsigned int len)
+{
+	struct state_stream *stream;
+	char *error = NULL;
+
+	if (!*buf || !strcmp(buf, "help")) {
+		qh_printf_nul(sd, "Query handler for program, host, service, comment and downtime state.\n"
+		              "  <table>[;columns=<col>[,<col>...]][;filter=<col><op><value>]...[;limit=<n>]\n"
+		              "                     Show the given columns (default all) of the objects\n"
+		              "                     in <table> that pass all filters\n"
+		              "  columns <table>    List the columns of <table> and their types\n"
+		              "Tables are program, hosts, services, comments and downtimes. Filter\n"
+		              "operators are =, !=, <, <=, > and >=, plus ~ (contains) and !~ for\n"
+		              "string columns.\n"
+		              "The reply is a line of column names followed by one tab separated line\n"
+		              "per object, with backslash, tab and newline escaped as \\\\, \\t and \\n.\n"
+		              "It ends with a nul byte, after which the connection is closed. Hanging\n"
+		              "up before that cancels the query.\n"
+		             );
+		return 0;
+	}
+
+	if (!strncmp(buf, "columns ", 8)) {
+		qh_state_columns(sd, buf + 8);
+		return 0;
+	}
+
+	if (!(stream = state_stream_create(buf, &error))) {
+		qh_printf_nul(sd, "400: %s\n", error);
+		g_free(error);
+		return 0;
+	}
+
+	if (qh_in_thread_pool()) {
+		GString *out;
+
+		/* generating the check statistics updates them, so leave it to main */
+		if (!strcmp(stream->table->name, "program")) {
+			state_stream_destroy(stream);
+			return QH_RUN_IN_MAIN;
+		}
+
+		out = g_string_new(NULL);
+		if (!state_stream_render(stream, out, STATE_THREADED_MAX_OBJECTS)) {
+			g_string_free(out, TRUE);
+			state_stream_destroy(stream);
+			return QH_RUN_IN_MAIN;
+		}
+		qh_write(sd, out->str, out->len + 1);
+		g_string_free(out, TRUE);
+		state_stream_destroy(stream);
+		return QH_CLOSE;
+	}
+
+	/* we answer from the event loop from here on */
+	iobroker_unregister(nagios_iobs, sd);
+	if (iobroker_register(nagios_iobs, sd, stream, state_stream_input) < 0) {
+		nm_log(NSLOG_RUNTIME_ERROR, "qh: state: Failed to register socket %d with the I/O broker\n", sd);
+		state_stream_destroy(stream);
+		return 500;
+	}
+	stream->sd = sd;
+	stream->event = schedule_event(0, state_stream_slice, stream);
+	return QH_TAKEOVER;
+}
+
+int qh_state_init(void)
+{
+	return qh_register_handler("state", "Program, host, service, comment and downtime state", QH_OPT_THREADSAFE, qh_state);
+}
@@ -0,0 +1,19 @@
+#ifndef _QUERY_STATE_H
+#define _QUERY_STATE_H
+
+#if !defined (_NAEMON_H_INSIDE) && !defined (NAEMON_COMPILATION)
+#error "Only <naemon/naemon.h> can be included directly."
+#endif
+
+NAGIOS_BEGIN_DECL
+
+/*
+ * Registers the "state" query handler, which answers filtered queries
+ * for program, host, service, comment and downtime state straight from
+ * memory, so clients don't have to poll status.dat.
+ */
+int qh_state_init(void);
+
+NAGIOS_END_DECL
+
+#endif
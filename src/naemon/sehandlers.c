@@ -278,7 +278,7 @@ static int run_global_service_event_handler(nagios_macros *mac, service *svc)
 	}
 
 	/* run the command through a worker */
-	result = wproc_run_callback(processed_command, event_handler_timeout, event_handler_job_handler, "Global service", mac);
+	result = wproc_run_check_callback(global_service_event_handler_ptr, processed_command, event_handler_timeout, CHECK_PRIORITY_HANDLER, event_handler_job_handler, "Global service", mac);
 
 	/* check to see if the event handler timed out */
 	if (early_timeout == TRUE)
@@ -359,7 +359,7 @@ static int run_service_event_handler(nagios_macros *mac, service *svc)
 	}
 
 	/* run the command through a worker */
-	result = wproc_run_callback(processed_command, event_handler_timeout, event_handler_job_handler, "Service", mac);
+	result = wproc_run_check_callback(svc->event_handler_ptr, processed_command, event_handler_timeout, CHECK_PRIORITY_HANDLER, event_handler_job_handler, "Service", mac);
 
 	/* check to see if the event handler timed out */
 	if (early_timeout == TRUE)
@@ -479,7 +479,7 @@ static int run_global_host_event_handler(nagios_macros *mac, const host *const h
 	}
 
 	/* run the command through a worker */
-	result = wproc_run_callback(processed_command, event_handler_timeout, event_handler_job_handler, "Global host", mac);
+	result = wproc_run_check_callback(global_host_event_handler_ptr, processed_command, event_handler_timeout, CHECK_PRIORITY_HANDLER, event_handler_job_handler, "Global host", mac);
 
 	/* check for a timeout in the execution of the event handler command */
 	if (early_timeout == TRUE)
@@ -560,7 +560,7 @@ static int run_host_event_handler(nagios_macros *mac, const host *const hst)
 	}
 
 	/* run the command through a worker */
-	result = wproc_run_callback(processed_command, event_handler_timeout, event_handler_job_handler, "Host", mac);
+	result = wproc_run_check_callback(hst->event_handler_ptr, processed_command, event_handler_timeout, CHECK_PRIORITY_HANDLER, event_handler_job_handler, "Host", mac);
 
 	/* check to see if the event handler timed out */
 	if (early_timeout == TRUE)
@@ -57,11 +57,18 @@ char *config_file_dir = NULL;
 char *config_rel_path = NULL;
 
 
+/*
+ * if set, timing points are handed to this instead of being printed,
+ * so benchmarks can record them without scraping stdout
+ */
+void (*timing_point_hook)(double since_first, double since_last, const char *msg) = NULL;
+
 /* silly debug-ish helper used to track down hotspots in config parsing */
 void timing_point(const char *fmt, ...)
 {
 	static struct timeval last = {0, 0}, first = {0, 0};
 	struct timeval now;
+	double since_first = 0.0, since_last = 0.0;
 	va_list ap;
 
 	if (!enable_timing_point)
@@ -70,14 +77,24 @@ void timing_point(const char *fmt, ...)
 	if (first.tv_sec == 0) {
 		tv_set(&first);
 		tv_clone(&last, &first);
-		printf("[0.0000 (+0.0000)] ");
 	} else {
 		tv_set(&now);
-		printf("[%.4f (+%.4f)] ", tv_delta_f(&first, &now), tv_delta_f(&last, &now));
+		since_first = tv_delta_f(&first, &now);
+		since_last = tv_delta_f(&last, &now);
 		tv_clone(&last, &now);
 	}
+
 	va_start(ap, fmt);
-	vprintf(fmt, ap);
+	if (timing_point_hook) {
+		char *msg = NULL;
+		if (vasprintf(&msg, fmt, ap) >= 0) {
+			timing_point_hook(since_first, since_last, msg);
+			free(msg);
+		}
+	} else {
+		printf("[%.4f (+%.4f)] ", since_first, since_last);
+		vprintf(fmt, ap);
+	}
 	va_end(ap);
 }
 
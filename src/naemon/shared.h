@@ -41,6 +41,7 @@ struct object_count {
 extern struct object_count num_objects;
 
 void timing_point(const char *fmt, ...); /* print a message and the time since the first message */
+extern void (*timing_point_hook)(double since_first, double since_last, const char *msg);
 char *my_strtok(char *buffer, const char *tokens);
 char *my_strsep(char **stringp, const char *delim);
 mmapfile *mmap_fopen(const char *filename);
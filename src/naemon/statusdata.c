@@ -2,6 +2,7 @@
 #include "common.h"
 #include "statusdata.h"
 #include "xsddefault.h"
+#include "xsdshm.h"
 #include "broker.h"
 #include "globals.h"
 #include "events.h"
@@ -46,6 +47,9 @@ int initialize_status_data(const char *cfgfile)
 	schedule_event(status_update_interval, update_all_status_data_eventhandler, NULL);
 	schedule_event(5, update_status_data_eventhandler, NULL);
 
+	/* the shared memory segment is optional, so it can't fail startup */
+	xsdshm_initialize_status_data();
+
 	return xsddefault_initialize_status_data(cfgfile);
 }
 
@@ -57,6 +61,7 @@ int update_all_status_data(void)
 
 	broker_aggregated_status_data(NEBTYPE_AGGREGATEDSTATUS_STARTDUMP, NEBFLAG_NONE, NEBATTR_NONE);
 
+	xsdshm_save_status_data();
 	result = xsddefault_save_status_data();
 
 	broker_aggregated_status_data(NEBTYPE_AGGREGATEDSTATUS_ENDDUMP, NEBFLAG_NONE, NEBATTR_NONE);
@@ -67,6 +72,7 @@ int update_all_status_data(void)
 /* cleans up status data before program termination */
 int cleanup_status_data(int delete_status_data)
 {
+	xsdshm_cleanup_status_data(delete_status_data);
 	return xsddefault_cleanup_status_data(delete_status_data);
 }
 
@@ -85,6 +91,7 @@ int update_program_status(int aggregated_dump)
 /* updates host status info */
 int update_host_status(host *hst, int aggregated_dump)
 {
+	xsdshm_update_host(hst);
 
 	if (aggregated_dump == FALSE)
 		broker_host_status(NEBTYPE_HOSTSTATUS_UPDATE, NEBFLAG_NONE, NEBATTR_NONE, hst);
@@ -96,6 +103,7 @@ int update_host_status(host *hst, int aggregated_dump)
 /* updates service status info */
 int update_service_status(service *svc, int aggregated_dump)
 {
+	xsdshm_update_service(svc);
 
 	if (aggregated_dump == FALSE)
 		broker_service_status(NEBTYPE_SERVICESTATUS_UPDATE, NEBFLAG_NONE, NEBATTR_NONE, svc);
@@ -48,7 +48,15 @@ objectlist *objcfg_dirs = NULL;
 int upipe_fd[2];
 
 int num_check_workers = 0; /* auto-decide */
+int max_check_workers = 0; /* no autoscaling */
+int config_load_threads = 0; /* auto-decide */
+unsigned long max_job_output_size = DEFAULT_MAX_JOB_OUTPUT_SIZE;
+unsigned int max_worker_backlog = DEFAULT_MAX_WORKER_BACKLOG;
+int query_handler_threads = 0; /* disabled */
 char *qh_socket_path = NULL; /* disabled */
+char *status_shm = NULL; /* disabled */
+char *worker_listen_address = NULL; /* disabled */
+char *worker_secret_file = NULL;
 
 char *ocsp_command = NULL;
 char *ochp_command = NULL;
@@ -95,6 +103,7 @@ command *global_service_notification_handler_ptr = NULL;
 
 int check_reaper_interval = DEFAULT_CHECK_REAPER_INTERVAL;
 int max_check_reaper_time = DEFAULT_MAX_REAPER_TIME;
+unsigned int check_result_batch_size = DEFAULT_CHECK_RESULT_BATCH_SIZE;
 int service_freshness_check_interval = DEFAULT_FRESHNESS_CHECK_INTERVAL;
 int host_freshness_check_interval = DEFAULT_FRESHNESS_CHECK_INTERVAL;
 
@@ -121,6 +130,7 @@ int use_retained_program_state = TRUE;
 int use_retained_scheduling_info = FALSE;
 int retained_scheduling_randomize_window = DEFAULT_RETAINED_SCHEDULING_RANDOMIZE_WINDOW;
 int retention_scheduling_horizon = DEFAULT_RETENTION_SCHEDULING_HORIZON;
+int check_load_levelling_window = 0;
 char *retention_file = NULL;
 
 unsigned long modified_process_attributes = MODATTR_NONE;
@@ -976,6 +986,7 @@ void free_memory(nagios_macros *mac)
 	destroy_objects_contactgroup();
 	destroy_objects_hostgroup();
 	destroy_objects_servicegroup(TRUE);
+	nm_object_arena_release();
 
 	free_comment_data();
 	free_downtime_data();
@@ -1004,6 +1015,7 @@ void free_memory(nagios_macros *mac)
 	clear_volatile_macros_r(mac);
 
 	free_macrox_names();
+	free_command_templates();
 
 	for (entry = objcfg_files; entry; entry = next) {
 		next = entry->next;
@@ -1034,6 +1046,9 @@ void free_memory(nagios_macros *mac)
 	nm_free(check_result_path);
 	nm_free(command_file);
 	nm_free(qh_socket_path);
+	nm_free(status_shm);
+	nm_free(worker_listen_address);
+	nm_free(worker_secret_file);
 	mac->x[MACRO_COMMANDFILE] = NULL; /* assigned from command_file */
 	nm_free(log_archive_path);
 
@@ -1118,6 +1133,7 @@ int reset_variables(void)
 	use_retained_program_state = TRUE;
 	use_retained_scheduling_info = FALSE;
 	retention_scheduling_horizon = DEFAULT_RETENTION_SCHEDULING_HORIZON;
+	check_load_levelling_window = 0;
 	modified_host_process_attributes = MODATTR_NONE;
 	modified_service_process_attributes = MODATTR_NONE;
 	retained_host_attribute_mask = 0L;
@@ -1129,6 +1145,7 @@ int reset_variables(void)
 
 	check_reaper_interval = DEFAULT_CHECK_REAPER_INTERVAL;
 	max_check_reaper_time = DEFAULT_MAX_REAPER_TIME;
+	check_result_batch_size = DEFAULT_CHECK_RESULT_BATCH_SIZE;
 	max_check_result_file_age = DEFAULT_MAX_CHECK_RESULT_AGE;
 	service_freshness_check_interval = DEFAULT_FRESHNESS_CHECK_INTERVAL;
 	host_freshness_check_interval = DEFAULT_FRESHNESS_CHECK_INTERVAL;
@@ -1181,6 +1198,8 @@ int reset_variables(void)
 	debug_level = DEFAULT_DEBUG_LEVEL;
 	debug_verbosity = DEFAULT_DEBUG_VERBOSITY;
 	max_debug_file_size = DEFAULT_MAX_DEBUG_FILE_SIZE;
+	max_job_output_size = DEFAULT_MAX_JOB_OUTPUT_SIZE;
+	max_worker_backlog = DEFAULT_MAX_WORKER_BACKLOG;
 
 	date_format = DATE_FORMAT_US;
 
@@ -17,9 +17,13 @@
 #include "defaults.h"
 #include "nm_alloc.h"
 #include "events.h"
+#include "checks.h"
 #include "lib/worker.h"
+#include "lib/nsock.h"
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <fcntl.h>
 
 /* perfect hash function for wproc response codes */
 #include "wpres-phash.h"
@@ -30,10 +34,13 @@ struct wproc_worker;
 struct wproc_job {
 	unsigned int id;
 	unsigned int timeout;
+	unsigned long max_output;
 	char *command;
 	void (*callback)(struct wproc_result *, void *, int);
 	void *data;
 	struct wproc_worker *wp;
+	int priority; /**< one of the CHECK_PRIORITY_* classes */
+	struct timeval queued; /**< when it went into the backlog */
 };
 
 struct wproc_list;
@@ -48,6 +55,9 @@ struct wproc_worker {
 	nm_bufferqueue *bq;  /**< bufferqueue for reading from worker */
 	GHashTable *jobs; /**< array of jobs */
 	struct wproc_list *wp_list;
+	int remote; /**< connected over the network, so pid isn't our child */
+	struct worker_session *session; /**< authenticates messages to and from remote workers */
+	int draining; /**< gets no new jobs and is stopped once idle */
 };
 
 struct wproc_list {
@@ -61,11 +71,89 @@ static struct wproc_list workers = {0, 0, NULL};
 static GHashTable *specialized_workers;
 static struct wproc_list *to_remove = NULL;
 
+/* remote workers connect here, see worker_listen_address */
+static int remote_listen_sock = -1;
+static char *remote_secret;
+static size_t remote_secret_len;
+
+/* a network connection that hasn't registered as a worker yet */
+struct remote_registration {
+	int sd;
+	nm_bufferqueue *bq;
+	timed_event *timeout; /* hangs up on peers that take too long */
+	char challenge[WORKER_CHALLENGE_LEN + 1];
+};
+static GQueue remote_pending = G_QUEUE_INIT;
+
+/* the most jobs we hand a single worker at once, whatever it says */
+#define WPROC_MAX_JOBS_LIMIT 10000
+
+/* longest registration request we wait for before giving up on a peer */
+#define REMOTE_REGISTRATION_MAX 4096
+/* seconds a peer gets to register, and how many may be at it at once */
+#define REMOTE_REGISTRATION_TIMEOUT 10
+#define REMOTE_REGISTRATION_PENDING_MAX 16
+
+/*
+ * Autoscaling of the core worker pool, see max_check_workers. Every
+ * WPROC_SCALE_INTERVAL seconds we look at how much of the pool's
+ * capacity is in use. Refused jobs or WPROC_SCALE_UP_PCT in use grows
+ * the pool by half (at least one worker), while staying below
+ * WPROC_SCALE_DOWN_PCT for WPROC_SCALE_DOWN_TICKS intervals in a row
+ * drains one worker.
+ */
+#define WPROC_SCALE_INTERVAL 5
+#define WPROC_SCALE_UP_PCT 75
+#define WPROC_SCALE_DOWN_PCT 20
+#define WPROC_SCALE_DOWN_TICKS 6
+
+static struct {
+	timed_event *event;
+	unsigned long jobs_refused; /* jobs no worker had room for */
+	unsigned long refused_seen; /* jobs_refused at the previous tick */
+	unsigned int idle_ticks;
+	unsigned int scaled_up, scaled_down;
+	time_t last_change;
+	const char *last_reason;
+} autoscale = {NULL, 0, 0, 0, 0, 0, 0, "none"};
+
+/* drained workers that hadn't exited yet when we hung up on them */
+static GSList *retired_pids;
+
+/*
+ * Jobs for the core workers that came in while all of them were full,
+ * see max_worker_backlog. There's one queue per check priority class,
+ * each oldest first, and as soon as results free up job slots they're
+ * handed out starting with the highest class.
+ */
+static GQueue backlog[CHECK_PRIORITIES];
+static struct {
+	timed_event *event;
+	unsigned long queued, dropped, expired;
+	unsigned long dispatched; /* jobs that left the backlog for a worker */
+	double wait_total, wait_max;
+} backlog_stats;
+
+/*
+ * Jobs below CHECK_PRIORITY_RETRY leave this share of each worker's
+ * slots alone, so there's always room for host checks and retries
+ * to start right away, even when routine checks would fill the pool.
+ */
+#define WPROC_RESERVED_PCT 10
+
 unsigned int wproc_num_workers_online = 0, wproc_num_workers_desired = 0;
 unsigned int wproc_num_workers_spawned = 0;
 
 static int get_desired_workers(int desired_workers);
 static int spawn_core_worker(void);
+static unsigned int local_workers(void);
+static void retire_worker(struct wproc_worker *wp);
+static void backlog_drain(void);
+static void backlog_free_job(struct wproc_job *job);
+static void backlog_discard_job(struct wproc_job *job, int flags);
+static unsigned int backlog_length(int priority);
+static int wproc_submit(void (*cb)(struct wproc_result *, void *, int), void *data, time_t timeout, unsigned long max_output, int priority, char *cmd);
+static void remote_registration_close(int sd, struct remote_registration *reg);
 
 #define tv2float(tv) ((float)((tv)->tv_sec) + ((float)(tv)->tv_usec) / 1000000.0)
 
@@ -130,11 +218,12 @@ static struct wproc_list *get_wproc_list(const char *cmd)
 	return wp_list ? wp_list : &workers;
 }
 
-static struct wproc_worker *get_worker(const char *cmd)
+static struct wproc_worker *get_worker(const char *cmd, int priority)
 {
 	struct wproc_list *wp_list;
 	struct wproc_worker *worker = NULL;
-	size_t i, boundary;
+	unsigned long long best_running = 0;
+	size_t i, n, best = 0;
 
 	if (!cmd)
 		return NULL;
@@ -143,18 +232,35 @@ static struct wproc_worker *get_worker(const char *cmd)
 	if (!wp_list || !wp_list->wps || !wp_list->len)
 		return NULL;
 
-	/* Try to find a worker that is not overloaded. We go one lap around the
-	 * list before giving up. */
-	i = boundary = wp_list->idx % wp_list->len;
-	do {
+	/*
+	 * Go one lap around the list and pick the worker using the
+	 * smallest share of its max_jobs, so workers that advertise more
+	 * capacity (remote ones on bigger boxes, usually) get more of the
+	 * jobs. We start one past the previous pick so equally loaded
+	 * workers still take turns.
+	 */
+	i = wp_list->idx % wp_list->len;
+	for (n = 0; n < wp_list->len; n++) {
+		struct wproc_worker *wp;
+		unsigned long long running;
+		unsigned int slots;
+
 		i = (i + 1) % wp_list->len;
-		if (g_hash_table_size(wp_list->wps[i]->jobs) < (unsigned int) wp_list->wps[i]->max_jobs) {
-			/* We found one! */
-			wp_list->idx = i;
-			worker = wp_list->wps[i];
-			break;
+		wp = wp_list->wps[i];
+		running = g_hash_table_size(wp->jobs);
+		slots = wp->max_jobs;
+		if (priority < CHECK_PRIORITY_RETRY)
+			slots -= slots * WPROC_RESERVED_PCT / 100;
+		if (wp->draining || running >= slots)
+			continue;
+		if (!worker || running * worker->max_jobs < best_running * wp->max_jobs) {
+			worker = wp;
+			best = i;
+			best_running = running;
 		}
-	} while (i != boundary);
+	}
+	if (worker)
+		wp_list->idx = best;
 
 	return worker;
 }
@@ -187,8 +293,10 @@ static void destroy_job(gpointer job_)
 
 static int wproc_is_alive(struct wproc_worker *wp)
 {
-	if (!wp || !wp->pid)
+	if (!wp || (!wp->pid && !wp->remote))
 		return 0;
+	if (wp->remote)
+		return iobroker_is_registered(nagios_iobs, wp->sd);
 	if (kill(wp->pid, 0) == 0 && iobroker_is_registered(nagios_iobs, wp->sd))
 		return 1;
 	return 0;
@@ -214,11 +322,20 @@ static int wproc_destroy(struct wproc_worker *wp, int flags)
 	nm_free(wp->name);
 	g_hash_table_destroy(wp->jobs);
 	wp->jobs = NULL;
+	worker_session_destroy(wp->session);
+	wp->session = NULL;
 
 	/* workers must never control other workers, so they return early */
 	if (self != nagios_pid)
 		return 0;
 
+	/* remote workers aren't our children, so hanging up is all we can do */
+	if (wp->remote) {
+		iobroker_close(nagios_iobs, wp->sd);
+		free(wp);
+		return 0;
+	}
+
 	/* kill(0, SIGKILL) equals suicide, so we avoid it */
 	if (wp->pid) {
 		kill(wp->pid, SIGKILL);
@@ -270,6 +387,9 @@ static void remove_worker(struct wproc_worker *worker)
  */
 void free_worker_memory(int flags)
 {
+	struct wproc_job *job;
+	int priority;
+
 	if (workers.wps) {
 		unsigned int i;
 
@@ -288,6 +408,34 @@ void free_worker_memory(int flags)
 	workers.wps = NULL;
 	workers.len = 0;
 	workers.idx = 0;
+
+	if (autoscale.event)
+		destroy_event(autoscale.event);
+	if (backlog_stats.event)
+		destroy_event(backlog_stats.event);
+	for (priority = 0; priority < CHECK_PRIORITIES; priority++) {
+		while ((job = g_queue_pop_head(&backlog[priority])))
+			backlog_discard_job(job, 0);
+	}
+	while (retired_pids) {
+		waitpid(GPOINTER_TO_INT(retired_pids->data), NULL, 0);
+		retired_pids = g_slist_delete_link(retired_pids, retired_pids);
+	}
+
+	if (remote_listen_sock >= 0) {
+		iobroker_close(nagios_iobs, remote_listen_sock);
+		remote_listen_sock = -1;
+	}
+	while (!g_queue_is_empty(&remote_pending)) {
+		struct remote_registration *reg = g_queue_peek_head(&remote_pending);
+		remote_registration_close(reg->sd, reg);
+	}
+	if (remote_secret) {
+		memset(remote_secret, 0, remote_secret_len);
+		g_free(remote_secret);
+		remote_secret = NULL;
+	}
+	remote_secret_len = 0;
 }
 
 /*
@@ -388,6 +536,12 @@ static int parse_worker_result(wproc_result *wpres, struct kvvec *kvv)
 		case WPRES_ru_nivcsw:
 			wpres->rusage.ru_nsignals = atoi(value);
 			break;
+		case WPRES_max_output:
+			/* ignored */
+			break;
+		case WPRES_truncated:
+			wpres->truncated = atoi(value);
+			break;
 
 		default:
 			nm_log(NSLOG_RUNTIME_WARNING, "wproc: Recognized but unhandled result variable: %s=%s\n", key, value);
@@ -397,8 +551,7 @@ static int parse_worker_result(wproc_result *wpres, struct kvvec *kvv)
 	return 0;
 }
 
-static struct wproc_job *create_job(void (*callback)(struct wproc_result *, void *, int), void *data, time_t timeout, const char *cmd);
-static int wproc_run_job(struct wproc_job *job, nagios_macros *mac);
+static struct wproc_job *create_job(void (*callback)(struct wproc_result *, void *, int), void *data, time_t timeout, unsigned long max_output, int priority, const char *cmd);
 
 static int handle_worker_result(int sd, int events, void *arg)
 {
@@ -427,7 +580,8 @@ static int handle_worker_result(int sd, int events, void *arg)
 
 		desired_workers = get_desired_workers(num_check_workers);
 
-		if (workers.len < desired_workers) {
+		/* remote workers come and go on their own, so don't count them */
+		if (local_workers() < desired_workers) {
 			/* there aren't global workers left, we can't run any more checks
 			 * we should try respawning a few of the standard ones
 			 */
@@ -446,14 +600,11 @@ static int handle_worker_result(int sd, int events, void *arg)
 			nm_log(NSLOG_RUNTIME_ERROR, "wproc: All our workers are dead, we can't do anything!");
 		}
 
-		/* reassign this dead worker's jobs */
+		/* reassign this dead worker's jobs, through the backlog if need be */
 		g_hash_table_iter_init(&iter, wp->jobs);
 		while (g_hash_table_iter_next(&iter, NULL, &job_)) {
 			struct wproc_job *job = job_;
-			wproc_run_job(
-			    create_job(job->callback, job->data, job->timeout, job->command),
-			    NULL
-			);
+			wproc_submit(job->callback, job->data, job->timeout, job->max_output, job->priority, job->command);
 		}
 
 		wproc_destroy(wp, WPROC_FORCE);
@@ -464,6 +615,14 @@ static int handle_worker_result(int sd, int events, void *arg)
 		struct wproc_job *job;
 		wproc_result wpres;
 
+		if (wp->session && worker_session_verify(wp->session, buf, &size) < 0) {
+			/* hang up, and the next read sees a dead worker */
+			nm_log(NSLOG_RUNTIME_ERROR, "wproc: Message from %s failed authentication. Disconnecting\n", wp->name);
+			nm_free(buf);
+			shutdown(wp->sd, SHUT_RDWR);
+			break;
+		}
+
 		/* log messages are handled first */
 		if (size > 5 && !memcmp(buf, "log=", 4)) {
 			log_debug_info(DEBUGL_IPC, DEBUGV_BASIC, "wproc: %s: %s\n", wp->name, buf + 4);
@@ -521,11 +680,22 @@ static int handle_worker_result(int sd, int events, void *arg)
 		}
 		nm_free(error_reason);
 
+		if (wpres.truncated) {
+			log_debug_info(DEBUGL_IPC, DEBUGV_BASIC, "wproc: job %d from worker %s had its output truncated at %lu bytes\n",
+			               job->id, wp->name, job->max_output);
+		}
+
 		run_job_callback(job, &wpres, 0);
 		g_hash_table_remove(wp->jobs, GINT_TO_POINTER(job->id));
 		nm_free(buf);
 	}
 
+	/* results free up job slots for whatever is waiting */
+	backlog_drain();
+
+	if (wp->draining && !g_hash_table_size(wp->jobs))
+		retire_worker(wp);
+
 	return 0;
 }
 
@@ -542,25 +712,54 @@ int workers_alive(void)
 	return alive;
 }
 
-/* a service for registering workers */
-static int register_worker(int sd, char *buf, unsigned int len)
+/*
+ * Workers may tell us how many jobs they can take. Anything but a
+ * positive number is refused, and however many a worker claims to
+ * handle, it gets at most WPROC_MAX_JOBS_LIMIT. Sets *max_jobs to 0
+ * if the worker didn't say.
+ */
+static int registration_max_jobs(struct kvvec *info, int *max_jobs)
 {
-	int i, is_global = 1;
-	struct kvvec *info;
-	struct wproc_worker *worker;
+	int i;
 
-	g_return_val_if_fail(specialized_workers != NULL, ERROR);
+	*max_jobs = 0;
+	for (i = 0; i < info->kv_pairs; i++) {
+		char *end;
+		long value;
 
-	log_debug_info(DEBUGL_IPC, DEBUGV_BASIC, "wproc: Registry request: %s\n", buf);
-	worker = nm_calloc(1, sizeof(*worker));
-	info = buf2kvvec(buf, len, '=', ';', 0);
-	if (info == NULL) {
-		free(worker);
-		nm_log(NSLOG_RUNTIME_ERROR, "wproc: Failed to parse registration request\n");
-		return 500;
+		if (strcmp(info->kv[i].key, "max_jobs"))
+			continue;
+		errno = 0;
+		value = strtol(info->kv[i].value, &end, 10);
+		if (errno || end == info->kv[i].value || *end || value <= 0)
+			return -1;
+		*max_jobs = value > WPROC_MAX_JOBS_LIMIT ? WPROC_MAX_JOBS_LIMIT : (int)value;
 	}
 
+	return 0;
+}
+
+/*
+ * takes a worker described by info into service on sd. Remote workers
+ * come with their session, and get our proof of knowing the secret
+ * along with the OK.
+ */
+static int add_worker(int sd, struct kvvec *info, struct worker_session *session, const char *proof)
+{
+	int i, is_global = 1, max_jobs;
+	struct wproc_worker *worker;
+
+	if (registration_max_jobs(info, &max_jobs) < 0) {
+		nm_log(NSLOG_RUNTIME_WARNING, "wproc: Refusing worker on fd %d with an invalid max_jobs\n", sd);
+		kvvec_destroy(info, 0);
+		return 400;
+	}
+
+	worker = nm_calloc(1, sizeof(*worker));
 	worker->sd = sd;
+	worker->max_jobs = max_jobs;
+	worker->remote = session != NULL;
+	worker->session = session;
 	worker->bq = nm_bufferqueue_create();
 
 	iobroker_unregister(nagios_iobs, sd);
@@ -572,8 +771,6 @@ static int register_worker(int sd, char *buf, unsigned int len)
 			worker->name = nm_strdup(kv->value);
 		} else if (!strcmp(kv->key, "pid")) {
 			worker->pid = atoi(kv->value);
-		} else if (!strcmp(kv->key, "max_jobs")) {
-			worker->max_jobs = atoi(kv->value);
 		} else if (!strcmp(kv->key, "plugin")) {
 			struct wproc_list *command_handlers;
 			is_global = 0;
@@ -614,23 +811,273 @@ static int register_worker(int sd, char *buf, unsigned int len)
 	}
 	wproc_num_workers_online++;
 	kvvec_destroy(info, 0);
-	nsock_printf_nul(sd, "OK");
+	if (proof)
+		qh_printf_nul(sd, "OK auth=%s", proof);
+	else
+		qh_printf_nul(sd, "OK");
+	backlog_drain();
 
 	/* signal query handler to release its bufferqueue for this one */
 	return QH_TAKEOVER;
 }
 
+/* workers we've spawned ourselves, as opposed to remote ones */
+static unsigned int local_workers(void)
+{
+	unsigned int i, local = 0;
+
+	for (i = 0; i < workers.len; i++) {
+		if (!workers.wps[i]->remote)
+			local++;
+	}
+
+	return local;
+}
+
+/* a service for registering workers */
+static int register_worker(int sd, char *buf, unsigned int len)
+{
+	struct kvvec *info;
+
+	g_return_val_if_fail(specialized_workers != NULL, ERROR);
+
+	log_debug_info(DEBUGL_IPC, DEBUGV_BASIC, "wproc: Registry request: %s\n", buf);
+	info = buf2kvvec(buf, len, '=', ';', 0);
+	if (info == NULL) {
+		nm_log(NSLOG_RUNTIME_ERROR, "wproc: Failed to parse registration request\n");
+		return 500;
+	}
+
+	return add_worker(sd, info, NULL, NULL);
+}
+
+static void remote_registration_free(struct remote_registration *reg)
+{
+	timed_event *ev = reg->timeout;
+
+	reg->timeout = NULL;
+	if (ev)
+		destroy_event(ev);
+	g_queue_remove(&remote_pending, reg);
+	nm_bufferqueue_destroy(reg->bq);
+	free(reg);
+}
+
+static void remote_registration_close(int sd, struct remote_registration *reg)
+{
+	iobroker_close(nagios_iobs, sd);
+	remote_registration_free(reg);
+}
+
+static void remote_registration_timeout(struct nm_event_execution_properties *evprop)
+{
+	struct remote_registration *reg = evprop->user_data;
+
+	if (evprop->execution_type != EVENT_EXEC_NORMAL) {
+		/* the event queue is going away. If we cancelled it ourselves, there's nothing left to do */
+		if (reg->timeout) {
+			reg->timeout = NULL;
+			remote_registration_close(reg->sd, reg);
+		}
+		return;
+	}
+
+	reg->timeout = NULL;
+	nm_log(NSLOG_RUNTIME_WARNING, "wproc: Remote worker on fd %d didn't register within %d seconds. Disconnecting\n",
+	       reg->sd, REMOTE_REGISTRATION_TIMEOUT);
+	remote_registration_close(reg->sd, reg);
+}
+
+/*
+ * A remote worker answers the challenge we sent when it connected with
+ * the same "@wproc register <options>" request local workers send over
+ * the query socket, but with auth=<response> and a challenge=<hex> of
+ * its own among the options. We answer that with "OK auth=<proof>", so
+ * the worker knows it's talking to us. Once it's accepted, jobs and
+ * results use the same framing as locally, plus a mac pair on every
+ * message (see worker_session_sign()).
+ */
+static int remote_registration_input(int sd, int events, void *reg_)
+{
+	struct remote_registration *reg = (struct remote_registration *)reg_;
+	struct kvvec *info;
+	char *buf, *query, *expected, *proof, *auth = NULL, *challenge = NULL;
+	struct worker_session *session;
+	size_t len;
+	int i, result;
+
+	result = nm_bufferqueue_read(reg->bq, sd);
+	if (result == 0 || (result < 0 && errno != EAGAIN && errno != EINTR)) {
+		remote_registration_close(sd, reg);
+		return 0;
+	}
+
+	if (nm_bufferqueue_unshift_to_delim(reg->bq, "\0", 1, &len, (void **)&buf)) {
+		if (nm_bufferqueue_get_available(reg->bq) > REMOTE_REGISTRATION_MAX) {
+			nm_log(NSLOG_RUNTIME_WARNING, "wproc: Remote worker on fd %d sent too much without registering. Disconnecting\n", sd);
+			remote_registration_close(sd, reg);
+		}
+		return 0;
+	}
+
+	if (len < 17 || strncmp(buf, "@wproc register ", 16)) {
+		nsock_printf_nul(sd, "400: %s", qh_strerror(400));
+		nm_free(buf);
+		remote_registration_close(sd, reg);
+		return 0;
+	}
+	query = buf + 16;
+	len -= 16;
+	while (len > 0 && (query[len - 1] == 0 || query[len - 1] == '\n'))
+		query[--len] = 0;
+
+	if (!(info = buf2kvvec(query, len, '=', ';', 0))) {
+		nsock_printf_nul(sd, "500: %s", qh_strerror(500));
+		nm_free(buf);
+		remote_registration_close(sd, reg);
+		return 0;
+	}
+	for (i = 0; i < info->kv_pairs; i++) {
+		if (!strcmp(info->kv[i].key, "auth"))
+			auth = info->kv[i].value;
+		else if (!strcmp(info->kv[i].key, "challenge"))
+			challenge = info->kv[i].value;
+	}
+
+	expected = worker_auth_response(remote_secret, remote_secret_len, reg->challenge);
+	if (!expected || !auth || !worker_auth_matches(expected, auth) ||
+	    !challenge || strlen(challenge) < WORKER_CHALLENGE_LEN) {
+		nm_log(NSLOG_RUNTIME_WARNING, "wproc: Remote worker on fd %d failed to authenticate\n", sd);
+		nsock_printf_nul(sd, "401: %s", qh_strerror(401));
+		g_free(expected);
+		kvvec_destroy(info, 0);
+		nm_free(buf);
+		remote_registration_close(sd, reg);
+		return 0;
+	}
+	g_free(expected);
+
+	proof = worker_master_proof(remote_secret, remote_secret_len, reg->challenge, challenge);
+	session = worker_session_create(remote_secret, remote_secret_len, reg->challenge, challenge, 1);
+	if (!proof || !session) {
+		nsock_printf_nul(sd, "500: %s", qh_strerror(500));
+		g_free(proof);
+		worker_session_destroy(session);
+		kvvec_destroy(info, 0);
+		nm_free(buf);
+		remote_registration_close(sd, reg);
+		return 0;
+	}
+
+	result = add_worker(sd, info, session, proof);
+	g_free(proof);
+	nm_free(buf);
+	if (result != QH_TAKEOVER) {
+		nsock_printf_nul(sd, "%d: %s", result, qh_strerror(result));
+		worker_session_destroy(session);
+		remote_registration_close(sd, reg);
+		return 0;
+	}
+
+	log_debug_info(DEBUGL_IPC, DEBUGV_BASIC, "wproc: Remote worker on fd %d authenticated\n", sd);
+	remote_registration_free(reg);
+	return 0;
+}
+
+static int remote_worker_connect(int sd, int events, void *arg)
+{
+	struct remote_registration *reg;
+	int nsd;
+
+	if ((nsd = accept(sd, NULL, NULL)) < 0) {
+		if (errno != EAGAIN && errno != EINTR)
+			nm_log(NSLOG_RUNTIME_WARNING, "wproc: Failed to accept remote worker: %s\n", strerror(errno));
+		return 0;
+	}
+
+	/* peers that never get around to registering mustn't pile up */
+	if (g_queue_get_length(&remote_pending) >= REMOTE_REGISTRATION_PENDING_MAX) {
+		nm_log(NSLOG_RUNTIME_WARNING, "wproc: Too many remote workers registering at once. Disconnecting fd %d\n", nsd);
+		close(nsd);
+		return 0;
+	}
+
+	reg = nm_calloc(1, sizeof(*reg));
+	reg->sd = nsd;
+	if (worker_challenge(reg->challenge, sizeof(reg->challenge)) < 0) {
+		nm_log(NSLOG_RUNTIME_ERROR, "wproc: Failed to create challenge for remote worker: %s\n", strerror(errno));
+		free(reg);
+		close(nsd);
+		return 0;
+	}
+	reg->bq = nm_bufferqueue_create();
+	if (iobroker_register(nagios_iobs, nsd, reg, remote_registration_input) < 0) {
+		nm_log(NSLOG_RUNTIME_ERROR, "wproc: Failed to register remote worker socket with I/O broker\n");
+		nm_bufferqueue_destroy(reg->bq);
+		free(reg);
+		close(nsd);
+		return 0;
+	}
+
+	g_queue_push_tail(&remote_pending, reg);
+	reg->timeout = schedule_event(REMOTE_REGISTRATION_TIMEOUT, remote_registration_timeout, reg);
+
+	worker_set_sockopts(nsd, 0);
+	nsock_printf_nul(nsd, "challenge=%s", reg->challenge);
+	return 0;
+}
+
+static int init_remote_workers(void)
+{
+	GError *error = NULL;
+
+	if (!worker_secret_file) {
+		nm_log(NSLOG_CONFIG_ERROR, "wproc: worker_listen_address requires a worker_secret_file\n");
+		return -1;
+	}
+	if (!g_file_get_contents(worker_secret_file, &remote_secret, &remote_secret_len, &error)) {
+		nm_log(NSLOG_CONFIG_ERROR, "wproc: Failed to read worker_secret_file: %s\n", error->message);
+		g_clear_error(&error);
+		return -1;
+	}
+	while (remote_secret_len > 0 && g_ascii_isspace(remote_secret[remote_secret_len - 1]))
+		remote_secret[--remote_secret_len] = 0;
+	if (!remote_secret_len) {
+		nm_log(NSLOG_CONFIG_ERROR, "wproc: worker_secret_file '%s' is empty\n", worker_secret_file);
+		return -1;
+	}
+
+	remote_listen_sock = nsock_inet(worker_listen_address, NSOCK_TCP | NSOCK_REUSE);
+	if (remote_listen_sock < 0) {
+		nm_log(NSLOG_RUNTIME_ERROR, "wproc: Failed to listen for remote workers on %s: %s: %s\n",
+		       worker_listen_address, nsock_strerror(remote_listen_sock), strerror(errno));
+		remote_listen_sock = -1;
+		return -1;
+	}
+	(void)fcntl(remote_listen_sock, F_SETFD, FD_CLOEXEC);
+	if (iobroker_register(nagios_iobs, remote_listen_sock, NULL, remote_worker_connect) < 0) {
+		nm_log(NSLOG_RUNTIME_ERROR, "wproc: Failed to register remote worker listener with I/O broker\n");
+		iobroker_close(nagios_iobs, remote_listen_sock);
+		remote_listen_sock = -1;
+		return -1;
+	}
+
+	nm_log(NSLOG_INFO_MESSAGE, "wproc: Accepting remote workers on %s\n", worker_listen_address);
+	return 0;
+}
+
 static int wproc_query_handler(int sd, char *buf, unsigned int len)
 {
 	char *space, *rbuf = NULL;
 
 	if (!*buf || !strcmp(buf, "help")) {
-		nsock_printf_nul(sd, "Control worker processes.\n"
-		                 "Valid commands:\n"
-		                 "  wpstats              Print general job information\n"
-		                 "  register <options>   Register a new worker\n"
-		                 "                       <options> can be name, pid, max_jobs and/or plugin.\n"
-		                 "                       There can be many plugin args.");
+		qh_printf_nul(sd, "Control worker processes.\n"
+		              "Valid commands:\n"
+		              "  wpstats              Print general job information and\n"
+		              "                       autoscaling decisions\n"
+		              "  register <options>   Register a new worker\n"
+		              "                       <options> can be name, pid, max_jobs and/or plugin.\n"
+		              "                       There can be many plugin args.");
 		return 0;
 	}
 
@@ -640,17 +1087,47 @@ static int wproc_query_handler(int sd, char *buf, unsigned int len)
 	rbuf = space ? space + 1 : buf;
 	len -= (unsigned long)rbuf - (unsigned long)buf;
 
-	if (!strcmp(buf, "register"))
+	if (!strcmp(buf, "register")) {
+		/* takes over the socket, which only the main thread may do */
+		if (qh_in_thread_pool())
+			return QH_RUN_IN_MAIN;
 		return register_worker(sd, rbuf, len);
+	}
 	if (!strcmp(buf, "wpstats")) {
+		struct wproc_job *oldest;
+		struct timeval now;
 		unsigned int i;
 
 		for (i = 0; i < workers.len; i++) {
 			struct wproc_worker *wp = workers.wps[i];
-			nsock_printf(sd, "name=%s;pid=%d;jobs_running=%u;jobs_started=%u\n",
-			             wp->name, wp->pid,
-			             g_hash_table_size(wp->jobs), wp->jobs_started);
+			qh_printf(sd, "name=%s;pid=%d;jobs_running=%u;jobs_started=%u;max_jobs=%d;remote=%d;draining=%d\n",
+			          wp->name, wp->pid,
+			          g_hash_table_size(wp->jobs), wp->jobs_started,
+			          wp->max_jobs, wp->remote, wp->draining);
+		}
+		qh_printf(sd, "autoscale=%d;min=%u;max=%d;jobs_refused=%lu;scaled_up=%u;scaled_down=%u;last_change=%lu;last_reason=%s\n",
+		          autoscale.event != NULL, wproc_num_workers_desired, max_check_workers,
+		          autoscale.jobs_refused, autoscale.scaled_up, autoscale.scaled_down,
+		          (unsigned long)autoscale.last_change, autoscale.last_reason);
+		oldest = NULL;
+		for (i = 0; i < CHECK_PRIORITIES; i++) {
+			struct wproc_job *head = g_queue_peek_head(&backlog[i]);
+			if (head && (!oldest || tv_delta_f(&oldest->queued, &head->queued) < 0))
+				oldest = head;
 		}
+		if (oldest)
+			gettimeofday(&now, NULL);
+		qh_printf(sd, "backlog=%u;max=%u;handler=%u;host=%u;retry=%u;freshness=%u;regular=%u;queued=%lu;dropped=%lu;expired=%lu;oldest_wait=%.3f;avg_wait=%.3f;max_wait=%.3f\n",
+		          backlog_length(0), max_worker_backlog,
+		          g_queue_get_length(&backlog[CHECK_PRIORITY_HANDLER]),
+		          g_queue_get_length(&backlog[CHECK_PRIORITY_HOST]),
+		          g_queue_get_length(&backlog[CHECK_PRIORITY_RETRY]),
+		          g_queue_get_length(&backlog[CHECK_PRIORITY_FRESHNESS]),
+		          g_queue_get_length(&backlog[CHECK_PRIORITY_REGULAR]),
+		          backlog_stats.queued, backlog_stats.dropped, backlog_stats.expired,
+		          oldest ? tv_delta_f(&oldest->queued, &now) : 0.0,
+		          backlog_stats.dispatched ? backlog_stats.wait_total / backlog_stats.dispatched : 0.0,
+		          backlog_stats.wait_max);
 		return 0;
 	}
 
@@ -697,6 +1174,132 @@ static int get_desired_workers(int desired_workers)
 }
 
 
+/* hang up on a drained worker. It exits once it sees EOF */
+static void retire_worker(struct wproc_worker *wp)
+{
+	nm_log(NSLOG_INFO_MESSAGE, "wproc: Stopping idle worker %s\n", wp->name);
+	remove_worker(wp);
+	wproc_num_workers_online--;
+	iobroker_close(nagios_iobs, wp->sd);
+	if (waitpid(wp->pid, NULL, WNOHANG) == 0)
+		retired_pids = g_slist_prepend(retired_pids, GINT_TO_POINTER(wp->pid));
+
+	nm_bufferqueue_destroy(wp->bq);
+	nm_free(wp->name);
+	g_hash_table_destroy(wp->jobs);
+	free(wp);
+}
+
+static void reap_retired_workers(void)
+{
+	GSList *l, *next;
+
+	for (l = retired_pids; l; l = next) {
+		next = l->next;
+		if (waitpid(GPOINTER_TO_INT(l->data), NULL, WNOHANG) != 0)
+			retired_pids = g_slist_delete_link(retired_pids, l);
+	}
+}
+
+static void scale_decision(const char *reason)
+{
+	autoscale.last_change = time(NULL);
+	autoscale.last_reason = reason;
+	log_debug_info(DEBUGL_IPC, DEBUGV_BASIC, "wproc: autoscale: %s\n", reason);
+}
+
+static void scale_workers(void)
+{
+	struct wproc_worker *idlest = NULL;
+	unsigned long running = 0, capacity = 0, refused;
+	unsigned int i, local = 0, draining = 0;
+
+	refused = autoscale.jobs_refused - autoscale.refused_seen;
+	autoscale.refused_seen = autoscale.jobs_refused;
+
+	/* drained workers that were idle all along haven't been stopped yet */
+	for (i = 0; i < workers.len;) {
+		struct wproc_worker *wp = workers.wps[i];
+		if (wp->draining && !g_hash_table_size(wp->jobs)) {
+			retire_worker(wp);
+			continue;
+		}
+		i++;
+	}
+
+	for (i = 0; i < workers.len; i++) {
+		struct wproc_worker *wp = workers.wps[i];
+		unsigned int jobs = g_hash_table_size(wp->jobs);
+
+		running += jobs;
+		if (wp->draining) {
+			draining++;
+			continue;
+		}
+		capacity += wp->max_jobs;
+		if (wp->remote)
+			continue;
+		local++;
+		if (!idlest || jobs < g_hash_table_size(idlest->jobs))
+			idlest = wp;
+	}
+
+	if (refused || backlog_length(0) || running * 100 >= capacity * WPROC_SCALE_UP_PCT) {
+		unsigned int grow;
+
+		autoscale.idle_ticks = 0;
+		if (draining) {
+			/* workers we were about to stop are the cheapest ones to add */
+			for (i = 0; i < workers.len; i++)
+				workers.wps[i]->draining = 0;
+			scale_decision(refused ? "jobs refused, stopped draining workers" : "busy, stopped draining workers");
+			return;
+		}
+		if (local >= (unsigned int)max_check_workers) {
+			scale_decision(refused ? "jobs refused, but already at max_check_workers" : "busy, but already at max_check_workers");
+			return;
+		}
+		grow = local / 2 ? local / 2 : 1;
+		if (local + grow > (unsigned int)max_check_workers)
+			grow = max_check_workers - local;
+		nm_log(NSLOG_INFO_MESSAGE, "wproc: %lu of %lu job slots in use and %lu jobs refused. Starting %u more workers\n",
+		       running, capacity, refused, grow);
+		for (i = 0; i < grow; i++) {
+			if (spawn_core_worker() > 0)
+				autoscale.scaled_up++;
+		}
+		scale_decision(refused ? "jobs refused, started workers" : "busy, started workers");
+		return;
+	}
+
+	if (running * 100 >= capacity * WPROC_SCALE_DOWN_PCT) {
+		autoscale.idle_ticks = 0;
+		return;
+	}
+	if (++autoscale.idle_ticks < WPROC_SCALE_DOWN_TICKS || local <= wproc_num_workers_desired || !idlest)
+		return;
+
+	autoscale.idle_ticks = 0;
+	autoscale.scaled_down++;
+	log_debug_info(DEBUGL_IPC, DEBUGV_BASIC, "wproc: Draining worker %s\n", idlest->name);
+	idlest->draining = 1;
+	if (!g_hash_table_size(idlest->jobs))
+		retire_worker(idlest);
+	scale_decision("idle, drained a worker");
+}
+
+static void wproc_autoscale(struct nm_event_execution_properties *evprop)
+{
+	if (evprop->execution_type != EVENT_EXEC_NORMAL) {
+		autoscale.event = NULL;
+		return;
+	}
+
+	autoscale.event = schedule_event(WPROC_SCALE_INTERVAL, wproc_autoscale, NULL);
+	reap_retired_workers();
+	scale_workers();
+}
+
 int init_workers(int desired_workers)
 {
 	int i;
@@ -708,16 +1311,25 @@ int init_workers(int desired_workers)
 	specialized_workers = g_hash_table_new_full(g_str_hash, g_str_equal,
 	                      free, NULL
 	                                           );
-	if (!qh_register_handler("wproc", "Worker process management and info", 0, wproc_query_handler)) {
+	if (!qh_register_handler("wproc", "Worker process management and info", QH_OPT_THREADSAFE, wproc_query_handler)) {
 		log_debug_info(DEBUGL_IPC, DEBUGV_BASIC, "wproc: Successfully registered manager as @wproc with query handler\n");
 	} else {
 		nm_log(NSLOG_RUNTIME_ERROR, "wproc: Failed to register manager with query handler\n");
 		return -1;
 	}
 
+	if (worker_listen_address && *worker_listen_address && init_remote_workers() < 0)
+		return -1;
+
 	/* Get the number of workers we need */
 	desired_workers = get_desired_workers(desired_workers);
 
+	if (max_check_workers > desired_workers) {
+		autoscale.idle_ticks = 0;
+		autoscale.refused_seen = autoscale.jobs_refused;
+		autoscale.event = schedule_event(WPROC_SCALE_INTERVAL, wproc_autoscale, NULL);
+	}
+
 	if (workers_alive() == desired_workers)
 		return 0;
 
@@ -732,12 +1344,12 @@ int init_workers(int desired_workers)
 }
 
 
-static struct wproc_job *create_job(void (*callback)(struct wproc_result *, void *, int), void *data, time_t timeout, const char *cmd)
+static struct wproc_job *create_job(void (*callback)(struct wproc_result *, void *, int), void *data, time_t timeout, unsigned long max_output, int priority, const char *cmd)
 {
 	struct wproc_job *job;
 	struct wproc_worker *wp;
 
-	wp = get_worker(cmd);
+	wp = get_worker(cmd, priority);
 	if (!wp)
 		return NULL;
 
@@ -747,6 +1359,8 @@ static struct wproc_job *create_job(void (*callback)(struct wproc_result *, void
 	job->callback = callback;
 	job->data = data;
 	job->timeout = timeout;
+	job->max_output = max_output;
+	job->priority = priority;
 	job->command = nm_strdup(cmd);
 	g_hash_table_insert(wp->jobs, GINT_TO_POINTER(job->id), job);
 	return job;
@@ -769,14 +1383,22 @@ static int wproc_run_job(struct wproc_job *job, nagios_macros *mac)
 
 	wp = job->wp;
 
-	if (!kvvec_init(&kvv, 4))	/* job_id, command and timeout */
+	if (!kvvec_init(&kvv, 5))	/* job_id, type, command, timeout and max_output */
 		return ERROR;
 
 	kvvec_addkv_str(&kvv, "job_id", (char *)mkstr("%d", job->id));
 	kvvec_addkv_str(&kvv, "type", "0");
 	kvvec_addkv_str(&kvv, "command", job->command);
 	kvvec_addkv_str(&kvv, "timeout", (char *)mkstr("%u", job->timeout));
+	if (job->max_output)
+		kvvec_addkv_str(&kvv, "max_output", (char *)mkstr("%lu", job->max_output));
 	kvvb = build_kvvec_buf(&kvv);
+	if (wp->session) {
+		struct kvvec_buf *signed_kvvb = worker_session_sign(wp->session, kvvb->buf, kvvb->buflen);
+		nm_free(kvvb->buf);
+		nm_free(kvvb);
+		kvvb = signed_kvvb;
+	}
 	ret = iobroker_write_packet(nagios_iobs, wp->sd, kvvb->buf, kvvb->bufsize);
 	if (ret < 0) {
 		nm_log(NSLOG_RUNTIME_ERROR, "wproc: '%s' seems to be choked. ret = %d; bufsize = %lu: errno = %d (%s)\n",
@@ -792,11 +1414,207 @@ static int wproc_run_job(struct wproc_job *job, nagios_macros *mac)
 	return result;
 }
 
+static void backlog_free_job(struct wproc_job *job)
+{
+	nm_free(job->command);
+	free(job);
+}
+
+/*
+ * A job that will never run. Without a result, the callback only frees
+ * its data, and reschedules checks if flags has WPROC_JOB_DROPPED.
+ */
+static void backlog_discard_job(struct wproc_job *job, int flags)
+{
+	if (job->callback)
+		(*job->callback)(NULL, job->data, flags);
+	backlog_free_job(job);
+}
+
+/* number of jobs waiting at the given priority or above */
+static unsigned int backlog_length(int priority)
+{
+	unsigned int len = 0;
+
+	for (; priority < CHECK_PRIORITIES; priority++)
+		len += g_queue_get_length(&backlog[priority]);
+	return len;
+}
+
+static void backlog_drain(void)
+{
+	struct wproc_job *pending, *job;
+	struct timeval now;
+	int priority;
+
+	if (!backlog_length(0))
+		return;
+
+	gettimeofday(&now, NULL);
+	for (priority = CHECK_PRIORITIES - 1; priority >= 0; priority--) {
+		while ((pending = g_queue_peek_head(&backlog[priority]))) {
+			double waited;
+
+			/* if this class doesn't fit anywhere, lower ones won't either */
+			job = create_job(pending->callback, pending->data, pending->timeout, pending->max_output, priority, pending->command);
+			if (!job)
+				return;
+			g_queue_pop_head(&backlog[priority]);
+
+			waited = tv_delta_f(&pending->queued, &now);
+			backlog_stats.dispatched++;
+			backlog_stats.wait_total += waited;
+			if (waited > backlog_stats.wait_max)
+				backlog_stats.wait_max = waited;
+
+			if (wproc_run_job(job, NULL) != OK) {
+				/* the worker is gone, so its job went with it */
+				backlog_discard_job(pending, WPROC_JOB_DROPPED);
+				continue;
+			}
+			backlog_free_job(pending);
+		}
+	}
+}
+
+static void backlog_expire(void)
+{
+	GList *l, *next;
+	time_t now = time(NULL);
+	int priority;
+
+	for (priority = 0; priority < CHECK_PRIORITIES; priority++) {
+		for (l = backlog[priority].head; l; l = next) {
+			struct wproc_job *job = l->data;
+
+			next = l->next;
+			if (job->timeout && now - job->queued.tv_sec < (time_t)job->timeout)
+				continue;
+			g_queue_delete_link(&backlog[priority], l);
+			backlog_stats.expired++;
+			log_debug_info(DEBUGL_IPC, DEBUGV_BASIC, "wproc: Job waited %lds for a worker, giving up on it: %s\n",
+			               (long)(now - job->queued.tv_sec), job->command);
+			backlog_discard_job(job, WPROC_JOB_DROPPED);
+		}
+	}
+}
+
+static void backlog_tick(struct nm_event_execution_properties *evprop)
+{
+	if (evprop->execution_type != EVENT_EXEC_NORMAL) {
+		backlog_stats.event = NULL;
+		return;
+	}
+
+	backlog_drain();
+	backlog_expire();
+	if (!backlog_length(0))
+		backlog_stats.event = NULL;
+	else
+		backlog_stats.event = schedule_event(1, backlog_tick, NULL);
+}
+
+/*
+ * A full backlog makes room for a job by dropping the newest one
+ * from the lowest class below it, if there is one. Notifications and
+ * event handlers are the top class, so they're never dropped.
+ */
+static int backlog_make_room(int priority)
+{
+	struct wproc_job *victim;
+	int lower;
+
+	for (lower = 0; lower < priority; lower++) {
+		if (!(victim = g_queue_pop_tail(&backlog[lower])))
+			continue;
+		backlog_stats.dropped++;
+		log_debug_info(DEBUGL_IPC, DEBUGV_BASIC, "wproc: Worker backlog is full, dropping job: %s\n", victim->command);
+		backlog_discard_job(victim, WPROC_JOB_DROPPED);
+		return OK;
+	}
+	return ERROR;
+}
+
+static int backlog_push(void (*cb)(struct wproc_result *, void *, int), void *data, time_t timeout, unsigned long max_output, int priority, const char *cmd)
+{
+	struct wproc_job *job;
+
+	/*
+	 * Only jobs for the core workers can wait, and only when there are
+	 * some. Specialized workers and an empty pool fail jobs right away.
+	 */
+	if (!max_worker_backlog || !workers.len || get_wproc_list(cmd) != &workers)
+		return ERROR;
+	/* an alert nobody hears about is worse than a backlog over its limit */
+	if (backlog_length(0) >= max_worker_backlog && backlog_make_room(priority) != OK &&
+	    priority != CHECK_PRIORITY_HANDLER) {
+		backlog_stats.dropped++;
+		return ERROR;
+	}
+
+	job = nm_calloc(1, sizeof(*job));
+	job->callback = cb;
+	job->data = data;
+	job->timeout = timeout;
+	job->max_output = max_output;
+	job->priority = priority;
+	job->command = nm_strdup(cmd);
+	gettimeofday(&job->queued, NULL);
+	g_queue_push_tail(&backlog[priority], job);
+	backlog_stats.queued++;
+
+	if (!backlog_stats.event)
+		backlog_stats.event = schedule_event(1, backlog_tick, NULL);
+
+	return OK;
+}
+
+static int wproc_submit(void (*cb)(struct wproc_result *, void *, int), void *data, time_t timeout, unsigned long max_output, int priority, char *cmd)
+{
+	struct wproc_job *job;
+
+	if (!cmd)
+		return ERROR;
+	if (priority < 0 || priority >= CHECK_PRIORITIES)
+		priority = CHECK_PRIORITY_REGULAR;
+
+	/* nothing gets to skip the queue, except past lower classes */
+	if (!backlog_length(priority)) {
+		if ((job = create_job(cb, data, timeout, max_output, priority, cmd)))
+			return wproc_run_job(job, NULL);
+
+		/* more core workers won't help jobs meant for specialized ones */
+		if (get_wproc_list(cmd) == &workers)
+			autoscale.jobs_refused++;
+	}
+
+	if (backlog_push(cb, data, timeout, max_output, priority, cmd) != OK)
+		return ERROR;
+	backlog_drain();
+	return OK;
+}
+
 int wproc_run_callback(char *cmd, int timeout,
                        void (*cb)(struct wproc_result *, void *, int), void *data,
                        nagios_macros *mac)
 {
-	struct wproc_job *job;
-	job = create_job(cb, data, timeout, cmd);
-	return wproc_run_job(job, mac);
+	return wproc_submit(cb, data, timeout, max_job_output_size, CHECK_PRIORITY_REGULAR, cmd);
+}
+
+int wproc_run_command_callback(command *cmd_ptr, char *cmd, int timeout,
+                               void (*cb)(struct wproc_result *, void *, int), void *data,
+                               nagios_macros *mac)
+{
+	return wproc_run_check_callback(cmd_ptr, cmd, timeout, CHECK_PRIORITY_REGULAR, cb, data, mac);
+}
+
+int wproc_run_check_callback(command *cmd_ptr, char *cmd, int timeout, int priority,
+                             void (*cb)(struct wproc_result *, void *, int), void *data,
+                             nagios_macros *mac)
+{
+	unsigned long max_output = max_job_output_size;
+
+	if (cmd_ptr && cmd_ptr->max_output_size)
+		max_output = cmd_ptr->max_output_size;
+	return wproc_submit(cb, data, timeout, max_output, priority, cmd);
 }
@@ -12,6 +12,13 @@
 
 #define WPROC_FORCE  (1 << 0)
 
+/*
+ * Passed to the callback, without a result, of a job that gave up
+ * waiting for a worker. It never ran, so there's no new state to
+ * report, but checks can be rescheduled.
+ */
+#define WPROC_JOB_DROPPED (1 << 0)
+
 #ifndef ETIME
 #define ETIME ETIMEDOUT
 #endif
@@ -33,6 +40,7 @@ typedef struct wproc_result {
 	int error_code;
 	int exited_ok;
 	int early_timeout;
+	int truncated; /* output was cut at the job's max_output */
 	struct kvvec *response;
 	struct rusage rusage;
 } wproc_result;
@@ -48,6 +56,10 @@ int workers_alive(void);
 int init_workers(int desired_workers);
 
 int wproc_run_callback(char *cmt, int timeout, void (*cb)(struct wproc_result *, void *, int), void *data, nagios_macros *mac);
+/* same as wproc_run_callback(), but honours the limits set on cmd_ptr */
+int wproc_run_command_callback(command *cmd_ptr, char *cmd, int timeout, void (*cb)(struct wproc_result *, void *, int), void *data, nagios_macros *mac);
+/* same as wproc_run_command_callback(), for a job of the given CHECK_PRIORITY_* class */
+int wproc_run_check_callback(command *cmd_ptr, char *cmd, int timeout, int priority, void (*cb)(struct wproc_result *, void *, int), void *data, nagios_macros *mac);
 
 NAGIOS_END_DECL
 #endif
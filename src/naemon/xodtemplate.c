@@ -211,6 +211,160 @@ static gboolean xod_tree_traverse(GTree *tree, int (*cb)(gpointer, gpointer), gp
 	return stor.result;
 }
 
+/******************************************************************/
+/******************* PARALLEL OBJECT PROCESSING *******************/
+/******************************************************************/
+
+/*
+ * Objects are handed out to the threads in small batches from a shared
+ * cursor, so a thread that runs into cheap objects just keeps claiming
+ * more instead of sitting idle while its peers finish. Callbacks may
+ * only modify the object they're given (and per-worker scratch data);
+ * everything else must be treated as read-only until the run is done.
+ */
+#define XOD_PARALLEL_BATCH 64
+#define XOD_PARALLEL_MAX_THREADS 64
+
+struct xod_parallel {
+	GPtrArray *objs;
+	int (*fn)(struct xod_parallel *p, guint idx, guint worker);
+	void *arg;
+	volatile gint next;
+	volatile gint result;
+	guint threads;
+	gint64 *busy;
+};
+
+struct xod_parallel_thread {
+	struct xod_parallel *p;
+	guint worker;
+};
+
+/* accumulated statistics for the phase currently being timed */
+static struct {
+	guint threads;
+	gint64 wall, busy;
+} xod_phase;
+
+static guint xodtemplate_parallel_threads(void)
+{
+	guint threads;
+
+	if (config_load_threads > 0)
+		threads = config_load_threads;
+	else
+		threads = g_get_num_processors();
+
+	if (threads < 1)
+		threads = 1;
+	if (threads > XOD_PARALLEL_MAX_THREADS)
+		threads = XOD_PARALLEL_MAX_THREADS;
+
+	return threads;
+}
+
+static void xodtemplate_parallel_run(struct xod_parallel *p, guint worker)
+{
+	gint64 start = g_get_monotonic_time();
+	guint len = p->objs->len;
+
+	while (g_atomic_int_get(&p->result) == OK) {
+		guint i, end, idx = (guint)g_atomic_int_add(&p->next, XOD_PARALLEL_BATCH);
+		if (idx >= len)
+			break;
+		end = idx + XOD_PARALLEL_BATCH > len ? len : idx + XOD_PARALLEL_BATCH;
+		for (i = idx; i < end; i++) {
+			if (p->fn(p, i, worker) != OK) {
+				g_atomic_int_set(&p->result, ERROR);
+				break;
+			}
+		}
+	}
+
+	p->busy[worker] = g_get_monotonic_time() - start;
+}
+
+static gpointer xodtemplate_parallel_thread(gpointer data)
+{
+	struct xod_parallel_thread *t = (struct xod_parallel_thread *)data;
+	xodtemplate_parallel_run(t->p, t->worker);
+	return NULL;
+}
+
+/*
+ * Runs fn() once for every object in objs, spread over up to 'threads'
+ * threads (the calling thread included). Returns ERROR if any of the
+ * calls failed, in which case some objects may not have been visited.
+ */
+static int xodtemplate_parallel_foreach(GPtrArray *objs, guint threads, int (*fn)(struct xod_parallel *, guint, guint), void *arg)
+{
+	struct xod_parallel p;
+	struct xod_parallel_thread *t;
+	GThread **tids;
+	gint64 start;
+	guint i;
+
+	if (!objs->len)
+		return OK;
+
+	/* no point in starting threads that won't get a batch of their own */
+	if (threads > (objs->len + XOD_PARALLEL_BATCH - 1) / XOD_PARALLEL_BATCH)
+		threads = (objs->len + XOD_PARALLEL_BATCH - 1) / XOD_PARALLEL_BATCH;
+
+	p.objs = objs;
+	p.fn = fn;
+	p.arg = arg;
+	p.next = 0;
+	p.result = OK;
+	p.threads = threads;
+	p.busy = nm_calloc(threads, sizeof(gint64));
+	t = nm_calloc(threads, sizeof(*t));
+	tids = nm_calloc(threads, sizeof(GThread *));
+
+	start = g_get_monotonic_time();
+	for (i = 1; i < threads; i++) {
+		t[i].p = &p;
+		t[i].worker = i;
+		tids[i] = g_thread_try_new("xodtemplate", xodtemplate_parallel_thread, &t[i], NULL);
+		/* the threads we did get (and this one) will pick up the slack */
+		if (!tids[i])
+			break;
+	}
+	xodtemplate_parallel_run(&p, 0);
+	for (i = 1; i < threads && tids[i]; i++)
+		g_thread_join(tids[i]);
+
+	xod_phase.wall += g_get_monotonic_time() - start;
+	for (i = 0; i < threads; i++)
+		xod_phase.busy += p.busy[i];
+	if (threads > xod_phase.threads)
+		xod_phase.threads = threads;
+
+	nm_free(tids);
+	nm_free(t);
+	nm_free(p.busy);
+	return p.result;
+}
+
+static void xodtemplate_phase_begin(void)
+{
+	memset(&xod_phase, 0, sizeof(xod_phase));
+}
+
+/* used as a timing_point() suffix, so it has to fit on the same line */
+static const char *xodtemplate_phase_summary(void)
+{
+	static char buf[80];
+
+	if (!xod_phase.wall) {
+		*buf = 0;
+		return buf;
+	}
+	snprintf(buf, sizeof(buf), " (%u threads, %.2f threads busy on average)",
+	         xod_phase.threads, (double)xod_phase.busy / (double)xod_phase.wall);
+	return buf;
+}
+
 /******************************************************************/
 /********************** CLEANUP FUNCTIONS *************************/
 /******************************************************************/
@@ -1474,6 +1628,7 @@ static int xodtemplate_expand_hostgroups(objectlist **list, bitmap *reject_map,
 {
 	char *hostgroup_names = NULL;
 	char *temp_ptr = NULL;
+	char *saveptr = NULL;
 	xodtemplate_hostgroup *temp_hostgroup = NULL;
 	regex_t preg;
 	int found_match = TRUE;
@@ -1487,7 +1642,7 @@ static int xodtemplate_expand_hostgroups(objectlist **list, bitmap *reject_map,
 
 	/* allocate memory for hostgroup name list */
 	hostgroup_names = nm_strdup(hostgroups);
-	for (temp_ptr = strtok(hostgroup_names, ","); temp_ptr; temp_ptr = strtok(NULL, ",")) {
+	for (temp_ptr = strtok_r(hostgroup_names, ",", &saveptr); temp_ptr; temp_ptr = strtok_r(NULL, ",", &saveptr)) {
 
 		found_match = FALSE;
 		reject_item = FALSE;
@@ -1604,6 +1759,7 @@ static int xodtemplate_expand_hostgroups(objectlist **list, bitmap *reject_map,
 static int xodtemplate_expand_hosts(objectlist **list, bitmap *reject_map, char *hosts, int _config_file, int _start_line)
 {
 	char *temp_ptr = NULL;
+	char *saveptr = NULL;
 	xodtemplate_host *temp_host = NULL;
 	regex_t preg;
 	int found_match = TRUE;
@@ -1614,7 +1770,7 @@ static int xodtemplate_expand_hosts(objectlist **list, bitmap *reject_map, char
 		return ERROR;
 
 	/* expand each host name */
-	for (temp_ptr = strtok(hosts, ","); temp_ptr; temp_ptr = strtok(NULL, ",")) {
+	for (temp_ptr = strtok_r(hosts, ",", &saveptr); temp_ptr; temp_ptr = strtok_r(NULL, ",", &saveptr)) {
 
 		found_match = FALSE;
 		reject_item = FALSE;
@@ -2376,113 +2532,186 @@ static int xodtemplate_duplicate_service(xodtemplate_service *temp_service, char
 
 
 
-/* duplicates service definitions */
-static int xodtemplate_duplicate_services(void)
+/* the hosts a single service definition expands to */
+struct xod_service_expansion {
+	unsigned int count, size;
+	struct xod_service_target {
+		char *host_name;
+		int from_hg;
+		int is_last; /* use the existing entry rather than a copy */
+	} *targets;
+};
+
+struct xod_duplicate_services {
+	struct xod_service_expansion *exp;
+	bitmap **host_maps; /* one reject map per worker */
+};
+
+
+/*
+ * expands the host and hostgroup members of a service definition.
+ * The duplication itself happens afterwards, in definition order, so
+ * ids and the order of the service list don't depend on thread timing.
+ */
+static int xodtemplate_expand_service_hosts(struct xod_parallel *p, guint idx, guint worker)
 {
-	gpointer prev;
-	xodtemplate_service *temp_service = NULL;
-	xodtemplate_host *temp_host = NULL;
+	struct xod_duplicate_services *dup = (struct xod_duplicate_services *)p->arg;
+	struct xod_service_expansion *exp = &dup->exp[idx];
+	xodtemplate_service *temp_service = g_ptr_array_index(p->objs, idx);
+	objectlist *hlist = NULL, *list = NULL, *glist = NULL, *next;
+	xodtemplate_hostgroup fake_hg;
+	bitmap *reject_map;
 
-	xodcount.services = 0;
-	/****** DUPLICATE SERVICE DEFINITIONS WITH ONE OR MORE HOSTGROUP AND/OR HOST NAMES ******/
-	for (temp_service = xodtemplate_service_list; temp_service != NULL; temp_service = temp_service->next) {
-		objectlist *hlist = NULL, *list = NULL, *glist = NULL, *next;
-		xodtemplate_hostgroup fake_hg;
+	if (!dup->host_maps[worker] && !(dup->host_maps[worker] = bitmap_create(xodcount.hosts))) {
+		nm_log(NSLOG_CONFIG_ERROR, "Error: Failed to create host map for expanding services\n");
+		return ERROR;
+	}
+	reject_map = dup->host_maps[worker];
 
-		/* clear for each round */
-		bitmap_clear(host_map);
+	/* clear for each round */
+	bitmap_clear(reject_map);
 
-		/* skip services that shouldn't be registered */
-		if (temp_service->register_object == FALSE)
-			continue;
+	/* skip services that shouldn't be registered */
+	if (temp_service->register_object == FALSE)
+		return OK;
 
-		/* bail out on service definitions without enough data */
-		if ((temp_service->hostgroup_name == NULL && temp_service->host_name == NULL) || temp_service->service_description == NULL) {
-			/* service templates don't need any of that though */
-			if (temp_service->name)
-				continue;
-			nm_log(NSLOG_CONFIG_ERROR, "Error: Service has no hosts and/or service_description (config file '%s', starting on line %d)\n", xodtemplate_config_file_name(temp_service->_config_file), temp_service->_start_line);
+	/* bail out on service definitions without enough data */
+	if ((temp_service->hostgroup_name == NULL && temp_service->host_name == NULL) || temp_service->service_description == NULL) {
+		/* service templates don't need any of that though */
+		if (temp_service->name)
+			return OK;
+		nm_log(NSLOG_CONFIG_ERROR, "Error: Service has no hosts and/or service_description (config file '%s', starting on line %d)\n", xodtemplate_config_file_name(temp_service->_config_file), temp_service->_start_line);
+		return ERROR;
+	}
+
+	if (temp_service->hostgroup_name != NULL) {
+		if (xodtemplate_expand_hostgroups(&glist, reject_map, temp_service->hostgroup_name, temp_service->_config_file, temp_service->_start_line) == ERROR) {
 			return ERROR;
 		}
+		/* no longer needed */
+		nm_free(temp_service->hostgroup_name);
 
-		if (temp_service->hostgroup_name != NULL) {
-			if (xodtemplate_expand_hostgroups(&glist, host_map, temp_service->hostgroup_name, temp_service->_config_file, temp_service->_start_line) == ERROR) {
+		/* empty result is only bad if allow_empty_hostgroup_assignment is off */
+		if (!glist && !bitmap_count_set_bits(reject_map)) {
+			if (!allow_empty_hostgroup_assignment) {
+				nm_log(NSLOG_CONFIG_ERROR, "Error: Could not expand hostgroups and/or hosts specified in service (config file '%s', starting on line %d)\n", xodtemplate_config_file_name(temp_service->_config_file), temp_service->_start_line);
 				return ERROR;
+			} else if (allow_empty_hostgroup_assignment == 2) {
+				nm_log(NSLOG_CONFIG_WARNING, "Warning: Could not expand hostgroups and/or hosts specified in service (config file '%s', starting on line %d)\n", xodtemplate_config_file_name(temp_service->_config_file), temp_service->_start_line);
 			}
-			/* no longer needed */
-			nm_free(temp_service->hostgroup_name);
+		}
+	}
 
-			/* empty result is only bad if allow_empty_hostgroup_assignment is off */
-			if (!glist && !bitmap_count_set_bits(host_map)) {
-				if (!allow_empty_hostgroup_assignment) {
-					nm_log(NSLOG_CONFIG_ERROR, "Error: Could not expand hostgroups and/or hosts specified in service (config file '%s', starting on line %d)\n", xodtemplate_config_file_name(temp_service->_config_file), temp_service->_start_line);
-					return ERROR;
-				} else if (allow_empty_hostgroup_assignment == 2) {
-					nm_log(NSLOG_CONFIG_WARNING, "Warning: Could not expand hostgroups and/or hosts specified in service (config file '%s', starting on line %d)\n", xodtemplate_config_file_name(temp_service->_config_file), temp_service->_start_line);
-				}
-			}
+	/* now find direct hosts */
+	if (temp_service->host_name) {
+		if (xodtemplate_expand_hosts(&hlist, reject_map, temp_service->host_name, temp_service->_config_file, temp_service->_start_line) != OK) {
+			nm_log(NSLOG_CONFIG_ERROR, "Error: Failed to expand host list '%s' for service '%s' (%s:%d)\n",
+			       temp_service->host_name, temp_service->service_description,
+			       xodtemplate_config_file_name(temp_service->_config_file),
+			       temp_service->_start_line);
+			return ERROR;
 		}
+		/* we don't need this anymore now that we have the hlist */
+		nm_free(temp_service->host_name);
+	}
 
-		/* now find direct hosts */
-		if (temp_service->host_name) {
-			if (xodtemplate_expand_hosts(&hlist, host_map, temp_service->host_name, temp_service->_config_file, temp_service->_start_line) != OK) {
-				nm_log(NSLOG_CONFIG_ERROR, "Error: Failed to expand host list '%s' for service '%s' (%s:%d)\n",
-				       temp_service->host_name, temp_service->service_description,
-				       xodtemplate_config_file_name(temp_service->_config_file),
-				       temp_service->_start_line);
-				return ERROR;
+	/*
+	 * reject_map now contains all rejected hosts
+	 * group_map contains all rejected hostgroups
+	 * hlist contains all hosts we're directly assigned to.
+	 * glist contains all hostgroups we're assigned to.
+	 * We ignore hostgroups we're assigned to that are also rejected.
+	 * We do a dirty trick here and prepend a fake hostgroup
+	 * to the hostgroup list so we can use the same loop for
+	 * the rest of the code.
+	 */
+	fake_hg.hostgroup_name = "!!FAKE HOSTGROUP";
+	fake_hg.member_list = hlist;
+	prepend_object_to_objectlist(&glist, &fake_hg);
+	for (list = glist; list; list = next) {
+		xodtemplate_hostgroup *hg = (xodtemplate_hostgroup *)list->object_ptr;
+		next = list->next;
+		free(list);
+
+		/* we don't free this list */
+		for (hlist = hg->member_list; hlist; hlist = hlist->next) {
+			xodtemplate_host *h = (xodtemplate_host *)hlist->object_ptr;
+			struct xod_service_target *target;
+
+			/* ignore this host if it's rejected */
+			if (bitmap_isset(reject_map, h->id))
+				continue;
+
+			/*
+			 * reject more copies of this host. This happens
+			 * if the service is assigned to multiple hostgroups
+			 * where the same host is part of more than one of
+			 * them
+			 */
+			bitmap_set(reject_map, h->id);
+
+			if (exp->count == exp->size) {
+				exp->size = exp->size ? exp->size * 2 : 4;
+				exp->targets = nm_realloc(exp->targets, exp->size * sizeof(*exp->targets));
 			}
-			/* we don't need this anymore now that we have the hlist */
-			nm_free(temp_service->host_name);
+			target = &exp->targets[exp->count++];
+			target->host_name = h->host_name;
+			target->from_hg = (hg != &fake_hg);
+			/* if this is the last duplication, use the existing entry */
+			target->is_last = (!next && !hlist->next);
 		}
+		free_objectlist(&fake_hg.member_list);
+	}
 
-		/*
-		 * host_map now contains all rejected hosts
-		 * group_map contains all rejected hostgroups
-		 * hlist contains all hosts we're directly assigned to.
-		 * glist contains all hostgroups we're assigned to.
-		 * We ignore hostgroups we're assigned to that are also rejected.
-		 * We do a dirty trick here and prepend a fake hostgroup
-		 * to the hostgroup list so we can use the same loop for
-		 * the rest of the code.
-		 */
-		fake_hg.hostgroup_name = "!!FAKE HOSTGROUP";
-		fake_hg.member_list = hlist;
-		prepend_object_to_objectlist(&glist, &fake_hg);
-		for (list = glist; list; list = next) {
-			xodtemplate_hostgroup *hg = (xodtemplate_hostgroup *)list->object_ptr;
-			next = list->next;
-			free(list);
-
-			/* we don't free this list */
-			for (hlist = hg->member_list; hlist; hlist = hlist->next) {
-				xodtemplate_host *h = (xodtemplate_host *)hlist->object_ptr;
+	return OK;
+}
 
-				/* ignore this host if it's rejected */
-				if (bitmap_isset(host_map, h->id))
-					continue;
 
-				/*
-				 * reject more copies of this host. This happens
-				 * if the service is assigned to multiple hostgroups
-				 * where the same host is part of more than one of
-				 * them
-				 */
-				bitmap_set(host_map, h->id);
+/* duplicates service definitions */
+static int xodtemplate_duplicate_services(void)
+{
+	gpointer prev;
+	xodtemplate_service *temp_service = NULL;
+	xodtemplate_host *temp_host = NULL;
+	struct xod_duplicate_services dup;
+	guint threads = xodtemplate_parallel_threads();
+	GPtrArray *objs;
+	unsigned int i, x;
+	int result;
 
-				/* if this is the last duplication, use the existing entry */
-				if (!next && !hlist->next) {
-					temp_service->id = xodcount.services++;
-					temp_service->host_name = h->host_name;
-					temp_service->is_from_hostgroup = (hg != &fake_hg);
-				} else {
-					/* duplicate service definition */
-					xodtemplate_duplicate_service(temp_service, h->host_name, hg != &fake_hg);
-				}
+	xodcount.services = 0;
+	/****** DUPLICATE SERVICE DEFINITIONS WITH ONE OR MORE HOSTGROUP AND/OR HOST NAMES ******/
+	objs = g_ptr_array_new();
+	for (temp_service = xodtemplate_service_list; temp_service != NULL; temp_service = temp_service->next)
+		g_ptr_array_add(objs, temp_service);
+
+	dup.exp = nm_calloc(objs->len ? objs->len : 1, sizeof(*dup.exp));
+	dup.host_maps = nm_calloc(threads, sizeof(bitmap *));
+	result = xodtemplate_parallel_foreach(objs, threads, xodtemplate_expand_service_hosts, &dup);
+	for (i = 0; i < threads; i++)
+		bitmap_destroy(dup.host_maps[i]);
+	nm_free(dup.host_maps);
+
+	for (i = 0; i < objs->len; i++) {
+		struct xod_service_expansion *exp = &dup.exp[i];
+		temp_service = g_ptr_array_index(objs, i);
+		for (x = 0; result == OK && x < exp->count; x++) {
+			struct xod_service_target *target = &exp->targets[x];
+			if (target->is_last) {
+				temp_service->id = xodcount.services++;
+				temp_service->host_name = target->host_name;
+				temp_service->is_from_hostgroup = target->from_hg;
+			} else {
+				/* duplicate service definition */
+				xodtemplate_duplicate_service(temp_service, target->host_name, target->from_hg);
 			}
-			free_objectlist(&fake_hg.member_list);
 		}
+		nm_free(exp->targets);
 	}
+	nm_free(dup.exp);
+	g_ptr_array_free(objs, TRUE);
+	if (result != OK)
+		return result;
 
 	/***************************************/
 	/* INDEXING STUFF FOR FAST SORT/SEARCH */
@@ -2965,141 +3194,185 @@ static int xodtemplate_get_inherited_string(char *have_template_value, char **te
 }
 
 
-/* inherit object properties */
-/* some missing defaults (notification options, etc.) are also applied here */
-static int xodtemplate_inherit_object_properties(void)
+/* services inherit some properties from their associated host... */
+static int xodtemplate_inherit_service_properties(struct xod_parallel *p, guint idx, guint worker)
 {
+	xodtemplate_service *temp_service = g_ptr_array_index(p->objs, idx);
 	xodtemplate_host *temp_host = NULL;
-	xodtemplate_service *temp_service = NULL;
-	xodtemplate_serviceescalation *temp_serviceescalation = NULL;
-	xodtemplate_hostescalation *temp_hostescalation = NULL;
 
+	/* find the host */
+	if ((temp_host = xodtemplate_find_real_host(temp_service->host_name)) == NULL)
+		return OK;
 
-	/* fill in missing defaults for hosts... */
-	for (temp_host = xodtemplate_host_list; temp_host != NULL; temp_host = temp_host->next) {
+	/*
+	 * if the service has no contacts specified, it will inherit
+	 * them from the host
+	 */
+	if (temp_service->have_contact_groups == FALSE && temp_service->have_contacts == FALSE) {
+		xod_inherit_str(temp_service, temp_host, contact_groups);
+		xod_inherit_str(temp_service, temp_host, contacts);
+	}
 
-		/* if notification options are missing, assume all */
-		if (temp_host->have_notification_options == FALSE) {
-			temp_host->notification_options = OPT_ALL;
-			temp_host->have_notification_options = TRUE;
-		}
+	/* services inherit notification interval from host if not already specified */
+	xod_inherit(temp_service, temp_host, notification_interval);
+
+	/* services inherit notification period from host if not already specified */
+	xod_inherit_str(temp_service, temp_host, notification_period);
+
+	/* services inherit check period from host if not already specified */
+	xod_inherit_str(temp_service, temp_host, check_period);
+
+	/* if notification options are missing, assume all */
+	if (temp_service->have_notification_options == FALSE) {
+		temp_service->notification_options = OPT_ALL;
+		temp_service->have_notification_options = TRUE;
 	}
 
-	/* services inherit some properties from their associated host... */
-	for (temp_service = xodtemplate_service_list; temp_service != NULL; temp_service = temp_service->next) {
+	return OK;
+}
 
-		/* find the host */
-		if ((temp_host = xodtemplate_find_real_host(temp_service->host_name)) == NULL)
-			continue;
 
-		/*
-		 * if the service has no contacts specified, it will inherit
-		 * them from the host
-		 */
-		if (temp_service->have_contact_groups == FALSE && temp_service->have_contacts == FALSE) {
-			xod_inherit_str(temp_service, temp_host, contact_groups);
-			xod_inherit_str(temp_service, temp_host, contacts);
-		}
+/* service escalations inherit some properties from their associated service... */
+static int xodtemplate_inherit_serviceescalation_properties(struct xod_parallel *p, guint idx, guint worker)
+{
+	xodtemplate_serviceescalation *temp_serviceescalation = g_ptr_array_index(p->objs, idx);
+	xodtemplate_service *temp_service = NULL;
 
-		/* services inherit notification interval from host if not already specified */
-		xod_inherit(temp_service, temp_host, notification_interval);
+	/* find the service */
+	if ((temp_service = xodtemplate_find_real_service(temp_serviceescalation->host_name, temp_serviceescalation->service_description)) == NULL)
+		return OK;
 
-		/* services inherit notification period from host if not already specified */
-		xod_inherit_str(temp_service, temp_host, notification_period);
+	/* SPECIAL RULE 10/04/07 - additive inheritance from service's contactgroup(s) */
+	if (temp_serviceescalation->contact_groups != NULL && temp_serviceescalation->contact_groups[0] == '+')
+		xodtemplate_get_inherited_string(&temp_service->have_contact_groups, &temp_service->contact_groups, &temp_serviceescalation->have_contact_groups, &temp_serviceescalation->contact_groups);
 
-		/* services inherit check period from host if not already specified */
-		xod_inherit_str(temp_service, temp_host, check_period);
+	/* SPECIAL RULE 10/04/07 - additive inheritance from service's contact(s) */
+	if (temp_serviceescalation->contacts != NULL && temp_serviceescalation->contacts[0] == '+')
+		xodtemplate_get_inherited_string(&temp_service->have_contacts, &temp_service->contacts, &temp_serviceescalation->have_contacts, &temp_serviceescalation->contacts);
 
-		/* if notification options are missing, assume all */
-		if (temp_service->have_notification_options == FALSE) {
-			temp_service->notification_options = OPT_ALL;
-			temp_service->have_notification_options = TRUE;
-		}
+	/* service escalations inherit contacts from service if none are specified */
+	if (temp_serviceescalation->have_contact_groups == FALSE && temp_serviceescalation->have_contacts == FALSE) {
+		xod_inherit_str(temp_serviceescalation, temp_service, contact_groups);
+		xod_inherit_str(temp_serviceescalation, temp_service, contacts);
 	}
 
-	/* service escalations inherit some properties from their associated service... */
-	for (temp_serviceescalation = xodtemplate_serviceescalation_list; temp_serviceescalation != NULL; temp_serviceescalation = temp_serviceescalation->next) {
+	/* service escalations inherit notification interval from service if not already defined */
+	xod_inherit(temp_serviceescalation, temp_service, notification_interval);
 
-		/* find the service */
-		if ((temp_service = xodtemplate_find_real_service(temp_serviceescalation->host_name, temp_serviceescalation->service_description)) == NULL)
-			continue;
+	/* service escalations inherit escalation period from service if not already defined */
+	if (temp_serviceescalation->have_escalation_period == FALSE && temp_service->have_notification_period == TRUE && temp_service->notification_period != NULL) {
+		temp_serviceescalation->escalation_period = nm_strdup(temp_service->notification_period);
+		temp_serviceescalation->have_escalation_period = TRUE;
+	}
 
-		/* SPECIAL RULE 10/04/07 - additive inheritance from service's contactgroup(s) */
-		if (temp_serviceescalation->contact_groups != NULL && temp_serviceescalation->contact_groups[0] == '+')
-			xodtemplate_get_inherited_string(&temp_service->have_contact_groups, &temp_service->contact_groups, &temp_serviceescalation->have_contact_groups, &temp_serviceescalation->contact_groups);
+	/* if escalation options are missing, assume all */
+	if (temp_serviceescalation->have_escalation_options == FALSE) {
+		temp_serviceescalation->escalation_options = OPT_ALL;
+		temp_serviceescalation->have_escalation_options = TRUE;
+	}
 
-		/* SPECIAL RULE 10/04/07 - additive inheritance from service's contact(s) */
-		if (temp_serviceescalation->contacts != NULL && temp_serviceescalation->contacts[0] == '+')
-			xodtemplate_get_inherited_string(&temp_service->have_contacts, &temp_service->contacts, &temp_serviceescalation->have_contacts, &temp_serviceescalation->contacts);
+	/* 03/05/08 clear additive string chars - not done in xodtemplate_clean_additive_strings() anymore */
+	xodtemplate_clean_additive_string(&temp_serviceescalation->contact_groups);
+	xodtemplate_clean_additive_string(&temp_serviceescalation->contacts);
 
-		/* service escalations inherit contacts from service if none are specified */
-		if (temp_serviceescalation->have_contact_groups == FALSE && temp_serviceescalation->have_contacts == FALSE) {
-			xod_inherit_str(temp_serviceescalation, temp_service, contact_groups);
-			xod_inherit_str(temp_serviceescalation, temp_service, contacts);
-		}
+	return OK;
+}
 
-		/* service escalations inherit notification interval from service if not already defined */
-		xod_inherit(temp_serviceescalation, temp_service, notification_interval);
 
-		/* service escalations inherit escalation period from service if not already defined */
-		if (temp_serviceescalation->have_escalation_period == FALSE && temp_service->have_notification_period == TRUE && temp_service->notification_period != NULL) {
-			temp_serviceescalation->escalation_period = nm_strdup(temp_service->notification_period);
-			temp_serviceescalation->have_escalation_period = TRUE;
-		}
+/* host escalations inherit some properties from their associated host... */
+static int xodtemplate_inherit_hostescalation_properties(struct xod_parallel *p, guint idx, guint worker)
+{
+	xodtemplate_hostescalation *temp_hostescalation = g_ptr_array_index(p->objs, idx);
+	xodtemplate_host *temp_host = NULL;
 
-		/* if escalation options are missing, assume all */
-		if (temp_serviceescalation->have_escalation_options == FALSE) {
-			temp_serviceescalation->escalation_options = OPT_ALL;
-			temp_serviceescalation->have_escalation_options = TRUE;
-		}
+	/* find the host */
+	if ((temp_host = xodtemplate_find_real_host(temp_hostescalation->host_name)) == NULL)
+		return OK;
+
+	/* SPECIAL RULE 10/04/07 - additive inheritance from host's contactgroup(s) */
+	if (temp_hostescalation->contact_groups != NULL && temp_hostescalation->contact_groups[0] == '+')
+		xodtemplate_get_inherited_string(&temp_host->have_contact_groups, &temp_host->contact_groups, &temp_hostescalation->have_contact_groups, &temp_hostescalation->contact_groups);
+
+	/* SPECIAL RULE 10/04/07 - additive inheritance from host's contact(s) */
+	if (temp_hostescalation->contacts != NULL && temp_hostescalation->contacts[0] == '+')
+		xodtemplate_get_inherited_string(&temp_host->have_contacts, &temp_host->contacts, &temp_hostescalation->have_contacts, &temp_hostescalation->contacts);
 
-		/* 03/05/08 clear additive string chars - not done in xodtemplate_clean_additive_strings() anymore */
-		xodtemplate_clean_additive_string(&temp_serviceescalation->contact_groups);
-		xodtemplate_clean_additive_string(&temp_serviceescalation->contacts);
+	/* host escalations inherit contacts from host if none are specified */
+	if (temp_hostescalation->have_contact_groups == FALSE && temp_hostescalation->have_contacts == FALSE) {
+		xod_inherit_str(temp_hostescalation, temp_host, contact_groups);
+		xod_inherit_str(temp_hostescalation, temp_host, contacts);
 	}
 
-	/* host escalations inherit some properties from their associated host... */
-	for (temp_hostescalation = xodtemplate_hostescalation_list; temp_hostescalation != NULL; temp_hostescalation = temp_hostescalation->next) {
+	/* host escalations inherit notification interval from host if not already defined */
+	xod_inherit(temp_hostescalation, temp_host, notification_interval);
 
-		/* find the host */
-		if ((temp_host = xodtemplate_find_real_host(temp_hostescalation->host_name)) == NULL)
-			continue;
+	/* host escalations inherit escalation period from host if not already defined */
+	if (temp_hostescalation->have_escalation_period == FALSE && temp_host->have_notification_period == TRUE && temp_host->notification_period != NULL) {
+		temp_hostescalation->escalation_period = nm_strdup(temp_host->notification_period);
+		temp_hostescalation->have_escalation_period = TRUE;
+	}
 
-		/* SPECIAL RULE 10/04/07 - additive inheritance from host's contactgroup(s) */
-		if (temp_hostescalation->contact_groups != NULL && temp_hostescalation->contact_groups[0] == '+')
-			xodtemplate_get_inherited_string(&temp_host->have_contact_groups, &temp_host->contact_groups, &temp_hostescalation->have_contact_groups, &temp_hostescalation->contact_groups);
+	/* if escalation options are missing, assume all */
+	if (temp_hostescalation->have_escalation_options == FALSE) {
+		temp_hostescalation->escalation_options = OPT_ALL;
+		temp_hostescalation->have_escalation_options = TRUE;
+	}
 
-		/* SPECIAL RULE 10/04/07 - additive inheritance from host's contact(s) */
-		if (temp_hostescalation->contacts != NULL && temp_hostescalation->contacts[0] == '+')
-			xodtemplate_get_inherited_string(&temp_host->have_contacts, &temp_host->contacts, &temp_hostescalation->have_contacts, &temp_hostescalation->contacts);
+	/* 03/05/08 clear additive string chars - not done in xodtemplate_clean_additive_strings() anymore */
+	xodtemplate_clean_additive_string(&temp_hostescalation->contact_groups);
+	xodtemplate_clean_additive_string(&temp_hostescalation->contacts);
 
-		/* host escalations inherit contacts from host if none are specified */
-		if (temp_hostescalation->have_contact_groups == FALSE && temp_hostescalation->have_contacts == FALSE) {
-			xod_inherit_str(temp_hostescalation, temp_host, contact_groups);
-			xod_inherit_str(temp_hostescalation, temp_host, contacts);
-		}
+	return OK;
+}
 
-		/* host escalations inherit notification interval from host if not already defined */
-		xod_inherit(temp_hostescalation, temp_host, notification_interval);
 
-		/* host escalations inherit escalation period from host if not already defined */
-		if (temp_hostescalation->have_escalation_period == FALSE && temp_host->have_notification_period == TRUE && temp_host->notification_period != NULL) {
-			temp_hostescalation->escalation_period = nm_strdup(temp_host->notification_period);
-			temp_hostescalation->have_escalation_period = TRUE;
-		}
+/* inherit object properties */
+/* some missing defaults (notification options, etc.) are also applied here */
+/* each pass only writes to the objects it walks, so they can all run in parallel */
+static int xodtemplate_inherit_object_properties(void)
+{
+	xodtemplate_host *temp_host = NULL;
+	xodtemplate_service *temp_service = NULL;
+	xodtemplate_serviceescalation *temp_serviceescalation = NULL;
+	xodtemplate_hostescalation *temp_hostescalation = NULL;
+	guint threads = xodtemplate_parallel_threads();
+	GPtrArray *objs;
+	int result;
 
-		/* if escalation options are missing, assume all */
-		if (temp_hostescalation->have_escalation_options == FALSE) {
-			temp_hostescalation->escalation_options = OPT_ALL;
-			temp_hostescalation->have_escalation_options = TRUE;
-		}
 
-		/* 03/05/08 clear additive string chars - not done in xodtemplate_clean_additive_strings() anymore */
-		xodtemplate_clean_additive_string(&temp_hostescalation->contact_groups);
-		xodtemplate_clean_additive_string(&temp_hostescalation->contacts);
+	/* fill in missing defaults for hosts... */
+	for (temp_host = xodtemplate_host_list; temp_host != NULL; temp_host = temp_host->next) {
+
+		/* if notification options are missing, assume all */
+		if (temp_host->have_notification_options == FALSE) {
+			temp_host->notification_options = OPT_ALL;
+			temp_host->have_notification_options = TRUE;
+		}
 	}
 
-	return OK;
+	objs = g_ptr_array_new();
+	for (temp_service = xodtemplate_service_list; temp_service != NULL; temp_service = temp_service->next)
+		g_ptr_array_add(objs, temp_service);
+	result = xodtemplate_parallel_foreach(objs, threads, xodtemplate_inherit_service_properties, NULL);
+	g_ptr_array_free(objs, TRUE);
+	if (result != OK)
+		return result;
+
+	objs = g_ptr_array_new();
+	for (temp_serviceescalation = xodtemplate_serviceescalation_list; temp_serviceescalation != NULL; temp_serviceescalation = temp_serviceescalation->next)
+		g_ptr_array_add(objs, temp_serviceescalation);
+	result = xodtemplate_parallel_foreach(objs, threads, xodtemplate_inherit_serviceescalation_properties, NULL);
+	g_ptr_array_free(objs, TRUE);
+	if (result != OK)
+		return result;
+
+	objs = g_ptr_array_new();
+	for (temp_hostescalation = xodtemplate_hostescalation_list; temp_hostescalation != NULL; temp_hostescalation = temp_hostescalation->next)
+		g_ptr_array_add(objs, temp_hostescalation);
+	result = xodtemplate_parallel_foreach(objs, threads, xodtemplate_inherit_hostescalation_properties, NULL);
+	g_ptr_array_free(objs, TRUE);
+
+	return result;
 }
 
 
@@ -3238,6 +3511,7 @@ static int xodtemplate_resolve_command(xodtemplate_command *this_command)
 		/* apply missing properties from template command... */
 		xod_inherit_str_nohave(this_command, template_command, command_name);
 		xod_inherit_str_nohave(this_command, template_command, command_line);
+		xod_inherit(this_command, template_command, max_output_size);
 	}
 
 	nm_free(template_names);
@@ -4094,6 +4368,18 @@ static int xodtemplate_resolve_serviceextinfo(xodtemplate_serviceextinfo *this_s
 }
 
 
+static int xodtemplate_resolve_host_parallel(struct xod_parallel *p, guint idx, guint worker)
+{
+	return xodtemplate_resolve_host(g_ptr_array_index(p->objs, idx));
+}
+
+
+static int xodtemplate_resolve_service_parallel(struct xod_parallel *p, guint idx, guint worker)
+{
+	return xodtemplate_resolve_service(g_ptr_array_index(p->objs, idx));
+}
+
+
 /* resolves object definitions */
 static int xodtemplate_resolve_objects(void)
 {
@@ -4111,6 +4397,9 @@ static int xodtemplate_resolve_objects(void)
 	xodtemplate_hostescalation *temp_hostescalation = NULL;
 	xodtemplate_hostextinfo *temp_hostextinfo = NULL;
 	xodtemplate_serviceextinfo *temp_serviceextinfo = NULL;
+	guint threads = xodtemplate_parallel_threads();
+	GPtrArray *objs;
+	int result;
 
 	/* resolve all timeperiod objects */
 	for (temp_timeperiod = xodtemplate_timeperiod_list; temp_timeperiod != NULL; temp_timeperiod = temp_timeperiod->next) {
@@ -4160,17 +4449,39 @@ static int xodtemplate_resolve_objects(void)
 			return ERROR;
 	}
 
-	/* resolve all host objects */
+	/*
+	 * resolve all host and service objects. Anything with a name can
+	 * be used as a template, so we resolve those first. After that,
+	 * resolving an object only reads from its (already resolved)
+	 * templates, so the rest can be resolved in parallel.
+	 */
+	objs = g_ptr_array_new();
 	for (temp_host = xodtemplate_host_list; temp_host != NULL; temp_host = temp_host->next) {
-		if (xodtemplate_resolve_host(temp_host) == ERROR)
+		if (temp_host->name == NULL) {
+			g_ptr_array_add(objs, temp_host);
+		} else if (xodtemplate_resolve_host(temp_host) == ERROR) {
+			g_ptr_array_free(objs, TRUE);
 			return ERROR;
+		}
 	}
+	result = xodtemplate_parallel_foreach(objs, threads, xodtemplate_resolve_host_parallel, NULL);
+	g_ptr_array_free(objs, TRUE);
+	if (result == ERROR)
+		return ERROR;
 
-	/* resolve all service objects */
+	objs = g_ptr_array_new();
 	for (temp_service = xodtemplate_service_list; temp_service != NULL; temp_service = temp_service->next) {
-		if (xodtemplate_resolve_service(temp_service) == ERROR)
+		if (temp_service->name == NULL) {
+			g_ptr_array_add(objs, temp_service);
+		} else if (xodtemplate_resolve_service(temp_service) == ERROR) {
+			g_ptr_array_free(objs, TRUE);
 			return ERROR;
+		}
 	}
+	result = xodtemplate_parallel_foreach(objs, threads, xodtemplate_resolve_service_parallel, NULL);
+	g_ptr_array_free(objs, TRUE);
+	if (result == ERROR)
+		return ERROR;
 
 	/* resolve all hostdependency objects */
 	for (temp_hostdependency = xodtemplate_hostdependency_list; temp_hostdependency != NULL; temp_hostdependency = temp_hostdependency->next) {
@@ -4509,6 +4820,7 @@ static int xodtemplate_get_hostgroup_names(xodtemplate_memberlist **list, xodtem
 {
 	char *hostgroup_names = NULL;
 	char *temp_ptr = NULL;
+	char *saveptr = NULL;
 	xodtemplate_hostgroup *temp_hostgroup = NULL;
 	regex_t preg;
 	int found_match = TRUE;
@@ -4521,7 +4833,7 @@ static int xodtemplate_get_hostgroup_names(xodtemplate_memberlist **list, xodtem
 	/* allocate memory for hostgroup name list */
 	hostgroup_names = nm_strdup(hostgroups);
 
-	for (temp_ptr = strtok(hostgroup_names, ","); temp_ptr; temp_ptr = strtok(NULL, ",")) {
+	for (temp_ptr = strtok_r(hostgroup_names, ",", &saveptr); temp_ptr; temp_ptr = strtok_r(NULL, ",", &saveptr)) {
 
 		found_match = FALSE;
 		reject_item = FALSE;
@@ -5060,82 +5372,145 @@ static int xodtemplate_recombobulate_hostgroup_subgroups(xodtemplate_hostgroup *
 }
 
 
-/* recombobulates hostgroup definitions */
-static int xodtemplate_recombobulate_hostgroups(void)
+/* expands the members of a single hostgroup */
+static int xodtemplate_expand_hostgroup_members(struct xod_parallel *p, guint idx, guint worker)
 {
+	xodtemplate_hostgroup *temp_hostgroup = g_ptr_array_index(p->objs, idx);
 	xodtemplate_host *temp_host = NULL;
-	xodtemplate_hostgroup *temp_hostgroup = NULL;
-	char *hostgroup_names = NULL;
-	char *ptr, *next_ptr, *temp_ptr = NULL;
+	objectlist *next, *list, *accepted = NULL;
+	char *ptr, *next_ptr;
 	int res;
 
-	/* expand members of all hostgroups - this could be done in xodtemplate_register_hostgroup(), but we can save the CGIs some work if we do it here */
-	for (temp_hostgroup = xodtemplate_hostgroup_list; temp_hostgroup; temp_hostgroup = temp_hostgroup->next) {
-		objectlist *next, *list, *accepted = NULL;
+	/*
+	 * if the hostgroup has no accept or reject list and no group
+	 * members we don't need the bitmaps for it. bitmap_isset()
+	 * will return 0 when passed a NULL map, so we can safely use
+	 * that to add any items from the object list later.
+	 */
+	if (temp_hostgroup->members == NULL && temp_hostgroup->hostgroup_members == NULL)
+		return OK;
 
-		/*
-		 * if the hostgroup has no accept or reject list and no group
-		 * members we don't need the bitmaps for it. bitmap_isset()
-		 * will return 0 when passed a NULL map, so we can safely use
-		 * that to add any items from the object list later.
-		 */
-		if (temp_hostgroup->members == NULL && temp_hostgroup->hostgroup_members == NULL)
-			continue;
+	/* we'll need the member_map */
+	if (!(temp_hostgroup->member_map = bitmap_create(xodcount.hosts))) {
+		nm_log(NSLOG_CONFIG_ERROR, "Error: Could not create member map for hostgroup '%s'\n", temp_hostgroup->hostgroup_name);
+		return ERROR;
+	}
 
-		/* we'll need the member_map */
-		if (!(temp_hostgroup->member_map = bitmap_create(xodcount.hosts))) {
-			nm_log(NSLOG_CONFIG_ERROR, "Error: Could not create member map for hostgroup '%s'\n", temp_hostgroup->hostgroup_name);
+	/* resolve groups into a group-list */
+	for (next_ptr = ptr = temp_hostgroup->hostgroup_members; next_ptr; ptr = next_ptr + 1) {
+		xodtemplate_hostgroup *hg;
+		next_ptr = strchr(ptr, ',');
+		if (next_ptr)
+			*next_ptr = 0;
+
+		ptr = trim(ptr);
+
+		if (!(hg = xodtemplate_find_real_hostgroup(ptr))) {
+			nm_log(NSLOG_CONFIG_ERROR, "Error: Could not find member group '%s' specified in hostgroup '%s' (config file '%s', starting on line %d)\n", ptr, temp_hostgroup->hostgroup_name, xodtemplate_config_file_name(temp_hostgroup->_config_file), temp_hostgroup->_start_line);
 			return ERROR;
 		}
+		prepend_object_to_objectlist(&temp_hostgroup->group_list, hg);
+	}
 
-		/* resolve groups into a group-list */
-		for (next_ptr = ptr = temp_hostgroup->hostgroup_members; next_ptr; ptr = next_ptr + 1) {
-			xodtemplate_hostgroup *hg;
-			next_ptr = strchr(ptr, ',');
-			if (next_ptr)
-				*next_ptr = 0;
+	/* move on if we have no members */
+	if (temp_hostgroup->members == NULL)
+		return OK;
 
-			ptr = trim(ptr);
+	/* we might need this */
+	if (!use_precached_objects && !(temp_hostgroup->reject_map = bitmap_create(xodcount.hosts))) {
+		nm_log(NSLOG_CONFIG_ERROR, "Error: Could not create reject map for hostgroup '%s'\n", temp_hostgroup->hostgroup_name);
+		return ERROR;
+	}
 
-			if (!(hg = xodtemplate_find_real_hostgroup(ptr))) {
-				nm_log(NSLOG_CONFIG_ERROR, "Error: Could not find member group '%s' specified in hostgroup '%s' (config file '%s', starting on line %d)\n", ptr, temp_hostgroup->hostgroup_name, xodtemplate_config_file_name(temp_hostgroup->_config_file), temp_hostgroup->_start_line);
-				return ERROR;
-			}
-			prepend_object_to_objectlist(&temp_hostgroup->group_list, hg);
-		}
+	/* get list of hosts in the hostgroup */
+	res = xodtemplate_expand_hosts(&accepted, temp_hostgroup->reject_map, temp_hostgroup->members, temp_hostgroup->_config_file, temp_hostgroup->_start_line);
+	if (res != OK || (!accepted && !bitmap_count_set_bits(temp_hostgroup->reject_map))) {
+		nm_log(NSLOG_CONFIG_ERROR, "Error: Could not expand members specified in hostgroup (config file '%s', starting on line %d)\n", xodtemplate_config_file_name(temp_hostgroup->_config_file), temp_hostgroup->_start_line);
+		return ERROR;
+	}
 
-		/* move on if we have no members */
-		if (temp_hostgroup->members == NULL)
-			continue;
+	nm_free(temp_hostgroup->members);
 
-		/* we might need this */
-		if (!use_precached_objects && !(temp_hostgroup->reject_map = bitmap_create(xodcount.hosts))) {
-			nm_log(NSLOG_CONFIG_ERROR, "Error: Could not create reject map for hostgroup '%s'\n", temp_hostgroup->hostgroup_name);
-			return ERROR;
-		}
+	for (list = accepted; list; list = next) {
+		temp_host = (xodtemplate_host *)list->object_ptr;
+		next = list->next;
+		free(list);
+		xodtemplate_add_hostgroup_member(temp_hostgroup, temp_host);
+	}
 
-		/* get list of hosts in the hostgroup */
-		res = xodtemplate_expand_hosts(&accepted, temp_hostgroup->reject_map, temp_hostgroup->members, temp_hostgroup->_config_file, temp_hostgroup->_start_line);
-		if (res != OK || (!accepted && !bitmap_count_set_bits(temp_hostgroup->reject_map))) {
-			nm_log(NSLOG_CONFIG_ERROR, "Error: Could not expand members specified in hostgroup (config file '%s', starting on line %d)\n", xodtemplate_config_file_name(temp_hostgroup->_config_file), temp_hostgroup->_start_line);
-			return ERROR;
-		}
+	return OK;
+}
 
-		nm_free(temp_hostgroup->members);
 
-		for (list = accepted; list; list = next) {
-			temp_host = (xodtemplate_host *)list->object_ptr;
-			next = list->next;
-			free(list);
-			xodtemplate_add_hostgroup_member(temp_hostgroup, temp_host);
+/*
+ * finds the hostgroups a host asks to join through its hostgroups
+ * directive. Joining them is left to the caller, since a hostgroup
+ * can be joined by many hosts at once.
+ */
+static int xodtemplate_find_host_hostgroups(struct xod_parallel *p, guint idx, guint worker)
+{
+	objectlist **joins = (objectlist **)p->arg;
+	xodtemplate_host *temp_host = g_ptr_array_index(p->objs, idx);
+	xodtemplate_hostgroup *temp_hostgroup = NULL;
+	char *hostgroup_names = NULL;
+	char *temp_ptr = NULL, *saveptr = NULL;
+
+	/* preprocess the hostgroup list, to change "grp1,grp2,grp3,!grp2" into "grp1,grp3" */
+	/* 10/18/07 EG an empty return value means an error occurred */
+	if ((hostgroup_names = xodtemplate_process_hostgroup_names(temp_host->host_groups, temp_host->_config_file, temp_host->_start_line)) == NULL) {
+		nm_log(NSLOG_CONFIG_ERROR, "Error: Failed to process hostgroup names for host '%s' (config file '%s', starting at line %d)\n",
+		       temp_host->host_name, xodtemplate_config_file_name(temp_host->_config_file), temp_host->_start_line);
+		return ERROR;
+	}
+
+	/* process the list of hostgroups */
+	for (temp_ptr = strtok_r(hostgroup_names, ",", &saveptr); temp_ptr; temp_ptr = strtok_r(NULL, ",", &saveptr)) {
+
+		/* strip trailing spaces */
+		temp_ptr = trim(temp_ptr);
+
+		/* find the hostgroup */
+		temp_hostgroup = xodtemplate_find_real_hostgroup(temp_ptr);
+		if (temp_hostgroup == NULL) {
+			nm_log(NSLOG_CONFIG_ERROR, "Error: Could not find hostgroup '%s' specified in host '%s' definition (config file '%s', starting on line %d)\n", temp_ptr, temp_host->host_name, xodtemplate_config_file_name(temp_host->_config_file), temp_host->_start_line);
+			nm_free(hostgroup_names);
+			return ERROR;
 		}
+		prepend_object_to_objectlist(&joins[idx], temp_hostgroup);
 	}
 
+	nm_free(hostgroup_names);
+
+	return OK;
+}
+
+
+/* recombobulates hostgroup definitions */
+static int xodtemplate_recombobulate_hostgroups(void)
+{
+	xodtemplate_host *temp_host = NULL;
+	xodtemplate_hostgroup *temp_hostgroup = NULL;
+	guint threads = xodtemplate_parallel_threads();
+	objectlist **joins, *list;
+	GPtrArray *objs;
+	unsigned int i;
+	int result;
+
+	/* expand members of all hostgroups - this could be done in xodtemplate_register_hostgroup(), but we can save the CGIs some work if we do it here */
+	objs = g_ptr_array_new();
+	for (temp_hostgroup = xodtemplate_hostgroup_list; temp_hostgroup; temp_hostgroup = temp_hostgroup->next)
+		g_ptr_array_add(objs, temp_hostgroup);
+	result = xodtemplate_parallel_foreach(objs, threads, xodtemplate_expand_hostgroup_members, NULL);
+	g_ptr_array_free(objs, TRUE);
+	if (result != OK)
+		return ERROR;
+
 	/* if we're using precached objects we can bail out now */
 	if (use_precached_objects)
 		return OK;
 
 	/* process all hosts that have hostgroup directives */
+	objs = g_ptr_array_new();
 	for (temp_host = xodtemplate_host_list; temp_host != NULL; temp_host = temp_host->next) {
 
 		/* skip hosts without hostgroup directives or host names */
@@ -5146,39 +5521,32 @@ static int xodtemplate_recombobulate_hostgroups(void)
 		if (temp_host->register_object == FALSE)
 			continue;
 
-		/* preprocess the hostgroup list, to change "grp1,grp2,grp3,!grp2" into "grp1,grp3" */
-		/* 10/18/07 EG an empty return value means an error occurred */
-		if ((hostgroup_names = xodtemplate_process_hostgroup_names(temp_host->host_groups, temp_host->_config_file, temp_host->_start_line)) == NULL) {
-			nm_log(NSLOG_CONFIG_ERROR, "Error: Failed to process hostgroup names for host '%s' (config file '%s', starting at line %d)\n",
-			       temp_host->host_name, xodtemplate_config_file_name(temp_host->_config_file), temp_host->_start_line);
-			return ERROR;
-		}
-
-		/* process the list of hostgroups */
-		for (temp_ptr = strtok(hostgroup_names, ","); temp_ptr; temp_ptr = strtok(NULL, ",")) {
-
-			/* strip trailing spaces */
-			temp_ptr = trim(temp_ptr);
+		g_ptr_array_add(objs, temp_host);
+	}
+	joins = nm_calloc(objs->len ? objs->len : 1, sizeof(objectlist *));
+	result = xodtemplate_parallel_foreach(objs, threads, xodtemplate_find_host_hostgroups, joins);
 
-			/* find the hostgroup */
-			temp_hostgroup = xodtemplate_find_real_hostgroup(temp_ptr);
-			if (temp_hostgroup == NULL) {
-				nm_log(NSLOG_CONFIG_ERROR, "Error: Could not find hostgroup '%s' specified in host '%s' definition (config file '%s', starting on line %d)\n", temp_ptr, temp_host->host_name, xodtemplate_config_file_name(temp_host->_config_file), temp_host->_start_line);
-				nm_free(hostgroup_names);
-				return ERROR;
-			}
+	/* add the hosts to their hostgroups, in host definition order */
+	for (i = 0; i < objs->len; i++) {
+		temp_host = g_ptr_array_index(objs, i);
+		for (list = joins[i]; result == OK && list; list = list->next) {
+			temp_hostgroup = (xodtemplate_hostgroup *)list->object_ptr;
 			if (!temp_hostgroup->member_map && !(temp_hostgroup->member_map = bitmap_create(xodcount.hosts))) {
 				nm_log(NSLOG_CONFIG_ERROR, "Failed to create bitmap to join host '%s' to group '%s'\n",
 				       temp_host->host_name, temp_hostgroup->hostgroup_name);
-				return ERROR;
+				result = ERROR;
+				break;
 			}
 
 			/* add ourselves to the hostgroup member list */
 			xodtemplate_add_hostgroup_member(temp_hostgroup, temp_host);
 		}
-
-		nm_free(hostgroup_names);
+		free_objectlist(&joins[i]);
 	}
+	nm_free(joins);
+	g_ptr_array_free(objs, TRUE);
+	if (result != OK)
+		return ERROR;
 
 	/* expand subgroup membership recursively */
 	for (temp_hostgroup = xodtemplate_hostgroup_list; temp_hostgroup; temp_hostgroup = temp_hostgroup->next) {
@@ -5581,6 +5949,7 @@ static int xodtemplate_register_command(void *cmnd, void *discard)
 		nm_log(NSLOG_CONFIG_ERROR, "Error: Could not register command (config file '%s', starting on line %d)\n", xodtemplate_config_file_name(this_command->_config_file), this_command->_start_line);
 		return ERROR;
 	}
+	new_command->max_output_size = this_command->max_output_size;
 
 	return register_command(new_command);
 }
@@ -6729,6 +7098,9 @@ static int xodtemplate_add_object_property(char *input)
 			}
 		} else if (!strcmp(variable, "command_line")) {
 			temp_command->command_line = nm_strdup(value);
+		} else if (!strcmp(variable, "max_output_size")) {
+			temp_command->max_output_size = strtoul(value, NULL, 0);
+			temp_command->have_max_output_size = TRUE;
 		} else if (!strcmp(variable, "register"))
 			return xod_parse_bool(temp_command, register_object, value);
 		else {
@@ -8682,9 +9054,10 @@ int xodtemplate_read_config_data(const char *main_config_file)
 	if (use_precached_objects == FALSE) {
 
 		/* resolve objects definitions */
+		xodtemplate_phase_begin();
 		if (result == OK)
 			result = xodtemplate_resolve_objects();
-		timing_point("Done resolving objects\n");
+		timing_point("Done resolving objects%s\n", xodtemplate_phase_summary());
 
 		/* these are no longer needed */
 		xodtemplate_free_template_trees();
@@ -8706,16 +9079,18 @@ int xodtemplate_read_config_data(const char *main_config_file)
 
 	timing_point("Done recombobulating contactgroups\n");
 
+	xodtemplate_phase_begin();
 	if (result == OK)
 		result = xodtemplate_recombobulate_hostgroups();
 
-	timing_point("Done recombobulating hostgroups\n");
+	timing_point("Done recombobulating hostgroups%s\n", xodtemplate_phase_summary());
 
 	if (use_precached_objects == FALSE) {
+		xodtemplate_phase_begin();
 		if (result == OK)
 			result = xodtemplate_duplicate_services();
 
-		timing_point("Created %u services (dupes possible)\n", xodcount.services);
+		timing_point("Created %u services (dupes possible)%s\n", xodcount.services, xodtemplate_phase_summary());
 	}
 
 	/* now we have an accurate service count */
@@ -8735,9 +9110,10 @@ int xodtemplate_read_config_data(const char *main_config_file)
 			result = xodtemplate_duplicate_objects();
 
 		/* NOTE: some missing defaults (notification options, etc.) are also applied here */
+		xodtemplate_phase_begin();
 		if (result == OK)
 			result = xodtemplate_inherit_object_properties();
-		timing_point("Done propagating inherited object properties\n");
+		timing_point("Done propagating inherited object properties%s\n", xodtemplate_phase_summary());
 	}
 
 	/* register objects */
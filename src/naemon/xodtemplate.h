@@ -98,7 +98,9 @@ typedef struct xodtemplate_command_struct {
 
     char       *command_name;
     char       *command_line;
+    unsigned long max_output_size;
 
+    unsigned have_max_output_size : 1;
     unsigned has_been_resolved : 1;
     unsigned register_object : 1;
     struct xodtemplate_command_struct *next;
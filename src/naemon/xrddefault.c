@@ -241,7 +241,7 @@ int xrddefault_save_state_information(void)
 
 		fprintf(fp, "state_history=");
 		for (x = 0; x < MAX_STATE_HISTORY_ENTRIES; x++)
-			fprintf(fp, "%s%d", (x > 0) ? "," : "", temp_host->state_history[(x + temp_host->state_history_index) % MAX_STATE_HISTORY_ENTRIES]);
+			fprintf(fp, "%s%d", (x > 0) ? "," : "", state_history_get(temp_host->state_history, (x + temp_host->state_history_index) % MAX_STATE_HISTORY_ENTRIES));
 		fprintf(fp, "\n");
 
 		/* custom variables */
@@ -339,7 +339,7 @@ int xrddefault_save_state_information(void)
 		fprintf(fp, "check_flapping_recovery_notification=%d\n", temp_service->check_flapping_recovery_notification);
 		fprintf(fp, "state_history=");
 		for (x = 0; x < MAX_STATE_HISTORY_ENTRIES; x++)
-			fprintf(fp, "%s%d", (x > 0) ? "," : "", temp_service->state_history[(x + temp_service->state_history_index) % MAX_STATE_HISTORY_ENTRIES]);
+			fprintf(fp, "%s%d", (x > 0) ? "," : "", state_history_get(temp_service->state_history, (x + temp_service->state_history_index) % MAX_STATE_HISTORY_ENTRIES));
 		fprintf(fp, "\n");
 
 		/* custom variables */
@@ -1117,7 +1117,7 @@ int xrddefault_read_state_information(void)
 							temp_ptr = val;
 							for (x = 0; x < MAX_STATE_HISTORY_ENTRIES; x++) {
 								if ((ch = my_strsep(&temp_ptr, ",")) != NULL)
-									temp_host->state_history[x] = atoi(ch);
+									state_history_set(&temp_host->state_history, x, atoi(ch));
 								else
 									break;
 							}
@@ -1173,11 +1173,10 @@ int xrddefault_read_state_information(void)
 							if (temp_host->modified_attributes & MODATTR_CHECK_COMMAND) {
 
 								/* make sure the check command still exists... */
-								tempval = nm_strdup(val);
-								temp_command = find_bang_command(tempval);
-								if (temp_command && tempval) {
-									nm_free(temp_host->check_command);
-									temp_host->check_command = tempval;
+								temp_command = find_bang_command(val);
+								if (temp_command) {
+									nm_intern_release(temp_host->check_command);
+									temp_host->check_command = nm_intern(val);
 								} else
 									temp_host->modified_attributes &= ~MODATTR_CHECK_COMMAND;
 							}
@@ -1187,8 +1186,8 @@ int xrddefault_read_state_information(void)
 								/* make sure the timeperiod still exists... */
 								temp_timeperiod = find_timeperiod(val);
 								if (temp_timeperiod) {
-									nm_free(temp_host->check_period);
-									temp_host->check_period = nm_strdup(temp_timeperiod->name);
+									nm_intern_release(temp_host->check_period);
+									temp_host->check_period = nm_intern(temp_timeperiod->name);
 									temp_host->check_period_ptr = temp_timeperiod;
 								} else {
 									temp_host->modified_attributes &= ~MODATTR_CHECK_TIMEPERIOD;
@@ -1200,8 +1199,8 @@ int xrddefault_read_state_information(void)
 								/* make sure the timeperiod still exists... */
 								temp_timeperiod = find_timeperiod(val);
 								if (temp_timeperiod) {
-									nm_free(temp_host->notification_period);
-									temp_host->notification_period = nm_strdup(temp_timeperiod->name);
+									nm_intern_release(temp_host->notification_period);
+									temp_host->notification_period = nm_intern(temp_timeperiod->name);
 									temp_host->notification_period_ptr = temp_timeperiod;
 								} else {
 									temp_host->modified_attributes &= ~MODATTR_NOTIFICATION_TIMEPERIOD;
@@ -1211,11 +1210,10 @@ int xrddefault_read_state_information(void)
 							if (temp_host->modified_attributes & MODATTR_EVENT_HANDLER_COMMAND) {
 
 								/* make sure the check command still exists... */
-								tempval = nm_strdup(val);
-								temp_command = find_bang_command(tempval);
-								if (temp_command && tempval) {
-									nm_free(temp_host->event_handler);
-									temp_host->event_handler = tempval;
+								temp_command = find_bang_command(val);
+								if (temp_command) {
+									nm_intern_release(temp_host->event_handler);
+									temp_host->event_handler = nm_intern(val);
 								} else
 									temp_host->modified_attributes &= ~MODATTR_EVENT_HANDLER_COMMAND;
 							}
@@ -1391,7 +1389,7 @@ int xrddefault_read_state_information(void)
 							temp_ptr = val;
 							for (x = 0; x < MAX_STATE_HISTORY_ENTRIES; x++) {
 								if ((ch = my_strsep(&temp_ptr, ",")) != NULL)
-									temp_service->state_history[x] = atoi(ch);
+									state_history_set(&temp_service->state_history, x, atoi(ch));
 								else
 									break;
 							}
@@ -1447,11 +1445,10 @@ int xrddefault_read_state_information(void)
 							if (temp_service->modified_attributes & MODATTR_CHECK_COMMAND) {
 
 								/* make sure the check command still exists... */
-								tempval = nm_strdup(val);
-								temp_command = find_bang_command(tempval);
-								if (temp_command && tempval) {
-									nm_free(temp_service->check_command);
-									temp_service->check_command = tempval;
+								temp_command = find_bang_command(val);
+								if (temp_command) {
+									nm_intern_release(temp_service->check_command);
+									temp_service->check_command = nm_intern(val);
 								} else {
 									temp_service->modified_attributes &= ~MODATTR_CHECK_COMMAND;
 								}
@@ -1462,8 +1459,8 @@ int xrddefault_read_state_information(void)
 								/* make sure the timeperiod still exists... */
 								temp_timeperiod = find_timeperiod(val);
 								if (temp_timeperiod) {
-									nm_free(temp_service->check_period);
-									temp_service->check_period = nm_strdup(temp_timeperiod->name);
+									nm_intern_release(temp_service->check_period);
+									temp_service->check_period = nm_intern(temp_timeperiod->name);
 									temp_service->check_period_ptr = temp_timeperiod;
 								} else {
 									temp_service->modified_attributes &= ~MODATTR_CHECK_TIMEPERIOD;
@@ -1475,8 +1472,8 @@ int xrddefault_read_state_information(void)
 								/* make sure the timeperiod still exists... */
 								temp_timeperiod = find_timeperiod(val);
 								if (temp_timeperiod) {
-									nm_free(temp_service->notification_period);
-									temp_service->notification_period = nm_strdup(temp_timeperiod->name);
+									nm_intern_release(temp_service->notification_period);
+									temp_service->notification_period = nm_intern(temp_timeperiod->name);
 									temp_service->notification_period_ptr = temp_timeperiod;
 								} else {
 									temp_service->modified_attributes &= ~MODATTR_NOTIFICATION_TIMEPERIOD;
@@ -1486,11 +1483,10 @@ int xrddefault_read_state_information(void)
 							if (temp_service->modified_attributes & MODATTR_EVENT_HANDLER_COMMAND) {
 
 								/* make sure the check command still exists... */
-								tempval = nm_strdup(val);
-								temp_command = find_bang_command(temp_ptr);
-								if (temp_command && tempval) {
-									nm_free(temp_service->event_handler);
-									temp_service->event_handler = tempval;
+								temp_command = find_bang_command(val);
+								if (temp_command) {
+									nm_intern_release(temp_service->event_handler);
+									temp_service->event_handler = nm_intern(val);
 								} else {
 									temp_service->modified_attributes &= ~MODATTR_EVENT_HANDLER_COMMAND;
 								}
@@ -0,0 +1,144 @@
+#include "config.h"
+#include "common.h"
+#include "xsdshm.h"
+#include "objects_host.h"
+#include "objects_service.h"
+#include "logging.h"
+#include "globals.h"
+#include "lib/shmstatus.h"
+#include <string.h>
+
+static struct shmstatus_header *segment;
+
+/******************************************************************/
+/********************* INIT/CLEANUP FUNCTIONS *********************/
+/******************************************************************/
+
+int xsdshm_initialize_status_data(void)
+{
+	struct shmstatus_entry *e;
+	size_t names_size = 0;
+	unsigned int i;
+
+	/* users have to ask for it */
+	if (!status_shm || !*status_shm)
+		return OK;
+
+	if (*status_shm != '/' || strchr(status_shm + 1, '/')) {
+		nm_log(NSLOG_RUNTIME_ERROR, "Error: status_shm must be a name like '/naemon-status', not '%s'\n", status_shm);
+		return ERROR;
+	}
+
+	for (i = 0; i < num_objects.hosts; i++)
+		names_size += strlen(host_ary[i]->name) + 1;
+	for (i = 0; i < num_objects.services; i++)
+		names_size += strlen(service_ary[i]->description) + 1;
+
+	segment = shmstatus_create(status_shm, num_objects.hosts, num_objects.services, names_size);
+	if (!segment) {
+		nm_log(NSLOG_RUNTIME_ERROR, "Error: Failed to create shared memory status segment '%s': %s\n", status_shm, strerror(errno));
+		return ERROR;
+	}
+
+	/* names never change, so they're set up once and for all */
+	for (i = 0; i < num_objects.hosts; i++) {
+		e = shmstatus_host(segment, i);
+		e->id = host_ary[i]->id;
+		e->name = shmstatus_add_string(segment, host_ary[i]->name);
+	}
+	for (i = 0; i < num_objects.services; i++) {
+		service *svc = service_ary[i];
+
+		e = shmstatus_service(segment, i);
+		e->id = svc->id;
+		e->host_id = svc->host_ptr->id;
+		e->name = shmstatus_host(segment, svc->host_ptr->id)->name;
+		e->description = shmstatus_add_string(segment, svc->description);
+	}
+
+	log_debug_info(DEBUGL_STATUSDATA, 1, "Created shared memory status segment '%s' (%lu bytes)\n",
+	               status_shm, (unsigned long)segment->size);
+	return xsdshm_save_status_data();
+}
+
+
+int xsdshm_cleanup_status_data(int delete_status_data)
+{
+	if (!segment)
+		return OK;
+
+	/* readers see it's stale either way, and move on to the next one */
+	shmstatus_destroy(segment, delete_status_data == TRUE ? status_shm : NULL);
+	segment = NULL;
+	return OK;
+}
+
+
+/******************************************************************/
+/****************** STATUS DATA OUTPUT FUNCTIONS ******************/
+/******************************************************************/
+
+#define copy_state(e, obj) \
+	do { \
+		(e)->current_state = (obj)->current_state; \
+		(e)->last_hard_state = (obj)->last_hard_state; \
+		(e)->state_type = (obj)->state_type; \
+		(e)->current_attempt = (obj)->current_attempt; \
+		(e)->max_attempts = (obj)->max_attempts; \
+		(e)->checks_enabled = (obj)->checks_enabled; \
+		(e)->has_been_checked = (obj)->has_been_checked; \
+		(e)->problem_has_been_acknowledged = (obj)->problem_has_been_acknowledged; \
+		(e)->scheduled_downtime_depth = (obj)->scheduled_downtime_depth; \
+		(e)->is_flapping = (obj)->is_flapping; \
+		(e)->last_check = (obj)->last_check; \
+		(e)->next_check = (obj)->next_check; \
+		(e)->last_state_change = (obj)->last_state_change; \
+		(e)->last_hard_state_change = (obj)->last_hard_state_change; \
+		(e)->latency = (obj)->latency; \
+		(e)->execution_time = (obj)->execution_time; \
+		shmstatus_set_output(segment, (e), (obj)->plugin_output); \
+	} while (0)
+
+void xsdshm_update_host(host *hst)
+{
+	struct shmstatus_entry *e;
+
+	if (!segment || hst->id >= segment->num_hosts)
+		return;
+
+	e = shmstatus_host(segment, hst->id);
+	shmstatus_write_begin(e);
+	copy_state(e, hst);
+	shmstatus_write_end(e);
+}
+
+
+void xsdshm_update_service(service *svc)
+{
+	struct shmstatus_entry *e;
+
+	if (!segment || svc->id >= segment->num_services)
+		return;
+
+	e = shmstatus_service(segment, svc->id);
+	shmstatus_write_begin(e);
+	copy_state(e, svc);
+	shmstatus_write_end(e);
+}
+
+
+/* catches state that changed without a status update, such as check scheduling */
+int xsdshm_save_status_data(void)
+{
+	unsigned int i;
+
+	if (!segment)
+		return OK;
+
+	for (i = 0; i < num_objects.hosts; i++)
+		xsdshm_update_host(host_ary[i]);
+	for (i = 0; i < num_objects.services; i++)
+		xsdshm_update_service(service_ary[i]);
+
+	return OK;
+}
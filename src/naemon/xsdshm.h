@@ -0,0 +1,25 @@
+#ifndef _XSDSHM_H
+#define _XSDSHM_H
+
+#if !defined (_NAEMON_H_INSIDE) && !defined (NAEMON_COMPILATION)
+#error "Only <naemon/naemon.h> can be included directly."
+#endif
+
+#include "objects_host.h"
+#include "objects_service.h"
+
+NAGIOS_BEGIN_DECL
+
+/*
+ * Mirrors host and service state into the shared memory segment named
+ * by status_shm, if set. See lib/shmstatus.h for the layout.
+ */
+int xsdshm_initialize_status_data(void);
+int xsdshm_cleanup_status_data(int);
+int xsdshm_save_status_data(void);
+void xsdshm_update_host(host *);
+void xsdshm_update_service(service *);
+
+NAGIOS_END_DECL
+
+#endif
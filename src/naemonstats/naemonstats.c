@@ -5,8 +5,11 @@
 #include <getopt.h>
 #include <string.h>
 #include <stdio.h>
+#include <ctype.h>
+#include <unistd.h>
 
 #include "lib/nspath.h"
+#include "lib/nsock.h"
 #include "config.h"
 #include <naemon/common.h>
 #include <naemon/defaults.h>
@@ -21,6 +24,8 @@
 
 static char *main_config_file = NULL;
 char *status_file = NULL;
+static char *query_socket = NULL;
+static int use_query_socket = FALSE;
 static char *mrtg_variables = NULL;
 static const char *mrtg_delimiter = "\n";
 char *mrtg_delimiter_save = NULL;
@@ -179,6 +184,7 @@ static int display_mrtg_values(void);
 static int display_stats(void);
 static int read_config_file(void);
 static int read_status_file(void);
+static int read_query_socket(void);
 static void free_memory(void);
 
 int main(int argc, char **argv)
@@ -197,6 +203,8 @@ int main(int argc, char **argv)
 		{"license", no_argument, NULL, 'L'},
 		{"config", required_argument, NULL, 'c'},
 		{"statsfile", required_argument, NULL, 's'},
+		{"query", no_argument, NULL, 'q'},
+		{"query-socket", required_argument, NULL, 'Q'},
 		{"mrtg", no_argument, NULL, 'm'},
 		{"data", required_argument, NULL, 'd'},
 		{"delimiter", required_argument, NULL, 'D'},
@@ -211,7 +219,7 @@ int main(int argc, char **argv)
 	/* get all command line arguments */
 	while (1) {
 
-		c = getopt(argc, argv, "+hVLc:ms:d:D:");
+		c = getopt(argc, argv, "+hVLc:ms:qQ:d:D:");
 
 		if (c == -1 || c == EOF)
 			break;
@@ -236,6 +244,14 @@ int main(int argc, char **argv)
 		case 's':
 			status_file = strdup(optarg);
 			break;
+		case 'q':
+			use_query_socket = TRUE;
+			break;
+		case 'Q':
+			nm_free(query_socket);
+			query_socket = strdup(optarg);
+			use_query_socket = TRUE;
+			break;
 		case 'm':
 			mrtg_mode = TRUE;
 			break;
@@ -292,6 +308,10 @@ int main(int argc, char **argv)
 		printf(" -c, --config=FILE  specifies location of main Naemon config file.\n");
 		printf(" -s, --statsfile=FILE  specifies alternate location of file to read Naemon\n");
 		printf("                       performance data from.\n");
+		printf(" -q, --query        ask the running Naemon through its query socket instead\n");
+		printf("                    of reading the status file.\n");
+		printf(" -Q, --query-socket=FILE  specifies alternate location of the query socket.\n");
+		printf("                          Implies -q.\n");
 		printf("\n");
 		printf("Output:\n");
 		printf(" -m, --mrtg         display output in MRTG compatible format.\n");
@@ -371,8 +391,8 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
-	/* if we got no -s option, we must read the main config file */
-	if (status_file == NULL) {
+	/* if we got no -s or -Q option, we must read the main config file */
+	if (use_query_socket == TRUE ? query_socket == NULL : status_file == NULL) {
 		/* read main config file */
 		result = read_config_file();
 		if (result == ERROR && mrtg_mode == FALSE) {
@@ -382,12 +402,23 @@ int main(int argc, char **argv)
 		}
 	}
 
-	/* read status file */
-	result = read_status_file();
-	if (result == ERROR && mrtg_mode == FALSE) {
-		printf("Error reading status file '%s': %s\n", status_file, strerror(errno));
-		free_memory();
-		return 1;
+	if (use_query_socket == TRUE) {
+		if (query_socket == NULL)
+			query_socket = strdup(get_default_query_socket());
+		result = read_query_socket();
+		if (result == ERROR && mrtg_mode == FALSE) {
+			printf("Error querying Naemon through '%s'\n", query_socket);
+			free_memory();
+			return 1;
+		}
+	} else {
+		/* read status file */
+		result = read_status_file();
+		if (result == ERROR && mrtg_mode == FALSE) {
+			printf("Error reading status file '%s': %s\n", status_file, strerror(errno));
+			free_memory();
+			return 1;
+		}
 	}
 
 	/* display stats */
@@ -740,7 +771,10 @@ static int display_stats(void)
 
 	printf("CURRENT STATUS DATA\n");
 	printf("------------------------------------------------------\n");
-	printf("Status File:                            %s\n", status_file);
+	if (use_query_socket == TRUE)
+		printf("Query Socket:                           %s\n", query_socket);
+	else
+		printf("Status File:                            %s\n", status_file);
 	time_difference = (current_time - status_creation_date);
 	get_time_breakdown(time_difference, &days, &hours, &minutes, &seconds);
 	printf("Status File Age:                        %dd %dh %dm %ds\n", days, hours, minutes, seconds);
@@ -857,6 +891,9 @@ static int read_config_file(void)
 			if (status_file)
 				free(status_file);
 			status_file = nspath_absolute(val, main_cfg_dir);
+		} else if (!strcmp(var, "query_socket")) {
+			nm_free(query_socket);
+			query_socket = nspath_absolute(val, main_cfg_dir);
 		}
 	}
 
@@ -872,26 +909,416 @@ static int read_config_file(void)
 }
 
 
+/* one object's worth of status data, from status.dat or the query socket */
+struct status_entry {
+	int data_type;
+	double execution_time;
+	double latency;
+	int check_type;
+	int current_state;
+	double state_change;
+	int is_flapping;
+	int downtime_depth;
+	time_t last_check;
+	int has_been_checked;
+};
+
+static void begin_status_entry(struct status_entry *e, int data_type)
+{
+	memset(e, 0, sizeof(*e));
+	e->data_type = data_type;
+
+	if (data_type == STATUS_SERVICE_DATA)
+		status_service_entries++;
+	else if (data_type == STATUS_HOST_DATA)
+		status_host_entries++;
+}
+
+static void add_status_var(struct status_entry *e, char *var, char *val)
+{
+	char *temp_ptr = NULL;
+
+	switch (e->data_type) {
+
+	case STATUS_INFO_DATA:
+		if (!strcmp(var, "created"))
+			status_creation_date = strtoul(val, NULL, 10);
+		else if (!strcmp(var, "version"))
+			status_version = strdup(val);
+		break;
+
+	case STATUS_PROGRAM_DATA:
+		if (!strcmp(var, "program_start"))
+			program_start = strtoul(val, NULL, 10);
+		else if (!strcmp(var, "nagios_pid"))
+			nagios_pid = strtoul(val, NULL, 10);
+		else if (!strcmp(var, "active_scheduled_host_check_stats")) {
+			if ((temp_ptr = strtok(val, ",")))
+				active_scheduled_host_checks_last_1min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				active_scheduled_host_checks_last_5min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				active_scheduled_host_checks_last_15min = atoi(temp_ptr);
+		} else if (!strcmp(var, "active_ondemand_host_check_stats")) {
+			if ((temp_ptr = strtok(val, ",")))
+				active_ondemand_host_checks_last_1min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				active_ondemand_host_checks_last_5min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				active_ondemand_host_checks_last_15min = atoi(temp_ptr);
+		} else if (!strcmp(var, "cached_host_check_stats")) {
+			if ((temp_ptr = strtok(val, ",")))
+				active_cached_host_checks_last_1min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				active_cached_host_checks_last_5min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				active_cached_host_checks_last_15min = atoi(temp_ptr);
+		} else if (!strcmp(var, "passive_host_check_stats")) {
+			if ((temp_ptr = strtok(val, ",")))
+				passive_host_checks_last_1min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				passive_host_checks_last_5min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				passive_host_checks_last_15min = atoi(temp_ptr);
+		} else if (!strcmp(var, "active_scheduled_service_check_stats")) {
+			if ((temp_ptr = strtok(val, ",")))
+				active_scheduled_service_checks_last_1min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				active_scheduled_service_checks_last_5min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				active_scheduled_service_checks_last_15min = atoi(temp_ptr);
+		} else if (!strcmp(var, "active_ondemand_service_check_stats")) {
+			if ((temp_ptr = strtok(val, ",")))
+				active_ondemand_service_checks_last_1min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				active_ondemand_service_checks_last_5min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				active_ondemand_service_checks_last_15min = atoi(temp_ptr);
+		} else if (!strcmp(var, "cached_service_check_stats")) {
+			if ((temp_ptr = strtok(val, ",")))
+				active_cached_service_checks_last_1min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				active_cached_service_checks_last_5min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				active_cached_service_checks_last_15min = atoi(temp_ptr);
+		} else if (!strcmp(var, "passive_service_check_stats")) {
+			if ((temp_ptr = strtok(val, ",")))
+				passive_service_checks_last_1min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				passive_service_checks_last_5min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				passive_service_checks_last_15min = atoi(temp_ptr);
+		} else if (!strcmp(var, "external_command_stats")) {
+			if ((temp_ptr = strtok(val, ",")))
+				external_commands_last_1min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				external_commands_last_5min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				external_commands_last_15min = atoi(temp_ptr);
+		} else if (!strcmp(var, "parallel_host_check_stats")) {
+			if ((temp_ptr = strtok(val, ",")))
+				parallel_host_checks_last_1min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				parallel_host_checks_last_5min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				parallel_host_checks_last_15min = atoi(temp_ptr);
+		} else if (!strcmp(var, "serial_host_check_stats")) {
+			if ((temp_ptr = strtok(val, ",")))
+				serial_host_checks_last_1min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				serial_host_checks_last_5min = atoi(temp_ptr);
+			if ((temp_ptr = strtok(NULL, ",")))
+				serial_host_checks_last_15min = atoi(temp_ptr);
+		}
+		break;
+
+	case STATUS_HOST_DATA:
+		if (!strcmp(var, "check_execution_time"))
+			e->execution_time = strtod(val, NULL);
+		else if (!strcmp(var, "check_latency"))
+			e->latency = strtod(val, NULL);
+		else if (!strcmp(var, "percent_state_change"))
+			e->state_change = strtod(val, NULL);
+		else if (!strcmp(var, "check_type"))
+			e->check_type = atoi(val);
+		else if (!strcmp(var, "current_state"))
+			e->current_state = atoi(val);
+		else if (!strcmp(var, "is_flapping"))
+			e->is_flapping = (atoi(val) > 0) ? TRUE : FALSE;
+		else if (!strcmp(var, "scheduled_downtime_depth"))
+			e->downtime_depth = atoi(val);
+		else if (!strcmp(var, "last_check"))
+			e->last_check = strtoul(val, NULL, 10);
+		else if (!strcmp(var, "has_been_checked"))
+			e->has_been_checked = (atoi(val) > 0) ? TRUE : FALSE;
+		break;
+
+	case STATUS_SERVICE_DATA:
+		if (!strcmp(var, "check_execution_time"))
+			e->execution_time = strtod(val, NULL);
+		else if (!strcmp(var, "check_latency"))
+			e->latency = strtod(val, NULL);
+		else if (!strcmp(var, "percent_state_change"))
+			e->state_change = strtod(val, NULL);
+		else if (!strcmp(var, "check_type"))
+			e->check_type = atoi(val);
+		else if (!strcmp(var, "current_state"))
+			e->current_state = atoi(val);
+		else if (!strcmp(var, "is_flapping"))
+			e->is_flapping = (atoi(val) > 0) ? TRUE : FALSE;
+		else if (!strcmp(var, "scheduled_downtime_depth"))
+			e->downtime_depth = atoi(val);
+		else if (!strcmp(var, "last_check"))
+			e->last_check = strtoul(val, NULL, 10);
+		else if (!strcmp(var, "has_been_checked"))
+			e->has_been_checked = (atoi(val) > 0) ? TRUE : FALSE;
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void end_status_entry(struct status_entry *e, time_t current_time)
+{
+	unsigned long time_difference = 0L;
+
+	switch (e->data_type) {
+
+	case STATUS_INFO_DATA:
+		break;
+
+	case STATUS_PROGRAM_DATA:
+		/* 02-15-2008 exclude cached host checks from total (they were ondemand checks that never actually executed) */
+		active_host_checks_last_1min = active_scheduled_host_checks_last_1min + active_ondemand_host_checks_last_1min;
+		active_host_checks_last_5min = active_scheduled_host_checks_last_5min + active_ondemand_host_checks_last_5min;
+		active_host_checks_last_15min = active_scheduled_host_checks_last_15min + active_ondemand_host_checks_last_15min;
+
+		/* 02-15-2008 exclude cached service checks from total (they were ondemand checks that never actually executed) */
+		active_service_checks_last_1min = active_scheduled_service_checks_last_1min + active_ondemand_service_checks_last_1min;
+		active_service_checks_last_5min = active_scheduled_service_checks_last_5min + active_ondemand_service_checks_last_5min;
+		active_service_checks_last_15min = active_scheduled_service_checks_last_15min + active_ondemand_service_checks_last_15min;
+		break;
+
+	case STATUS_HOST_DATA:
+		average_host_state_change = (((average_host_state_change * ((double)status_host_entries - 1.0)) + e->state_change) / (double)status_host_entries);
+		if (have_min_host_state_change == FALSE || min_host_state_change > e->state_change) {
+			have_min_host_state_change = TRUE;
+			min_host_state_change = e->state_change;
+		}
+		if (have_max_host_state_change == FALSE || max_host_state_change < e->state_change) {
+			have_max_host_state_change = TRUE;
+			max_host_state_change = e->state_change;
+		}
+		if (e->check_type == CHECK_TYPE_ACTIVE) {
+			active_host_checks++;
+			average_active_host_latency = (((average_active_host_latency * ((double)active_host_checks - 1.0)) + e->latency) / (double)active_host_checks);
+			if (have_min_active_host_latency == FALSE || min_active_host_latency > e->latency) {
+				have_min_active_host_latency = TRUE;
+				min_active_host_latency = e->latency;
+			}
+			if (have_max_active_host_latency == FALSE || max_active_host_latency < e->latency) {
+				have_max_active_host_latency = TRUE;
+				max_active_host_latency = e->latency;
+			}
+			average_active_host_execution_time = (((average_active_host_execution_time * ((double)active_host_checks - 1.0)) + e->execution_time) / (double)active_host_checks);
+			if (have_min_active_host_execution_time == FALSE || min_active_host_execution_time > e->execution_time) {
+				have_min_active_host_execution_time = TRUE;
+				min_active_host_execution_time = e->execution_time;
+			}
+			if (have_max_active_host_execution_time == FALSE || max_active_host_execution_time < e->execution_time) {
+				have_max_active_host_execution_time = TRUE;
+				max_active_host_execution_time = e->execution_time;
+			}
+			average_active_host_state_change = (((average_active_host_state_change * ((double)active_host_checks - 1.0)) + e->state_change) / (double)active_host_checks);
+			if (have_min_active_host_state_change == FALSE || min_active_host_state_change > e->state_change) {
+				have_min_active_host_state_change = TRUE;
+				min_active_host_state_change = e->state_change;
+			}
+			if (have_max_active_host_state_change == FALSE || max_active_host_state_change < e->state_change) {
+				have_max_active_host_state_change = TRUE;
+				max_active_host_state_change = e->state_change;
+			}
+			time_difference = current_time - e->last_check;
+			if (time_difference <= 3600)
+				active_hosts_checked_last_1hour++;
+			if (time_difference <= 900)
+				active_hosts_checked_last_15min++;
+			if (time_difference <= 300)
+				active_hosts_checked_last_5min++;
+			if (time_difference <= 60)
+				active_hosts_checked_last_1min++;
+		} else {
+			passive_host_checks++;
+			average_passive_host_latency = (((average_passive_host_latency * ((double)passive_host_checks - 1.0)) + e->latency) / (double)passive_host_checks);
+			if (have_min_passive_host_latency == FALSE || min_passive_host_latency > e->latency) {
+				have_min_passive_host_latency = TRUE;
+				min_passive_host_latency = e->latency;
+			}
+			if (have_max_passive_host_latency == FALSE || max_passive_host_latency < e->latency) {
+				have_max_passive_host_latency = TRUE;
+				max_passive_host_latency = e->latency;
+			}
+			average_passive_host_state_change = (((average_passive_host_state_change * ((double)passive_host_checks - 1.0)) + e->state_change) / (double)passive_host_checks);
+			if (have_min_passive_host_state_change == FALSE || min_passive_host_state_change > e->state_change) {
+				have_min_passive_host_state_change = TRUE;
+				min_passive_host_state_change = e->state_change;
+			}
+			if (have_max_passive_host_state_change == FALSE || max_passive_host_state_change < e->state_change) {
+				have_max_passive_host_state_change = TRUE;
+				max_passive_host_state_change = e->state_change;
+			}
+			time_difference = current_time - e->last_check;
+			if (time_difference <= 3600)
+				passive_hosts_checked_last_1hour++;
+			if (time_difference <= 900)
+				passive_hosts_checked_last_15min++;
+			if (time_difference <= 300)
+				passive_hosts_checked_last_5min++;
+			if (time_difference <= 60)
+				passive_hosts_checked_last_1min++;
+		}
+		switch (e->current_state) {
+		case STATE_UP:
+			hosts_up++;
+			break;
+		case STATE_DOWN:
+			hosts_down++;
+			break;
+		case STATE_UNREACHABLE:
+			hosts_unreachable++;
+			break;
+		default:
+			break;
+		}
+		if (e->is_flapping == TRUE)
+			hosts_flapping++;
+		if (e->downtime_depth > 0)
+			hosts_in_downtime++;
+		if (e->has_been_checked == TRUE)
+			hosts_checked++;
+		hosts_scheduled++;
+		break;
+
+	case STATUS_SERVICE_DATA:
+		average_service_state_change = (((average_service_state_change * ((double)status_service_entries - 1.0)) + e->state_change) / (double)status_service_entries);
+		if (have_min_service_state_change == FALSE || min_service_state_change > e->state_change) {
+			have_min_service_state_change = TRUE;
+			min_service_state_change = e->state_change;
+		}
+		if (have_max_service_state_change == FALSE || max_service_state_change < e->state_change) {
+			have_max_service_state_change = TRUE;
+			max_service_state_change = e->state_change;
+		}
+		if (e->check_type == CHECK_TYPE_ACTIVE) {
+			active_service_checks++;
+			average_active_service_latency = (((average_active_service_latency * ((double)active_service_checks - 1.0)) + e->latency) / (double)active_service_checks);
+			if (have_min_active_service_latency == FALSE || min_active_service_latency > e->latency) {
+				have_min_active_service_latency = TRUE;
+				min_active_service_latency = e->latency;
+			}
+			if (have_max_active_service_latency == FALSE || max_active_service_latency < e->latency) {
+				have_max_active_service_latency = TRUE;
+				max_active_service_latency = e->latency;
+			}
+			average_active_service_execution_time = (((average_active_service_execution_time * ((double)active_service_checks - 1.0)) + e->execution_time) / (double)active_service_checks);
+			if (have_min_active_service_execution_time == FALSE || min_active_service_execution_time > e->execution_time) {
+				have_min_active_service_execution_time = TRUE;
+				min_active_service_execution_time = e->execution_time;
+			}
+			if (have_max_active_service_execution_time == FALSE || max_active_service_execution_time < e->execution_time) {
+				have_max_active_service_execution_time = TRUE;
+				max_active_service_execution_time = e->execution_time;
+			}
+			average_active_service_state_change = (((average_active_service_state_change * ((double)active_service_checks - 1.0)) + e->state_change) / (double)active_service_checks);
+			if (have_min_active_service_state_change == FALSE || min_active_service_state_change > e->state_change) {
+				have_min_active_service_state_change = TRUE;
+				min_active_service_state_change = e->state_change;
+			}
+			if (have_max_active_service_state_change == FALSE || max_active_service_state_change < e->state_change) {
+				have_max_active_service_state_change = TRUE;
+				max_active_service_state_change = e->state_change;
+			}
+			time_difference = current_time - e->last_check;
+			if (time_difference <= 3600)
+				active_services_checked_last_1hour++;
+			if (time_difference <= 900)
+				active_services_checked_last_15min++;
+			if (time_difference <= 300)
+				active_services_checked_last_5min++;
+			if (time_difference <= 60)
+				active_services_checked_last_1min++;
+		} else {
+			passive_service_checks++;
+			average_passive_service_latency = (((average_passive_service_latency * ((double)passive_service_checks - 1.0)) + e->latency) / (double)passive_service_checks);
+			if (have_min_passive_service_latency == FALSE || min_passive_service_latency > e->latency) {
+				have_min_passive_service_latency = TRUE;
+				min_passive_service_latency = e->latency;
+			}
+			if (have_max_passive_service_latency == FALSE || max_passive_service_latency < e->latency) {
+				have_max_passive_service_latency = TRUE;
+				max_passive_service_latency = e->latency;
+			}
+			average_passive_service_state_change = (((average_passive_service_state_change * ((double)passive_service_checks - 1.0)) + e->state_change) / (double)passive_service_checks);
+			if (have_min_passive_service_state_change == FALSE || min_passive_service_state_change > e->state_change) {
+				have_min_passive_service_state_change = TRUE;
+				min_passive_service_state_change = e->state_change;
+			}
+			if (have_max_passive_service_state_change == FALSE || max_passive_service_state_change < e->state_change) {
+				have_max_passive_service_state_change = TRUE;
+				max_passive_service_state_change = e->state_change;
+			}
+			time_difference = current_time - e->last_check;
+			if (time_difference <= 3600)
+				passive_services_checked_last_1hour++;
+			if (time_difference <= 900)
+				passive_services_checked_last_15min++;
+			if (time_difference <= 300)
+				passive_services_checked_last_5min++;
+			if (time_difference <= 60)
+				passive_services_checked_last_1min++;
+		}
+		switch (e->current_state) {
+		case STATE_OK:
+			services_ok++;
+			break;
+		case STATE_WARNING:
+			services_warning++;
+			break;
+		case STATE_UNKNOWN:
+			services_unknown++;
+			break;
+		case STATE_CRITICAL:
+			services_critical++;
+			break;
+		default:
+			break;
+		}
+		if (e->is_flapping == TRUE)
+			services_flapping++;
+		if (e->downtime_depth > 0)
+			services_in_downtime++;
+		if (e->has_been_checked == TRUE)
+			services_checked++;
+		services_scheduled++;
+		break;
+
+	default:
+		break;
+	}
+
+	e->data_type = STATUS_NO_DATA;
+}
+
+
 static int read_status_file(void)
 {
 	char temp_buffer[MAX_INPUT_BUFFER] = {0};
 	FILE *fp = NULL;
-	int data_type = STATUS_NO_DATA;
+	struct status_entry entry = { STATUS_NO_DATA };
 	char *var = NULL;
 	char *val = NULL;
-	char *temp_ptr = NULL;
 	time_t current_time;
-	unsigned long time_difference = 0L;
-
-	double execution_time = 0.0;
-	double latency = 0.0;
-	int check_type = CHECK_TYPE_ACTIVE;
-	int current_state = STATE_OK;
-	double state_change = 0.0;
-	int is_flapping = FALSE;
-	int downtime_depth = 0;
-	time_t last_check = 0L;
-	int has_been_checked = TRUE;
 
 
 	time(&current_time);
@@ -910,407 +1337,28 @@ static int read_status_file(void)
 		strip(temp_buffer);
 
 		/* start of definition */
-		if (!strcmp(temp_buffer, "servicestatus {")) {
-			data_type = STATUS_SERVICE_DATA;
-			status_service_entries++;
-		} else if (!strcmp(temp_buffer, "hoststatus {")) {
-			data_type = STATUS_HOST_DATA;
-			status_host_entries++;
-		} else if (!strcmp(temp_buffer, "info {"))
-			data_type = STATUS_INFO_DATA;
+		if (!strcmp(temp_buffer, "servicestatus {"))
+			begin_status_entry(&entry, STATUS_SERVICE_DATA);
+		else if (!strcmp(temp_buffer, "hoststatus {"))
+			begin_status_entry(&entry, STATUS_HOST_DATA);
+		else if (!strcmp(temp_buffer, "info {"))
+			begin_status_entry(&entry, STATUS_INFO_DATA);
 		else if (!strcmp(temp_buffer, "programstatus {"))
-			data_type = STATUS_PROGRAM_DATA;
-
+			begin_status_entry(&entry, STATUS_PROGRAM_DATA);
 
 		/* end of definition */
-		else if (!strcmp(temp_buffer, "}")) {
-
-			switch (data_type) {
-
-			case STATUS_INFO_DATA:
-				break;
-
-			case STATUS_PROGRAM_DATA:
-				/* 02-15-2008 exclude cached host checks from total (they were ondemand checks that never actually executed) */
-				active_host_checks_last_1min = active_scheduled_host_checks_last_1min + active_ondemand_host_checks_last_1min;
-				active_host_checks_last_5min = active_scheduled_host_checks_last_5min + active_ondemand_host_checks_last_5min;
-				active_host_checks_last_15min = active_scheduled_host_checks_last_15min + active_ondemand_host_checks_last_15min;
-
-				/* 02-15-2008 exclude cached service checks from total (they were ondemand checks that never actually executed) */
-				active_service_checks_last_1min = active_scheduled_service_checks_last_1min + active_ondemand_service_checks_last_1min;
-				active_service_checks_last_5min = active_scheduled_service_checks_last_5min + active_ondemand_service_checks_last_5min;
-				active_service_checks_last_15min = active_scheduled_service_checks_last_15min + active_ondemand_service_checks_last_15min;
-				break;
-
-			case STATUS_HOST_DATA:
-				average_host_state_change = (((average_host_state_change * ((double)status_host_entries - 1.0)) + state_change) / (double)status_host_entries);
-				if (have_min_host_state_change == FALSE || min_host_state_change > state_change) {
-					have_min_host_state_change = TRUE;
-					min_host_state_change = state_change;
-				}
-				if (have_max_host_state_change == FALSE || max_host_state_change < state_change) {
-					have_max_host_state_change = TRUE;
-					max_host_state_change = state_change;
-				}
-				if (check_type == CHECK_TYPE_ACTIVE) {
-					active_host_checks++;
-					average_active_host_latency = (((average_active_host_latency * ((double)active_host_checks - 1.0)) + latency) / (double)active_host_checks);
-					if (have_min_active_host_latency == FALSE || min_active_host_latency > latency) {
-						have_min_active_host_latency = TRUE;
-						min_active_host_latency = latency;
-					}
-					if (have_max_active_host_latency == FALSE || max_active_host_latency < latency) {
-						have_max_active_host_latency = TRUE;
-						max_active_host_latency = latency;
-					}
-					average_active_host_execution_time = (((average_active_host_execution_time * ((double)active_host_checks - 1.0)) + execution_time) / (double)active_host_checks);
-					if (have_min_active_host_execution_time == FALSE || min_active_host_execution_time > execution_time) {
-						have_min_active_host_execution_time = TRUE;
-						min_active_host_execution_time = execution_time;
-					}
-					if (have_max_active_host_execution_time == FALSE || max_active_host_execution_time < execution_time) {
-						have_max_active_host_execution_time = TRUE;
-						max_active_host_execution_time = execution_time;
-					}
-					average_active_host_state_change = (((average_active_host_state_change * ((double)active_host_checks - 1.0)) + state_change) / (double)active_host_checks);
-					if (have_min_active_host_state_change == FALSE || min_active_host_state_change > state_change) {
-						have_min_active_host_state_change = TRUE;
-						min_active_host_state_change = state_change;
-					}
-					if (have_max_active_host_state_change == FALSE || max_active_host_state_change < state_change) {
-						have_max_active_host_state_change = TRUE;
-						max_active_host_state_change = state_change;
-					}
-					time_difference = current_time - last_check;
-					if (time_difference <= 3600)
-						active_hosts_checked_last_1hour++;
-					if (time_difference <= 900)
-						active_hosts_checked_last_15min++;
-					if (time_difference <= 300)
-						active_hosts_checked_last_5min++;
-					if (time_difference <= 60)
-						active_hosts_checked_last_1min++;
-				} else {
-					passive_host_checks++;
-					average_passive_host_latency = (((average_passive_host_latency * ((double)passive_host_checks - 1.0)) + latency) / (double)passive_host_checks);
-					if (have_min_passive_host_latency == FALSE || min_passive_host_latency > latency) {
-						have_min_passive_host_latency = TRUE;
-						min_passive_host_latency = latency;
-					}
-					if (have_max_passive_host_latency == FALSE || max_passive_host_latency < latency) {
-						have_max_passive_host_latency = TRUE;
-						max_passive_host_latency = latency;
-					}
-					average_passive_host_state_change = (((average_passive_host_state_change * ((double)passive_host_checks - 1.0)) + state_change) / (double)passive_host_checks);
-					if (have_min_passive_host_state_change == FALSE || min_passive_host_state_change > state_change) {
-						have_min_passive_host_state_change = TRUE;
-						min_passive_host_state_change = state_change;
-					}
-					if (have_max_passive_host_state_change == FALSE || max_passive_host_state_change < state_change) {
-						have_max_passive_host_state_change = TRUE;
-						max_passive_host_state_change = state_change;
-					}
-					time_difference = current_time - last_check;
-					if (time_difference <= 3600)
-						passive_hosts_checked_last_1hour++;
-					if (time_difference <= 900)
-						passive_hosts_checked_last_15min++;
-					if (time_difference <= 300)
-						passive_hosts_checked_last_5min++;
-					if (time_difference <= 60)
-						passive_hosts_checked_last_1min++;
-				}
-				switch (current_state) {
-				case STATE_UP:
-					hosts_up++;
-					break;
-				case STATE_DOWN:
-					hosts_down++;
-					break;
-				case STATE_UNREACHABLE:
-					hosts_unreachable++;
-					break;
-				default:
-					break;
-				}
-				if (is_flapping == TRUE)
-					hosts_flapping++;
-				if (downtime_depth > 0)
-					hosts_in_downtime++;
-				if (has_been_checked == TRUE)
-					hosts_checked++;
-				hosts_scheduled++;
-				break;
-
-			case STATUS_SERVICE_DATA:
-				average_service_state_change = (((average_service_state_change * ((double)status_service_entries - 1.0)) + state_change) / (double)status_service_entries);
-				if (have_min_service_state_change == FALSE || min_service_state_change > state_change) {
-					have_min_service_state_change = TRUE;
-					min_service_state_change = state_change;
-				}
-				if (have_max_service_state_change == FALSE || max_service_state_change < state_change) {
-					have_max_service_state_change = TRUE;
-					max_service_state_change = state_change;
-				}
-				if (check_type == CHECK_TYPE_ACTIVE) {
-					active_service_checks++;
-					average_active_service_latency = (((average_active_service_latency * ((double)active_service_checks - 1.0)) + latency) / (double)active_service_checks);
-					if (have_min_active_service_latency == FALSE || min_active_service_latency > latency) {
-						have_min_active_service_latency = TRUE;
-						min_active_service_latency = latency;
-					}
-					if (have_max_active_service_latency == FALSE || max_active_service_latency < latency) {
-						have_max_active_service_latency = TRUE;
-						max_active_service_latency = latency;
-					}
-					average_active_service_execution_time = (((average_active_service_execution_time * ((double)active_service_checks - 1.0)) + execution_time) / (double)active_service_checks);
-					if (have_min_active_service_execution_time == FALSE || min_active_service_execution_time > execution_time) {
-						have_min_active_service_execution_time = TRUE;
-						min_active_service_execution_time = execution_time;
-					}
-					if (have_max_active_service_execution_time == FALSE || max_active_service_execution_time < execution_time) {
-						have_max_active_service_execution_time = TRUE;
-						max_active_service_execution_time = execution_time;
-					}
-					average_active_service_state_change = (((average_active_service_state_change * ((double)active_service_checks - 1.0)) + state_change) / (double)active_service_checks);
-					if (have_min_active_service_state_change == FALSE || min_active_service_state_change > state_change) {
-						have_min_active_service_state_change = TRUE;
-						min_active_service_state_change = state_change;
-					}
-					if (have_max_active_service_state_change == FALSE || max_active_service_state_change < state_change) {
-						have_max_active_service_state_change = TRUE;
-						max_active_service_state_change = state_change;
-					}
-					time_difference = current_time - last_check;
-					if (time_difference <= 3600)
-						active_services_checked_last_1hour++;
-					if (time_difference <= 900)
-						active_services_checked_last_15min++;
-					if (time_difference <= 300)
-						active_services_checked_last_5min++;
-					if (time_difference <= 60)
-						active_services_checked_last_1min++;
-				} else {
-					passive_service_checks++;
-					average_passive_service_latency = (((average_passive_service_latency * ((double)passive_service_checks - 1.0)) + latency) / (double)passive_service_checks);
-					if (have_min_passive_service_latency == FALSE || min_passive_service_latency > latency) {
-						have_min_passive_service_latency = TRUE;
-						min_passive_service_latency = latency;
-					}
-					if (have_max_passive_service_latency == FALSE || max_passive_service_latency < latency) {
-						have_max_passive_service_latency = TRUE;
-						max_passive_service_latency = latency;
-					}
-					average_passive_service_state_change = (((average_passive_service_state_change * ((double)passive_service_checks - 1.0)) + state_change) / (double)passive_service_checks);
-					if (have_min_passive_service_state_change == FALSE || min_passive_service_state_change > state_change) {
-						have_min_passive_service_state_change = TRUE;
-						min_passive_service_state_change = state_change;
-					}
-					if (have_max_passive_service_state_change == FALSE || max_passive_service_state_change < state_change) {
-						have_max_passive_service_state_change = TRUE;
-						max_passive_service_state_change = state_change;
-					}
-					time_difference = current_time - last_check;
-					if (time_difference <= 3600)
-						passive_services_checked_last_1hour++;
-					if (time_difference <= 900)
-						passive_services_checked_last_15min++;
-					if (time_difference <= 300)
-						passive_services_checked_last_5min++;
-					if (time_difference <= 60)
-						passive_services_checked_last_1min++;
-				}
-				switch (current_state) {
-				case STATE_OK:
-					services_ok++;
-					break;
-				case STATE_WARNING:
-					services_warning++;
-					break;
-				case STATE_UNKNOWN:
-					services_unknown++;
-					break;
-				case STATE_CRITICAL:
-					services_critical++;
-					break;
-				default:
-					break;
-				}
-				if (is_flapping == TRUE)
-					services_flapping++;
-				if (downtime_depth > 0)
-					services_in_downtime++;
-				if (has_been_checked == TRUE)
-					services_checked++;
-				services_scheduled++;
-				break;
-
-			default:
-				break;
-			}
-
-			data_type = STATUS_NO_DATA;
-
-			execution_time = 0.0;
-			latency = 0.0;
-			check_type = 0;
-			current_state = 0;
-			state_change = 0.0;
-			is_flapping = FALSE;
-			downtime_depth = 0;
-			last_check = (time_t)0;
-			has_been_checked = FALSE;
-		}
-
+		else if (!strcmp(temp_buffer, "}"))
+			end_status_entry(&entry, current_time);
 
 		/* inside definition */
-		else if (data_type != STATUS_NO_DATA) {
+		else if (entry.data_type != STATUS_NO_DATA) {
 
 			var = strtok(temp_buffer, "=");
 			val = strtok(NULL, "\n");
 			if (val == NULL)
 				continue;
 
-			switch (data_type) {
-
-			case STATUS_INFO_DATA:
-				if (!strcmp(var, "created"))
-					status_creation_date = strtoul(val, NULL, 10);
-				else if (!strcmp(var, "version"))
-					status_version = strdup(val);
-				break;
-
-			case STATUS_PROGRAM_DATA:
-				if (!strcmp(var, "program_start"))
-					program_start = strtoul(val, NULL, 10);
-				else if (!strcmp(var, "nagios_pid"))
-					nagios_pid = strtoul(val, NULL, 10);
-				else if (!strcmp(var, "active_scheduled_host_check_stats")) {
-					if ((temp_ptr = strtok(val, ",")))
-						active_scheduled_host_checks_last_1min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						active_scheduled_host_checks_last_5min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						active_scheduled_host_checks_last_15min = atoi(temp_ptr);
-				} else if (!strcmp(var, "active_ondemand_host_check_stats")) {
-					if ((temp_ptr = strtok(val, ",")))
-						active_ondemand_host_checks_last_1min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						active_ondemand_host_checks_last_5min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						active_ondemand_host_checks_last_15min = atoi(temp_ptr);
-				} else if (!strcmp(var, "cached_host_check_stats")) {
-					if ((temp_ptr = strtok(val, ",")))
-						active_cached_host_checks_last_1min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						active_cached_host_checks_last_5min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						active_cached_host_checks_last_15min = atoi(temp_ptr);
-				} else if (!strcmp(var, "passive_host_check_stats")) {
-					if ((temp_ptr = strtok(val, ",")))
-						passive_host_checks_last_1min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						passive_host_checks_last_5min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						passive_host_checks_last_15min = atoi(temp_ptr);
-				} else if (!strcmp(var, "active_scheduled_service_check_stats")) {
-					if ((temp_ptr = strtok(val, ",")))
-						active_scheduled_service_checks_last_1min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						active_scheduled_service_checks_last_5min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						active_scheduled_service_checks_last_15min = atoi(temp_ptr);
-				} else if (!strcmp(var, "active_ondemand_service_check_stats")) {
-					if ((temp_ptr = strtok(val, ",")))
-						active_ondemand_service_checks_last_1min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						active_ondemand_service_checks_last_5min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						active_ondemand_service_checks_last_15min = atoi(temp_ptr);
-				} else if (!strcmp(var, "cached_service_check_stats")) {
-					if ((temp_ptr = strtok(val, ",")))
-						active_cached_service_checks_last_1min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						active_cached_service_checks_last_5min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						active_cached_service_checks_last_15min = atoi(temp_ptr);
-				} else if (!strcmp(var, "passive_service_check_stats")) {
-					if ((temp_ptr = strtok(val, ",")))
-						passive_service_checks_last_1min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						passive_service_checks_last_5min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						passive_service_checks_last_15min = atoi(temp_ptr);
-				} else if (!strcmp(var, "external_command_stats")) {
-					if ((temp_ptr = strtok(val, ",")))
-						external_commands_last_1min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						external_commands_last_5min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						external_commands_last_15min = atoi(temp_ptr);
-				} else if (!strcmp(var, "parallel_host_check_stats")) {
-					if ((temp_ptr = strtok(val, ",")))
-						parallel_host_checks_last_1min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						parallel_host_checks_last_5min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						parallel_host_checks_last_15min = atoi(temp_ptr);
-				} else if (!strcmp(var, "serial_host_check_stats")) {
-					if ((temp_ptr = strtok(val, ",")))
-						serial_host_checks_last_1min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						serial_host_checks_last_5min = atoi(temp_ptr);
-					if ((temp_ptr = strtok(NULL, ",")))
-						serial_host_checks_last_15min = atoi(temp_ptr);
-				}
-				break;
-
-			case STATUS_HOST_DATA:
-				if (!strcmp(var, "check_execution_time"))
-					execution_time = strtod(val, NULL);
-				else if (!strcmp(var, "check_latency"))
-					latency = strtod(val, NULL);
-				else if (!strcmp(var, "percent_state_change"))
-					state_change = strtod(val, NULL);
-				else if (!strcmp(var, "check_type"))
-					check_type = atoi(val);
-				else if (!strcmp(var, "current_state"))
-					current_state = atoi(val);
-				else if (!strcmp(var, "is_flapping"))
-					is_flapping = (atoi(val) > 0) ? TRUE : FALSE;
-				else if (!strcmp(var, "scheduled_downtime_depth"))
-					downtime_depth = atoi(val);
-				else if (!strcmp(var, "last_check"))
-					last_check = strtoul(val, NULL, 10);
-				else if (!strcmp(var, "has_been_checked"))
-					has_been_checked = (atoi(val) > 0) ? TRUE : FALSE;
-				break;
-
-			case STATUS_SERVICE_DATA:
-				if (!strcmp(var, "check_execution_time"))
-					execution_time = strtod(val, NULL);
-				else if (!strcmp(var, "check_latency"))
-					latency = strtod(val, NULL);
-				else if (!strcmp(var, "percent_state_change"))
-					state_change = strtod(val, NULL);
-				else if (!strcmp(var, "check_type"))
-					check_type = atoi(val);
-				else if (!strcmp(var, "current_state"))
-					current_state = atoi(val);
-				else if (!strcmp(var, "is_flapping"))
-					is_flapping = (atoi(val) > 0) ? TRUE : FALSE;
-				else if (!strcmp(var, "scheduled_downtime_depth"))
-					downtime_depth = atoi(val);
-				else if (!strcmp(var, "last_check"))
-					last_check = strtoul(val, NULL, 10);
-				else if (!strcmp(var, "has_been_checked"))
-					has_been_checked = (atoi(val) > 0) ? TRUE : FALSE;
-				break;
-
-			default:
-				break;
-			}
-
+			add_status_var(&entry, var, val);
 		}
 	}
 
@@ -1320,6 +1368,104 @@ static int read_status_file(void)
 }
 
 
+/*
+ * runs one query against the "state" query handler and feeds the rows
+ * to the same code status.dat entries go through
+ */
+static int query_state_table(const char *query, int data_type, time_t current_time)
+{
+	struct status_entry entry;
+	char *buf = NULL, *line, *next, *field, *end;
+	char *columns[64];
+	size_t len = 0, size = 0;
+	ssize_t bytes;
+	int sd, num_columns = 0, i;
+
+	sd = nsock_unix(query_socket, NSOCK_TCP | NSOCK_CONNECT);
+	if (sd < 0)
+		return ERROR;
+	if (nsock_printf_nul(sd, "#state %s", query) < 0) {
+		close(sd);
+		return ERROR;
+	}
+
+	/* the reply ends with a nul byte, and naemon hangs up after it */
+	do {
+		if (len + 4096 > size) {
+			size = (len + 4096) * 2;
+			buf = nm_realloc(buf, size);
+		}
+		bytes = read(sd, buf + len, size - len - 1);
+		if (bytes > 0)
+			len += bytes;
+	} while (bytes > 0 && buf[len - 1] != 0);
+	close(sd);
+
+	if (!len || buf[len - 1] != 0) {
+		nm_free(buf);
+		return ERROR;
+	}
+	buf[len] = 0;
+
+	/* "404: state: No such handler" and friends */
+	if (isdigit(*buf)) {
+		if (mrtg_mode == FALSE)
+			printf("%s\n", buf);
+		nm_free(buf);
+		return ERROR;
+	}
+
+	for (line = buf; line && *line; line = next) {
+		if ((next = strchr(line, '\n')))
+			*next++ = 0;
+
+		if (!num_columns) {
+			for (field = line; field && num_columns < (int)(sizeof(columns) / sizeof(*columns)); field = end) {
+				if ((end = strchr(field, '\t')))
+					*end++ = 0;
+				columns[num_columns++] = field;
+			}
+			continue;
+		}
+
+		begin_status_entry(&entry, data_type);
+		for (i = 0, field = line; field && i < num_columns; i++, field = end) {
+			if ((end = strchr(field, '\t')))
+				*end++ = 0;
+			/* status.dat has this in its info section */
+			if (data_type == STATUS_PROGRAM_DATA && !strcmp(columns[i], "version")) {
+				nm_free(status_version);
+				status_version = strdup(field);
+			}
+			add_status_var(&entry, columns[i], field);
+		}
+		end_status_entry(&entry, current_time);
+	}
+
+	nm_free(buf);
+	return OK;
+}
+
+#define STATE_QUERY_COLUMNS "columns=check_execution_time,check_latency,percent_state_change,check_type,current_state,is_flapping,scheduled_downtime_depth,last_check,has_been_checked"
+
+/* asks the running naemon through its query socket rather than reading status.dat */
+static int read_query_socket(void)
+{
+	time_t current_time;
+
+	time(&current_time);
+
+	/* the data is as fresh as it gets */
+	status_creation_date = current_time;
+
+	if (query_state_table("program", STATUS_PROGRAM_DATA, current_time) != OK)
+		return ERROR;
+	if (query_state_table("hosts;" STATE_QUERY_COLUMNS, STATUS_HOST_DATA, current_time) != OK)
+		return ERROR;
+	return query_state_table("services;" STATE_QUERY_COLUMNS, STATUS_SERVICE_DATA, current_time);
+}
+
+
 /* strip newline, carriage return, and tab characters from beginning and end of a string */
 void strip(char *buffer)
 {
@@ -1390,6 +1536,7 @@ static void free_memory(void)
 	//deallocate memory
 	nm_free(main_config_file);
 	nm_free(status_file);
+	nm_free(query_socket);
 	nm_free(status_version);
 	nm_free(mrtg_variables);
 	nm_free(mrtg_delimiter_save);
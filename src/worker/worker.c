@@ -8,15 +8,42 @@
 #include <sys/socket.h>
 #include <string.h>
 #include <stdarg.h>
+#include <signal.h>
 #include <glib.h>
+#ifdef __linux__
+# include <sys/syscall.h>
+#endif
+
+/*
+ * With pidfds, a child's exit is just another readable fd in the
+ * iobroker and the pid can't be reused until we've reaped it. We
+ * call the syscalls directly, as libc wrappers are fairly new.
+ */
+#if defined(SYS_pidfd_open) && defined(SYS_pidfd_send_signal) && defined(SYS_waitid)
+# define HAVE_PIDFD 1
+# ifndef P_PIDFD
+#  define P_PIDFD 3
+# endif
+#endif
+
+/* the pidfd of a child, when it's not an open descriptor */
+#define PIDFD_NONE   -1 /* not tracked through a pidfd */
+#define PIDFD_REAPED -2 /* tracked through a pidfd, and reaped */
 
 static unsigned int started, running_jobs, timeouts, reapable;
 static int master_sd;
 static GHashTable *ptab;
 
+/* set when we're a remote worker, see nm_core_worker() */
+static struct worker_session *session;
+
+/* use_pidfd if the kernel supports it, wait_reaping for everything else */
+static int use_pidfd, wait_reaping;
+
 struct execution_information {
 	timed_event *timed_event;
 	pid_t pid;
+	int pidfd;
 	int state;
 	struct timeval start;
 	struct timeval stop;
@@ -53,6 +80,23 @@ static void exit_worker(int code, const char *msg)
 	exit(code);
 }
 
+/* sends a message that already has its delimiter, signing it if need be */
+static int send_to_master(int sd, char *buf, size_t size)
+{
+	struct kvvec_buf *kvvb;
+	int ret;
+
+	if (!session)
+		return iobroker_write_packet(nagios_iobs, sd, buf, size);
+
+	if (!(kvvb = worker_session_sign(session, buf, size - MSG_DELIM_LEN)))
+		return -1;
+	ret = iobroker_write_packet(nagios_iobs, sd, kvvb->buf, (size_t)kvvb->bufsize);
+	free(kvvb->buf);
+	free(kvvb);
+	return ret;
+}
+
 /*
  * write a log message to master.
  * Note that this will break if we change delimiters someday,
@@ -79,7 +123,7 @@ static void wlog(const char *fmt, ...)
 	to_send = len + MSG_DELIM_LEN + 1;
 	lmsg[len] = 0;
 	memcpy(&lmsg[len + 1], MSG_DELIM, MSG_DELIM_LEN);
-	if (iobroker_write_packet(nagios_iobs, master_sd, lmsg, to_send) < 0) {
+	if (send_to_master(master_sd, lmsg, to_send) < 0) {
 		if (errno == EPIPE) {
 			/* master has died or abandoned us, so exit */
 			exit_worker(1, "Failed to write() to master");
@@ -97,7 +141,7 @@ static int worker_send_kvvec(int sd, struct kvvec *kvv)
 		return -1;
 
 	/* bufsize, not buflen, as it gets us the delimiter */
-	ret = iobroker_write_packet(nagios_iobs, sd, kvvb->buf, (size_t)kvvb->bufsize);
+	ret = send_to_master(sd, kvvb->buf, (size_t)kvvb->bufsize);
 	free(kvvb->buf);
 	free(kvvb);
 
@@ -133,6 +177,11 @@ static void destroy_job(child_process *cp)
 	/*XXX: Maybe let this function be the value destructor for ptab? */
 	g_hash_table_remove(ptab, GINT_TO_POINTER(cp->ei->pid));
 
+	if (cp->ei->pidfd >= 0) {
+		iobroker_close(nagios_iobs, cp->ei->pidfd);
+		cp->ei->pidfd = PIDFD_NONE;
+	}
+
 	if (cp->outstd.buf) {
 		free(cp->outstd.buf);
 		cp->outstd.buf = NULL;
@@ -179,7 +228,7 @@ static int finish_job(child_process *cp, int reason)
 	}
 
 	/* how many key/value pairs do we need? */
-	if (kvvec_init(&resp, 12 + cp->request->kv_pairs) == NULL) {
+	if (kvvec_init(&resp, 13 + cp->request->kv_pairs) == NULL) {
 		/* what the hell do we do now? */
 		exit_worker(1, "Failed to init response key/value vector");
 	}
@@ -218,6 +267,8 @@ static int finish_job(child_process *cp, int reason)
 		kvvec_addkv_str(&resp, "exited_ok", "0");
 		kvvec_addkv_str(&resp, "error_code", mkstr("%d", reason));
 	}
+	if (cp->outstd.discarded || cp->outerr.discarded)
+		kvvec_addkv_str(&resp, "truncated", "1");
 	buflen = nm_bufferqueue_get_available(cp->outerr.buf);
 	buferr = malloc(buflen);
 	nm_bufferqueue_unshift(cp->outerr.buf, buflen, buferr);
@@ -279,6 +330,138 @@ static int get_process_parent_id(const pid_t pid, pid_t *ppid)
 	return 0;
 }
 
+#ifdef HAVE_PIDFD
+/* turn what waitid() tells us into what wait() would have said */
+static int siginfo_wait_status(const siginfo_t *info)
+{
+	switch (info->si_code) {
+	case CLD_EXITED:
+		return (info->si_status & 0xff) << 8;
+	case CLD_KILLED:
+		return info->si_status & 0x7f;
+	case CLD_DUMPED:
+		return (info->si_status & 0x7f) | 0x80;
+	}
+	return 0;
+}
+
+/*
+ * reap a child through its pidfd. Returns the pid if it was reaped,
+ * 0 if it's still running and -1 on errors. If someone else already
+ * reaped it, errno is ECHILD and the pidfd is closed
+ */
+static int reap_pidfd(child_process *cp, int *status, struct rusage *ru)
+{
+	siginfo_t info;
+
+	memset(&info, 0, sizeof(info));
+	/* the raw syscall takes a struct rusage, unlike the libc wrapper */
+	if (syscall(SYS_waitid, P_PIDFD, cp->ei->pidfd, &info, WEXITED | WNOHANG, ru) < 0) {
+		if (errno == ECHILD) {
+			iobroker_close(nagios_iobs, cp->ei->pidfd);
+			cp->ei->pidfd = PIDFD_REAPED;
+			errno = ECHILD;
+		}
+		return -1;
+	}
+	if (!info.si_pid)
+		return 0;
+
+	iobroker_close(nagios_iobs, cp->ei->pidfd);
+	cp->ei->pidfd = PIDFD_REAPED;
+	*status = siginfo_wait_status(&info);
+	return info.si_pid;
+}
+
+static int pidfd_handler(int fd, int events, void *cp_)
+{
+	child_process *cp = (child_process *)cp_;
+	struct rusage ru;
+	int ret, status;
+
+	ret = reap_pidfd(cp, &status, &ru);
+	if (!ret)
+		return 0;
+	if (ret < 0) {
+		if (errno != ECHILD)
+			wlog("job %d (pid=%d): Failed to waitid(): %s", cp->id, cp->ei->pid, strerror(errno));
+		return 0;
+	}
+
+	cp->ret = status;
+	memcpy(&cp->ei->rusage, &ru, sizeof(ru));
+	/* see reap_jobs() for why grandchildren are left alone */
+	if (cp->ei->state != ESTALE)
+		finish_job(cp, cp->ei->state);
+	return 0;
+}
+
+static int track_pidfd(child_process *cp)
+{
+	int fd;
+
+	if ((fd = syscall(SYS_pidfd_open, cp->ei->pid, 0)) < 0) {
+		wlog("job %d (pid=%d): Failed to open pidfd: %s", cp->id, cp->ei->pid, strerror(errno));
+		return -1;
+	}
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	if (iobroker_register(nagios_iobs, fd, cp, pidfd_handler)) {
+		wlog("Failed to register iobroker for pidfd");
+		close(fd);
+		return -1;
+	}
+	cp->ei->pidfd = fd;
+	return 0;
+}
+
+/* see if this kernel lets us use pidfds at all */
+static int pidfd_works(void)
+{
+	int fd;
+
+	if ((fd = syscall(SYS_pidfd_open, getpid(), 0)) < 0)
+		return 0;
+	close(fd);
+	return 1;
+}
+#endif
+
+static void sigchld_handler(int sig)
+{
+	reapable++;
+}
+
+/*
+ * Fall back to reaping children with wait3() when signalled. Once
+ * enabled this stays on, since any child may be the one we lose
+ * track of.
+ */
+static void start_wait_reaping(void)
+{
+	wait_reaping = 1;
+	/* we need to catch child signals to mark jobs as reapable */
+	signal(SIGCHLD, sigchld_handler);
+}
+
+/*
+ * make sure the pid of a job still is the child we started, as
+ * it may have been reaped and the pid reused by now
+ */
+static int job_is_ours(child_process *cp)
+{
+	pid_t ppid;
+
+	/* an open pidfd pins the pid until the child is reaped */
+	if (cp->ei->pidfd >= 0)
+		return 1;
+	if (cp->ei->pidfd == PIDFD_REAPED)
+		return 0;
+
+	if (get_process_parent_id(cp->ei->pid, &ppid) != 0)
+		return 0;
+	return ppid == getpid();
+}
+
 /*
  * "What can the harvest hope for, if not for the care
  * of the Reaper Man?"
@@ -296,7 +479,6 @@ static void kill_job(struct nm_event_execution_properties *event)
 {
 	child_process *cp = event->user_data;
 	int pid, id, ret, status, reaped = 0;
-	pid_t ppid, wpid;
 
 	g_return_if_fail(cp != NULL);
 	g_return_if_fail(cp->ei != NULL);
@@ -308,9 +490,7 @@ static void kill_job(struct nm_event_execution_properties *event)
 		return;
 	}
 	/* check if the child we'r killing belongs to this worker process */
-	wpid = getpid();
-	status = get_process_parent_id(pid, &ppid);
-	if (status != 0 || ppid != wpid) {
+	if (!job_is_ours(cp)) {
 		/* the pid might be reallocated but still exists in child proc list */
 		destroy_job(cp);
 		return;
@@ -326,6 +506,12 @@ static void kill_job(struct nm_event_execution_properties *event)
 	}
 
 	/* brutal but efficient */
+#ifdef HAVE_PIDFD
+	if (cp->ei->pidfd >= 0 && syscall(SYS_pidfd_send_signal, cp->ei->pidfd, SIGKILL, NULL, 0) < 0 && errno != ESRCH) {
+		wlog("pidfd_send_signal(%d, SIGKILL) failed: %s\n", cp->ei->pid, strerror(errno));
+	}
+#endif
+	/* the rest of the process group, which our unreaped child keeps reserved */
 	if (kill(-cp->ei->pid, SIGKILL) < 0) {
 		if (errno == ESRCH) {
 			reaped = 1;
@@ -339,7 +525,12 @@ static void kill_job(struct nm_event_execution_properties *event)
 	 * ESRCH when there's zombies
 	 */
 	do {
-		ret = waitpid(cp->ei->pid, &status, WNOHANG);
+#ifdef HAVE_PIDFD
+		if (cp->ei->pidfd >= 0)
+			ret = reap_pidfd(cp, &status, NULL);
+		else
+#endif
+			ret = waitpid(cp->ei->pid, &status, WNOHANG);
 		if (ret == cp->ei->pid || (ret < 0 && errno == ECHILD)) {
 			reaped = 1;
 		}
@@ -374,12 +565,50 @@ static void kill_job(struct nm_event_execution_properties *event)
 	}
 }
 
+/*
+ * Like nm_bufferqueue_read(), but once the job's max_output is
+ * reached the rest is read and thrown away instead of buffered
+ */
+static int read_output(child_process *cp, iobuf *io)
+{
+	char chunk[8192];
+	size_t have, keep;
+	int rd;
+
+	if (!cp || !cp->max_output)
+		return nm_bufferqueue_read(io->buf, io->fd);
+
+	rd = read(io->fd, chunk, sizeof(chunk));
+	if (rd <= 0)
+		return rd;
+
+	have = nm_bufferqueue_get_available(io->buf);
+	keep = have < cp->max_output ? cp->max_output - have : 0;
+	if (keep > (size_t)rd)
+		keep = rd;
+	if (keep && nm_bufferqueue_push(io->buf, chunk, keep)) {
+		errno = ENOMEM;
+		return -1;
+	}
+	io->discarded += rd - keep;
+	return rd;
+}
+
+/*
+ * a capped read only takes a chunk at a time, so the final read
+ * gets a few goes at emptying the pipe. It can't go on forever,
+ * since a grandchild may still be writing
+ */
+#define FINAL_CAPPED_READS 16
+
 static void gather_output(child_process *cp, iobuf *io, int final)
 {
+	int reads = 0;
+
 	for (;;) {
 		int rd;
 
-		rd = nm_bufferqueue_read(io->buf, io->fd);
+		rd = read_output(cp, io);
 		if (rd < 0) {
 			if (errno == EINTR) {
 				/* signal caught before we read anything */
@@ -407,7 +636,7 @@ static void gather_output(child_process *cp, iobuf *io, int final)
 		 * second (or third) time its entered for the same
 		 * job.
 		 */
-		if (rd <= 0 || final) {
+		if (rd <= 0 || (final && (!cp || !cp->max_output || ++reads >= FINAL_CAPPED_READS))) {
 			iobroker_close(nagios_iobs, io->fd);
 			io->fd = -1;
 			return;
@@ -429,11 +658,6 @@ static int stdout_handler(int fd, int events, void *cp_)
 	return 0;
 }
 
-static void sigchld_handler(int sig)
-{
-	reapable++;
-}
-
 static void reap_jobs(void)
 {
 	do {
@@ -448,6 +672,11 @@ static void reap_jobs(void)
 				continue;
 			}
 			reapable--;
+			if (cp->ei->pidfd >= 0) {
+				/* raced with pidfd_handler(), but we got here first */
+				iobroker_close(nagios_iobs, cp->ei->pidfd);
+				cp->ei->pidfd = PIDFD_REAPED;
+			}
 			cp->ret = status;
 			memcpy(&cp->ei->rusage, &ru, sizeof(ru));
 			if (cp->ei->state != ESTALE) {
@@ -491,6 +720,13 @@ static int start_cmd(child_process *cp)
 		wlog("Failed to register iobroker for stderr");
 	g_hash_table_insert(ptab, GINT_TO_POINTER(cp->ei->pid), cp);
 
+#ifdef HAVE_PIDFD
+	if (use_pidfd && !track_pidfd(cp))
+		return 0;
+#endif
+	if (!wait_reaping)
+		start_wait_reaping();
+
 	return 0;
 }
 
@@ -510,6 +746,7 @@ static child_process *parse_command_kvvec(struct kvvec *kvv)
 		wlog("Failed to calloc() a execution_information struct");
 		return NULL;
 	}
+	cp->ei->pidfd = PIDFD_NONE;
 
 	for (i = 0; i < kvv->kv_pairs; i++) {
 		struct key_value *kv = &kvv->kv[i];
@@ -529,6 +766,10 @@ static child_process *parse_command_kvvec(struct kvvec *kvv)
 			cp->timeout = (unsigned int)strtoul(value, &endptr, 0);
 			continue;
 		}
+		if (!strcmp(key, "max_output")) {
+			cp->max_output = strtoul(value, &endptr, 0);
+			continue;
+		}
 	}
 
 	/* jobs without a timeout get a default of 60 seconds. */
@@ -601,8 +842,15 @@ static int receive_command(int sd, int events, void *arg)
 	 */
 	while (!nm_bufferqueue_unshift_to_delim(bq, MSG_DELIM, MSG_DELIM_LEN, &size, (void **)&buf)) {
 		struct kvvec *kvv;
+
+		size -= MSG_DELIM_LEN;
+		if (session && worker_session_verify(session, buf, &size) < 0) {
+			free(buf);
+			iobroker_close(nagios_iobs, sd);
+			exit_worker(1, "Message from master failed authentication");
+		}
 		/* we must copy vars here, as we preserve them for the response */
-		kvv = buf2kvvec(buf, (unsigned int)size - MSG_DELIM_LEN, KV_SEP, PAIR_SEP, KVVEC_COPY);
+		kvv = buf2kvvec(buf, (unsigned int)size, KV_SEP, PAIR_SEP, KVVEC_COPY);
 		if (kvv)
 			spawn_job(kvv);
 		free(buf);
@@ -621,8 +869,15 @@ static void enter_worker(int sd)
 		/* XXX: handle error somehow, or maybe just ignore it */
 	}
 
-	/* we need to catch child signals to mark jobs as reapable */
-	signal(SIGCHLD, sigchld_handler);
+#ifdef HAVE_PIDFD
+	use_pidfd = pidfd_works();
+#endif
+	if (use_pidfd) {
+		/* children must stay waitable, whatever our parent told us */
+		signal(SIGCHLD, SIG_DFL);
+	} else {
+		start_wait_reaping();
+	}
 
 	fcntl(fileno(stdout), F_SETFD, FD_CLOEXEC);
 	fcntl(fileno(stderr), F_SETFD, FD_CLOEXEC);
@@ -639,8 +894,104 @@ static void enter_worker(int sd)
 	iobroker_register(nagios_iobs, master_sd, NULL, receive_command);
 	for (;;) {
 		event_poll();
-		reap_jobs();
+		if (wait_reaping)
+			reap_jobs();
+	}
+}
+
+/* reads a nul-terminated message from the master, before the iobroker is up */
+static int read_greeting(int sd, char *buf, size_t size)
+{
+	size_t len = 0;
+
+	do {
+		if (read(sd, &buf[len], 1) != 1)
+			return -1;
+	} while (buf[len] && ++len < size - 1);
+	buf[len] = 0;
+
+	return 0;
+}
+
+/*
+ * The master greets remote workers with "challenge=<hex>". We answer
+ * it with the secret in $NAEMON_WORKER_SECRET_FILE, which the master
+ * has in its worker_secret_file, and send a challenge of our own. The
+ * master must answer that with "OK auth=<proof>" before we run anything
+ * for it. From then on every message both ways is signed with a key
+ * only the two of us know.
+ */
+static int remote_register(int sd)
+{
+	char greeting[128], response[128], challenge[WORKER_CHALLENGE_LEN + 1];
+	char hostname[256] = "unknown", *secret = NULL, *auth, *proof;
+	const char *secret_file, *max_jobs = getenv("NAEMON_WORKER_MAX_JOBS");
+	gsize secret_len = 0;
+	GError *error = NULL;
+	int ret = -1;
+
+	if (read_greeting(sd, greeting, sizeof(greeting)) < 0) {
+		printf("Failed to read challenge from wproc manager\n");
+		return -1;
+	}
+	if (strncmp(greeting, "challenge=", 10)) {
+		printf("Unexpected greeting from wproc manager: %s\n", greeting);
+		return -1;
+	}
+
+	if (!(secret_file = getenv("NAEMON_WORKER_SECRET_FILE"))) {
+		printf("NAEMON_WORKER_SECRET_FILE must be set for remote workers\n");
+		return -1;
 	}
+	if (!g_file_get_contents(secret_file, &secret, &secret_len, &error)) {
+		printf("Failed to read worker secret: %s\n", error->message);
+		g_clear_error(&error);
+		return -1;
+	}
+	while (secret_len > 0 && g_ascii_isspace(secret[secret_len - 1]))
+		secret[--secret_len] = 0;
+
+	if (worker_challenge(challenge, sizeof(challenge)) < 0) {
+		printf("Failed to create challenge for wproc manager: %s\n", strerror(errno));
+		goto out;
+	}
+	if (!(auth = worker_auth_response(secret, secret_len, greeting + 10)))
+		goto out;
+	gethostname(hostname, sizeof(hostname) - 1);
+	ret = nsock_printf_nul(sd, "@wproc register name=Remote Worker %s %d;pid=%d;max_jobs=%d;challenge=%s;auth=%s",
+	                       hostname, getpid(), getpid(),
+	                       max_jobs ? atoi(max_jobs) : (iobroker_max_usable_fds() / 2) - 50,
+	                       challenge, auth);
+	g_free(auth);
+	if (ret < 0) {
+		printf("Failed to register as worker.\n");
+		goto out;
+	}
+
+	ret = -1;
+	if (read_greeting(sd, response, sizeof(response)) < 0) {
+		printf("Failed to read response from wproc manager\n");
+		goto out;
+	}
+	if (strncmp(response, "OK auth=", 8)) {
+		printf("Failed to register with wproc manager: %s\n", response);
+		goto out;
+	}
+	proof = worker_master_proof(secret, secret_len, greeting + 10, challenge);
+	if (!proof || !worker_auth_matches(proof, response + 8)) {
+		printf("wproc manager failed to authenticate\n");
+		g_free(proof);
+		goto out;
+	}
+	g_free(proof);
+
+	if ((session = worker_session_create(secret, secret_len, greeting + 10, challenge, 0)))
+		ret = 0;
+
+out:
+	memset(secret, 0, secret_len);
+	g_free(secret);
+	return ret;
 }
 
 int nm_core_worker(const char *path)
@@ -648,13 +999,23 @@ int nm_core_worker(const char *path)
 	int sd, ret;
 	char response[128];
 
-	sd = nsock_unix(path, NSOCK_TCP | NSOCK_CONNECT);
+	if (!strncmp(path, "tcp:", 4))
+		sd = nsock_inet(path + 4, NSOCK_TCP | NSOCK_CONNECT);
+	else
+		sd = nsock_unix(path, NSOCK_TCP | NSOCK_CONNECT);
 	if (sd < 0) {
 		printf("Failed to connect to query socket '%s': %s: %s\n",
 		       path, nsock_strerror(sd), strerror(errno));
 		return 1;
 	}
 
+	if (!strncmp(path, "tcp:", 4)) {
+		if (remote_register(sd) < 0)
+			return 1;
+		enter_worker(sd);
+		return 0;
+	}
+
 	ret = nsock_printf_nul(sd, "@wproc register name=Core Worker %d;pid=%d", getpid(), getpid());
 	if (ret < 0) {
 		printf("Failed to register as worker.\n");
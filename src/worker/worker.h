@@ -34,12 +34,14 @@ NAGIOS_BEGIN_DECL
 typedef struct iobuf {
 	int fd;
 	nm_bufferqueue *buf;
+	unsigned long discarded; /* bytes read past the job's max_output */
 } iobuf;
 
 typedef struct execution_information execution_information;
 
 typedef struct child_process {
 	unsigned int id, timeout;
+	unsigned long max_output; /* per stream, 0 means unlimited */
 	char *cmd;
 	int ret;
 	struct kvvec *request;
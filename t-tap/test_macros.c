@@ -216,6 +216,100 @@ static void test_ondemand_macros(nagios_macros *mac)
 	RUN_MACRO_TEST("$HOSTNAME:" TEST_HOSTGROUPNAME ":,$", TEST_HOSTNAME, 0);
 }
 
+static void test_command_line(nagios_macros *mac)
+{
+	struct command test_command = {
+		.name = "check_command",
+		.command_line = "/bin/check $ARG1$ -H $HOSTNAME$ $$ $ARG2$ $ARG3$ $IDONOTEXIST$ $ARG1",
+	};
+	char *cmd = "check_command!$HOSTNAME$!a\\!b!";
+	char *raw_command = NULL, *expected = NULL, *output = NULL;
+	int i;
+
+	/* the compiled command line must expand exactly like the raw one */
+	for (i = 0; i < 2; i++) {
+		get_raw_command_line_r(mac, &test_command, cmd, &raw_command, STRIP_ILLEGAL_MACRO_CHARS | ESCAPE_MACRO_CHARS);
+		process_macros_r(mac, raw_command, &expected, STRIP_ILLEGAL_MACRO_CHARS | ESCAPE_MACRO_CHARS);
+		get_processed_command_line_r(mac, &test_command, cmd, &output, STRIP_ILLEGAL_MACRO_CHARS | ESCAPE_MACRO_CHARS);
+		ok(output && !strcmp(output, expected), "'%s' == '%s'", output, expected);
+		nm_free(raw_command);
+		nm_free(expected);
+		nm_free(output);
+	}
+
+	get_processed_command_line_r(mac, &test_command, cmd, &output, 0);
+	ok(!strcmp(output, "/bin/check " TEST_HOSTNAME " -H " TEST_HOSTNAME " $ a!b  $IDONOTEXIST$ " TEST_HOSTNAME),
+	   "Command line expanded as '%s'", output);
+	nm_free(output);
+	clear_argv_macros_r(mac);
+	free_command_templates();
+}
+
+/*
+ * Expected output for command lines with nested, escaped, missing and
+ * on-demand macros, as expanded by get_raw_command_line_r() and the
+ * process_macros_r() from before macro templates.
+ */
+static const struct {
+	const char *command_line, *args;
+	int options;
+	const char *expected;
+} command_line_cases[] = {
+	/* macros in arguments, and macros in those macros */
+	{ "/bin/check -n '$ARG1$'", "check_command!$HOSTNOTES$",
+	  STRIP_ILLEGAL_MACRO_CHARS | ESCAPE_MACRO_CHARS, "/bin/check -n 'notes%(action_url%)'" },
+	{ "/bin/check -n '$ARG1$'", "check_command!$HOSTNOTES$",
+	  0, "/bin/check -n 'notes'&%\"(action_url'&%)'" },
+	{ "/bin/check -u $HOSTNOTESURL$", "check_command", URL_ENCODE_MACRO_CHARS,
+	  "/bin/check -u notes_url%27%26%25%28notes%2527%2526%2525%2522%2528action_url%2527%2526%2525%2529%29" },
+	{ "/bin/check $ARG1$ $ARG2$", "check_command!$ARG2$!two", 0, "/bin/check  two" },
+	{ "/bin/check $ARG1$", "check_command!$HOSTOUTPUT$ '&%", STRIP_ILLEGAL_MACRO_CHARS, "/bin/check name% '&%" },
+	/* escaped dollar signs, in the command line and in arguments */
+	{ "/bin/check $$$$ $$HOSTNAME$$ $ARG1$", "check_command!$$x$$", 0, "/bin/check $$ $HOSTNAME$ $x$" },
+	{ "$", "check_command", 0, "$" },
+	/* missing arguments and unknown or unterminated macros */
+	{ "/bin/check $ARG5$|$ARG1$|$USER1$|$IDONOTEXIST$|", "check_command!one", 0, "/bin/check |one||$IDONOTEXIST$|" },
+	{ "/bin/check $HOSTNAME", "check_command", 0, "/bin/check " TEST_HOSTNAME },
+	/* on-demand macros */
+	{ "/bin/check $SERVICESTATEID:" TEST_HOSTNAME ":service description$ $HOSTSTATEID:" TEST_HOSTGROUPNAME ":,$ $HOSTNAME:" TEST_HOSTGROUPNAME ":,$",
+	  "check_command", 0, "/bin/check 2 0 " TEST_HOSTNAME },
+	{ "/bin/check $SERVICESTATEID:" TEST_HOSTNAME ",service description$", "check_command",
+	  0, "/bin/check $SERVICESTATEID:" TEST_HOSTNAME ",service description$" },
+};
+
+static void test_command_line_expected(nagios_macros *mac)
+{
+	char *raw_command = NULL, *output = NULL;
+	unsigned int i, pass;
+
+	for (i = 0; i < ARRAY_SIZE(command_line_cases); i++) {
+		struct command test_command = {
+			.name = "check_command",
+			.command_line = (char *)command_line_cases[i].command_line,
+		};
+		char *args = (char *)command_line_cases[i].args;
+		int options = command_line_cases[i].options;
+		const char *expected = command_line_cases[i].expected;
+
+		/* the second pass comes from the template caches */
+		for (pass = 0; pass < 2; pass++) {
+			get_processed_command_line_r(mac, &test_command, args, &output, options);
+			ok(output && !strcmp(output, expected), "'%s' expanded as '%s', expected '%s'",
+			   test_command.command_line, output, expected);
+			nm_free(output);
+		}
+
+		get_raw_command_line_r(mac, &test_command, args, &raw_command, options);
+		process_macros_r(mac, raw_command, &output, options);
+		ok(output && !strcmp(output, expected), "'%s' processed as '%s', expected '%s'",
+		   raw_command, output, expected);
+		nm_free(raw_command);
+		nm_free(output);
+		clear_argv_macros_r(mac);
+	}
+	free_command_templates();
+}
+
 /*****************************************************************************/
 /*                             Main function                                 */
 /*****************************************************************************/
@@ -224,7 +318,7 @@ int main(void)
 {
 	nagios_macros *mac;
 
-	plan_tests(26);
+	plan_tests(29 + 3 * ARRAY_SIZE(command_line_cases));
 
 	reset_variables();
 	init_environment();
@@ -234,6 +328,8 @@ int main(void)
 
 	test_escaping(mac);
 	test_ondemand_macros(mac);
+	test_command_line(mac);
+	test_command_line_expected(mac);
 
 	free(mac);
 
@@ -95,6 +95,16 @@ tests_test_query_handler_LDADD =  $(TESTSLDADD)
 tests_test_query_handler_LDFLAGS = $(TESTSLDFLAGS)
 tests_test_query_handler_CPPFLAGS = $(TESTSCPPFLAGS)
 
+tests_test_query_state_SOURCES = tests/test-query-state.c
+tests_test_query_state_LDADD = $(TESTSLDADD)
+tests_test_query_state_LDFLAGS = $(TESTSLDFLAGS)
+tests_test_query_state_CPPFLAGS = $(TESTSCPPFLAGS)
+
+tests_test_nerd_SOURCES = tests/test-nerd.c
+tests_test_nerd_LDADD = $(TESTSLDADD)
+tests_test_nerd_LDFLAGS = $(TESTSLDFLAGS)
+tests_test_nerd_CPPFLAGS = $(TESTSCPPFLAGS)
+
 tests_test_arith_SOURCES = tests/test-arith.c
 tests_test_arith_LDADD =  $(TESTSLDADD)
 tests_test_arith_CFLAGS =  $(CFLAGS) -DNM_SKIP_BUILTIN_OVERFLOW_CHECKS=1
@@ -162,6 +172,11 @@ tests_test_retention_LDADD = $(TESTSLDADD)
 tests_test_retention_LDFLAGS = $(TESTSLDADD)
 tests_test_retention_CPPFLAGS = $(TESTSCPPFLAGS)
 
+tests_test_perfdata_SOURCES = tests/test-perfdata.c
+tests_test_perfdata_LDADD = $(TESTSLDADD)
+tests_test_perfdata_LDFLAGS = $(TESTSLDFLAGS)
+tests_test_perfdata_CPPFLAGS = $(TESTSCPPFLAGS)
+
 tests_test_neb_callbacks_SOURCES = tests/test-neb-callbacks.c
 tests_test_neb_callbacks_LDADD = $(TESTSLDADD)
 tests_test_neb_callbacks_LDFLAGS = $(TESTSLDADD)
@@ -175,6 +190,8 @@ check_PROGRAMS += \
 	tests/test-check-scheduling \
 	tests/test-check-dependencies \
 	tests/test-query-handler \
+	tests/test-query-state \
+	tests/test-nerd \
 	tests/test-obj-config-parse \
 	tests/test-utils \
 	tests/test-log \
@@ -187,6 +204,7 @@ check_PROGRAMS += \
 	tests/test-kvvec-ekvstr \
 	tests/test-worker \
 	tests/test-retention \
+	tests/test-perfdata \
 	tests/test-arith \
 	tests/test-arith-builtins
 
@@ -196,10 +214,49 @@ test_iobroker_SOURCES = lib/test-iobroker.c $(LIBTEST_UTILS)
 test_bufferqueue_SOURCES = lib/test-bufferqueue.c $(LIBTEST_UTILS)
 test_nsutils_SOURCES = lib/test-nsutils.c $(LIBTEST_UTILS)
 test_runcmd_SOURCES = lib/test-runcmd.c $(LIBTEST_UTILS)
+test_shmstatus_SOURCES = lib/test-shmstatus.c $(LIBTEST_UTILS)
 check_PROGRAMS += test-bitmap test-iobroker test-bufferqueue \
-	test-nsutils test-runcmd
+	test-nsutils test-runcmd test-shmstatus
 
 
 endif
+# config load and check dispatch benchmarks, not part of "make check"; tune
+# the generated config with e.g. make bench BENCH_CONFIG_ARGS="--hosts 50000 --services 20"
+BENCH_CONFIG_ARGS = --hosts 10000 --services 10 --hostgroups 100 --groups-per-host 3 \
+	--template-depth 3 --escalations 1
+BENCH_DISPATCH_ARGS = -n 10
+# the scheduler simulation, e.g. make bench-sim BENCH_SIM_ARGS="-d 3600 -w 32 -l 60"
+BENCH_SIM_CONFIG_ARGS = --hosts 10000 --services 10 --hostgroups 100 --groups-per-host 3 \
+	--template-depth 1 --escalations 0
+BENCH_SIM_ARGS = -d 900 -w 16 -j 256 -r 500
+EXTRA_PROGRAMS = tests/bench-config-load tests/bench-check-dispatch tests/bench-scheduler-sim
+tests_bench_config_load_SOURCES = tests/bench-config-load.c
+tests_bench_config_load_CPPFLAGS = $(AM_CPPFLAGS) -Isrc
+tests_bench_config_load_LDADD = $(LDADD)
+tests_bench_check_dispatch_SOURCES = tests/bench-check-dispatch.c
+tests_bench_check_dispatch_CPPFLAGS = $(AM_CPPFLAGS) -Isrc
+tests_bench_check_dispatch_LDADD = $(LDADD)
+tests_bench_scheduler_sim_SOURCES = tests/bench-scheduler-sim.c
+tests_bench_scheduler_sim_CPPFLAGS = $(AM_CPPFLAGS) -Isrc
+tests_bench_scheduler_sim_LDADD = $(LDADD)
+
+bench: tests/bench-config-load tests/bench-check-dispatch
+	perl $(srcdir)/t/bin/generate_config $(BENCH_CONFIG_ARGS) --dir $(builddir)/bench-config
+	./tests/bench-config-load -o bench-config-load.json $(builddir)/bench-config/naemon.cfg
+	cat bench-config-load.json
+	./tests/bench-check-dispatch $(BENCH_DISPATCH_ARGS) $(builddir)/bench-config/naemon.cfg
+	./tests/bench-check-dispatch $(BENCH_DISPATCH_ARGS) -d -1 -v 2 $(builddir)/bench-config/naemon.cfg
+
+bench-sim: tests/bench-scheduler-sim
+	perl $(srcdir)/t/bin/generate_config $(BENCH_SIM_CONFIG_ARGS) --dir $(builddir)/bench-sim-config
+	./tests/bench-scheduler-sim $(BENCH_SIM_ARGS) $(builddir)/bench-sim-config/naemon.cfg
+
+clean-local: clean-bench
+clean-bench:
+	rm -rf $(builddir)/bench-config bench-config-load.json $(builddir)/bench-sim-config
+
+.PHONY: bench bench-sim clean-bench
+EXTRA_DIST += t/bin/generate_config
+
 TEST_LOG_DRIVER = env AM_TAP_AWK='$(AWK)' $(SHELL) \
 	build-aux/tap-driver.sh
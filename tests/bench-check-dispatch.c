@@ -0,0 +1,120 @@
+/*****************************************************************************
+ *
+ * bench-check-dispatch.c - Time the core side of dispatching checks
+ *
+ * Program: Naemon Core Testing
+ * License: GPL
+ *
+ * Description:
+ *
+ * Loads a configuration (see t/bin/generate_config) and repeatedly does
+ * what run_scheduled_service_check() does before handing a check to a
+ * worker: grab the host and service macros, build the command line and
+ * clear the macros again. Nothing is actually run. debug_level and
+ * debug_verbosity can be set to see what the debug logging costs, with
+ * or without it compiled in (see --with-debug-levels).
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "naemon/common.h"
+#include "naemon/objects.h"
+#include "naemon/configuration.h"
+#include "naemon/globals.h"
+#include "naemon/logging.h"
+#include "naemon/macros.h"
+#include "naemon/utils.h"
+#include "naemon/nm_alloc.h"
+
+/* so this also builds against trees from before --with-debug-levels, for comparison */
+#ifndef NAEMON_DEBUG_LEVELS
+# define NAEMON_DEBUG_LEVELS DEBUGL_ALL
+#endif
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-n <iterations>] [-d <debug_level>] [-v <debug_verbosity>] <naemon.cfg>\n", name);
+	printf("\n");
+	printf("Prepares <iterations> checks of every service in the given configuration\n");
+	printf("and writes the time it took as JSON to stdout\n");
+	exit(ERROR);
+}
+
+int main(int argc, char **argv)
+{
+	nagios_macros mac;
+	struct timeval start, stop;
+	char *processed_command = NULL;
+	unsigned long iterations = 10, checks = 0, i;
+	int level = DEBUGL_NONE, verbosity = DEBUGV_BASIC;
+	double elapsed;
+	unsigned int x;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:d:v:h")) != -1) {
+		switch (c) {
+		case 'n':
+			iterations = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			level = atoi(optarg);
+			break;
+		case 'v':
+			verbosity = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	reset_variables();
+	config_file = nspath_absolute(argv[optind], NULL);
+	config_file_dir = nspath_absolute_dirname(config_file, NULL);
+	config_rel_path = nm_strdup(config_file_dir);
+
+	if (read_main_config_file(config_file) != OK || read_all_object_data(config_file) != OK || pre_flight_check() != OK) {
+		fprintf(stderr, "Failed to load %s\n", config_file);
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 * the debug log is never opened, so enabled messages cost their
+	 * arguments and the call, but nothing gets written
+	 */
+	debug_level = level;
+	debug_verbosity = verbosity;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++) {
+		for (x = 0; x < num_objects.services; x++) {
+			service *svc = service_ary[x];
+
+			memset(&mac, 0, sizeof(mac));
+			grab_host_macros_r(&mac, svc->host_ptr);
+			grab_service_macros_r(&mac, svc);
+			get_processed_command_line_r(&mac, svc->check_command_ptr, svc->check_command, &processed_command, STRIP_ILLEGAL_MACRO_CHARS | ESCAPE_MACRO_CHARS);
+			nm_free(processed_command);
+			clear_volatile_macros_r(&mac);
+			checks++;
+		}
+	}
+	gettimeofday(&stop, NULL);
+	elapsed = tv_delta_f(&start, &stop);
+
+	printf("{\n  \"version\": \"%s\",\n", VERSION);
+	printf("  \"debug_level\": %d,\n  \"debug_verbosity\": %d,\n", level, verbosity);
+	printf("  \"debug_levels_compiled\": %d,\n", NAEMON_DEBUG_LEVELS);
+	printf("  \"services\": %u,\n  \"checks\": %lu,\n", num_objects.services, checks);
+	printf("  \"seconds\": %.6f,\n", elapsed);
+	printf("  \"checks_per_second\": %.1f\n}\n", elapsed > 0 ? checks / elapsed : 0.0);
+
+	cleanup();
+	nm_free(config_file);
+
+	return EXIT_SUCCESS;
+}
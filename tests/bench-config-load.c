@@ -0,0 +1,163 @@
+/*****************************************************************************
+ *
+ * bench-config-load.c - Time configuration and retention data loading
+ *
+ * Program: Naemon Core Testing
+ * License: GPL
+ *
+ * Description:
+ *
+ * Loads a (usually generated, see t/bin/generate_config) configuration
+ * the same way naemon does at startup and records every timing_point()
+ * along the way. The result is written as a single JSON document so runs
+ * against different releases can be compared mechanically.
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "naemon/common.h"
+#include "naemon/objects.h"
+#include "naemon/comments.h"
+#include "naemon/configuration.h"
+#include "naemon/downtime.h"
+#include "naemon/events.h"
+#include "naemon/globals.h"
+#include "naemon/sretention.h"
+#include "naemon/utils.h"
+#include "naemon/nm_alloc.h"
+
+static FILE *out;
+static int num_phases;
+
+/* phase names are our own timing_point() strings, but quote them properly anyway */
+static void json_string(const char *str)
+{
+	fputc('"', out);
+	for (; *str; str++) {
+		if (*str == '\n')
+			continue;
+		if (*str == '"' || *str == '\\')
+			fputc('\\', out);
+		if ((unsigned char)*str < 0x20)
+			fprintf(out, "\\u%04x", *str);
+		else
+			fputc(*str, out);
+	}
+	fputc('"', out);
+}
+
+static void record_phase(double since_first, double since_last, const char *msg)
+{
+	fprintf(out, "%s\n    {\"phase\": ", num_phases++ ? "," : "");
+	json_string(msg);
+	fprintf(out, ", \"elapsed\": %.6f, \"seconds\": %.6f}", since_first, since_last);
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-o <output.json>] <naemon.cfg>\n", name);
+	printf("\n");
+	printf("Loads the given configuration, including retention data, and\n");
+	printf("writes the time spent in each phase as JSON to stdout or <output.json>\n");
+	exit(ERROR);
+}
+
+int main(int argc, char **argv)
+{
+	struct rusage ru;
+	const char *outfile = NULL;
+	int result = OK;
+	int c;
+
+	while ((c = getopt(argc, argv, "o:h")) != -1) {
+		switch (c) {
+		case 'o':
+			outfile = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	out = outfile ? fopen(outfile, "w") : stdout;
+	if (!out) {
+		perror(outfile);
+		exit(ERROR);
+	}
+
+	reset_variables();
+	enable_timing_point = TRUE;
+	timing_point_hook = record_phase;
+
+	config_file = nspath_absolute(argv[optind], NULL);
+	config_file_dir = nspath_absolute_dirname(config_file, NULL);
+	config_rel_path = nm_strdup(config_file_dir);
+
+	fprintf(out, "{\n  \"version\": ");
+	json_string(VERSION);
+	fprintf(out, ",\n  \"config\": ");
+	json_string(config_file);
+	fprintf(out, ",\n  \"phases\": [");
+
+	timing_point("Reading main config file\n");
+	if (read_main_config_file(config_file) != OK) {
+		result = ERROR;
+		goto done;
+	}
+	timing_point("Read main config file\n");
+
+	if (read_all_object_data(config_file) != OK) {
+		result = ERROR;
+		goto done;
+	}
+	timing_point("Read all object data\n");
+
+	if (pre_flight_check() != OK) {
+		result = ERROR;
+		goto done;
+	}
+	timing_point("Ran pre flight check\n");
+
+	init_event_queue();
+	initialize_retention_data();
+	initialize_downtime_data();
+	initialize_comment_data();
+	timing_point("Initialized retention, downtime and comment data\n");
+
+	/* make sure there's one retention entry per object to read back */
+	retain_state_information = TRUE;
+	if (save_state_information(FALSE) != OK) {
+		result = ERROR;
+		goto done;
+	}
+	timing_point("Saved retention data\n");
+
+	if (read_initial_state_information() != OK) {
+		result = ERROR;
+		goto done;
+	}
+	timing_point("Read retention data\n");
+
+done:
+	getrusage(RUSAGE_SELF, &ru);
+	fprintf(out, "\n  ],\n");
+	fprintf(out, "  \"hosts\": %u,\n  \"services\": %u,\n", num_objects.hosts, num_objects.services);
+	fprintf(out, "  \"max_rss_kb\": %ld,\n", ru.ru_maxrss);
+	fprintf(out, "  \"result\": \"%s\"\n}\n", result == OK ? "ok" : "error");
+	if (out != stdout)
+		fclose(out);
+
+	cleanup_downtime_data();
+	cleanup_retention_data();
+	cleanup();
+	nm_free(config_file);
+
+	return result == OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
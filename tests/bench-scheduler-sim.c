@@ -0,0 +1,535 @@
+/*****************************************************************************
+ *
+ * bench-scheduler-sim.c - Simulate the scheduler against fake workers
+ *
+ * Program: Naemon Core Testing
+ * License: GPL
+ *
+ * Description:
+ *
+ * Loads a configuration (see t/bin/generate_config) and runs the real
+ * event queue, check scheduling and worker dispatch against a simulated
+ * clock. The workers are simulated too: they live in this process on the
+ * other end of a socketpair, speak the regular worker protocol and answer
+ * each job after a runtime drawn from the configured distribution, with
+ * some share of the jobs failing or timing out. Nothing is ever executed
+ * and nothing sleeps, so hours of scheduling take minutes, and the same
+ * seed always gives the same run.
+ *
+ * time(), gettimeofday() and clock_gettime() are replaced for the whole
+ * process, libnaemon included. The result is written as JSON to stdout:
+ * event latency percentiles, how evenly jobs were spread over the
+ * simulated seconds, backlog figures, events per CPU second and memory.
+ *
+ *****************************************************************************/
+
+#include "config.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "naemon/common.h"
+#include "naemon/objects.h"
+#include "naemon/checks.h"
+#include "naemon/comments.h"
+#include "naemon/configuration.h"
+#include "naemon/downtime.h"
+#include "naemon/globals.h"
+#include "naemon/perfdata.h"
+#include "naemon/utils.h"
+#include "naemon/nm_alloc.h"
+
+/* we need the event heap and worker internals */
+#include "naemon/events.c"
+#include "naemon/workers.c"
+
+/* a fixed start keeps timeperiods and thus the whole run reproducible */
+#define SIM_EPOCH 1700000000
+/* event latencies are kept per millisecond up to this, and counted above it */
+#define SIM_LATENCY_BUCKETS 60000
+
+enum sim_distribution {
+	SIM_DIST_FIXED,
+	SIM_DIST_UNIFORM,
+	SIM_DIST_EXP,
+};
+
+enum sim_outcome {
+	SIM_OK,
+	SIM_FAIL,
+	SIM_TIMEOUT,
+};
+
+struct sim_worker {
+	int sd;
+	nm_bufferqueue *bq;
+};
+
+struct sim_job {
+	struct timespec done;
+	struct timeval start;
+	struct sim_worker *worker;
+	int job_id;
+	int timeout;
+	enum sim_outcome outcome;
+};
+
+static struct timespec sim_now = {SIM_EPOCH, 0};
+static unsigned long long rng;
+
+static struct {
+	unsigned int workers;
+	unsigned int max_jobs;
+	unsigned int runtime_ms;
+	enum sim_distribution dist;
+	double fail_pct, timeout_pct;
+	unsigned long duration;
+	unsigned long long seed;
+} sim = {8, 256, 500, SIM_DIST_EXP, 2.0, 0.1, 900, 1};
+
+/* jobs the simulated workers are "running", a min-heap on completion time */
+static struct sim_job **running;
+static size_t running_count, running_size;
+
+static struct {
+	unsigned long events;
+	unsigned long jobs, failed, timed_out;
+	unsigned long latency[SIM_LATENCY_BUCKETS + 1];
+	double latency_max;
+	/* jobs started per simulated second */
+	time_t second;
+	unsigned long this_second, busiest_second, seconds;
+	double sum, sum_sq;
+} stats;
+
+/*
+ * The simulated clock. These take over from libc for all of naemon,
+ * so the scheduler and the workers see the same time.
+ */
+time_t time(time_t *t)
+{
+	if (t)
+		*t = sim_now.tv_sec;
+	return sim_now.tv_sec;
+}
+
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 31)
+int gettimeofday(struct timeval *tv, void *tz)
+#else
+int gettimeofday(struct timeval *tv, struct timezone *tz)
+#endif
+{
+	tv->tv_sec = sim_now.tv_sec;
+	tv->tv_usec = sim_now.tv_nsec / 1000;
+	return 0;
+}
+
+int clock_gettime(clockid_t clk_id, struct timespec *tp)
+{
+	*tp = sim_now;
+	return 0;
+}
+
+static int ts_cmp(const struct timespec *a, const struct timespec *b)
+{
+	if (a->tv_sec != b->tv_sec)
+		return a->tv_sec < b->tv_sec ? -1 : 1;
+	if (a->tv_nsec != b->tv_nsec)
+		return a->tv_nsec < b->tv_nsec ? -1 : 1;
+	return 0;
+}
+
+static void ts_add_ms(struct timespec *ts, unsigned long ms)
+{
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000;
+	if (ts->tv_nsec >= 1000000000) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+/* xorshift64*, so runs don't depend on the libc's rand() */
+static double sim_random(void)
+{
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+	return ((rng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static unsigned long sim_runtime_ms(void)
+{
+	switch (sim.dist) {
+	case SIM_DIST_FIXED:
+		return sim.runtime_ms;
+	case SIM_DIST_UNIFORM:
+		return (unsigned long)(sim_random() * 2 * sim.runtime_ms);
+	case SIM_DIST_EXP:
+	default:
+		return (unsigned long)(-log(1.0 - sim_random()) * sim.runtime_ms);
+	}
+}
+
+static void running_push(struct sim_job *job)
+{
+	size_t i, parent;
+
+	if (running_count == running_size) {
+		running_size = running_size ? running_size * 2 : 1024;
+		running = nm_realloc(running, running_size * sizeof(*running));
+	}
+	for (i = running_count++; i > 0; i = parent) {
+		parent = (i - 1) / 2;
+		if (ts_cmp(&running[parent]->done, &job->done) <= 0)
+			break;
+		running[i] = running[parent];
+	}
+	running[i] = job;
+}
+
+static struct sim_job *running_pop(void)
+{
+	struct sim_job *top, *last;
+	size_t i, child;
+
+	if (!running_count)
+		return NULL;
+	top = running[0];
+	last = running[--running_count];
+	for (i = 0; (child = i * 2 + 1) < running_count; i = child) {
+		if (child + 1 < running_count && ts_cmp(&running[child + 1]->done, &running[child]->done) < 0)
+			child++;
+		if (ts_cmp(&last->done, &running[child]->done) <= 0)
+			break;
+		running[i] = running[child];
+	}
+	if (running_count)
+		running[i] = last;
+	return top;
+}
+
+static void count_job_start(void)
+{
+	if (sim_now.tv_sec != stats.second) {
+		if (stats.second) {
+			stats.seconds += sim_now.tv_sec - stats.second;
+			stats.sum += stats.this_second;
+			stats.sum_sq += (double)stats.this_second * stats.this_second;
+			if (stats.this_second > stats.busiest_second)
+				stats.busiest_second = stats.this_second;
+		}
+		stats.second = sim_now.tv_sec;
+		stats.this_second = 0;
+	}
+	stats.this_second++;
+	stats.jobs++;
+}
+
+/* a simulated worker got a job from the core */
+static int sim_worker_input(int sd, int events, void *arg)
+{
+	static struct kvvec kvv = KVVEC_INITIALIZER;
+	struct sim_worker *worker = arg;
+	char *buf;
+	size_t size;
+
+	if (nm_bufferqueue_read(worker->bq, sd) <= 0)
+		return 0;
+
+	while ((buf = worker_ioc2msg(worker->bq, &size, 0))) {
+		struct sim_job *job;
+		double dice;
+		int i;
+
+		job = nm_calloc(1, sizeof(*job));
+		job->worker = worker;
+		buf2kvvec_prealloc(&kvv, buf, size, KV_SEP, PAIR_SEP, KVVEC_ASSIGN);
+		for (i = 0; i < kvv.kv_pairs; i++) {
+			if (!strcmp(kvv.kv[i].key, "job_id"))
+				job->job_id = atoi(kvv.kv[i].value);
+			else if (!strcmp(kvv.kv[i].key, "timeout"))
+				job->timeout = atoi(kvv.kv[i].value);
+		}
+		nm_free(buf);
+
+		job->start.tv_sec = sim_now.tv_sec;
+		job->start.tv_usec = sim_now.tv_nsec / 1000;
+		job->done = sim_now;
+		dice = sim_random() * 100;
+		if (dice < sim.timeout_pct && job->timeout) {
+			job->outcome = SIM_TIMEOUT;
+			ts_add_ms(&job->done, job->timeout * 1000UL);
+		} else {
+			job->outcome = dice < sim.timeout_pct + sim.fail_pct ? SIM_FAIL : SIM_OK;
+			ts_add_ms(&job->done, sim_runtime_ms());
+		}
+		count_job_start();
+		running_push(job);
+	}
+
+	return 0;
+}
+
+/* send the results of everything that's done by now */
+static void sim_deliver_results(void)
+{
+	static struct kvvec resp = KVVEC_INITIALIZER;
+	struct kvvec_buf *kvvb;
+	struct sim_job *job;
+	struct timeval stop;
+
+	while (running_count && ts_cmp(&running[0]->done, &sim_now) <= 0) {
+		job = running_pop();
+		stop.tv_sec = job->done.tv_sec;
+		stop.tv_usec = job->done.tv_nsec / 1000;
+
+		kvvec_init(&resp, 8);
+		kvvec_addkv_str(&resp, "job_id", mkstr("%d", job->job_id));
+		kvvec_addkv_tv(&resp, "start", &job->start);
+		kvvec_addkv_tv(&resp, "stop", &stop);
+		if (job->outcome == SIM_TIMEOUT) {
+			kvvec_addkv_str(&resp, "exited_ok", "0");
+			kvvec_addkv_str(&resp, "error_code", mkstr("%d", ETIME));
+			kvvec_addkv_str(&resp, "outstd", "");
+			stats.timed_out++;
+		} else if (job->outcome == SIM_FAIL) {
+			kvvec_addkv_str(&resp, "exited_ok", "1");
+			kvvec_addkv_str(&resp, "wait_status", mkstr("%d", STATE_CRITICAL << 8));
+			kvvec_addkv_str(&resp, "outstd", "CRITICAL: simulated failure|time=1s\n");
+			stats.failed++;
+		} else {
+			kvvec_addkv_str(&resp, "exited_ok", "1");
+			kvvec_addkv_str(&resp, "wait_status", "0");
+			kvvec_addkv_str(&resp, "outstd", "OK: simulated|time=1s\n");
+		}
+		kvvec_addkv_str(&resp, "outerr", "");
+
+		kvvb = build_kvvec_buf(&resp);
+		iobroker_write_packet(nagios_iobs, job->worker->sd, kvvb->buf, kvvb->bufsize);
+		nm_free(kvvb->buf);
+		nm_free(kvvb);
+		nm_free(job);
+	}
+}
+
+static int sim_add_worker(unsigned int id)
+{
+	struct sim_worker *worker;
+	struct kvvec *info;
+	char name[64], max_jobs[16], ok[3];
+	int sv[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		perror("socketpair");
+		return ERROR;
+	}
+	worker_set_sockopts(sv[0], 256 * 1024);
+	worker_set_sockopts(sv[1], 256 * 1024);
+
+	snprintf(name, sizeof(name), "Simulated Worker %u", id);
+	snprintf(max_jobs, sizeof(max_jobs), "%u", sim.max_jobs);
+	info = kvvec_create(2);
+	kvvec_addkv_str(info, "name", name);
+	kvvec_addkv_str(info, "max_jobs", max_jobs);
+	add_worker(sv[0], info, NULL, NULL);
+
+	/* the core says hello before it sends any jobs */
+	if (read(sv[1], ok, sizeof(ok)) != sizeof(ok)) {
+		fprintf(stderr, "Simulated worker %u wasn't accepted\n", id);
+		return ERROR;
+	}
+
+	worker = nm_calloc(1, sizeof(*worker));
+	worker->sd = sv[1];
+	worker->bq = nm_bufferqueue_create();
+	iobroker_register(nagios_iobs, worker->sd, worker, sim_worker_input);
+	return OK;
+}
+
+/* run whatever is due, then jump ahead to whatever happens next */
+static void sim_run(void)
+{
+	struct nm_event_execution_properties evprop;
+	struct timed_event *evt;
+	struct timespec end = sim_now;
+
+	end.tv_sec += sim.duration;
+	for (;;) {
+		sim_deliver_results();
+		do {
+			iobroker_push(nagios_iobs);
+		} while (iobroker_poll(nagios_iobs, 0) > 0);
+
+		evt = evheap_head(event_queue);
+		if (evt && ts_cmp(&evt->event_time, &sim_now) <= 0) {
+			double latency = (sim_now.tv_sec - evt->event_time.tv_sec) * 1000.0 +
+			                 (sim_now.tv_nsec - evt->event_time.tv_nsec) / 1000000.0;
+
+			stats.latency[latency < SIM_LATENCY_BUCKETS ? (size_t)latency : SIM_LATENCY_BUCKETS]++;
+			if (latency > stats.latency_max)
+				stats.latency_max = latency;
+			stats.events++;
+
+			/* the same as event_poll_full() does once the event is due */
+			evprop.event_type = EVENT_TYPE_TIMED;
+			evprop.execution_type = EVENT_EXEC_NORMAL;
+			evprop.user_data = evt->user_data;
+			evprop.attributes.timed.event = evt;
+			evprop.attributes.timed.latency = latency / 1000.0;
+			execute_and_destroy_event(&evprop);
+			continue;
+		}
+
+		/* nothing to do right now, so skip ahead */
+		if (running_count && (!evt || ts_cmp(&running[0]->done, &evt->event_time) < 0))
+			sim_now = running[0]->done;
+		else if (evt)
+			sim_now = evt->event_time;
+		else
+			break;
+		if (ts_cmp(&sim_now, &end) >= 0)
+			break;
+	}
+}
+
+static double latency_percentile(double pct)
+{
+	unsigned long total = 0, seen = 0;
+	size_t i;
+
+	for (i = 0; i <= SIM_LATENCY_BUCKETS; i++)
+		total += stats.latency[i];
+	for (i = 0; i < SIM_LATENCY_BUCKETS; i++) {
+		seen += stats.latency[i];
+		if (seen && seen >= total * pct / 100)
+			return i;
+	}
+	return stats.latency_max;
+}
+
+static void usage(const char *name)
+{
+	printf("Usage: %s [-d <seconds>] [-w <workers>] [-j <jobs per worker>] [-r <runtime ms>]\n", name);
+	printf("          [-D fixed|uniform|exp] [-f <fail %%>] [-t <timeout %%>] [-l <levelling window>]\n");
+	printf("          [-s <seed>] <naemon.cfg>\n");
+	printf("\n");
+	printf("Runs the scheduler on the given configuration for <seconds> of simulated time\n");
+	printf("against simulated workers, and writes what happened as JSON to stdout\n");
+	exit(ERROR);
+}
+
+int main(int argc, char **argv)
+{
+	struct rusage ru;
+	double cpu, mean;
+	int levelling = -1;
+	int c;
+	unsigned int i;
+
+	while ((c = getopt(argc, argv, "d:w:j:r:D:f:t:l:s:h")) != -1) {
+		switch (c) {
+		case 'd':
+			sim.duration = strtoul(optarg, NULL, 10);
+			break;
+		case 'w':
+			sim.workers = strtoul(optarg, NULL, 10);
+			break;
+		case 'j':
+			sim.max_jobs = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			sim.runtime_ms = strtoul(optarg, NULL, 10);
+			break;
+		case 'D':
+			if (!strcmp(optarg, "fixed"))
+				sim.dist = SIM_DIST_FIXED;
+			else if (!strcmp(optarg, "uniform"))
+				sim.dist = SIM_DIST_UNIFORM;
+			else if (!strcmp(optarg, "exp"))
+				sim.dist = SIM_DIST_EXP;
+			else
+				usage(argv[0]);
+			break;
+		case 'f':
+			sim.fail_pct = atof(optarg);
+			break;
+		case 't':
+			sim.timeout_pct = atof(optarg);
+			break;
+		case 'l':
+			levelling = atoi(optarg);
+			break;
+		case 's':
+			sim.seed = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || !sim.workers || !sim.max_jobs || !sim.seed)
+		usage(argv[0]);
+	rng = sim.seed;
+	srand(sim.seed);
+
+	reset_variables();
+	config_file = nspath_absolute(argv[optind], NULL);
+	config_file_dir = nspath_absolute_dirname(config_file, NULL);
+	config_rel_path = nm_strdup(config_file_dir);
+
+	if (read_main_config_file(config_file) != OK || read_all_object_data(config_file) != OK || pre_flight_check() != OK) {
+		fprintf(stderr, "Failed to load %s\n", config_file);
+		exit(EXIT_FAILURE);
+	}
+	if (levelling >= 0)
+		check_load_levelling_window = levelling;
+
+	init_event_queue();
+	nagios_iobs = iobroker_create();
+	specialized_workers = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+	for (i = 0; i < sim.workers; i++) {
+		if (sim_add_worker(i) != OK)
+			exit(EXIT_FAILURE);
+	}
+	initialize_downtime_data();
+	initialize_comment_data();
+	initialize_performance_data(config_file);
+	checks_init();
+	init_check_stats();
+
+	sim_run();
+
+	getrusage(RUSAGE_SELF, &ru);
+	cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1000000.0;
+	mean = stats.seconds ? stats.sum / stats.seconds : 0.0;
+
+	printf("{\n  \"version\": \"%s\",\n", VERSION);
+	printf("  \"hosts\": %u,\n  \"services\": %u,\n", num_objects.hosts, num_objects.services);
+	printf("  \"workers\": %u,\n  \"max_jobs\": %u,\n", sim.workers, sim.max_jobs);
+	printf("  \"runtime_ms\": %u,\n  \"distribution\": \"%s\",\n", sim.runtime_ms,
+	       sim.dist == SIM_DIST_FIXED ? "fixed" : sim.dist == SIM_DIST_UNIFORM ? "uniform" : "exp");
+	printf("  \"check_load_levelling_window\": %d,\n", check_load_levelling_window);
+	printf("  \"seed\": %llu,\n", sim.seed);
+	printf("  \"simulated_seconds\": %lu,\n", sim.duration);
+	printf("  \"events\": %lu,\n", stats.events);
+	printf("  \"jobs\": %lu,\n  \"jobs_failed\": %lu,\n  \"jobs_timed_out\": %lu,\n", stats.jobs, stats.failed, stats.timed_out);
+	printf("  \"event_latency_ms\": {\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"p999\": %.0f, \"max\": %.3f},\n",
+	       latency_percentile(50), latency_percentile(90), latency_percentile(99), latency_percentile(99.9), stats.latency_max);
+	printf("  \"jobs_per_second\": {\"mean\": %.2f, \"stddev\": %.2f, \"max\": %lu},\n",
+	       mean, stats.seconds ? sqrt(stats.sum_sq / stats.seconds - mean * mean) : 0.0, stats.busiest_second);
+	printf("  \"backlog\": {\"queued\": %lu, \"dropped\": %lu, \"expired\": %lu, \"avg_wait\": %.3f, \"max_wait\": %.3f},\n",
+	       backlog_stats.queued, backlog_stats.dropped, backlog_stats.expired,
+	       backlog_stats.dispatched ? backlog_stats.wait_total / backlog_stats.dispatched : 0.0, backlog_stats.wait_max);
+	printf("  \"cpu_seconds\": %.3f,\n", cpu);
+	printf("  \"events_per_cpu_second\": %.1f,\n", cpu > 0 ? stats.events / cpu : 0.0);
+	printf("  \"max_rss_kb\": %ld\n}\n", ru.ru_maxrss);
+
+	cleanup();
+	nm_free(config_file);
+
+	return EXIT_SUCCESS;
+}
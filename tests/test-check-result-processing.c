@@ -1,4 +1,5 @@
 #include <check.h>
+#include <sys/time.h>
 #include "naemon/checks.h"
 #include "naemon/checks_host.h"
 #include "naemon/checks_service.h"
@@ -112,6 +113,116 @@ START_TEST(spool_file_processing)
 }
 END_TEST
 
+static void write_spool_file(const char *dir, const char *name, const char *output)
+{
+	char path[256];
+	time_t now = time(NULL);
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	fp = fopen(path, "w");
+	ck_assert(fp != NULL);
+	fprintf(fp,
+	        "file_time=%ld\n"
+	        "\n"
+	        "host_name=%s\n"
+	        "service_description=%s\n"
+	        "check_type=1\n"
+	        "start_time=%ld.000000\n"
+	        "finish_time=%ld.000000\n"
+	        "exited_ok=1\n"
+	        "return_code=0\n"
+	        "output=%s\n",
+	        now, TARGET_HOST_NAME, TARGET_SERVICE_NAME, now, now, output);
+	fclose(fp);
+
+	/* the ok-to-go file is what says the result is complete */
+	snprintf(path, sizeof(path), "%s/%s.ok", dir, name);
+	fp = fopen(path, "w");
+	ck_assert(fp != NULL);
+	fclose(fp);
+}
+
+START_TEST(spool_watcher_batches)
+{
+	char dir[] = "/tmp/naemon-spool-dir-XXXXXX";
+	char path[256];
+	int i;
+
+	ck_assert(mkdtemp(dir) != NULL);
+	nagios_iobs = iobroker_create();
+	ck_assert(nagios_iobs != NULL);
+
+	/* results spooled before we start watching are found by the initial rescan */
+	write_spool_file(dir, "cAAAAAA", "left behind");
+	ck_assert_int_eq(OK, watch_check_result_path(dir));
+	ck_assert_int_eq(1, process_check_result_spool(10));
+	ck_assert_str_eq(svc->plugin_output, "left behind");
+
+	for (i = 0; i < 3; i++) {
+		char name[8], output[16];
+		snprintf(name, sizeof(name), "cBBBBB%d", i);
+		snprintf(output, sizeof(output), "batch %d", i);
+		write_spool_file(dir, name, output);
+	}
+	iobroker_poll(nagios_iobs, 1000);
+
+	/* no more than we ask for at a time, in the order they arrived */
+	ck_assert_int_eq(2, process_check_result_spool(2));
+	ck_assert_str_eq(svc->plugin_output, "batch 1");
+	ck_assert_int_eq(1, process_check_result_spool(2));
+	ck_assert_str_eq(svc->plugin_output, "batch 2");
+	ck_assert_int_eq(0, process_check_result_spool(2));
+
+	snprintf(path, sizeof(path), "%s/cBBBBB2", dir);
+	ck_assert(access(path, F_OK) < 0);
+	snprintf(path, sizeof(path), "%s/cBBBBB2.ok", dir);
+	ck_assert(access(path, F_OK) < 0);
+
+	unwatch_check_result_path();
+	iobroker_destroy(nagios_iobs, 0);
+	nagios_iobs = NULL;
+	ck_assert_int_eq(0, rmdir(dir));
+}
+END_TEST
+
+START_TEST(spool_watcher_sweeps_stale_files)
+{
+	char dir[] = "/tmp/naemon-spool-dir-XXXXXX";
+	char path[256];
+	struct timeval old[2];
+	time_t start;
+	FILE *fp;
+
+	ck_assert(mkdtemp(dir) != NULL);
+	nagios_iobs = iobroker_create();
+	ck_assert(nagios_iobs != NULL);
+	max_check_result_file_age = 1;
+	ck_assert_int_eq(OK, watch_check_result_path(dir));
+	ck_assert_int_eq(0, process_check_result_spool(10));
+
+	/* a submitter died before writing the .ok file, long ago */
+	snprintf(path, sizeof(path), "%s/cDDDDDD", dir);
+	fp = fopen(path, "w");
+	ck_assert(fp != NULL);
+	fclose(fp);
+	old[0].tv_sec = old[1].tv_sec = time(NULL) - 3600;
+	old[0].tv_usec = old[1].tv_usec = 0;
+	ck_assert_int_eq(0, utimes(path, old));
+
+	start = time(NULL);
+	while (access(path, F_OK) == 0 && time(NULL) < start + 5)
+		event_poll();
+	ck_assert(access(path, F_OK) < 0);
+
+	unwatch_check_result_path();
+	max_check_result_file_age = DEFAULT_MAX_CHECK_RESULT_AGE;
+	iobroker_destroy(nagios_iobs, 0);
+	nagios_iobs = NULL;
+	ck_assert_int_eq(0, rmdir(dir));
+}
+END_TEST
+
 int main(int argc, char **argv)
 {
 	int number_failed = 0;
@@ -129,6 +240,8 @@ int main(int argc, char **argv)
 	s = suite_create("Check results");
 	tcase_add_test(tc_process, host_soft_to_hard);
 	tcase_add_test(tc_process, spool_file_processing);
+	tcase_add_test(tc_process, spool_watcher_batches);
+	tcase_add_test(tc_process, spool_watcher_sweeps_stale_files);
 	suite_add_tcase(s, tc_process);
 
 	sr = srunner_create(s);
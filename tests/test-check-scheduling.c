@@ -996,6 +996,149 @@ START_TEST(disable_service_check_host_down)
 }
 END_TEST
 
+/*
+ * Load levelling: a pile of services all due at the same second should
+ * end up spread over the window, and never further than it allows.
+ */
+#define LEVELLED_SERVICES 300
+static service *levelled[LEVELLED_SERVICES];
+
+void levelling_setup(void)
+{
+	char name[32];
+	int i;
+
+	init_event_queue();
+	init_objects_host(1);
+	init_objects_service(LEVELLED_SERVICES);
+	init_objects_command(1);
+
+	cmd = create_command("my_command", "/bin/true");
+	ck_assert(cmd != NULL);
+	register_command(cmd);
+
+	hst = create_host(TARGET_HOST_NAME);
+	ck_assert(hst != NULL);
+	hst->check_command_ptr = cmd;
+	register_host(hst);
+
+	for (i = 0; i < LEVELLED_SERVICES; i++) {
+		snprintf(name, sizeof(name), "levelled_%d", i);
+		levelled[i] = create_service(hst, name);
+		ck_assert(levelled[i] != NULL);
+		levelled[i]->check_command_ptr = cmd;
+		levelled[i]->check_interval = 5.0;
+		levelled[i]->retry_interval = 1.0;
+		levelled[i]->current_state = STATE_OK;
+		levelled[i]->state_type = HARD_STATE;
+		register_service(levelled[i]);
+	}
+	reset_check_slots();
+}
+
+void levelling_teardown(void)
+{
+	check_load_levelling_window = 0;
+	teardown();
+}
+
+static void schedule_all(time_t delay, int options)
+{
+	int i;
+
+	for (i = 0; i < LEVELLED_SERVICES; i++)
+		schedule_next_service_check(levelled[i], delay, options);
+}
+
+/* most checks in any one second, and the range they span, going by next_check */
+static unsigned int busiest_second(time_t *first, time_t *last)
+{
+	GHashTable *histogram = g_hash_table_new(g_direct_hash, g_direct_equal);
+	unsigned int busiest = 0;
+	int i;
+
+	*first = *last = levelled[0]->next_check;
+	for (i = 0; i < LEVELLED_SERVICES; i++) {
+		time_t when = levelled[i]->next_check;
+		unsigned int checks = GPOINTER_TO_UINT(g_hash_table_lookup(histogram, GINT_TO_POINTER(when))) + 1;
+
+		g_hash_table_insert(histogram, GINT_TO_POINTER(when), GUINT_TO_POINTER(checks));
+		if (checks > busiest)
+			busiest = checks;
+		if (when < *first)
+			*first = when;
+		if (when > *last)
+			*last = when;
+	}
+	g_hash_table_destroy(histogram);
+	return busiest;
+}
+
+START_TEST(levelling_disabled_keeps_clusters)
+{
+	time_t now = time(NULL), first, last;
+
+	check_load_levelling_window = 0;
+	schedule_all(300, CHECK_OPTION_NONE);
+	/* the clock may tick once while we're at it */
+	ck_assert_int_ge(busiest_second(&first, &last), LEVELLED_SERVICES / 2);
+	ck_assert_int_ge(first, now + 300);
+	ck_assert_int_le(last, now + 301);
+}
+END_TEST
+
+START_TEST(levelling_spreads_clustered_checks)
+{
+	time_t now = time(NULL), first, last;
+	unsigned int busiest;
+
+	check_load_levelling_window = 60;
+	schedule_all(300, CHECK_OPTION_NONE);
+	busiest = busiest_second(&first, &last);
+
+	/* 300 checks over 61 seconds is 5 a second, give or take a clock tick */
+	ck_assert_int_le(busiest, 6);
+	ck_assert_int_ge(first, now + 300 - 30);
+	ck_assert_int_le(last, now + 301 + 30);
+	ck_assert_int_ge(last - first, 55);
+
+	/* rescheduling gives back the old slots, so it's as flat the second time */
+	schedule_all(300, CHECK_OPTION_NONE);
+	ck_assert_int_le(busiest_second(&first, &last), 6);
+}
+END_TEST
+
+START_TEST(levelling_window_stays_within_interval)
+{
+	time_t now = time(NULL), first, last;
+	int i;
+
+	/* a window far wider than the one minute interval is cut down to it */
+	check_load_levelling_window = 600;
+	for (i = 0; i < LEVELLED_SERVICES; i++)
+		levelled[i]->check_interval = 1.0;
+	schedule_all(60, CHECK_OPTION_NONE);
+	busiest_second(&first, &last);
+	ck_assert_int_ge(first, now + 60 - 30);
+	ck_assert_int_le(last, now + 61 + 30);
+}
+END_TEST
+
+START_TEST(levelling_leaves_forced_checks_alone)
+{
+	time_t now = time(NULL), first, last;
+
+	check_load_levelling_window = 60;
+	schedule_all(100, CHECK_OPTION_FORCE_EXECUTION);
+	busiest_second(&first, &last);
+	ck_assert_int_ge(first, now + 100);
+	ck_assert_int_le(last, now + 101);
+
+	/* but they still count towards how busy that second is */
+	ck_assert_int_ge(check_slot_occupancy(first) + check_slot_occupancy(last), LEVELLED_SERVICES);
+}
+END_TEST
+
 Suite *
 check_scheduling_suite(void)
 {
@@ -1005,6 +1148,7 @@ check_scheduling_suite(void)
 	TCase *tc_miscellaneous = tcase_create("Miscellaneous tests");
 	TCase *tc_ondemand = tcase_create("On demand host checks");
 	TCase *tc_retain = tcase_create("Retain next_check schedule");
+	TCase *tc_levelling = tcase_create("Load levelling");
 	tcase_add_checked_fixture(tc_freshness_checking, setup, teardown);
 	tcase_add_test(tc_freshness_checking, service_freshness_checking);
 	tcase_add_test(tc_freshness_checking, host_freshness_checking);
@@ -1047,6 +1191,13 @@ check_scheduling_suite(void)
 	tcase_add_test(tc_miscellaneous, disable_service_check_host_down);
 	suite_add_tcase(s, tc_miscellaneous);
 
+	tcase_add_checked_fixture(tc_levelling, levelling_setup, levelling_teardown);
+	tcase_add_test(tc_levelling, levelling_disabled_keeps_clusters);
+	tcase_add_test(tc_levelling, levelling_spreads_clustered_checks);
+	tcase_add_test(tc_levelling, levelling_window_stays_within_interval);
+	tcase_add_test(tc_levelling, levelling_leaves_forced_checks_alone);
+	suite_add_tcase(s, tc_levelling);
+
 	return s;
 }
 
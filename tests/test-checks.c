@@ -1,5 +1,8 @@
 #include <check.h>
+#include <glib.h>
+#include <sys/time.h>
 #include "naemon/checks.h"
+#include "naemon/nm_alloc.h"
 
 char *full_output;
 char *short_output;
@@ -202,11 +205,286 @@ START_TEST(multiline_unicode)
 }
 END_TEST
 
+/* what parse_output() used to be, to compare the single pass parser against */
+static struct check_output *strtok_parse_output(const char *buf, struct check_output *check_output)
+{
+	char *saveptr = NULL, *tmpbuf = NULL;
+	char *p = NULL, *tmp = NULL;
+	GString *perf_data_string;
+
+	check_output->perf_data = NULL;
+	check_output->long_output = NULL;
+	check_output->short_output = NULL;
+	if (!buf || !*buf)
+		return check_output;
+	tmpbuf = nm_strdup(buf);
+
+	perf_data_string = g_string_new(NULL);
+	tmp = strtok_r(tmpbuf, "\n", &saveptr);
+	if (tmp != NULL)
+		p = strpbrk(tmp, "|");
+	if (p == NULL) {
+		check_output->short_output = tmp ? nm_strdup(tmp) : nm_strdup("");
+	} else {
+		check_output->short_output = nm_strndup(tmp, (size_t)(p - tmp));
+		g_string_append(perf_data_string, p + 1);
+	}
+
+	if ((tmp = strtok_r(NULL, "", &saveptr))) {
+		p = strpbrk(tmp, "|");
+		if (p == NULL) {
+			check_output->long_output = nm_strdup(tmp);
+		} else {
+			if (p != tmp)
+				check_output->long_output = nm_strndup(tmp, (size_t)(p - tmp));
+			tmp = strtok_r(p + 1, "\n", &saveptr);
+			while (tmp) {
+				if (*tmp != ' ')
+					g_string_append_c(perf_data_string, ' ');
+				g_string_append(perf_data_string, tmp);
+				tmp = strtok_r(NULL, "\n", &saveptr);
+			}
+		}
+	}
+
+	check_output->perf_data = *perf_data_string->str ? nm_strdup(perf_data_string->str) : NULL;
+	g_string_free(perf_data_string, TRUE);
+	free(tmpbuf);
+	return check_output;
+}
+
+static void free_check_output(struct check_output *co)
+{
+	free(co->short_output);
+	free(co->long_output);
+	free(co->perf_data);
+}
+
+static void assert_same_output(const char *buf)
+{
+	struct check_output expected, got;
+
+	strtok_parse_output(buf, &expected);
+	parse_output(buf, &got);
+	ck_assert_msg(!g_strcmp0(expected.short_output, got.short_output), "short output of '%s': '%s' != '%s'", buf, expected.short_output, got.short_output);
+	ck_assert_msg(!g_strcmp0(expected.long_output, got.long_output), "long output of '%s': '%s' != '%s'", buf, expected.long_output, got.long_output);
+	ck_assert_msg(!g_strcmp0(expected.perf_data, got.perf_data), "perfdata of '%s': '%s' != '%s'", buf, expected.perf_data, got.perf_data);
+	free_check_output(&expected);
+	free_check_output(&got);
+}
+
+START_TEST(parse_output_matches_strtok_parser)
+{
+	static const char *outputs[] = {
+		"", "\n", "\n\n\n", "|", "||", "\n|", "|\n", "a|b|c", "a\n|", "a\n||b\n|c",
+		"OK | a=1\n\n\nlong\n\n| b=2\n\n c=3\n\nd=4\n\n",
+		"\n\nOK\nlong | p=1\nq=2| r=3",
+		"OK\n \n | x=1",
+	};
+	static const char alphabet[] = "ab |\n";
+	unsigned int seed = 42, i, j;
+	char buf[64];
+
+	for (i = 0; i < sizeof(outputs) / sizeof(outputs[0]); i++)
+		assert_same_output(outputs[i]);
+
+	/* short strings over an alphabet of the interesting characters hit every corner */
+	for (i = 0; i < 100000; i++) {
+		size_t len = rand_r(&seed) % (sizeof(buf) - 1);
+		for (j = 0; j < len; j++)
+			buf[j] = alphabet[rand_r(&seed) % (sizeof(alphabet) - 1)];
+		buf[len] = 0;
+		assert_same_output(buf);
+	}
+}
+END_TEST
+
+START_TEST(scan_check_output_slices)
+{
+	struct check_output_slices slices;
+	const char *buf = "\nOK - fine | a=1\nmore\nlines | b=2\nc=3";
+
+	scan_check_output(buf, &slices);
+	ck_assert(slices.short_output == buf + 1);
+	ck_assert_int_eq(10, slices.short_len);
+	ck_assert(slices.perf_data == buf + 12);
+	ck_assert_int_eq(4, slices.perf_len);
+	ck_assert(slices.long_output == buf + 17);
+	ck_assert_int_eq(11, slices.long_len);
+	ck_assert(slices.perf_lines == buf + 29);
+	ck_assert_int_eq(8, slices.perf_lines_len);
+
+	scan_check_output(NULL, &slices);
+	ck_assert(NULL == slices.short_output);
+}
+END_TEST
+
+/* what the check result handlers did before store_check_output() */
+static void legacy_store_check_output(char *buf, const char *no_output, char **short_out, char **long_out, char **perf)
+{
+	char *p;
+
+	free(*short_out);
+	free(*long_out);
+	free(*perf);
+	parse_check_output(buf, short_out, long_out, perf, TRUE, FALSE);
+	if (*short_out == NULL)
+		*short_out = nm_strdup(no_output);
+	for (p = *short_out; (p = strchr(p, ';')); p++)
+		*p = ':';
+}
+
+START_TEST(store_check_output_matches_parse_check_output)
+{
+	static const char alphabet[] = "ab |;\n\t";
+	char *exp_short = NULL, *exp_long = NULL, *exp_perf = NULL;
+	char *got_short = NULL, *got_long = NULL, *got_perf = NULL;
+	unsigned int seed = 4711, i, j;
+	char buf[64], copy[64];
+
+	for (i = 0; i < 100000; i++) {
+		size_t len = rand_r(&seed) % (sizeof(buf) - 1);
+		for (j = 0; j < len; j++)
+			buf[j] = alphabet[rand_r(&seed) % (sizeof(alphabet) - 1)];
+		buf[len] = 0;
+		memcpy(copy, buf, len + 1);
+		legacy_store_check_output(copy, "(none)", &exp_short, &exp_long, &exp_perf);
+		store_check_output(buf, "(none)", &got_short, &got_long, &got_perf);
+		ck_assert_msg(!g_strcmp0(exp_short, got_short), "short output of '%s': '%s' != '%s'", buf, exp_short, got_short);
+		ck_assert_msg(!g_strcmp0(exp_long, got_long), "long output of '%s': '%s' != '%s'", buf, exp_long, got_long);
+		ck_assert_msg(!g_strcmp0(exp_perf, got_perf), "perfdata of '%s': '%s' != '%s'", buf, exp_perf, got_perf);
+	}
+	free(exp_short);
+	free(exp_long);
+	free(exp_perf);
+	free(got_short);
+	free(got_long);
+	free(got_perf);
+}
+END_TEST
+
+START_TEST(store_check_output_keeps_unchanged_parts)
+{
+	char *short_out = NULL, *long_out = NULL, *perf = NULL;
+	char *prev_short, *prev_long, *prev_perf;
+
+	ck_assert_int_eq(CHECK_OUTPUT_SHORT | CHECK_OUTPUT_LONG | CHECK_OUTPUT_PERF,
+	                 store_check_output("OK; fine | a=1\nlong\nlines | b=2", "(none)", &short_out, &long_out, &perf));
+	ck_assert_str_eq("OK: fine", short_out);
+	ck_assert_str_eq("long\\nlines ", long_out);
+	ck_assert_str_eq("a=1 b=2", perf);
+	prev_short = short_out;
+	prev_long = long_out;
+	prev_perf = perf;
+
+	/* the same output again doesn't touch anything */
+	ck_assert_int_eq(0, store_check_output("OK; fine | a=1\nlong\nlines | b=2", "(none)", &short_out, &long_out, &perf));
+	ck_assert(short_out == prev_short);
+	ck_assert(long_out == prev_long);
+	ck_assert(perf == prev_perf);
+
+	/* new perfdata only replaces the perfdata */
+	ck_assert_int_eq(CHECK_OUTPUT_PERF, store_check_output("OK; fine | a=2\nlong\nlines | b=2", "(none)", &short_out, &long_out, &perf));
+	ck_assert(short_out == prev_short);
+	ck_assert(long_out == prev_long);
+	ck_assert_str_eq("a=2 b=2", perf);
+
+	ck_assert_int_eq(CHECK_OUTPUT_SHORT | CHECK_OUTPUT_LONG | CHECK_OUTPUT_PERF, store_check_output("", "(none)", &short_out, &long_out, &perf));
+	ck_assert_str_eq("(none)", short_out);
+	ck_assert(NULL == long_out);
+	ck_assert(NULL == perf);
+	ck_assert_int_eq(0, store_check_output(NULL, "(none)", &short_out, &long_out, &perf));
+
+	free(short_out);
+}
+END_TEST
+
+/*
+ * not really a test, but prints how many MB/s of plugin output we
+ * get through, so changes to the parser can be compared
+ */
+START_TEST(parse_output_throughput)
+{
+	struct timeval start, stop;
+	GString *big = g_string_new("DISK OK - free space: / 3326 MB (56%); | /=2643MB;5948;5958;0;5968\n");
+	unsigned int i, iterations = 20000;
+	double elapsed, strtok_elapsed;
+
+	for (i = 0; i < 40; i++)
+		g_string_append_printf(big, "/mnt/volume%u 1234 MB (12%%) free, inode usage fine\n", i);
+	g_string_append(big, "| ");
+	for (i = 0; i < 40; i++)
+		g_string_append_printf(big, "/mnt/volume%u=%uMB;5948;5958;0;5968\n", i, i * 17);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++) {
+		struct check_output co;
+		parse_output(big->str, &co);
+		free_check_output(&co);
+	}
+	gettimeofday(&stop, NULL);
+	elapsed = tv_delta_f(&start, &stop);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++) {
+		struct check_output co;
+		strtok_parse_output(big->str, &co);
+		free_check_output(&co);
+	}
+	gettimeofday(&stop, NULL);
+	strtok_elapsed = tv_delta_f(&start, &stop);
+
+	printf("parse_output: %u x %lu bytes in %.3fs, %.1f MB/s (strtok parser: %.1f MB/s)\n",
+	       iterations, (unsigned long)big->len, elapsed,
+	       elapsed > 0 ? iterations * big->len / elapsed / 1048576 : 0.0,
+	       strtok_elapsed > 0 ? iterations * big->len / strtok_elapsed / 1048576 : 0.0);
+	g_string_free(big, TRUE);
+}
+END_TEST
+
+/*
+ * prints what handling the same result over and over costs, which is
+ * the common case for most checks most of the time
+ */
+START_TEST(store_check_output_throughput)
+{
+	char *buf = "DISK OK - free space: / 3326 MB (56%); | /=2643MB;5948;5958;0;5968\n/ is fine\n/var is fine\n| /var=123MB;5948;5958;0;5968";
+	char *short_out = NULL, *long_out = NULL, *perf = NULL;
+	struct timeval start, stop;
+	unsigned int i, iterations = 200000;
+	double elapsed, legacy_elapsed;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++) {
+		char *copy = nm_strdup(buf);
+		legacy_store_check_output(copy, "(none)", &short_out, &long_out, &perf);
+		free(copy);
+	}
+	gettimeofday(&stop, NULL);
+	legacy_elapsed = tv_delta_f(&start, &stop);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++)
+		store_check_output(buf, "(none)", &short_out, &long_out, &perf);
+	gettimeofday(&stop, NULL);
+	elapsed = tv_delta_f(&start, &stop);
+
+	printf("store_check_output: %u unchanged results in %.3fs, %.0f/s (parse and replace: %.0f/s)\n",
+	       iterations, elapsed,
+	       elapsed > 0 ? iterations / elapsed : 0.0,
+	       legacy_elapsed > 0 ? iterations / legacy_elapsed : 0.0);
+	free(short_out);
+	free(long_out);
+	free(perf);
+}
+END_TEST
+
 Suite *
 checks_suite(void)
 {
 	Suite *s = suite_create("Checks");
 	TCase *tc_output = tcase_create("Output parsing");
+	TCase *tc_throughput = tcase_create("Output parsing throughput");
 	tcase_add_checked_fixture(tc_output, setup, teardown);
 	tcase_add_test(tc_output, one_line_no_perfdata);
 	tcase_add_test(tc_output, one_line_with_perfdata);
@@ -223,7 +501,16 @@ checks_suite(void)
 	tcase_add_test(tc_output, multiple_line_output_newline_escaping);
 	tcase_add_test(tc_output, multiple_line_output_double_newline_escaping);
 	tcase_add_test(tc_output, multiline_unicode);
+	tcase_add_test(tc_output, parse_output_matches_strtok_parser);
+	tcase_add_test(tc_output, scan_check_output_slices);
+	tcase_add_test(tc_output, store_check_output_matches_parse_check_output);
+	tcase_add_test(tc_output, store_check_output_keeps_unchanged_parts);
 	suite_add_tcase(s, tc_output);
+
+	tcase_add_test(tc_throughput, parse_output_throughput);
+	tcase_add_test(tc_throughput, store_check_output_throughput);
+	tcase_set_timeout(tc_throughput, 60);
+	suite_add_tcase(s, tc_throughput);
 	return s;
 }
 
@@ -61,6 +61,7 @@ START_TEST(event_heap_count_ordered)
 		ev->callback = func_a;
 		ev->event_time.tv_sec = i;
 		ev->event_time.tv_nsec = i;
+		ev->priority = 0;
 		ev->user_data = NULL;
 		evheap_add(q, ev);
 
@@ -107,6 +108,7 @@ START_TEST(event_heap_count_random_order)
 		ev->callback = func_a;
 		ev->event_time.tv_sec = rand();
 		ev->event_time.tv_nsec = i;
+		ev->priority = 0;
 		ev->user_data = NULL;
 		evheap_add(q, ev);
 
@@ -166,6 +168,7 @@ START_TEST(event_heap_count_random_removal)
 		ev->callback = func_a;
 		ev->event_time.tv_sec = i;
 		ev->event_time.tv_nsec = i;
+		ev->priority = 0;
 		ev->user_data = NULL;
 		evheap_add(q, ev);
 
@@ -257,6 +260,49 @@ START_TEST(event_polling_scheduling_future)
 }
 END_TEST
 
+/* events due within the same second come out highest priority first */
+START_TEST(event_heap_priority_order)
+{
+	struct timed_event_queue *q;
+	struct timed_event *ev;
+	size_t i;
+	int last_priority = 4;
+
+	q = evheap_create();
+	for (i = 0; i < 100; i++) {
+		ev = nm_calloc(1, sizeof(struct timed_event));
+		ev->callback = func_a;
+		ev->event_time.tv_sec = 10;
+		ev->event_time.tv_nsec = i * 1000;
+		ev->priority = i % 4;
+		evheap_add(q, ev);
+	}
+	/* one second later, even the highest priority has to wait */
+	ev = nm_calloc(1, sizeof(struct timed_event));
+	ev->callback = func_a;
+	ev->event_time.tv_sec = 11;
+	ev->priority = 5;
+	evheap_add(q, ev);
+	verify_queue_heap(q);
+
+	for (i = 0; i < 100; i++) {
+		ev = evheap_head(q);
+		ck_assert_int_eq(10, ev->event_time.tv_sec);
+		ck_assert_int_le(ev->priority, last_priority);
+		last_priority = ev->priority;
+		evheap_remove(q, ev);
+		free(ev);
+	}
+	ev = evheap_head(q);
+	ck_assert_int_eq(11, ev->event_time.tv_sec);
+	evheap_remove(q, ev);
+	free(ev);
+	ck_assert_int_eq(q->count, 0);
+
+	evheap_destroy(q);
+}
+END_TEST
+
 START_TEST(event_timespec_msdiff)
 {
 	int64_t diff_s = 0, expected = 0;
@@ -297,6 +343,7 @@ Suite *event_heap_suite(void)
 	tcase_add_test(tc_event_heap, event_heap_count_ordered);
 	tcase_add_test(tc_event_heap, event_heap_count_random_order);
 	tcase_add_test(tc_event_heap, event_heap_count_random_removal);
+	tcase_add_test(tc_event_heap, event_heap_priority_order);
 	tcase_add_test(tc_event_heap, event_timespec_msdiff);
 	suite_add_tcase(s, tc_event_heap);
 
@@ -83,9 +83,13 @@ void setup_v1(void)
 	int ret = OK;
 	common_setup();
 	init_event_queue();
+	init_objects_host(1);
+	init_objects_service(1);
 	cr = nm_calloc(1, sizeof(*cr));
 	hst = create_host("MyHost");
+	register_host(hst);
 	svc = create_service(hst, "MyService");
+	register_service(svc);
 	svc->plugin_output = nm_strdup("Initial state");
 
 	/* We don't want this to be considered the first check, in order
@@ -130,8 +134,9 @@ void setup_v2(void)
 void teardown_v1(void)
 {
 	common_teardown();
-	destroy_service(svc, FALSE);
-	destroy_host(hst);
+	destroy_objects_service(TRUE);
+	destroy_objects_host();
+	nm_object_arena_release();
 	free_check_result(cr);
 	nm_free(cr);
 	clear_callback_data();
@@ -0,0 +1,188 @@
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "lib/libnaemon.h"
+#include "naemon/globals.h"
+#include "naemon/objects_host.h"
+#include "naemon/nerd.c"
+
+#define NERD_TEST_SOCKET "/tmp/naemon-nerd-test.qh"
+
+static host *hst;
+
+static void pump(void)
+{
+	int i;
+
+	for (i = 0; i < 10; i++)
+		iobroker_poll(nagios_iobs, 10);
+}
+
+static int subscribe_state_changes(const char *resume)
+{
+	int sd;
+
+	sd = nsock_unix(NERD_TEST_SOCKET, NSOCK_TCP | NSOCK_CONNECT);
+	ck_assert_msg(sd > 0, "failed to open client connection");
+	if (resume)
+		nsock_printf_nul(sd, "@nerd subscribe statechanges:%s", resume);
+	else
+		nsock_printf_nul(sd, "@nerd subscribe statechanges");
+	pump();
+	return sd;
+}
+
+static void assert_received(int sd, const char *expected)
+{
+	char buf[4096];
+	int len;
+
+	pump();
+	len = read(sd, buf, sizeof(buf) - 1);
+	ck_assert_msg(len > 0, "failed to read from subscription");
+	buf[len] = 0;
+	ck_assert_str_eq(buf, expected);
+}
+
+static void update_host(int state, const char *output)
+{
+	hst->current_state = state;
+	nm_free(hst->plugin_output);
+	hst->plugin_output = nm_strdup(output);
+	broker_host_status(NEBTYPE_HOSTSTATUS_UPDATE, NEBFLAG_NONE, NEBATTR_NONE, hst);
+}
+
+void setup(void)
+{
+	/* fake daemon mode to reduce noice on the console */
+	daemon_mode = TRUE;
+	event_broker_options = BROKER_EVERYTHING;
+
+	nagios_iobs = iobroker_create();
+	ck_assert(nagios_iobs != NULL);
+	neb_init_callback_list();
+	ck_assert_int_eq(OK, qh_init(NERD_TEST_SOCKET));
+	ck_assert_int_eq(0, nerd_init());
+
+	init_objects_host(1);
+	hst = create_host("host1");
+	ck_assert(hst != NULL);
+	hst->plugin_output = nm_strdup("up");
+	register_host(hst);
+
+	broker_program_state(NEBTYPE_PROCESS_EVENTLOOPSTART, NEBFLAG_NONE, NEBATTR_NONE);
+}
+
+void teardown(void)
+{
+	nerd_deinit();
+	neb_free_callback_list();
+	qh_deinit(NERD_TEST_SOCKET);
+	iobroker_destroy(nagios_iobs, IOBROKER_CLOSE_SOCKETS);
+	nagios_iobs = NULL;
+	destroy_objects_host();
+}
+
+START_TEST(state_changes_stream)
+{
+	char expected[256];
+	int sd;
+
+	sd = subscribe_state_changes(NULL);
+	snprintf(expected, sizeof(expected), "0\tresync\t%llu\n", state_stream_id);
+	assert_received(sd, expected);
+
+	update_host(STATE_DOWN, "down\tand out");
+	snprintf(expected, sizeof(expected), "1\thost\t%u\thost1\tcurrent_state=1\tplugin_output=down\\tand out\n", hst->id);
+	assert_received(sd, expected);
+
+	/* nothing changed, so nothing is sent */
+	update_host(STATE_DOWN, "down\tand out");
+	ck_assert(state_seq == 1);
+	close(sd);
+	pump();
+}
+END_TEST
+
+START_TEST(state_changes_resume)
+{
+	char expected[256], resume[64];
+	int sd;
+
+	update_host(STATE_DOWN, "down");
+	update_host(STATE_UP, "up");
+
+	snprintf(resume, sizeof(resume), "%llu:1", state_stream_id);
+	sd = subscribe_state_changes(resume);
+	snprintf(expected, sizeof(expected), "1\tresume\t%llu\n2\thost\t%u\thost1\tcurrent_state=0\tplugin_output=up\n",
+	         state_stream_id, hst->id);
+	assert_received(sd, expected);
+	close(sd);
+
+	/* a stream id from a previous run can't be resumed */
+	snprintf(resume, sizeof(resume), "%llu:1", state_stream_id - 1);
+	sd = subscribe_state_changes(resume);
+	snprintf(expected, sizeof(expected), "2\tresync\t%llu\n", state_stream_id);
+	assert_received(sd, expected);
+	close(sd);
+
+	/* and neither can a sequence number we haven't handed out */
+	snprintf(resume, sizeof(resume), "%llu:3", state_stream_id);
+	sd = subscribe_state_changes(resume);
+	assert_received(sd, expected);
+	close(sd);
+	pump();
+}
+END_TEST
+
+START_TEST(state_changes_ring_wraps)
+{
+	char expected[256], resume[64];
+	unsigned int i;
+	int sd;
+
+	for (i = 0; i < NERD_STATE_RING_SIZE + 2; i++)
+		update_host(i % 2 ? STATE_UP : STATE_DOWN, "flip");
+	ck_assert(state_seq == NERD_STATE_RING_SIZE + 2);
+
+	/* the first two changes have been overwritten */
+	snprintf(resume, sizeof(resume), "%llu:1", state_stream_id);
+	sd = subscribe_state_changes(resume);
+	snprintf(expected, sizeof(expected), "%llu\tresync\t%llu\n", state_seq, state_stream_id);
+	assert_received(sd, expected);
+	close(sd);
+
+	snprintf(resume, sizeof(resume), "%llu:%llu", state_stream_id, state_seq - 1);
+	sd = subscribe_state_changes(resume);
+	snprintf(expected, sizeof(expected), "%llu\tresume\t%llu\n%llu\thost\t%u\thost1\tcurrent_state=0\n",
+	         state_seq - 1, state_stream_id, state_seq, hst->id);
+	assert_received(sd, expected);
+	close(sd);
+	pump();
+}
+END_TEST
+
+Suite *nerd_suite(void)
+{
+	Suite *s = suite_create("NERD");
+	TCase *tc = tcase_create("State changes");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, state_changes_stream);
+	tcase_add_test(tc, state_changes_resume);
+	tcase_add_test(tc, state_changes_ring_wraps);
+	suite_add_tcase(s, tc);
+	return s;
+}
+
+int main(void)
+{
+	int number_failed = 0;
+	Suite *s = nerd_suite();
+	SRunner *sr = srunner_create(s);
+	srunner_run_all(sr, CK_ENV);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -159,6 +159,95 @@ START_TEST(test_hostgroup_service_host_override)
 }
 END_TEST
 
+/**
+ * Resolution, duplication and inheritance are spread over several threads
+ * once there are enough objects to go around. Make sure templates, host
+ * group members and host-inherited properties still end up on every object.
+ */
+START_TEST(test_parallel_resolve_and_duplicate)
+{
+	int result;
+	int count;
+	int i;
+	host *hst;
+	service *svc;
+
+	config_load_threads = 4;
+
+	object_def_start("command");
+	object_def_var("command_name", "cmd");
+	object_def_var("command_line", "cmd");
+	object_def_end();
+
+	object_def_start("timeperiod");
+	object_def_var("timeperiod_name", "my_tp");
+	object_def_var("alias", "my_tp");
+	object_def_end();
+
+	object_def_start("hostgroup");
+	object_def_var("hostgroup_name", "my_hg");
+	object_def_var("alias", "my_hg_alias");
+	object_def_end();
+
+	object_def_start("host");
+	object_def_var("name", "host_tmpl");
+	object_def_var("max_check_attempts", "3");
+	object_def_var("notification_period", "my_tp");
+	object_def_var("hostgroups", "my_hg");
+	object_def_var("register", "0");
+	object_def_end();
+
+	object_def_start("service");
+	object_def_var("name", "svc_tmpl");
+	object_def_var("max_check_attempts", "9");
+	object_def_var("check_command", "cmd");
+	object_def_var("register", "0");
+	object_def_end();
+
+	object_def_start("service");
+	object_def_var("use", "svc_tmpl");
+	object_def_var("hostgroup_name", "my_hg");
+	object_def_var("service_description", "svc_a");
+	object_def_end();
+
+	object_def_start("service");
+	object_def_var("use", "svc_tmpl");
+	object_def_var("hostgroup_name", "my_hg");
+	object_def_var("service_description", "svc_b");
+	object_def_end();
+
+	for (i = 0; i < 500; i++) {
+		object_def_start("host");
+		object_def_var("use", "host_tmpl");
+		object_def_var("host_name", "my_host_%d", i);
+		object_def_var("address", "127.0.0.1");
+		object_def_end();
+	}
+
+	result = read_all_object_data("(test config filename)");
+	ck_assert_int_eq(result, OK);
+
+	count = 0;
+	for (hst = host_list; hst != NULL; hst = hst->next) {
+		ck_assert_int_eq(hst->max_attempts, 3);
+		ck_assert(hst->hostgroups_ptr != NULL);
+		count++;
+	}
+	ck_assert_int_eq(count, 500);
+
+	count = 0;
+	for (svc = service_list; svc != NULL; svc = svc->next) {
+		ck_assert_int_eq(svc->max_attempts, 9);
+		ck_assert_str_eq(svc->notification_period, "my_tp");
+		count++;
+	}
+	ck_assert_int_eq(count, 2 * 500);
+
+	config_load_threads = 0;
+	unlink(cur_config_file);
+}
+END_TEST
+
 Suite *obj_config_parse_suite(void)
 {
 	Suite *s = suite_create("Object config parse");
@@ -166,6 +255,7 @@ Suite *obj_config_parse_suite(void)
 	tcase_add_checked_fixture(parse, init_configuration, free_configuration);
 
 	tcase_add_test(parse, test_hostgroup_service_host_override);
+	tcase_add_test(parse, test_parallel_resolve_and_duplicate);
 
 	suite_add_tcase(s, parse);
 	return s;
@@ -4,6 +4,7 @@
  */
 #include <check.h>
 #include <stdlib.h>
+#include <string.h>
 #include "naemon/objects.h"
 #include "naemon/objects_host.h"
 #include "naemon/objects_service.h"
@@ -61,6 +62,36 @@ START_TEST(test_lookups)
 }
 END_TEST
 
+START_TEST(test_intern)
+{
+	char *copy = strdup("t-intern");
+	char *a, *b;
+	unsigned int count = nm_intern_count();
+
+	a = nm_intern("t-intern");
+	b = nm_intern(copy);
+	ck_assert_msg(a == b, "equal strings must be interned to the same copy");
+	ck_assert_msg(a != copy, "nm_intern() must not take ownership of its argument");
+	ck_assert_str_eq(a, "t-intern");
+	ck_assert_int_eq(nm_intern_count(), count + 1);
+
+	nm_intern_release(a);
+	ck_assert_int_eq(nm_intern_count(), count + 1);
+	nm_intern_release(b);
+	ck_assert_int_eq(nm_intern_count(), count);
+
+	/* releasing a string that was never interned frees it */
+	a = nm_intern("t-intern");
+	nm_intern_release(copy);
+	ck_assert_int_eq(nm_intern_count(), count + 1);
+	nm_intern_release(a);
+	ck_assert_int_eq(nm_intern_count(), count);
+
+	ck_assert(nm_intern(NULL) == NULL);
+	nm_intern_release(NULL);
+}
+END_TEST
+
 #define TST_SETUP_OBJ(obj) \
 	do { \
 		init_objects_##obj(1); \
@@ -89,6 +120,7 @@ static Suite *objects_suite(void)
 	TCase *tc = tcase_create("Objects");
 	tcase_add_checked_fixture(tc, setup_objects, teardown_objects);
 	tcase_add_test(tc, test_lookups);
+	tcase_add_test(tc, test_intern);
 	suite_add_tcase(s, tc);
 	return s;
 }
@@ -0,0 +1,331 @@
+#include <check.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "lib/libnaemon.h"
+#include "naemon/globals.h"
+#include "naemon/perfdata.c"
+
+#define LINE "[SERVICEPERFDATA]\t1700000000\thost\tservice\t0.010\t0.001\tOK\ttime=0.01s\n"
+
+static int pipefd[2];
+static nm_bufferqueue *bq;
+static struct perfdata_batch batch;
+
+static void setup(void)
+{
+	ck_assert_int_eq(0, pipe(pipefd));
+	fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+	fcntl(pipefd[1], F_SETFL, O_NONBLOCK);
+	bq = nm_bufferqueue_create();
+	memset(&batch, 0, sizeof(batch));
+	perfdata_flush_size = DEFAULT_PERFDATA_FLUSH_SIZE;
+	perfdata_flush_interval = DEFAULT_PERFDATA_FLUSH_INTERVAL;
+	perfdata_max_buffer_size = DEFAULT_PERFDATA_MAX_BUFFER_SIZE;
+}
+
+static void teardown(void)
+{
+	close(pipefd[0]);
+	close(pipefd[1]);
+	nm_bufferqueue_destroy(bq);
+	if (batch.buf)
+		g_string_free(batch.buf, TRUE);
+}
+
+static ssize_t drain(void)
+{
+	char buf[8192];
+	ssize_t ret, total = 0;
+
+	while ((ret = read(pipefd[0], buf, sizeof(buf))) > 0)
+		total += ret;
+	return total;
+}
+
+START_TEST(perfdata_lines_are_batched)
+{
+	int i;
+
+	for (i = 0; i < 100; i++)
+		ck_assert_int_eq(OK, queue_perfdata(bq, &batch, "pipe", LINE, strlen(LINE)));
+
+	/* nothing is written until we flush */
+	ck_assert_int_eq(0, drain());
+	ck_assert_int_eq(100, batch.lines);
+	ck_assert_int_eq(100 * strlen(LINE), batch.buf->len);
+
+	ck_assert_int_eq(0, flush_perfdata(bq, &batch, pipefd[1], "pipe"));
+	ck_assert_int_eq(1, batch.flushes);
+	ck_assert_int_eq(100 * strlen(LINE), batch.bytes_written);
+	ck_assert_int_eq(0, batch.buf->len);
+	ck_assert_int_eq(0, nm_bufferqueue_get_available(bq));
+	ck_assert_int_eq(100 * strlen(LINE), drain());
+
+	/* flushing with nothing to write doesn't count */
+	ck_assert_int_eq(0, flush_perfdata(bq, &batch, pipefd[1], "pipe"));
+	ck_assert_int_eq(1, batch.flushes);
+}
+END_TEST
+
+START_TEST(perfdata_buffer_is_bounded)
+{
+	size_t len = strlen(LINE);
+	unsigned int i, queued = 0;
+
+	perfdata_max_buffer_size = 10 * len;
+
+	/* nobody's listening, so everything stays buffered */
+	for (i = 0; i < 15; i++) {
+		if (queue_perfdata(bq, &batch, "pipe", LINE, len) == OK)
+			queued++;
+		flush_perfdata(bq, &batch, -1, "pipe");
+	}
+	ck_assert_int_eq(10, queued);
+	ck_assert_int_eq(5, batch.dropped_lines);
+	ck_assert_int_eq(5 * len, batch.dropped_bytes);
+	ck_assert_int_eq(TRUE, batch.dropping);
+	ck_assert_int_eq(10 * len, nm_bufferqueue_get_available(bq));
+
+	/* once it's been written, lines are accepted again */
+	ck_assert_int_eq(0, flush_perfdata(bq, &batch, pipefd[1], "pipe"));
+	ck_assert_int_eq(10 * len, drain());
+	ck_assert_int_eq(OK, queue_perfdata(bq, &batch, "pipe", LINE, len));
+	ck_assert_int_eq(FALSE, batch.dropping);
+	ck_assert_int_eq(5, batch.dropped_lines);
+}
+END_TEST
+
+START_TEST(perfdata_stalled_reader_keeps_data)
+{
+	size_t len = strlen(LINE), written;
+	unsigned int i;
+
+	perfdata_max_buffer_size = 0;
+
+	/* fill the pipe and then some */
+	for (i = 0; i < 4096; i++)
+		queue_perfdata(bq, &batch, "pipe", LINE, len);
+	ck_assert_int_eq(0, flush_perfdata(bq, &batch, pipefd[1], "pipe"));
+	ck_assert_msg(nm_bufferqueue_get_available(bq) > 0, "expected a partial write to a full pipe");
+	ck_assert_int_eq(0, batch.failed_flushes);
+
+	written = drain();
+	while (nm_bufferqueue_get_available(bq) > 0) {
+		ck_assert_int_eq(0, flush_perfdata(bq, &batch, pipefd[1], "pipe"));
+		written += drain();
+	}
+	ck_assert_int_eq(4096 * len, written);
+	ck_assert_int_eq(4096 * len, batch.bytes_written);
+}
+END_TEST
+
+START_TEST(perfdata_parse_full_items)
+{
+	struct perfdata pd;
+
+	ck_assert_int_eq(3, perfdata_parse("time=0.012s;1;2;0;10 'used space'=42.5%;@80:90;~:95 load1=0.5", &pd));
+	ck_assert_int_eq(0, pd.malformed);
+
+	ck_assert_str_eq("time", pd.values[0].label);
+	ck_assert(pd.values[0].value == 0.012);
+	ck_assert_str_eq("s", pd.values[0].uom);
+	ck_assert_int_eq(PERFDATA_HAS_WARN | PERFDATA_HAS_CRIT | PERFDATA_HAS_MIN | PERFDATA_HAS_MAX, pd.values[0].flags);
+	ck_assert(pd.values[0].warn.start == 0 && pd.values[0].warn.end == 1);
+	ck_assert(pd.values[0].crit.start == 0 && pd.values[0].crit.end == 2);
+	ck_assert(pd.values[0].min == 0 && pd.values[0].max == 10);
+
+	ck_assert_str_eq("used space", pd.values[1].label);
+	ck_assert(pd.values[1].value == 42.5);
+	ck_assert_str_eq("%", pd.values[1].uom);
+	ck_assert_int_eq(PERFDATA_HAS_WARN | PERFDATA_HAS_CRIT, pd.values[1].flags);
+	ck_assert_int_eq(TRUE, pd.values[1].warn.inside);
+	ck_assert(pd.values[1].warn.start == 80 && pd.values[1].warn.end == 90);
+	ck_assert(isinf(pd.values[1].crit.start) && pd.values[1].crit.start < 0);
+	ck_assert(pd.values[1].crit.end == 95);
+
+	ck_assert_str_eq("load1", pd.values[2].label);
+	ck_assert_str_eq("", pd.values[2].uom);
+	ck_assert_int_eq(0, pd.values[2].flags);
+	perfdata_free(&pd);
+}
+END_TEST
+
+START_TEST(perfdata_parse_odd_but_valid)
+{
+	struct perfdata pd;
+
+	ck_assert_int_eq(5, perfdata_parse("  'it''s'=1,5B;10:;;;  \t x=U;1;2 y=-1e3 z=5c;oops;;abc;7\n 'C:\\ used'=3", &pd));
+	ck_assert_int_eq(0, pd.malformed);
+	ck_assert_str_eq("it's", pd.values[0].label);
+	ck_assert(pd.values[0].value == 1.5);
+	ck_assert_str_eq("B", pd.values[0].uom);
+	ck_assert_int_eq(PERFDATA_HAS_WARN, pd.values[0].flags);
+	ck_assert(pd.values[0].warn.start == 10 && isinf(pd.values[0].warn.end));
+	ck_assert(isnan(pd.values[1].value));
+	ck_assert(pd.values[2].value == -1000);
+	/* broken thresholds and limits are dropped, the value is kept */
+	ck_assert(pd.values[3].value == 5);
+	ck_assert_int_eq(PERFDATA_HAS_MAX, pd.values[3].flags);
+	ck_assert(pd.values[3].max == 7);
+	ck_assert_str_eq("C:\\ used", pd.values[4].label);
+	perfdata_free(&pd);
+}
+END_TEST
+
+START_TEST(perfdata_parse_malformed)
+{
+	struct perfdata pd;
+	static const char *broken[] = {
+		"", " ", "=", "=1", "foo", "foo=", "foo=bar", "foo=1.2.3", "foo=0x10",
+		"foo=inf", "foo=nan", "foo=1e999", "'foo=1", "'foo'", "''=1",
+		"foo=1s2", "foo=-", "foo=.", "foo=U1", NULL,
+	};
+	int i;
+
+	for (i = 0; broken[i]; i++) {
+		ck_assert_msg(perfdata_parse(broken[i], &pd) == 0, "'%s' should not parse", broken[i]);
+		perfdata_free(&pd);
+	}
+
+	/* the good ones survive their neighbours */
+	ck_assert_int_eq(2, perfdata_parse("a=1 b=x c=2 'd=3", &pd));
+	ck_assert_int_eq(2, pd.malformed);
+	ck_assert_str_eq("a", pd.values[0].label);
+	ck_assert_str_eq("c", pd.values[1].label);
+	perfdata_free(&pd);
+
+	ck_assert_int_eq(0, perfdata_parse(NULL, &pd));
+	perfdata_free(&pd);
+}
+END_TEST
+
+/*
+ * throw random garbage and mangled versions of valid perfdata at
+ * the parser. Whatever comes out has to be consistent.
+ */
+START_TEST(perfdata_parse_fuzz)
+{
+	static const char alphabet[] = "abcXYZ%'=;:@~U.,-+0123456789eE \t\n\\";
+	static const char *seeds[] = {
+		"time=0.012s;1;2;0;10 'used space'=42.5%;@80:90;~:95 load1=0.5",
+		"'it''s'=1,5B;10:;;; x=U;1;2 y=-1e3",
+		"rta=0.045ms;200.000;500.000;0; pl=0%;40;80;; rtmax=0.045ms;;;; rtmin=0.045ms;;;;",
+	};
+	unsigned int seed = 0x5eed, round, i, j;
+	char buf[256];
+	GString *out = g_string_new(NULL);
+	struct timeval when = { 1700000000, 0 };
+
+	for (round = 0; round < 20000; round++) {
+		struct perfdata pd;
+		size_t len;
+
+		if (round & 1) {
+			len = rand_r(&seed) % (sizeof(buf) - 1);
+			for (i = 0; i < len; i++)
+				buf[i] = alphabet[rand_r(&seed) % (sizeof(alphabet) - 1)];
+			buf[len] = 0;
+		} else {
+			const char *s = seeds[rand_r(&seed) % (sizeof(seeds) / sizeof(seeds[0]))];
+			len = strlen(s);
+			memcpy(buf, s, len + 1);
+			for (j = rand_r(&seed) % 8; j > 0; j--) {
+				i = rand_r(&seed) % len;
+				switch (rand_r(&seed) % 3) {
+				case 0: /* replace */
+					buf[i] = alphabet[rand_r(&seed) % (sizeof(alphabet) - 1)];
+					break;
+				case 1: /* truncate */
+					buf[i] = 0;
+					len = i ? i : 1;
+					break;
+				case 2: /* random byte */
+					buf[i] = (char)(rand_r(&seed) % 255 + 1);
+					break;
+				}
+			}
+		}
+
+		perfdata_parse(buf, &pd);
+		for (i = 0; i < pd.count; i++) {
+			struct perfdata_value *pv = &pd.values[i];
+			ck_assert_msg(*pv->label, "empty label from '%s'", buf);
+			ck_assert_msg(isnan(pv->value) || isfinite(pv->value), "bad value from '%s'", buf);
+			ck_assert_msg(strspn(pv->uom, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ%") == strlen(pv->uom), "bad unit from '%s'", buf);
+			if (pv->flags & PERFDATA_HAS_WARN)
+				ck_assert_msg(pv->warn.start <= pv->warn.end, "bad warning range from '%s'", buf);
+			if (pv->flags & PERFDATA_HAS_CRIT)
+				ck_assert_msg(pv->crit.start <= pv->crit.end, "bad critical range from '%s'", buf);
+		}
+
+		/* every line we emit has a measurement, tags, fields and a timestamp */
+		g_string_truncate(out, 0);
+		perfdata_line_protocol(out, "host", "svc", &pd, &when);
+		for (i = 0, j = 0; i < out->len; i++) {
+			if (out->str[i] == '\n') {
+				ck_assert_msg(!strncmp(out->str + j, "perfdata,host=host,service=svc,label=", 37), "bad line from '%s': %s", buf, out->str);
+				ck_assert_msg(!strncmp(out->str + i - 20, " 1700000000000000000", 20), "bad timestamp from '%s': %s", buf, out->str);
+				j = i + 1;
+			}
+		}
+		ck_assert_int_eq(j, out->len);
+		perfdata_free(&pd);
+	}
+	g_string_free(out, TRUE);
+}
+END_TEST
+
+START_TEST(perfdata_line_protocol_format)
+{
+	struct perfdata pd;
+	struct timeval when = { 1700000000, 250000 };
+	GString *out = g_string_new(NULL);
+
+	perfdata_parse("'used space'=42.5%;@80:90;95;0;100 x=U time=1s", &pd);
+	perfdata_line_protocol(out, "web 1", "disk,c", &pd, &when);
+	ck_assert_str_eq("perfdata,host=web\\ 1,service=disk\\,c,label=used\\ space,unit=% value=42.5,warn_lo=80,warn_hi=90,warn_inside=t,crit_lo=0,crit_hi=95,min=0,max=100 1700000000250000000\n"
+	                 "perfdata,host=web\\ 1,service=disk\\,c,label=time,unit=s value=1 1700000000250000000\n", out->str);
+
+	g_string_truncate(out, 0);
+	perfdata_line_protocol(out, "web1", NULL, &pd, &when);
+	ck_assert_str_eq("perfdata,host=web1,label=used\\ space,unit=% value=42.5,warn_lo=80,warn_hi=90,warn_inside=t,crit_lo=0,crit_hi=95,min=0,max=100 1700000000250000000\n"
+	                 "perfdata,host=web1,label=time,unit=s value=1 1700000000250000000\n", out->str);
+	perfdata_free(&pd);
+	g_string_free(out, TRUE);
+}
+END_TEST
+
+Suite *perfdata_suite(void)
+{
+	Suite *s = suite_create("Performance data");
+	TCase *tc_batch = tcase_create("Batched file writes");
+	TCase *tc_parse = tcase_create("Parsing");
+	tcase_add_checked_fixture(tc_batch, setup, teardown);
+	tcase_add_test(tc_batch, perfdata_lines_are_batched);
+	tcase_add_test(tc_batch, perfdata_buffer_is_bounded);
+	tcase_add_test(tc_batch, perfdata_stalled_reader_keeps_data);
+	suite_add_tcase(s, tc_batch);
+
+	tcase_add_test(tc_parse, perfdata_parse_full_items);
+	tcase_add_test(tc_parse, perfdata_parse_odd_but_valid);
+	tcase_add_test(tc_parse, perfdata_parse_malformed);
+	tcase_add_test(tc_parse, perfdata_parse_fuzz);
+	tcase_add_test(tc_parse, perfdata_line_protocol_format);
+	suite_add_tcase(s, tc_parse);
+
+	return s;
+}
+
+int main(void)
+{
+	int number_failed = 0;
+	Suite *s = perfdata_suite();
+	SRunner *sr = srunner_create(s);
+	srunner_run_all(sr, CK_ENV);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -20,7 +20,7 @@ static void run_main_loop(time_t runtime)
 
 START_TEST(common_case)
 {
-	int ret, sd;
+	int ret, sd, len;
 	char buf[256 * 1024];
 
 	/* fake daemon mode to reduce noice on the console */
@@ -28,6 +28,7 @@ START_TEST(common_case)
 	qh_socket_path = "/tmp/naemon.qh";
 
 	ck_assert_msg(NULL != (nagios_iobs = iobroker_create()), "failed to initialize iobroker");
+	init_event_queue();
 	ret = qh_init(qh_socket_path);
 	ck_assert_int_eq(OK, ret);
 	registered_commands_init(200);
@@ -64,8 +65,201 @@ START_TEST(common_case)
 	ck_assert_msg(strstr(buf, "Failed validation of service") != NULL, "incorrect response");
 	close(sd);
 
+	/* pipelined requests are all answered, in order, until a oneshot one closes the connection */
+	sd = nsock_unix(qh_socket_path, NSOCK_TCP | NSOCK_CONNECT);
+	ck_assert_msg(sd > 0, "failed to open client connection");
+	ret = nsock_write_all(sd, "@echo one\0@echo two\0#echo three\0@echo four", 42);
+	ck_assert_msg(ret == 0, "failed to send queries");
+	run_main_loop(1);
+	len = 0;
+	while ((ret = read(sd, buf + len, sizeof(buf) - len - 1)) > 0)
+		len += ret;
+	buf[len] = 0;
+	ck_assert_str_eq(buf, "onetwothree");
+	close(sd);
+
+	sd = nsock_unix(qh_socket_path, NSOCK_TCP | NSOCK_CONNECT);
+	ck_assert_msg(sd > 0, "failed to open client connection");
+	ret = nsock_printf_nul(sd, "help stats");
+	ck_assert_msg(ret > 0, "failed to send query");
+	run_main_loop(1);
+	len = read(sd, buf, sizeof(buf) - 1);
+	ck_assert_msg(len > 0, "failed to read response");
+	buf[len] = 0;
+	ck_assert_msg(strstr(buf, "handler=echo;requests=3;errors=0;") != NULL, "incorrect response: %s", buf);
+	close(sd);
+
 	registered_commands_deinit();
 	qh_deinit(qh_socket_path);
+	destroy_event_queue();
+	iobroker_destroy(nagios_iobs, IOBROKER_CLOSE_SOCKETS);
+	nagios_iobs = NULL;
+}
+END_TEST
+
+START_TEST(thread_pool)
+{
+	int ret, sd, len;
+	char buf[4096];
+
+	daemon_mode = TRUE;
+	qh_socket_path = "/tmp/naemon-pool.qh";
+	query_handler_threads = 2;
+
+	ck_assert_msg(NULL != (nagios_iobs = iobroker_create()), "failed to initialize iobroker");
+	init_event_queue();
+	ck_assert_int_eq(OK, qh_init(qh_socket_path));
+	ck_assert_msg(qh_pool != NULL, "thread pool wasn't started");
+
+	/* answered on the pool, but still in order */
+	sd = nsock_unix(qh_socket_path, NSOCK_TCP | NSOCK_CONNECT);
+	ck_assert_msg(sd > 0, "failed to open client connection");
+	ret = nsock_write_all(sd, "@echo one\0@echo two\0#echo three", 32);
+	ck_assert_msg(ret == 0, "failed to send queries");
+	run_main_loop(1);
+	len = 0;
+	while ((ret = read(sd, buf + len, sizeof(buf) - len - 1)) > 0)
+		len += ret;
+	buf[len] = 0;
+	ck_assert_str_eq(buf, "onetwothree");
+	close(sd);
+
+	/* the command handler isn't thread-safe, so its help is fetched from the main thread */
+	sd = nsock_unix(qh_socket_path, NSOCK_TCP | NSOCK_CONNECT);
+	ck_assert_msg(sd > 0, "failed to open client connection");
+	ret = nsock_printf_nul(sd, "help command");
+	ck_assert_msg(ret > 0, "failed to send query");
+	run_main_loop(1);
+	len = read(sd, buf, sizeof(buf) - 1);
+	ck_assert_msg(len > 0, "failed to read response");
+	buf[len] = 0;
+	ck_assert_msg(strstr(buf, "Query handler for naemon commands.") != NULL, "incorrect response: %s", buf);
+	close(sd);
+
+	/* a client hanging up before its job is done */
+	sd = nsock_unix(qh_socket_path, NSOCK_TCP | NSOCK_CONNECT);
+	ck_assert_msg(sd > 0, "failed to open client connection");
+	nsock_printf_nul(sd, "@echo gone");
+	close(sd);
+	run_main_loop(1);
+
+	qh_deinit(qh_socket_path);
+	ck_assert_msg(qh_pool == NULL, "thread pool wasn't stopped");
+	query_handler_threads = 0;
+	destroy_event_queue();
+	iobroker_destroy(nagios_iobs, IOBROKER_CLOSE_SOCKETS);
+	nagios_iobs = NULL;
+}
+END_TEST
+
+#define POOL_HOSTS 50
+#define POOL_CLIENTS 8
+
+static unsigned int updates, unlocked_updates;
+
+/* stands in for check results coming in from a worker */
+static int fake_check_results(int fd, int events, void *arg)
+{
+	char buf[64];
+	unsigned int i;
+
+	if (read(fd, buf, sizeof(buf)) <= 0)
+		return 0;
+
+	/* pool threads must not be able to read while we're at it */
+	if (g_rw_lock_reader_trylock(&qh_object_lock)) {
+		g_rw_lock_reader_unlock(&qh_object_lock);
+		unlocked_updates++;
+	}
+
+	for (i = 0; i < POOL_HOSTS; i++) {
+		host *hst = host_ary[i];
+		nm_free(hst->plugin_output);
+		hst->plugin_output = g_strdup_printf("update %u", updates);
+		hst->current_state = updates % 2;
+	}
+	updates++;
+	return 0;
+}
+
+/* reads a reply until the core hangs up, running the main loop while waiting */
+static int read_reply(int sd, char *buf, size_t size)
+{
+	int ret, len = 0, tries;
+
+	fcntl(sd, F_SETFL, O_NONBLOCK);
+	for (tries = 0; tries < 500; tries++) {
+		ret = read(sd, buf + len, size - len - 1);
+		if (ret > 0) {
+			len += ret;
+			continue;
+		}
+		if (ret == 0 || errno != EAGAIN)
+			break;
+		iobroker_poll(nagios_iobs, 10);
+	}
+	buf[len] = 0;
+	return len;
+}
+
+START_TEST(thread_pool_with_updates)
+{
+	int sds[POOL_CLIENTS], pfd[2], len, rounds, i, lines;
+	char buf[16384], *p;
+
+	daemon_mode = TRUE;
+	qh_socket_path = "/tmp/naemon-pool-updates.qh";
+	query_handler_threads = 4;
+
+	ck_assert_msg(NULL != (nagios_iobs = iobroker_create()), "failed to initialize iobroker");
+	init_event_queue();
+	init_objects_host(POOL_HOSTS);
+	for (i = 0; i < POOL_HOSTS; i++) {
+		host *hst;
+		snprintf(buf, sizeof(buf), "host%d", i);
+		hst = create_host(buf);
+		ck_assert(hst != NULL);
+		hst->plugin_output = nm_strdup("initial");
+		register_host(hst);
+	}
+	ck_assert_int_eq(OK, qh_init(qh_socket_path));
+	ck_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, pfd) == 0);
+	ck_assert(iobroker_register(nagios_iobs, pfd[0], NULL, fake_check_results) == 0);
+
+	for (rounds = 0; rounds < 10; rounds++) {
+		for (i = 0; i < POOL_CLIENTS; i++) {
+			sds[i] = nsock_unix(qh_socket_path, NSOCK_TCP | NSOCK_CONNECT);
+			ck_assert_msg(sds[i] > 0, "failed to open client connection");
+			nsock_printf_nul(sds[i], "#state hosts;columns=host_name,plugin_output");
+			/* the listen backlog is short, so accept as we go */
+			iobroker_poll(nagios_iobs, 1);
+		}
+
+		/* keep the objects changing while the queries are answered */
+		for (i = 0; i < 20; i++) {
+			ck_assert(write(pfd[1], "x", 1) == 1);
+			iobroker_poll(nagios_iobs, 1);
+		}
+
+		for (i = 0; i < POOL_CLIENTS; i++) {
+			len = read_reply(sds[i], buf, sizeof(buf));
+			close(sds[i]);
+			ck_assert_msg(len > 0 && buf[len - 1] == 0, "incomplete reply: %s", buf);
+			for (lines = 0, p = buf; *p; p++)
+				lines += *p == '\n';
+			ck_assert_int_eq(POOL_HOSTS + 1, lines);
+		}
+	}
+
+	ck_assert(updates > 0);
+	ck_assert_int_eq(0, unlocked_updates);
+
+	iobroker_close(nagios_iobs, pfd[0]);
+	close(pfd[1]);
+	qh_deinit(qh_socket_path);
+	query_handler_threads = 0;
+	destroy_objects_host();
+	destroy_event_queue();
 	iobroker_destroy(nagios_iobs, IOBROKER_CLOSE_SOCKETS);
 	nagios_iobs = NULL;
 }
@@ -76,7 +270,11 @@ checks_suite(void)
 {
 	Suite *s = suite_create("QueryHandler");
 	TCase *rot = tcase_create("Test Queries");
+	/* each query gets a second of main loop to be answered in */
+	tcase_set_timeout(rot, 15);
 	tcase_add_test(rot, common_case);
+	tcase_add_test(rot, thread_pool);
+	tcase_add_test(rot, thread_pool_with_updates);
 	suite_add_tcase(s, rot);
 	return s;
 }
@@ -0,0 +1,205 @@
+#include <check.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include "naemon/objects_host.h"
+#include "naemon/objects_service.h"
+#include "naemon/comments.h"
+#include "naemon/downtime.h"
+#include "naemon/events.h"
+#include "naemon/globals.h"
+#include "naemon/query-state.c"
+
+static host *hst1, *hst2;
+static service *svc1, *svc2;
+
+void setup(void)
+{
+	init_event_queue();
+	init_objects_host(2);
+	init_objects_service(2);
+	initialize_downtime_data();
+	initialize_comment_data();
+
+	hst1 = create_host("host1");
+	ck_assert(hst1 != NULL);
+	hst1->plugin_output = nm_strdup("tab\there, newline\nthere and a \\backslash");
+	hst1->current_state = STATE_UP;
+	register_host(hst1);
+
+	hst2 = create_host("host2");
+	ck_assert(hst2 != NULL);
+	hst2->plugin_output = nm_strdup("down");
+	hst2->current_state = STATE_DOWN;
+	hst2->execution_time = 1.5;
+	register_host(hst2);
+
+	svc1 = create_service(hst1, "svc1");
+	ck_assert(svc1 != NULL);
+	svc1->current_state = STATE_OK;
+	register_service(svc1);
+
+	svc2 = create_service(hst2, "svc2");
+	ck_assert(svc2 != NULL);
+	svc2->current_state = STATE_CRITICAL;
+	register_service(svc2);
+}
+
+void teardown(void)
+{
+	free_comment_data();
+	free_downtime_data();
+	destroy_objects_service(TRUE);
+	destroy_objects_host();
+	destroy_event_queue();
+}
+
+/* renders one object at a time, so the slicing is exercised as well */
+static char *run_query(const char *query)
+{
+	struct state_stream *stream;
+	GString *out = g_string_new(NULL);
+	char *error = NULL;
+
+	stream = state_stream_create(query, &error);
+	ck_assert_msg(stream != NULL, "Query '%s' failed: %s", query, error);
+	while (!state_stream_render(stream, out, 1))
+		;
+	state_stream_destroy(stream);
+	return g_string_free(out, FALSE);
+}
+
+static void assert_query(const char *query, const char *expected)
+{
+	char *result = run_query(query);
+
+	ck_assert_msg(!strcmp(result, expected), "Query '%s' returned\n%s\nexpected\n%s", query, result, expected);
+	g_free(result);
+}
+
+START_TEST(state_columns_and_escaping)
+{
+	char *result, *p;
+	int lines = 0;
+
+	assert_query("hosts;columns=host_name,current_state,plugin_output",
+	             "host_name\tcurrent_state\tplugin_output\n"
+	             "host1\t0\ttab\\there, newline\\nthere and a \\\\backslash\n"
+	             "host2\t1\tdown\n");
+	assert_query("services;columns=host_name,service_description,plugin_output",
+	             "host_name\tservice_description\tplugin_output\n"
+	             "host1\tsvc1\t\n"
+	             "host2\tsvc2\t\n");
+	assert_query("hosts;columns=check_execution_time;limit=1;filter=host_name=host2",
+	             "check_execution_time\n"
+	             "1.500\n");
+
+	/* all columns by default, in table order */
+	result = run_query("hosts");
+	ck_assert(!strncmp(result, "host_name\tdisplay_name\talias\t", 29));
+	for (p = result; *p; p++)
+		lines += *p == '\n';
+	ck_assert_int_eq(3, lines);
+	g_free(result);
+
+	result = run_query("program;columns=nagios_pid,external_command_stats");
+	ck_assert(!strcmp(result, "nagios_pid\texternal_command_stats\n0\t0,0,0\n"));
+	g_free(result);
+}
+END_TEST
+
+START_TEST(state_filters)
+{
+	assert_query("services;columns=service_description;filter=current_state!=0",
+	             "service_description\nsvc2\n");
+	assert_query("services;columns=service_description;filter=current_state>=0;filter=host_name=host1",
+	             "service_description\nsvc1\n");
+	assert_query("hosts;columns=host_name;filter=plugin_output~newline",
+	             "host_name\nhost1\n");
+	assert_query("hosts;columns=host_name;filter=plugin_output!~newline",
+	             "host_name\nhost2\n");
+	assert_query("hosts;columns=host_name;filter=host_name<host2",
+	             "host_name\nhost1\n");
+	assert_query("hosts;columns=host_name;filter=check_execution_time>1",
+	             "host_name\nhost2\n");
+	assert_query("hosts;columns=host_name;filter=long_plugin_output=",
+	             "host_name\nhost1\nhost2\n");
+	assert_query("hosts;columns=host_name;limit=1",
+	             "host_name\nhost1\n");
+	assert_query("services;columns=host_name;filter=current_state>3",
+	             "host_name\n");
+}
+END_TEST
+
+START_TEST(state_bad_queries)
+{
+	const char *bad[] = {
+		"",
+		"nosuchtable",
+		"hosts;columns=nosuchcolumn",
+		"hosts;columns=host_name,",
+		"hosts;filter=host_name",
+		"hosts;filter=nosuchcolumn=1",
+		"hosts;filter=current_state=up",
+		"hosts;filter=current_state~1",
+		"program;filter=external_command_stats=1",
+		"hosts;limit=ten",
+		"hosts;frobnicate=1",
+	};
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(bad); i++) {
+		char *error = NULL;
+
+		ck_assert_msg(state_stream_create(bad[i], &error) == NULL, "Query '%s' should fail", bad[i]);
+		ck_assert(error != NULL);
+		g_free(error);
+	}
+}
+END_TEST
+
+START_TEST(state_comments_deleted_while_streaming)
+{
+	struct state_stream *stream;
+	unsigned long first, second;
+	GString *out = g_string_new(NULL);
+	char *error = NULL;
+
+	ck_assert_int_eq(OK, add_new_host_comment(USER_COMMENT, "host1", 0, "me", "first", FALSE, COMMENTSOURCE_INTERNAL, FALSE, 0, &first));
+	ck_assert_int_eq(OK, add_new_host_comment(USER_COMMENT, "host2", 0, "me", "second", FALSE, COMMENTSOURCE_INTERNAL, FALSE, 0, &second));
+
+	stream = state_stream_create("comments;columns=host_name,comment_data", &error);
+	ck_assert(stream != NULL);
+	delete_comment(HOST_COMMENT, first);
+	while (!state_stream_render(stream, out, 1))
+		;
+	ck_assert_str_eq(out->str, "host_name\tcomment_data\nhost2\tsecond\n");
+
+	state_stream_destroy(stream);
+	g_string_free(out, TRUE);
+}
+END_TEST
+
+Suite *query_state_suite(void)
+{
+	Suite *s = suite_create("State query handler");
+	TCase *tc = tcase_create("Queries");
+	tcase_add_checked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, state_columns_and_escaping);
+	tcase_add_test(tc, state_filters);
+	tcase_add_test(tc, state_bad_queries);
+	tcase_add_test(tc, state_comments_deleted_while_streaming);
+	suite_add_tcase(s, tc);
+	return s;
+}
+
+int main(void)
+{
+	int number_failed = 0;
+	Suite *s = query_state_suite();
+	SRunner *sr = srunner_create(s);
+	srunner_run_all(sr, CK_ENV);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,5 +1,8 @@
 #include <check.h>
+#include <stdint.h>
+#include <string.h>
 #include "naemon/utils.h"
+#include "naemon/nm_alloc.h"
 
 
 START_TEST(my_strtok_null_buffer)
@@ -10,13 +13,47 @@ START_TEST(my_strtok_null_buffer)
 }
 END_TEST
 
+START_TEST(arena_alloc)
+{
+	nm_arena *arena = nm_arena_create(128);
+	char *small[32], *big;
+	int i, j;
+
+	for (i = 0; i < 32; i++) {
+		small[i] = nm_arena_alloc(arena, 7 + i);
+		ck_assert((uintptr_t)small[i] % 16 == 0);
+		for (j = 0; j < 7 + i; j++)
+			ck_assert(small[i][j] == 0);
+		memset(small[i], i, 7 + i);
+	}
+
+	/* larger than a block, so it must get one of its own */
+	big = nm_arena_alloc(arena, 1000);
+	memset(big, 0xff, 1000);
+	small[0] = nm_arena_alloc(arena, 8);
+	ck_assert(small[0][0] == 0);
+
+	for (i = 1; i < 32; i++)
+		for (j = 0; j < 7 + i; j++)
+			ck_assert(small[i][j] == i);
+
+	ck_assert(nm_arena_size(arena) >= 1000 + 32 * 16);
+	nm_arena_destroy(arena);
+	nm_arena_destroy(NULL);
+}
+END_TEST
+
 Suite *
 utils_suite(void)
 {
 	Suite *s = suite_create("Utilities");
 	TCase *tc_my_strtok = tcase_create("my_strtok");
+	TCase *tc_arena;
 	tcase_add_test(tc_my_strtok, my_strtok_null_buffer);
 	suite_add_tcase(s, tc_my_strtok);
+	tc_arena = tcase_create("nm_arena");
+	tcase_add_test(tc_arena, arena_alloc);
+	suite_add_tcase(s, tc_arena);
 	return s;
 }
 
@@ -1,13 +1,19 @@
 #include "naemon/events.h"
 #include "naemon/query-handler.h"
 #include "naemon/globals.h"
-#include "naemon/workers.h"
+#include "naemon/workers.c"
+#include "naemon/checks.h"
+#include "naemon/checks_service.h"
 #include "naemon/commands.h"
 #include "naemon/logging.h"
 #include "worker/worker.h"
 #include "lib/libnaemon.h"
 #include <check.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
 
 /*
  * A note about worker tests:
@@ -40,6 +46,7 @@ struct wrk_test {
 	int expected_wait_status;
 	int expected_error_code;
 	int timeout;
+	int expected_truncated;
 };
 
 static unsigned int completed_jobs;
@@ -57,6 +64,7 @@ void wrk_test_cb(struct wproc_result *wpres, void *data, int flags)
 	              wpres->outstd, t->expected_stdout, t->command);
 
 	ck_assert_int_eq(t->expected_error_code, wpres->error_code);
+	ck_assert_int_eq(t->expected_truncated, wpres->truncated);
 	ck_assert_msg(0 == strcmp(wpres->outerr, t->expected_stderr),
 	              "STDERR:\n###GOT\n%s###EXPECTED\n%s###STDERR_END\ncommand: '%s'",
 	              wpres->outerr, t->expected_stderr, t->command);
@@ -111,7 +119,7 @@ START_TEST(worker_test_output_stdout)
 		"stdbuf -oL echo 'hello world'",
 		"hello world\n",
 		"",
-		0, 0, 3
+		0, 0, 3, FALSE
 	};
 	run_worker_test(&j);
 }
@@ -123,7 +131,7 @@ START_TEST(worker_test_output_stderr)
 		"stdbuf -e0 /bin/sh -c 'echo \"this goes to stderr\" >&2'",
 		"",
 		"this goes to stderr\n",
-		0, 0, 3
+		0, 0, 3, FALSE
 	};
 	run_worker_test(&j);
 }
@@ -135,7 +143,7 @@ START_TEST(worker_test_output_staggered_output_and_exitcode_2)
 		"/bin/sh -c 'echo -n natt; sleep 3; echo -n hatt; sleep 3; echo -n kattegatt; exit 2'",
 		"natthattkattegatt",
 		"",
-		EXITCODE(2), 0, 7
+		EXITCODE(2), 0, 7, FALSE
 	};
 	run_worker_test(&j);
 }
@@ -147,7 +155,7 @@ START_TEST(worker_test_output_mixed_stdout_and_stderr)
 		"stdbuf -o0 -e0 /bin/sh -c 'echo -n nocrlf && echo -n lalala >&2'",
 		"nocrlf",
 		"lalala",
-		0, 0, 3
+		0, 0, 3, FALSE
 	};
 	run_worker_test(&j);
 }
@@ -159,7 +167,7 @@ START_TEST(worker_test_timeout)
 		"/bin/sh -c 'sleep 5'",
 		"",
 		"",
-		0, ETIME, 3,
+		0, ETIME, 3, FALSE,
 	};
 	run_worker_test(&j);
 
@@ -181,7 +189,7 @@ START_TEST(worker_test_no_timeout_log)
 		"stdbuf -oL echo 'hello world'",
 		"hello world\n",
 		"",
-		0, 0, 3
+		0, 0, 3, FALSE
 	};
 	run_worker_test(&j);
 
@@ -199,12 +207,26 @@ START_TEST(worker_test_output_stdout_and_timeout)
 		"stdbuf -o0 /bin/sh -c 'echo -n lalala && sleep 5'",
 		"lalala",
 		"",
-		0, ETIME, 3,
+		0, ETIME, 3, FALSE,
 	};
 	run_worker_test(&j);
 }
 END_TEST
 
+START_TEST(worker_test_output_truncated)
+{
+	struct wrk_test j = {
+		"/bin/sh -c 'echo hello world; yes | head -c 1000000; echo done >&2'",
+		"hello",
+		"done\n",
+		0, 0, 5, TRUE,
+	};
+	max_job_output_size = 5;
+	run_worker_test(&j);
+	max_job_output_size = DEFAULT_MAX_JOB_OUTPUT_SIZE;
+}
+END_TEST
+
 START_TEST(worker_test_child_remains_to_cause_sideeffects)
 {
 	char filepath[] = "/tmp/XXXXX-naemon-worker-test";
@@ -214,7 +236,7 @@ START_TEST(worker_test_child_remains_to_cause_sideeffects)
 		NULL,
 		"one\n",
 		"",
-		0, 0, 5,
+		0, 0, 5, FALSE,
 	};
 	close(fd);
 	nm_asprintf(&j.command, "stdbuf -o0 /bin/sh -c '(echo one && (sleep 1 && echo two > %s&))'", filepath);
@@ -314,11 +336,720 @@ void worker_test_teardown(void)
 	wproc_num_workers_desired = 0;
 }
 
+/*
+ * Remote workers are the test binary itself, run with --worker and
+ * connecting back to us over TCP on 127.0.0.1, next to a local one.
+ */
+#define NUM_REMOTE_WORKERS 3
+static pid_t remote_pids[NUM_REMOTE_WORKERS];
+static char remote_address[64];
+static char secret_path[] = "/tmp/naemon-worker-secret-XXXXXX";
+static unsigned int remote_jobs, local_jobs;
+
+static void remote_test_cb(struct wproc_result *wpres, void *data, int flags)
+{
+	completed_jobs++;
+	ck_assert(wpres != NULL);
+	ck_assert_str_eq("hello\n", wpres->outstd);
+	if (!strncmp(wpres->source, "Remote Worker", 13))
+		remote_jobs++;
+	else
+		local_jobs++;
+}
+
+static void run_until_completed(unsigned int jobs, time_t runtime)
+{
+	time_t start = time(NULL);
+
+	while (completed_jobs < jobs && time(NULL) < start + runtime)
+		iobroker_poll(nagios_iobs, 50);
+}
+
+/* ask the kernel for a free port, then let go of it for naemon to use */
+static int free_port(void)
+{
+	struct sockaddr_in sin;
+	socklen_t slen = sizeof(sin);
+	int sd, port;
+
+	sd = socket(AF_INET, SOCK_STREAM, 0);
+	ck_assert_int_ge(sd, 0);
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	ck_assert_int_eq(0, bind(sd, (struct sockaddr *)&sin, sizeof(sin)));
+	ck_assert_int_eq(0, getsockname(sd, (struct sockaddr *)&sin, &slen));
+	port = ntohs(sin.sin_port);
+	close(sd);
+	return port;
+}
+
+void remote_worker_setup(void)
+{
+	char connect_to[80];
+	char *argvec[] = {naemon_binary_path, "--worker", connect_to, NULL};
+	time_t start;
+	int i, fd;
+
+	completed_jobs = remote_jobs = local_jobs = 0;
+
+	fd = mkstemp(secret_path);
+	ck_assert_int_ge(fd, 0);
+	ck_assert_int_eq(7, write(fd, "s3cret\n", 7));
+	close(fd);
+
+	init_event_queue();
+	init_iobroker();
+	qh_socket_path = "/tmp/qh-socket";
+	qh_init(qh_socket_path);
+	sprintf(remote_address, "127.0.0.1:%d", free_port());
+	worker_listen_address = remote_address;
+	worker_secret_file = secret_path;
+	/* one local worker, and no respawning more when remote ones leave */
+	num_check_workers = 1;
+	ck_assert_int_eq(0, init_workers(num_check_workers));
+
+	sprintf(connect_to, "tcp:%s", remote_address);
+	setenv("NAEMON_WORKER_SECRET_FILE", secret_path, 1);
+	for (i = 0; i < NUM_REMOTE_WORKERS; i++) {
+		/* give the workers different capacities */
+		setenv("NAEMON_WORKER_MAX_JOBS", mkstr("%d", 10 * (i + 1)), 1);
+		remote_pids[i] = spawn_helper(argvec);
+		ck_assert_int_gt(remote_pids[i], 0);
+	}
+	unsetenv("NAEMON_WORKER_MAX_JOBS");
+
+	start = time(NULL);
+	while (wproc_num_workers_online < 1 + NUM_REMOTE_WORKERS && time(NULL) < start + 10) {
+		iobroker_poll(nagios_iobs, 10);
+	}
+	ck_assert_int_eq(1 + NUM_REMOTE_WORKERS, wproc_num_workers_online);
+}
+
+void remote_worker_teardown(void)
+{
+	int i;
+
+	free_worker_memory(WPROC_FORCE);
+	deinit_iobroker();
+	qh_deinit(qh_socket_path);
+	destroy_event_queue();
+	worker_listen_address = NULL;
+	worker_secret_file = NULL;
+	unlink(secret_path);
+	strcpy(secret_path, "/tmp/naemon-worker-secret-XXXXXX");
+	unsetenv("NAEMON_WORKER_SECRET_FILE");
+
+	/* the remote workers exit when we hang up on them */
+	for (i = 0; i < NUM_REMOTE_WORKERS; i++) {
+		kill(remote_pids[i], SIGKILL);
+		waitpid(remote_pids[i], NULL, 0);
+	}
+
+	wproc_num_workers_online = 0;
+	wproc_num_workers_spawned = 0;
+	wproc_num_workers_desired = 0;
+	num_check_workers = 0;
+}
+
+START_TEST(remote_worker_runs_jobs)
+{
+	int i, jobs = 60;
+
+	for (i = 0; i < jobs; i++)
+		ck_assert_int_eq(OK, wproc_run_callback("/bin/echo hello", 5, remote_test_cb, NULL, NULL));
+	run_until_completed(jobs, 15);
+	ck_assert_int_eq(jobs, completed_jobs);
+
+	/* 60 slots remote, one big local worker, so both sides get jobs */
+	ck_assert_int_gt(remote_jobs, 0);
+	ck_assert_int_gt(local_jobs, 0);
+}
+END_TEST
+
+START_TEST(remote_worker_death_reassigns_jobs)
+{
+	int i, jobs = 20;
+
+	for (i = 0; i < jobs; i++)
+		ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 1; echo hello'", 10, remote_test_cb, NULL, NULL));
+
+	/* whatever the dead ones were running goes to the survivors */
+	for (i = 0; i < NUM_REMOTE_WORKERS - 1; i++)
+		kill(remote_pids[i], SIGKILL);
+	run_until_completed(jobs, 20);
+	ck_assert_int_eq(jobs, completed_jobs);
+	ck_assert_int_eq(2, wproc_num_workers_online);
+}
+END_TEST
+
+/* reads a nul-terminated message from the master, letting it run meanwhile */
+static void read_from_master(int sd, char *buf, size_t size)
+{
+	size_t len = 0;
+
+	while (len < size - 1) {
+		iobroker_poll(nagios_iobs, 10);
+		if (read(sd, &buf[len], 1) != 1 || !buf[len])
+			break;
+		len++;
+	}
+	buf[len] = 0;
+}
+
+START_TEST(remote_worker_bad_auth)
+{
+	char buf[128];
+	int sd, ret;
+
+	sd = nsock_inet(remote_address, NSOCK_TCP | NSOCK_CONNECT);
+	ck_assert_int_ge(sd, 0);
+
+	/* read the challenge, then get it wrong */
+	read_from_master(sd, buf, sizeof(buf));
+	ck_assert_int_eq(0, strncmp(buf, "challenge=", 10));
+	nsock_printf_nul(sd, "@wproc register name=Impostor;pid=1;challenge=%032d;auth=%064d", 0, 0);
+
+	for (ret = 0; ret < 20; ret++)
+		iobroker_poll(nagios_iobs, 10);
+	ret = read(sd, buf, sizeof(buf) - 1);
+	ck_assert_int_gt(ret, 3);
+	buf[ret] = 0;
+	ck_assert_int_eq(0, strncmp(buf, "401", 3));
+	close(sd);
+	ck_assert_int_eq(1 + NUM_REMOTE_WORKERS, wproc_num_workers_online);
+}
+END_TEST
+
+START_TEST(remote_worker_bad_max_jobs)
+{
+	const char *bad[] = { "0", "-5", "many", "" };
+	char buf[128], *auth;
+	unsigned int i;
+	int sd;
+
+	for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+		sd = nsock_inet(remote_address, NSOCK_TCP | NSOCK_CONNECT);
+		ck_assert_int_ge(sd, 0);
+		read_from_master(sd, buf, sizeof(buf));
+		ck_assert_int_eq(0, strncmp(buf, "challenge=", 10));
+		auth = worker_auth_response("s3cret", 6, buf + 10);
+		nsock_printf_nul(sd, "@wproc register name=Greedy;pid=1;max_jobs=%s;challenge=%032d;auth=%s", bad[i], 0, auth);
+		g_free(auth);
+		read_from_master(sd, buf, sizeof(buf));
+		ck_assert_msg(!strncmp(buf, "400", 3), "max_jobs=%s got '%s'", bad[i], buf);
+		close(sd);
+	}
+	ck_assert_int_eq(1 + NUM_REMOTE_WORKERS, wproc_num_workers_online);
+}
+END_TEST
+
+/* peers that connect but don't register take up one of these each */
+#define PENDING_MAX 16 /* REMOTE_REGISTRATION_PENDING_MAX in workers.c */
+
+START_TEST(remote_worker_pending_limit)
+{
+	int sds[PENDING_MAX + 1], i;
+	char buf[128];
+
+	for (i = 0; i < PENDING_MAX; i++) {
+		sds[i] = nsock_inet(remote_address, NSOCK_TCP | NSOCK_CONNECT);
+		ck_assert_int_ge(sds[i], 0);
+		read_from_master(sds[i], buf, sizeof(buf));
+		ck_assert_int_eq(0, strncmp(buf, "challenge=", 10));
+	}
+
+	/* one too many is hung up on without a challenge */
+	sds[PENDING_MAX] = nsock_inet(remote_address, NSOCK_TCP | NSOCK_CONNECT);
+	ck_assert_int_ge(sds[PENDING_MAX], 0);
+	for (i = 0; i < 20; i++)
+		iobroker_poll(nagios_iobs, 10);
+	ck_assert_int_eq(0, read(sds[PENDING_MAX], buf, sizeof(buf)));
+	close(sds[PENDING_MAX]);
+
+	/* giving up one makes room for another */
+	close(sds[0]);
+	for (i = 0; i < 20; i++)
+		iobroker_poll(nagios_iobs, 10);
+	sds[0] = nsock_inet(remote_address, NSOCK_TCP | NSOCK_CONNECT);
+	ck_assert_int_ge(sds[0], 0);
+	read_from_master(sds[0], buf, sizeof(buf));
+	ck_assert_int_eq(0, strncmp(buf, "challenge=", 10));
+
+	for (i = 0; i < PENDING_MAX; i++)
+		close(sds[i]);
+	ck_assert_int_eq(1 + NUM_REMOTE_WORKERS, wproc_num_workers_online);
+}
+END_TEST
+
+/* registers by hand, checks the master's proof, then sends a forged message */
+START_TEST(remote_worker_session_mac)
+{
+	const char *challenge = "0123456789abcdef0123456789abcdef";
+	char buf[256], master_challenge[128], *auth, *proof;
+	struct worker_session *ws;
+	struct kvvec_buf *kvvb;
+	int sd, i;
+
+	sd = nsock_inet(remote_address, NSOCK_TCP | NSOCK_CONNECT);
+	ck_assert_int_ge(sd, 0);
+	read_from_master(sd, master_challenge, sizeof(master_challenge));
+	ck_assert_int_eq(0, strncmp(master_challenge, "challenge=", 10));
+
+	auth = worker_auth_response("s3cret", 6, master_challenge + 10);
+	nsock_printf_nul(sd, "@wproc register name=Hand Made;pid=1;max_jobs=1;challenge=%s;auth=%s", challenge, auth);
+	g_free(auth);
+	read_from_master(sd, buf, sizeof(buf));
+	proof = worker_master_proof("s3cret", 6, master_challenge + 10, challenge);
+	ck_assert_int_eq(0, strncmp(buf, "OK auth=", 8));
+	ck_assert_str_eq(proof, buf + 8);
+	g_free(proof);
+	ck_assert_int_eq(2 + NUM_REMOTE_WORKERS, wproc_num_workers_online);
+
+	/* a properly signed message is fine */
+	ws = worker_session_create("s3cret", 6, master_challenge + 10, challenge, 0);
+	ck_assert(ws != NULL);
+	kvvb = worker_session_sign(ws, "log=hello", 10);
+	ck_assert_int_eq((int)kvvb->bufsize, write(sd, kvvb->buf, kvvb->bufsize));
+	free(kvvb->buf);
+	free(kvvb);
+	for (i = 0; i < 20; i++)
+		iobroker_poll(nagios_iobs, 10);
+	ck_assert_int_eq(2 + NUM_REMOTE_WORKERS, wproc_num_workers_online);
+
+	/* one with a bit flipped after signing gets us thrown out */
+	kvvb = worker_session_sign(ws, "log=hello", 10);
+	kvvb->buf[4] = 'j';
+	ck_assert_int_eq((int)kvvb->bufsize, write(sd, kvvb->buf, kvvb->bufsize));
+	free(kvvb->buf);
+	free(kvvb);
+	for (i = 0; i < 50 && wproc_num_workers_online > 1 + NUM_REMOTE_WORKERS; i++)
+		iobroker_poll(nagios_iobs, 10);
+	ck_assert_int_eq(1 + NUM_REMOTE_WORKERS, wproc_num_workers_online);
+	ck_assert_int_eq(0, read(sd, buf, sizeof(buf)));
+
+	worker_session_destroy(ws);
+	close(sd);
+}
+END_TEST
+
+/* a remote worker must not take jobs from a master that can't prove itself */
+START_TEST(remote_worker_bad_master)
+{
+	char connect_to[80], buf[512], *expected, *auth;
+	char *argvec[] = {naemon_binary_path, "--worker", connect_to, NULL};
+	const char *challenge = "fedcba9876543210fedcba9876543210";
+	int lsd, sd, status;
+	size_t len = 0;
+	pid_t pid;
+
+	sprintf(connect_to, "tcp:127.0.0.1:%d", free_port());
+	lsd = nsock_inet(connect_to + 4, NSOCK_TCP | NSOCK_REUSE | NSOCK_BLOCK);
+	ck_assert_int_ge(lsd, 0);
+	pid = spawn_helper(argvec);
+	ck_assert_int_gt(pid, 0);
+	sd = accept(lsd, NULL, NULL);
+	ck_assert_int_ge(sd, 0);
+
+	nsock_printf_nul(sd, "challenge=%s", challenge);
+	while (len < sizeof(buf) - 1 && read(sd, &buf[len], 1) == 1 && buf[len])
+		len++;
+	buf[len] = 0;
+	ck_assert(strstr(buf, ";challenge=") != NULL);
+	ck_assert((auth = strstr(buf, ";auth=")) != NULL);
+	expected = worker_auth_response("s3cret", 6, challenge);
+	ck_assert_str_eq(expected, auth + 6);
+	g_free(expected);
+
+	/* we know the worker's secret, but pretend we don't */
+	nsock_printf_nul(sd, "OK auth=%064d", 0);
+	ck_assert_int_eq(pid, waitpid(pid, &status, 0));
+	ck_assert(WIFEXITED(status));
+	ck_assert_int_eq(1, WEXITSTATUS(status));
+	close(sd);
+	close(lsd);
+}
+END_TEST
+
+/*
+ * With room for only two jobs in the one worker, the rest have to
+ * wait in the backlog for results to come back.
+ */
+static struct rlimit saved_nofile;
+static const char *priority_order[2];
+static unsigned int priority_done;
+
+void backlog_test_setup(void)
+{
+	struct rlimit rlim;
+
+	ck_assert_int_eq(0, getrlimit(RLIMIT_NOFILE, &saved_nofile));
+	rlim = saved_nofile;
+	rlim.rlim_cur = 104; /* (104 / 2) - 50 == 2 jobs per worker */
+	ck_assert_int_eq(0, setrlimit(RLIMIT_NOFILE, &rlim));
+	init_event_queue();
+	worker_test_setup();
+	remote_jobs = local_jobs = 0;
+	priority_done = 0;
+}
+
+void backlog_test_teardown(void)
+{
+	worker_test_teardown();
+	destroy_event_queue();
+	setrlimit(RLIMIT_NOFILE, &saved_nofile);
+}
+
+START_TEST(worker_test_backlog)
+{
+	int i, jobs = 6;
+	time_t start = time(NULL);
+
+	for (i = 0; i < jobs; i++)
+		ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 1; echo hello'", 10, remote_test_cb, NULL, NULL));
+	run_until_completed(jobs, 15);
+	ck_assert_int_eq(jobs, completed_jobs);
+	ck_assert_int_eq(jobs, local_jobs);
+
+	/* three rounds of two */
+	ck_assert_int_ge(time(NULL) - start, 2);
+}
+END_TEST
+
+static void priority_test_cb(struct wproc_result *wpres, void *data, int flags)
+{
+	completed_jobs++;
+	if (data && priority_done < 2)
+		priority_order[priority_done++] = data;
+}
+
+START_TEST(worker_test_backlog_priority)
+{
+	/* take both slots, one for a second and one for three */
+	ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 1'", 10, priority_test_cb, NULL, NULL));
+	ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 3'", 10, priority_test_cb, NULL, NULL));
+
+	/* the routine check queues up first, but the host check gets the first free slot */
+	ck_assert_int_eq(OK, wproc_run_check_callback(NULL, "/bin/sh -c 'sleep 1'", 10, CHECK_PRIORITY_REGULAR, priority_test_cb, "regular", NULL));
+	ck_assert_int_eq(OK, wproc_run_check_callback(NULL, "/bin/sh -c 'sleep 1'", 10, CHECK_PRIORITY_HOST, priority_test_cb, "host", NULL));
+	run_until_completed(4, 15);
+	ck_assert_int_eq(4, completed_jobs);
+	ck_assert_int_eq(2, priority_done);
+	ck_assert_str_eq("host", priority_order[0]);
+	ck_assert_str_eq("regular", priority_order[1]);
+}
+END_TEST
+
+static unsigned int dropped_jobs;
+
+static void drop_test_cb(struct wproc_result *wpres, void *data, int flags)
+{
+	if (!wpres && (flags & WPROC_JOB_DROPPED))
+		dropped_jobs++;
+	else
+		completed_jobs++;
+}
+
+START_TEST(worker_test_backlog_keeps_handlers)
+{
+	max_worker_backlog = 1;
+	dropped_jobs = 0;
+
+	/* take both slots */
+	ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 1'", 10, drop_test_cb, NULL, NULL));
+	ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 1'", 10, drop_test_cb, NULL, NULL));
+
+	/* the routine check waits, until a notification needs its place */
+	ck_assert_int_eq(OK, wproc_run_callback("/bin/true", 10, drop_test_cb, NULL, NULL));
+	ck_assert_int_eq(OK, wproc_run_check_callback(NULL, "/bin/true", 10, CHECK_PRIORITY_HANDLER, drop_test_cb, NULL, NULL));
+	ck_assert_int_eq(1, dropped_jobs);
+
+	/* with nothing left to drop, handlers still get in and checks don't */
+	ck_assert_int_eq(OK, wproc_run_check_callback(NULL, "/bin/true", 10, CHECK_PRIORITY_HANDLER, drop_test_cb, NULL, NULL));
+	ck_assert_int_eq(ERROR, wproc_run_check_callback(NULL, "/bin/true", 10, CHECK_PRIORITY_HOST, drop_test_cb, NULL, NULL));
+
+	run_until_completed(4, 15);
+	ck_assert_int_eq(4, completed_jobs);
+	ck_assert_int_eq(1, dropped_jobs);
+	max_worker_backlog = DEFAULT_MAX_WORKER_BACKLOG;
+}
+END_TEST
+
+static unsigned int discarded_jobs;
+
+static void discard_test_cb(struct wproc_result *wpres, void *data, int flags)
+{
+	if (!wpres)
+		discarded_jobs++;
+	else
+		completed_jobs++;
+}
+
+START_TEST(worker_test_backlog_freed_on_shutdown)
+{
+	discarded_jobs = 0;
+
+	/* take both slots, so the rest are still waiting when we shut down */
+	ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 5'", 10, discard_test_cb, NULL, NULL));
+	ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 5'", 10, discard_test_cb, NULL, NULL));
+	ck_assert_int_eq(OK, wproc_run_callback("/bin/true", 10, discard_test_cb, NULL, NULL));
+	ck_assert_int_eq(OK, wproc_run_check_callback(NULL, "/bin/true", 10, CHECK_PRIORITY_HANDLER, discard_test_cb, NULL, NULL));
+
+	/* their callbacks must get the chance to free their data */
+	worker_test_teardown();
+	ck_assert_int_eq(2, discarded_jobs);
+	ck_assert_int_eq(0, completed_jobs);
+	worker_test_setup();
+}
+END_TEST
+
+static command *backlog_cmd;
+static host *backlog_hst;
+static service *backlog_svc;
+
+/* a service that's OK, with a check to queue up behind busy workers */
+static service *create_backlog_service(void)
+{
+	init_objects_command(1);
+	init_objects_host(1);
+	init_objects_service(1);
+	backlog_cmd = create_command("check_true", "/bin/true");
+	ck_assert(backlog_cmd != NULL);
+	register_command(backlog_cmd);
+	backlog_hst = create_host("backlog_host");
+	ck_assert(backlog_hst != NULL);
+	register_host(backlog_hst);
+	backlog_svc = create_service(backlog_hst, "backlog_service");
+	ck_assert(backlog_svc != NULL);
+	backlog_svc->check_command = nm_strdup("check_true");
+	backlog_svc->check_command_ptr = backlog_cmd;
+	backlog_svc->check_interval = 5.0;
+	backlog_svc->check_timeout = 1;
+	backlog_svc->current_state = STATE_OK;
+	backlog_svc->plugin_output = nm_strdup("all is well");
+	register_service(backlog_svc);
+	return backlog_svc;
+}
+
+static void destroy_backlog_service(void)
+{
+	if (backlog_svc->next_check_event)
+		destroy_event(backlog_svc->next_check_event);
+	destroy_objects_service(TRUE);
+	destroy_objects_host();
+	destroy_objects_command();
+}
+
+/* starts a check of svc, which has to wait in the backlog */
+static void queue_backlog_check(service *svc)
+{
+	time_t start;
+
+	schedule_service_check(svc, time(NULL), CHECK_OPTION_FORCE_EXECUTION);
+	for (start = time(NULL); !svc->is_executing && time(NULL) < start + 2;)
+		event_poll();
+	ck_assert(svc->is_executing);
+}
+
+/* a dropped check keeps its state and is due again at its normal interval */
+static void assert_check_dropped(service *svc)
+{
+	ck_assert(!svc->is_executing);
+	ck_assert_int_eq(STATE_OK, svc->current_state);
+	ck_assert_str_eq("all is well", svc->plugin_output);
+	ck_assert(svc->next_check_event != NULL);
+	ck_assert_int_ge(svc->next_check, time(NULL) + get_service_check_interval_s(svc) - 5);
+}
+
+START_TEST(worker_test_backlog_expired_check)
+{
+	service *svc = create_backlog_service();
+	time_t start;
+
+	discarded_jobs = 0;
+
+	/* take both slots for longer than the check is willing to wait */
+	ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 5'", 10, discard_test_cb, NULL, NULL));
+	ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 5'", 10, discard_test_cb, NULL, NULL));
+
+	queue_backlog_check(svc);
+	for (start = time(NULL); svc->is_executing && time(NULL) < start + 4;)
+		event_poll();
+	ck_assert_int_eq(0, completed_jobs);
+	assert_check_dropped(svc);
+	destroy_backlog_service();
+}
+END_TEST
+
+START_TEST(worker_test_backlog_pushed_out_check)
+{
+	service *svc = create_backlog_service();
+
+	max_worker_backlog = 1;
+	svc->check_timeout = 10;
+	discarded_jobs = 0;
+
+	ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 5'", 10, discard_test_cb, NULL, NULL));
+	ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 5'", 10, discard_test_cb, NULL, NULL));
+
+	/* a host check needs the service check's place in the backlog */
+	queue_backlog_check(svc);
+	ck_assert_int_eq(OK, wproc_run_check_callback(NULL, "/bin/true", 10, CHECK_PRIORITY_HOST, discard_test_cb, NULL, NULL));
+	ck_assert_int_eq(0, completed_jobs);
+	assert_check_dropped(svc);
+	destroy_backlog_service();
+	max_worker_backlog = DEFAULT_MAX_WORKER_BACKLOG;
+}
+END_TEST
+
+/*
+ * Autoscaling, ticked by hand rather than every WPROC_SCALE_INTERVAL
+ * seconds, with room for two jobs per worker like the backlog tests.
+ */
+void autoscale_test_setup(void)
+{
+	max_check_workers = 2;
+	backlog_test_setup();
+}
+
+void autoscale_test_teardown(void)
+{
+	backlog_test_teardown();
+	max_check_workers = 0;
+	memset(&autoscale, 0, sizeof(autoscale));
+	autoscale.last_reason = "none";
+}
+
+static void wait_for_workers(unsigned int online)
+{
+	time_t start = time(NULL);
+
+	while (wproc_num_workers_online < online && time(NULL) < start + 10)
+		iobroker_poll(nagios_iobs, 10);
+	ck_assert_int_eq(online, wproc_num_workers_online);
+}
+
+START_TEST(autoscale_grows_on_refused_jobs)
+{
+	int i;
+
+	/* two fit, the third is refused and has to wait */
+	for (i = 0; i < 3; i++)
+		ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 1; echo hello'", 10, remote_test_cb, NULL, NULL));
+	ck_assert_int_eq(1, autoscale.jobs_refused);
+
+	scale_workers();
+	ck_assert_int_eq(1, autoscale.scaled_up);
+	ck_assert_str_eq("jobs refused, started workers", autoscale.last_reason);
+	wait_for_workers(2);
+
+	/* the new worker takes the waiting job right away */
+	ck_assert_int_eq(0, backlog_length(0));
+	run_until_completed(3, 15);
+	ck_assert_int_eq(3, completed_jobs);
+}
+END_TEST
+
+START_TEST(autoscale_stops_at_max_check_workers)
+{
+	unsigned long refused;
+	int tick, i, jobs = 0;
+
+	for (tick = 0; tick < 3; tick++) {
+		/* fill every slot, until a job has to wait */
+		refused = autoscale.jobs_refused;
+		for (i = 0; i < 10 && autoscale.jobs_refused == refused && !backlog_length(0); i++) {
+			ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 2; echo hello'", 10, remote_test_cb, NULL, NULL));
+			jobs++;
+		}
+		scale_workers();
+		wait_for_workers(wproc_num_workers_spawned);
+	}
+
+	ck_assert_int_eq(max_check_workers, local_workers());
+	ck_assert_int_eq(max_check_workers, wproc_num_workers_spawned);
+	ck_assert_int_eq(1, autoscale.scaled_up);
+	ck_assert(strstr(autoscale.last_reason, "already at max_check_workers") != NULL);
+	run_until_completed(jobs, 20);
+	ck_assert_int_eq(jobs, completed_jobs);
+}
+END_TEST
+
+START_TEST(autoscale_retires_drained_worker)
+{
+	struct wproc_worker *wp = NULL;
+	unsigned int i, started;
+	time_t start;
+	pid_t pid;
+
+	ck_assert_int_gt(spawn_core_worker(), 0);
+	wait_for_workers(2);
+
+	/* drain whichever worker got the first job */
+	ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 1; echo hello'", 10, remote_test_cb, NULL, NULL));
+	for (i = 0; i < workers.len; i++) {
+		if (g_hash_table_size(workers.wps[i]->jobs))
+			wp = workers.wps[i];
+	}
+	ck_assert(wp != NULL);
+	wp->draining = 1;
+	started = wp->jobs_started;
+	pid = wp->pid;
+
+	/* new jobs all go to the other worker */
+	for (i = 0; i < 2; i++)
+		ck_assert_int_eq(OK, wproc_run_callback("/bin/echo hello", 10, remote_test_cb, NULL, NULL));
+	ck_assert_int_eq(started, wp->jobs_started);
+	ck_assert_int_eq(0, backlog_length(0));
+
+	/* and it's stopped once the job it had is done */
+	run_until_completed(3, 15);
+	ck_assert_int_eq(3, completed_jobs);
+	ck_assert_int_eq(1, workers.len);
+	ck_assert_int_ne(pid, workers.wps[0]->pid);
+	ck_assert_int_eq(1, wproc_num_workers_online);
+	for (start = time(NULL); retired_pids && time(NULL) < start + 5;) {
+		iobroker_poll(nagios_iobs, 10);
+		reap_retired_workers();
+	}
+	ck_assert(retired_pids == NULL);
+	ck_assert_int_eq(-1, kill(pid, 0));
+}
+END_TEST
+
+START_TEST(autoscale_wpstats)
+{
+	char query[] = "wpstats", buf[4096];
+	const char *expected;
+	int sv[2], i, len;
+
+	for (i = 0; i < 3; i++)
+		ck_assert_int_eq(OK, wproc_run_callback("/bin/sh -c 'sleep 1; echo hello'", 10, remote_test_cb, NULL, NULL));
+	scale_workers();
+
+	ck_assert_int_eq(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+	ck_assert_int_eq(0, wproc_query_handler(sv[0], query, strlen(query)));
+	len = read(sv[1], buf, sizeof(buf) - 1);
+	ck_assert_int_gt(len, 0);
+	buf[len] = 0;
+	expected = mkstr("\nautoscale=1;min=1;max=2;jobs_refused=1;scaled_up=1;scaled_down=0;last_change=%lu;last_reason=jobs refused, started workers\n",
+	                 (unsigned long)autoscale.last_change);
+	ck_assert_msg(strstr(buf, expected) != NULL, "wpstats said: %s", buf);
+	close(sv[0]);
+	close(sv[1]);
+
+	run_until_completed(3, 15);
+}
+END_TEST
+
 Suite *worker_suite(void)
 {
 	Suite *s;
 	TCase *tc_worker_output;
 	TCase *tc_command_worker;
+	TCase *tc_remote_worker;
+	TCase *tc_backlog;
+	TCase *tc_autoscale;
 
 	s = suite_create("worker tests");
 
@@ -331,6 +1062,7 @@ Suite *worker_suite(void)
 	tcase_add_test(tc_worker_output, worker_test_timeout);
 	tcase_add_test(tc_worker_output, worker_test_no_timeout_log);
 	tcase_add_test(tc_worker_output, worker_test_output_stdout_and_timeout);
+	tcase_add_test(tc_worker_output, worker_test_output_truncated);
 	tcase_add_test(tc_worker_output, worker_test_child_remains_to_cause_sideeffects);
 	suite_add_tcase(s, tc_worker_output);
 
@@ -339,6 +1071,35 @@ Suite *worker_suite(void)
 	tcase_add_test(tc_command_worker, command_worker_launch_shutdown_test);
 	suite_add_tcase(s, tc_command_worker);
 
+	tc_remote_worker = tcase_create("remote worker tests");
+	tcase_add_checked_fixture(tc_remote_worker, remote_worker_setup, remote_worker_teardown);
+	tcase_add_test(tc_remote_worker, remote_worker_runs_jobs);
+	tcase_add_test(tc_remote_worker, remote_worker_death_reassigns_jobs);
+	tcase_add_test(tc_remote_worker, remote_worker_bad_auth);
+	tcase_add_test(tc_remote_worker, remote_worker_session_mac);
+	tcase_add_test(tc_remote_worker, remote_worker_pending_limit);
+	tcase_add_test(tc_remote_worker, remote_worker_bad_max_jobs);
+	tcase_add_test(tc_remote_worker, remote_worker_bad_master);
+	suite_add_tcase(s, tc_remote_worker);
+
+	tc_backlog = tcase_create("worker backlog tests");
+	tcase_add_checked_fixture(tc_backlog, backlog_test_setup, backlog_test_teardown);
+	tcase_add_test(tc_backlog, worker_test_backlog);
+	tcase_add_test(tc_backlog, worker_test_backlog_priority);
+	tcase_add_test(tc_backlog, worker_test_backlog_keeps_handlers);
+	tcase_add_test(tc_backlog, worker_test_backlog_freed_on_shutdown);
+	tcase_add_test(tc_backlog, worker_test_backlog_expired_check);
+	tcase_add_test(tc_backlog, worker_test_backlog_pushed_out_check);
+	suite_add_tcase(s, tc_backlog);
+
+	tc_autoscale = tcase_create("worker autoscale tests");
+	tcase_add_checked_fixture(tc_autoscale, autoscale_test_setup, autoscale_test_teardown);
+	tcase_add_test(tc_autoscale, autoscale_grows_on_refused_jobs);
+	tcase_add_test(tc_autoscale, autoscale_stops_at_max_check_workers);
+	tcase_add_test(tc_autoscale, autoscale_retires_drained_worker);
+	tcase_add_test(tc_autoscale, autoscale_wpstats);
+	suite_add_tcase(s, tc_autoscale);
+
 	return s;
 }
 